@@ -1,5 +1,6 @@
 // Writed by yijian (eyjian@qq.com, eyjian@gmail.com)
 #include "config_loader.h"
+#include "db_connection_pool.h"
 #include "sql_logger.h"
 #include <errno.h>
 #include <fstream>
@@ -14,12 +15,11 @@
 #include <vector>
 
 STRING_ARG_DECLARE(conf);
+INTEGER_ARG_DECLARE(uint16_t, db_pool_size);
+INTEGER_ARG_DECLARE(uint32_t, db_pool_timeout);
 
 namespace mooon { namespace db_proxy {
 
-// 线程级DB连接
-static __thread sys::CMySQLConnection* g_db_connection[MAX_DB_CONNECTION] = { NULL } ;
-
 static void init_db_info_array(struct DbInfo* db_info_array[])
 {
     for (int index=0; index<MAX_DB_CONNECTION; ++index)
@@ -38,6 +38,12 @@ static void init_sql_logger_array(CSqlLogger* sql_logger_array[])
         sql_logger_array[index] = NULL;
 }
 
+static void init_db_connection_pool_array(CDbConnectionPool* db_connection_pool_array[])
+{
+    for (int index=0; index<MAX_DB_CONNECTION; ++index)
+        db_connection_pool_array[index] = NULL;
+}
+
 static void init_update_info_array(struct UpdateInfo* update_info_array[])
 {
     for (int index=0; index<MAX_SQL_TEMPLATE; ++index)
@@ -65,6 +71,18 @@ static void release_sql_logger_array(CSqlLogger* sql_logger_array[])
     }
 }
 
+static void release_db_connection_pool_array(CDbConnectionPool* db_connection_pool_array[])
+{
+    for (int index=0; index<MAX_DB_CONNECTION; ++index)
+    {
+        if (db_connection_pool_array[index] != NULL)
+        {
+            db_connection_pool_array[index]->dec_refcount();
+            db_connection_pool_array[index] = NULL;
+        }
+    }
+}
+
 static void release_query_info_array(struct QueryInfo* query_info_array[])
 {
     for (int index=0; index<MAX_SQL_TEMPLATE; ++index)
@@ -124,6 +142,7 @@ CConfigLoader::CConfigLoader()
     : _stop_monitor(false)
 {
     init_sql_logger_array(_sql_logger_array);
+    init_db_connection_pool_array(_db_connection_pool_array);
     init_db_info_array(_db_info_array);
     init_query_info_array(_query_info_array);
     init_update_info_array(_update_info_array);
@@ -182,6 +201,7 @@ bool CConfigLoader::load(const std::string& filepath)
     sys::WriteLockHelper write_lock(_read_write_lock);
     release_db_info_array(_db_info_array);
     release_sql_logger_array(_sql_logger_array);
+    release_db_connection_pool_array(_db_connection_pool_array);
     release_query_info_array(_query_info_array);
     release_update_info_array(_update_info_array);
 
@@ -202,6 +222,11 @@ bool CConfigLoader::load(const std::string& filepath)
             CSqlLogger* sql_logger = new CSqlLogger(index, _db_info_array[index]);
             _sql_logger_array[index] = sql_logger;
             sql_logger->inc_refcount();
+
+            // 连接池，正在使用旧连接池的在归还后自动删除旧的
+            CDbConnectionPool* db_connection_pool = new CDbConnectionPool(_db_info_array[index], mooon::argument::db_pool_size->value(), mooon::argument::db_pool_timeout->value());
+            _db_connection_pool_array[index] = db_connection_pool;
+            db_connection_pool->inc_refcount();
         }
     }
     for (int index=0; index<MAX_SQL_TEMPLATE; ++index)
@@ -271,28 +296,37 @@ void CConfigLoader::release_sql_logger(CSqlLogger* sql_logger)
     }
 }
 
-void CConfigLoader::release_db_connection(int index)
+CDbConnectionPool* CConfigLoader::get_db_connection_pool(int index)
 {
-    if ((index >= 0) && (index < MAX_DB_CONNECTION))
-    {
-        delete g_db_connection[index];
-        g_db_connection[index] = NULL;
-    }
-}
+    CDbConnectionPool* db_connection_pool = NULL;
 
-sys::CMySQLConnection* CConfigLoader::get_db_connection(int index) const
-{
     if ((index < 0) || (index >= MAX_DB_CONNECTION))
     {
         MYLOG_ERROR("invalid database index: %d\n", index);
-        return NULL;
     }
-    if (NULL == g_db_connection[index])
+    else
     {
-        g_db_connection[index] = init_db_connection(index, true);
+        sys::ReadLockHelper read_lock(_read_write_lock);
+        db_connection_pool = _db_connection_pool_array[index];
+        if (db_connection_pool != NULL)
+            db_connection_pool->inc_refcount();
     }
 
-    return g_db_connection[index];
+    return db_connection_pool;
+}
+
+void CConfigLoader::release_db_connection_pool(CDbConnectionPool* db_connection_pool)
+{
+    if (db_connection_pool != NULL)
+    {
+        const std::string str = db_connection_pool->str();
+
+        // _db_connection_pool_array持有一个引用，连接池还在数组中时不会被删除，
+        // 被删除的一定已在重新加载时从数组中移除，所以不需要修改数组
+        sys::ReadLockHelper read_lock(_read_write_lock);
+        if (db_connection_pool->dec_refcount())
+            MYLOG_WARN("deleted connection pool: %s\n", str.c_str());
+    }
 }
 
 bool CConfigLoader::get_db_info(int index, struct DbInfo* db_info) const
@@ -492,45 +526,7 @@ sys::CMySQLConnection* CConfigLoader::init_db_connection(int index, bool need_lo
 
 sys::CMySQLConnection* CConfigLoader::do_init_db_connection(int index) const
 {
-    const int max_retries = 3;
-    const struct DbInfo* _db_info = _db_info_array[index];
-    sys::CMySQLConnection* db_connection = NULL;
-
-    for (int retries=0; retries<max_retries; ++retries)
-    {
-        db_connection = new sys::CMySQLConnection;
-        db_connection->set_host(_db_info->host, (uint16_t)_db_info->port);
-        db_connection->set_user(_db_info->user, _db_info->password);
-        db_connection->set_db_name(_db_info->name);
-        db_connection->set_charset(_db_info->charset);
-        db_connection->enable_auto_reconnect();
-
-        try
-        {
-            db_connection->open();
-            MYLOG_INFO("connect %s ok\n", _db_info->str().c_str());
-            break;
-        }
-        catch (sys::CDBException& db_ex)
-        {
-            bool is_disconnected_exception = db_connection->is_disconnected_exception(db_ex);
-            delete db_connection;
-            db_connection = NULL;
-
-            if (!is_disconnected_exception || retries==max_retries-1)
-            {
-                MYLOG_ERROR("connect %s failed: %s\n", _db_info->str().c_str(), db_ex.str().c_str());
-                break;
-            }
-            else
-            {
-                MYLOG_ERROR("connect %s failed to retry: %s\n", _db_info->str().c_str(), db_ex.str().c_str());
-                mooon::sys::CUtils::millisleep(100); // 网络类原因稍后重试
-            }
-        }
-    }
-
-    return db_connection;
+    return CDbConnectionPool::create_connection(_db_info_array[index]);
 }
 
 } // namespace db_proxy
@@ -72,7 +72,7 @@ inline bool extract_filename(const std::string& filename, struct FilenameStruct*
 // 定义常量
 enum
 {
-    MAX_DB_CONNECTION = 100,  // 单个线程最多支持的DB连接个数
+    MAX_DB_CONNECTION = 100,  // 最多支持的DB个数，每个DB一个连接池
     MAX_SQL_TEMPLATE = 10000, // 单个线程最多支持的SQL模板个数
     MAX_LIMIT = 1000          // 限制一次性返回的记录数太多将db_proxy搞死
 };
@@ -274,6 +274,7 @@ struct UpdateInfo
 };
 
 class CSqlLogger;
+class CDbConnectionPool;
 
 // 负责配置的加载
 class CConfigLoader
@@ -293,8 +294,9 @@ public:
     CSqlLogger* get_sql_logger(int index);
     void release_sql_logger(CSqlLogger* sql_logger);
 
-    void release_db_connection(int index);
-    sys::CMySQLConnection* get_db_connection(int index) const;
+    // 取得的连接池须调用release_db_connection_pool释放，通常通过CDbConnectionHelper使用
+    CDbConnectionPool* get_db_connection_pool(int index);
+    void release_db_connection_pool(CDbConnectionPool* db_connection_pool);
 
     bool get_db_info(int index, struct DbInfo* db_info) const;
     bool get_query_info(int index, struct QueryInfo* query_info) const;
@@ -319,6 +321,7 @@ private:
     volatile bool _stop_monitor;
     mutable sys::CReadWriteLock _read_write_lock;
     CSqlLogger* _sql_logger_array[MAX_DB_CONNECTION];
+    CDbConnectionPool* _db_connection_pool_array[MAX_DB_CONNECTION];
     struct DbInfo* _db_info_array[MAX_DB_CONNECTION];
     struct QueryInfo* _query_info_array[MAX_SQL_TEMPLATE];
     struct UpdateInfo* _update_info_array[MAX_SQL_TEMPLATE];
@@ -0,0 +1,214 @@
+// Writed by yijian (eyjian@qq.com, eyjian@gmail.com)
+#include "db_connection_pool.h"
+#include "config_loader.h"
+#include <mooon/sys/datetime_utils.h>
+#include <mooon/sys/log.h>
+#include <mooon/sys/utils.h>
+namespace mooon { namespace db_proxy {
+
+// 空闲超过多少秒的连接在取用前先ping一下
+enum { PING_IDLE_SECONDS = 30 };
+
+sys::CMySQLConnection* CDbConnectionPool::create_connection(const struct DbInfo* db_info)
+{
+    const int max_retries = 3;
+    sys::CMySQLConnection* db_connection = NULL;
+
+    for (int retries=0; retries<max_retries; ++retries)
+    {
+        db_connection = new sys::CMySQLConnection;
+        db_connection->set_host(db_info->host, (uint16_t)db_info->port);
+        db_connection->set_user(db_info->user, db_info->password);
+        db_connection->set_db_name(db_info->name);
+        db_connection->set_charset(db_info->charset);
+        db_connection->enable_auto_reconnect();
+
+        try
+        {
+            db_connection->open();
+            MYLOG_INFO("connect %s ok\n", db_info->str().c_str());
+            break;
+        }
+        catch (sys::CDBException& db_ex)
+        {
+            bool is_disconnected_exception = db_connection->is_disconnected_exception(db_ex);
+            delete db_connection;
+            db_connection = NULL;
+
+            if (!is_disconnected_exception || retries==max_retries-1)
+            {
+                MYLOG_ERROR("connect %s failed: %s\n", db_info->str().c_str(), db_ex.str().c_str());
+                break;
+            }
+            else
+            {
+                MYLOG_ERROR("connect %s failed to retry: %s\n", db_info->str().c_str(), db_ex.str().c_str());
+                mooon::sys::CUtils::millisleep(100); // 网络类原因稍后重试
+            }
+        }
+    }
+
+    return db_connection;
+}
+
+CDbConnectionPool::CDbConnectionPool(const struct DbInfo* db_info, int max_size, uint32_t timeout_milliseconds)
+    : _db_info(new struct DbInfo(db_info)), _max_size(max_size), _timeout_milliseconds(timeout_milliseconds), _num_connections(0)
+{
+    _idle_connections.reserve(max_size);
+}
+
+CDbConnectionPool::~CDbConnectionPool()
+{
+    // 析构时所有取用者都已归还（由引用计数保证）
+    for (std::vector<std::pair<sys::CMySQLConnection*, time_t> >::size_type i=0; i<_idle_connections.size(); ++i)
+        delete _idle_connections[i].first;
+    MYLOG_INFO("connection pool deleted with %d connections: %s\n", _num_connections, _db_info->str().c_str());
+
+    _idle_connections.clear();
+    delete _db_info;
+}
+
+std::string CDbConnectionPool::str() const
+{
+    return _db_info->str();
+}
+
+int CDbConnectionPool::get_database_index() const
+{
+    return _db_info->index;
+}
+
+sys::CMySQLConnection* CDbConnectionPool::get()
+{
+    const uint64_t deadline = sys::current_milliseconds() + _timeout_milliseconds;
+
+    while (true)
+    {
+        sys::CMySQLConnection* db_connection = NULL;
+        time_t idle_time = 0;
+
+        {
+            sys::LockHelper<sys::CLock> lock_helper(_lock);
+
+            if (!_idle_connections.empty())
+            {
+                // 后进先出，使常用的连接保持活跃，多余的连接长时间空闲
+                db_connection = _idle_connections.back().first;
+                idle_time = _idle_connections.back().second;
+                _idle_connections.pop_back();
+            }
+            else if (_num_connections < _max_size)
+            {
+                ++_num_connections;
+            }
+            else
+            {
+                const uint64_t now = sys::current_milliseconds();
+                if (now >= deadline)
+                {
+                    MYLOG_ERROR("wait connection timeout(%ums): %s\n", _timeout_milliseconds, _db_info->str().c_str());
+                    return NULL;
+                }
+
+                _event.timed_wait(_lock, static_cast<uint32_t>(deadline - now));
+                continue;
+            }
+        }
+
+        if (NULL == db_connection)
+        {
+            // 在锁外建立连接，以免阻塞其它取用者
+            db_connection = create_connection(_db_info);
+            if (NULL == db_connection)
+            {
+                sys::LockHelper<sys::CLock> lock_helper(_lock);
+                --_num_connections;
+                _event.signal();
+            }
+
+            return db_connection;
+        }
+        if (time(NULL) - idle_time < PING_IDLE_SECONDS)
+        {
+            return db_connection;
+        }
+
+        try
+        {
+            db_connection->ping();
+            return db_connection;
+        }
+        catch (sys::CDBException& db_ex)
+        {
+            MYLOG_WARN("ping %s failed: %s\n", _db_info->str().c_str(), db_ex.str().c_str());
+            put(db_connection, true);
+        }
+    }
+}
+
+void CDbConnectionPool::put(sys::CMySQLConnection* db_connection, bool broken)
+{
+    {
+        sys::LockHelper<sys::CLock> lock_helper(_lock);
+
+        if (!broken)
+            _idle_connections.push_back(std::make_pair(db_connection, time(NULL)));
+        else
+            --_num_connections;
+        _event.signal();
+    }
+
+    if (broken)
+        delete db_connection;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+CDbConnectionHelper::CDbConnectionHelper(int database_index, bool acquire)
+    : _database_index(database_index), _db_connection_pool(NULL), _db_connection(NULL)
+{
+    if (acquire)
+    {
+        CConfigLoader* config_loader = CConfigLoader::get_singleton();
+
+        _db_connection_pool = config_loader->get_db_connection_pool(_database_index);
+        if (_db_connection_pool != NULL)
+            _db_connection = _db_connection_pool->get();
+    }
+}
+
+CDbConnectionHelper::~CDbConnectionHelper()
+{
+    if (_db_connection_pool != NULL)
+    {
+        if (_db_connection != NULL)
+            _db_connection_pool->put(_db_connection);
+
+        CConfigLoader* config_loader = CConfigLoader::get_singleton();
+        config_loader->release_db_connection_pool(_db_connection_pool);
+    }
+}
+
+void CDbConnectionHelper::release()
+{
+    if ((_db_connection_pool != NULL) && (_db_connection != NULL))
+    {
+        _db_connection_pool->put(_db_connection);
+        _db_connection = NULL;
+    }
+}
+
+sys::CMySQLConnection* CDbConnectionHelper::reacquire()
+{
+    release();
+    if (NULL == _db_connection_pool)
+    {
+        CConfigLoader* config_loader = CConfigLoader::get_singleton();
+        _db_connection_pool = config_loader->get_db_connection_pool(_database_index);
+    }
+    if (_db_connection_pool != NULL)
+        _db_connection = _db_connection_pool->get();
+    return _db_connection;
+}
+
+} // namespace db_proxy
+} // namespace mooon
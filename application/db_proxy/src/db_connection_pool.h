@@ -0,0 +1,76 @@
+// Writed by yijian (eyjian@qq.com, eyjian@gmail.com)
+#ifndef MOOON_DB_PROXY_DB_CONNECTION_POOL_H
+#define MOOON_DB_PROXY_DB_CONNECTION_POOL_H
+#include <mooon/sys/event.h>
+#include <mooon/sys/lock.h>
+#include <mooon/sys/mysql_db.h>
+#include <mooon/sys/ref_countable.h>
+#include <utility>
+#include <vector>
+namespace mooon { namespace db_proxy {
+
+struct DbInfo;
+
+// 单个DB的连接池，所有工作线程共享，
+// 连接数不超过max_size，和工作线程数无关，连接在第一次需要时才建立。
+//
+// 池中的连接空闲超过一定时长后，再被取用前会先ping一下，不通的直接丢弃，
+// 池中连接都被占用且已达上限时，取用者最多等待timeout_milliseconds毫秒。
+//
+// 配置重新加载时会创建新的连接池，旧的连接池通过引用计数，在所有取用者归还后自动删除。
+class CDbConnectionPool: public sys::CRefCountable
+{
+public:
+    // 按db_info建立一个连接，网络类错误会重试，失败返回NULL
+    static sys::CMySQLConnection* create_connection(const struct DbInfo* db_info);
+
+public:
+    CDbConnectionPool(const struct DbInfo* db_info, int max_size, uint32_t timeout_milliseconds);
+    ~CDbConnectionPool();
+
+    std::string str() const;
+    int get_database_index() const;
+
+    // 取一个连接，超时或连接不上返回NULL
+    sys::CMySQLConnection* get();
+
+    // 归还连接，broken为true表示连接已不可用，直接关闭
+    void put(sys::CMySQLConnection* db_connection, bool broken=false);
+
+private:
+    sys::CLock _lock;
+    sys::CEvent _event;
+    struct DbInfo* _db_info;
+    const int _max_size;
+    const uint32_t _timeout_milliseconds;
+    int _num_connections; // 已建立的连接数，包括空闲的和被取用的，受_lock保护
+    std::vector<std::pair<sys::CMySQLConnection*, time_t> > _idle_connections; // 空闲的连接和它被归还的时间，受_lock保护
+};
+
+// 自动归还连接和释放连接池的帮助类
+class CDbConnectionHelper
+{
+public:
+    // acquire为false时不取连接，直到调用reacquire()，
+    // 用于只在部分情况下需要连接的，比如写SQL日志的和缓存命中的不需要连接
+    CDbConnectionHelper(int database_index, bool acquire=true);
+    ~CDbConnectionHelper();
+
+    // 返回NULL表示DB不存在、连接不上或等待连接超时
+    sys::CMySQLConnection* get() const { return _db_connection; }
+
+    // 提前归还连接，比如需要较长时间等待别的结果时
+    void release();
+    // 重新从同一个连接池取一个连接，返回值同get()，
+    // 构造时acquire为false的，在第一次调用时才取连接池
+    sys::CMySQLConnection* reacquire();
+
+private:
+    const int _database_index;
+    CDbConnectionPool* _db_connection_pool;
+    sys::CMySQLConnection* _db_connection;
+};
+
+} // namespace db_proxy
+} // namespace mooon
+#endif // MOOON_DB_PROXY_DB_CONNECTION_POOL_H
@@ -18,6 +18,9 @@ INTEGER_ARG_DECLARE(int32_t, sql_file_size);
 INTEGER_ARG_DECLARE(uint16_t, port);
 INTEGER_ARG_DECLARE(uint8_t, batch);
 INTEGER_ARG_DECLARE(uint16_t, efficiency);
+INTEGER_ARG_DECLARE(uint16_t, merge_rows);
+INTEGER_ARG_DECLARE(int32_t, merge_bytes);
+INTEGER_ARG_DECLARE(uint8_t, replay_threads);
 INTEGER_ARG_DECLARE(uint16_t, history_days);
 INTEGER_ARG_DECLARE(uint8_t, history_hour);
 INTEGER_ARG_DECLARE(uint8_t, auto_exit);
@@ -36,6 +39,10 @@ CDbProcess::CDbProcess(const struct DbInfo& dbinfo)
     _begin_time = time(NULL);
     _interval_count = 0;
     _batch = 0;
+    _checkpoint_fd = -1;
+    _recovery_offset = 0;
+    _dispatched_offset = 0;
+    _num_dispatched = 0;
 }
 
 CDbProcess::~CDbProcess()
@@ -55,6 +62,13 @@ CDbProcess::~CDbProcess()
         _signal_thread->join();
         delete _signal_thread;
     }
+
+    // 须在信号线程结束后删除，因为on_terminated()会访问它们
+    for (std::vector<CReplayWorker*>::size_type i=0; i<_replay_workers.size(); ++i)
+        delete _replay_workers[i];
+    _replay_workers.clear();
+    if (_checkpoint_fd != -1)
+        close(_checkpoint_fd);
 }
 
 void CDbProcess::run()
@@ -101,8 +115,10 @@ void CDbProcess::run()
 
     if (create_history_directory())
     {
-        if (get_progress(&_progress) && open_progress())
+        _sql_log_watcher.watch(_log_dirpath);
+        if (get_progress(&_progress) && open_progress() && open_checkpoints())
         {
+            start_replay_workers();
             _signal_thread = new sys::CThreadEngine(sys::bind(&CDbProcess::signal_thread, this));
             while (!_stop_signal_thread)
             {
@@ -120,6 +136,8 @@ void CDbProcess::run()
 
                 handle_directory();
             }
+
+            stop_replay_workers();
         }
     }
 
@@ -137,6 +155,7 @@ void CDbProcess::signal_thread()
 void CDbProcess::on_terminated()
 {
     _stop_signal_thread = true;
+    stop_replay_workers();
     MYLOG_INFO("dbprocess(%u, %s) will exit\n", static_cast<unsigned int>(getpid()), _dbinfo.str().c_str());
     if (_report_frequency_seconds > 0)
         mooon::observer::destroy();
@@ -215,7 +234,7 @@ void CDbProcess::handle_directory()
     {
         if (!_stop_signal_thread)
         {
-            sys::CUtils::millisleep(1000);
+            _sql_log_watcher.wait(1000);
         }
     }
     else
@@ -251,12 +270,20 @@ void CDbProcess::handle_directory()
         // empty
         if (0 == valid_log_count)
         {
-            sys::CUtils::millisleep(1000);
+            _sql_log_watcher.wait(1000);
         }
     }
 }
 
 bool CDbProcess::handle_file(const std::string& filename)
+{
+    // 并行入库时，须等这个文件的都执行完后才能处理下一个文件
+    const bool ok = replay_file(filename);
+    wait_replay_workers();
+    return ok;
+}
+
+bool CDbProcess::replay_file(const std::string& filename)
 {
     uint32_t offset = 0;
     const std::string& log_tag = _dbinfo.alias + std::string("/") + filename;
@@ -271,6 +298,7 @@ bool CDbProcess::handle_file(const std::string& filename)
     }
 
     sys::CloseHelper<int> close_helper(fd);
+    _sql_log_watcher.watch_file(log_filepath); // 须在读之前，以免错过读完之后的写入
     if (is_current_file(filename))
     {
         if (-1 == lseek(fd, _progress.offset, SEEK_SET))
@@ -285,151 +313,335 @@ bool CDbProcess::handle_file(const std::string& filename)
         }
     }
 
-    int count = 0; // 入库的条数
+    // 上次并行入库留下的检查点只对当时正在处理的文件有效
+    if (!_checkpoints.empty() && !is_current_file(filename))
+    {
+        if (!reset_checkpoints())
+        {
+            return false;
+        }
+    }
+    for (std::vector<CReplayWorker*>::size_type i=0; i<_replay_workers.size(); ++i)
+    {
+        _replay_workers[i]->set_filename(filename);
+    }
+
+    _dispatched_offset = offset;
+    CInsertMerger insert_merger(mooon::argument::merge_rows->value(), mooon::argument::merge_bytes->value());
+    uint32_t merge_begin_offset = offset; // 已合并的第一条SQL的开始位置
+    CSqlLogReader sql_log_reader(fd, offset);
     int consecutive_nodata = 0; // 连续无data的次数
     while (!_stop_signal_thread)
     {
-        int bytes = 0;
-        int32_t length = 0;
+        std::string sql;
+        const uint32_t begin_offset = offset; // 本条SQL的开始位置
         if (parent_process_not_exists())
         {
             break;
         }
 
-        // 读取SQL语句长度
-        bytes = read(fd, &length, sizeof(length));
-        if (-1 == bytes)
+        // 读取一条完整的SQL语句
+        const int ret = sql_log_reader.read_sql(&sql);
+        if (-1 == ret)
         {
             MYLOG_ERROR("read %s:%u error: %s\n", log_filepath.c_str(), offset, sys::Error::to_string().c_str());
             return false;
         }
-        else if (0 == bytes)
+        else if (0 == ret)
         {
+            // 没有更多数据时，立即执行已合并的，合并不等待新的数据，所以不会增加入库的延迟
+            if (!insert_merger.empty())
+            {
+                if (!flush_merged(filename, log_tag, merge_begin_offset, &insert_merger))
+                {
+                    return false;
+                }
+
+                continue;
+            }
+            if (!_replay_workers.empty() && !update_watermark(filename))
+            {
+                return false;
+            }
             if (is_over(offset))
             {
+                // 并行入库时，须都执行完后才能归档
+                wait_replay_workers();
+                if (_stop_signal_thread)
+                {
+                    break;
+                }
+                if (!_replay_workers.empty() && !update_watermark(filename))
+                {
+                    return false;
+                }
+
                 archive_file(filename);
                 break;
             }
             if (0 == consecutive_nodata++%1000)
             {
-                MYLOG_INFO("[%s:%u]no data to sleep: %s\n", log_filepath.c_str(), offset, _progress.str().c_str());
+                MYLOG_INFO("[%s:%u]no data to wait: %s\n", log_filepath.c_str(), offset, _progress.str().c_str());
             }
 
-            // 可以考虑引入inotify，改轮询为监听方式
-            sys::CUtils::millisleep(1000);
+            // 等待日志文件被写入，有新的SQL时立即被唤醒
+            _sql_log_watcher.wait(1000);
             continue;
         }
 
         consecutive_nodata = 0; // reset
-        if (bytes > 0)
+        offset = sql_log_reader.get_offset();
+
+        MYLOG_DEBUG("%s\n", sql.c_str());
+        if (!_checkpoints.empty())
         {
-            offset += static_cast<uint32_t>(bytes);
+            // 重启后，先逐条执行上次并行入库时未执行的
+            if (offset <= _recovery_offset)
+            {
+                if (!recover_sql(filename, log_tag, offset, sql))
+                {
+                    return false;
+                }
+
+                continue;
+            }
+            if (!reset_checkpoints())
+            {
+                return false;
+            }
         }
 
-        // 读取SQL语句
-        std::string sql(length, '\0');
-        bytes = read(fd, const_cast<char*>(sql.data()), length);
-        if (-1 == bytes)
+        // 相邻的单行INSERT合并成多行的执行，
+        // 不能合并的，须先执行之前已合并的，以保持原有的执行顺序
+        if (insert_merger.merge(sql, offset))
         {
-            MYLOG_ERROR("read %s:%u error: %s\n", log_filepath.c_str(), offset, sys::Error::to_string().c_str());
-            return false;
+            if (1 == insert_merger.get_rows())
+            {
+                merge_begin_offset = begin_offset;
+            }
+
+            continue;
         }
-        if (bytes > 0)
+        if (!insert_merger.empty())
         {
-            offset += static_cast<uint32_t>(bytes);
+            if (!flush_merged(filename, log_tag, merge_begin_offset, &insert_merger))
+            {
+                return false;
+            }
+            if (insert_merger.merge(sql, offset))
+            {
+                merge_begin_offset = begin_offset;
+                continue;
+            }
         }
 
-        // 操作DB异常时不断重试
-        MYLOG_DEBUG("%s\n", sql.c_str());
-        while (!_stop_signal_thread)
+        if (!replay_sql(filename, log_tag, begin_offset, offset, sql))
         {
-            if (parent_process_not_exists())
-            {
-                break;
-            }
+            return false;
+        }
+    }
 
-            try
-            {
-                const int rows = _mysql.update("%s", sql.c_str());
-                const time_t end_time = time(NULL);
-                const int interval = static_cast<int>(end_time - _begin_time);
+    return true;
+}
 
-                if (mooon::argument::batch->value() <= 1)
-                {
-                    // 非批量提交
-                    ++count;
-                    ++_interval_count;
+bool CDbProcess::flush_merged(const std::string& filename, const std::string& log_tag, uint32_t begin_offset, CInsertMerger* insert_merger)
+{
+    if (_replay_workers.empty())
+    {
+        return execute_merged(filename, log_tag, insert_merger);
+    }
+    else
+    {
+        struct ReplayItem* item = new struct ReplayItem;
+        item->begin_offset = begin_offset;
+        item->sql = insert_merger->get_sql();
+        if (insert_merger->get_rows() > 1)
+            item->sqls = insert_merger->get_sqls();
+        item->offsets = insert_merger->get_offsets();
+        insert_merger->clear();
+
+        // 合并的都是同一个表的，顺序键相同
+        return dispatch(filename, CReplayWorker::get_order_key(item->sql), item);
+    }
+}
 
-                    if (interval >= mooon::argument::efficiency->value())
-                    {
-                        MYLOG_INFO("[%s:%u]efficiency: %d (%d, %ds)\n", log_tag.c_str(), offset, _interval_count/interval, _interval_count, interval);
-                        _begin_time = end_time;
-                        _interval_count = 0;
-                    }
-                }
-                else
-                {
-                    ++_batch;
+bool CDbProcess::replay_sql(const std::string& filename, const std::string& log_tag, uint32_t begin_offset, uint32_t offset, const std::string& sql)
+{
+    bool executed = false;
 
-                    // 批量提交
-                    if (_batch >= mooon::argument::batch->value() || (interval > 1))
-                    {
-                        _mysql.commit();
-                        count += _batch;
-                        _interval_count += _batch;
-                        _batch = 0;
+    if (_replay_workers.empty())
+    {
+        return execute_sql(filename, log_tag, offset, sql, 1, &executed);
+    }
 
-                        if (interval >= mooon::argument::efficiency->value())
-                        {
-                            MYLOG_INFO("[%s:%u] efficiency: %d (%d, %ds)\n", log_tag.c_str(), offset, _interval_count/interval, _interval_count, interval);
-                            _begin_time = end_time;
-                            _interval_count = 0;
-                        }
-                    }
-                }
+    const std::string& order_key = CReplayWorker::get_order_key(sql);
+    if (order_key.empty())
+    {
+        // 取不到顺序键的，等之前的都执行完后再单独执行，以保证它和所有SQL之间的顺序
+        wait_replay_workers();
 
-                // 更新进度
-                if (!update_progress(filename, offset))
-                {
-                    return false;
-                }
+        const bool ok = execute_sql(filename, log_tag, offset, sql, 1, &executed);
+        _dispatched_offset = offset;
+        return ok;
+    }
+    else
+    {
+        struct ReplayItem* item = new struct ReplayItem;
+        item->begin_offset = begin_offset;
+        item->sql = sql;
+        item->offsets.push_back(offset);
+        return dispatch(filename, order_key, item);
+    }
+}
 
-                // rows为0可能是失败，比如update时没有满足where条件的记录存在时
-                if (0 == rows)
-                {
-                    MYLOG_WARN("[UPDATE_WARNING][%s:%u][%s] ok: %d, %" PRIu64"\n", log_tag.c_str(), offset, sql.c_str(), rows, _success_num_sqls);
-                }
-                else if (0 == ++_success_num_sqls%1000)
-                {
-                    MYLOG_DEBUG("[%s:%u][%s][ROWS:%d] %s-lines: %" PRIu64"\n", log_tag.c_str(), offset, sql.c_str(), rows, _dbinfo.alias.c_str(), _success_num_sqls);
-                }
-                else
-                {
-                    MYLOG_DEBUG("[%s:%u][%s] ok: %d, %" PRIu64"\n", log_tag.c_str(), offset, sql.c_str(),  rows, _success_num_sqls);
-                }
+bool CDbProcess::dispatch(const std::string& filename, const std::string& order_key, struct ReplayItem* item)
+{
+    const uint32_t end_offset = item->offsets.back();
+    const int index = CReplayWorker::get_worker_index(order_key, static_cast<int>(_replay_workers.size()));
 
-                break;
-            }
-            catch (sys::CDBException& ex)
-            {
-                MYLOG_ERROR("[%s:%u]%s\n", log_tag.c_str(), offset, ex.str().c_str());
+    if (!_replay_workers[index]->push(item))
+    {
+        return true; // 已停止
+    }
 
-                // 网络类需要重试，直到成功
-                if (!_mysql.is_disconnected_exception(ex))
-                {
-                    ++_failure_num_sqls;
-                    break;
-                }
+    _dispatched_offset = end_offset;
+    if (0 == ++_num_dispatched%1000)
+    {
+        return update_watermark(filename);
+    }
+
+    return true;
+}
 
-                ++_retry_times;
-                sys::CUtils::millisleep(1000);
+bool CDbProcess::recover_sql(const std::string& filename, const std::string& log_tag, uint32_t offset, const std::string& sql)
+{
+    const std::string& order_key = CReplayWorker::get_order_key(sql);
+    const struct Progress& checkpoint = _checkpoints[CReplayWorker::get_worker_index(order_key, static_cast<int>(_checkpoints.size()))];
+
+    _dispatched_offset = offset;
+    if ((0 == strcmp(checkpoint.filename, filename.c_str())) && (offset <= checkpoint.offset))
+    {
+        // 上次已由负责这个顺序键的线程执行过
+        MYLOG_DEBUG("[%s:%u][%s] replayed before\n", log_tag.c_str(), offset, sql.c_str());
+        return update_progress(filename, offset);
+    }
+    else
+    {
+        bool executed = false;
+        return execute_sql(filename, log_tag, offset, sql, 1, &executed);
+    }
+}
+
+bool CDbProcess::update_watermark(const std::string& filename)
+{
+    // 之前的都已执行完的位置，重启后从这里开始，之后已执行过的由检查点判断
+    uint32_t watermark = _dispatched_offset;
+    for (std::vector<CReplayWorker*>::size_type i=0; i<_replay_workers.size(); ++i)
+    {
+        watermark = std::min(watermark, _replay_workers[i]->get_pending_offset());
+    }
+
+    if (is_current_file(filename) && (watermark == _progress.offset))
+    {
+        return true;
+    }
+
+    return update_progress(filename, watermark);
+}
+
+void CDbProcess::wait_replay_workers()
+{
+    for (std::vector<CReplayWorker*>::size_type i=0; i<_replay_workers.size(); ++i)
+    {
+        _replay_workers[i]->wait_idle();
+    }
+}
+
+bool CDbProcess::execute_merged(const std::string& filename, const std::string& log_tag, CInsertMerger* insert_merger)
+{
+    bool executed = false;
+    const int rows = insert_merger->get_rows();
+
+    if (!execute_sql(filename, log_tag, insert_merger->get_offset(), insert_merger->get_sql(), rows, &executed))
+    {
+        return false;
+    }
+
+    // 合并后的失败（比如其中一行主键冲突）会导致所有行都未入库，
+    // 这时再逐条执行，使结果和不合并时一样
+    if (!executed && (rows > 1) && !_stop_signal_thread)
+    {
+        const std::vector<std::string>& sqls = insert_merger->get_sqls();
+        const std::vector<uint32_t>& offsets = insert_merger->get_offsets();
+
+        MYLOG_WARN("[%s:%u]%d merged rows failed, to execute one by one\n", log_tag.c_str(), insert_merger->get_offset(), rows);
+        for (std::vector<std::string>::size_type i=0; i<sqls.size(); ++i)
+        {
+            if (!execute_sql(filename, log_tag, offsets[i], sqls[i], 1, &executed))
+            {
+                return false;
             }
         }
     }
 
+    insert_merger->clear();
     return true;
 }
 
+bool CDbProcess::execute_sql(const std::string& filename, const std::string& log_tag, uint32_t offset, const std::string& sql, int num_sqls, bool* executed)
+{
+    if (!CSqlExecutor::execute_sql(&_mysql, log_tag, offset, sql, num_sqls, executed))
+    {
+        return true; // 已停止
+    }
+
+    // 更新进度
+    return !*executed || update_progress(filename, offset);
+}
+
+bool CDbProcess::is_stopped()
+{
+    return _stop_signal_thread || parent_process_not_exists();
+}
+
+void CDbProcess::on_executed(const std::string& log_tag, uint32_t offset, int num_sqls)
+{
+    const time_t end_time = time(NULL);
+    const int interval = static_cast<int>(end_time - _begin_time);
+
+    if (mooon::argument::batch->value() <= 1)
+    {
+        // 非批量提交
+        _interval_count += num_sqls;
+
+        if (interval >= mooon::argument::efficiency->value())
+        {
+            MYLOG_INFO("[%s:%u]efficiency: %d (%d, %ds)\n", log_tag.c_str(), offset, _interval_count/interval, _interval_count, interval);
+            _begin_time = end_time;
+            _interval_count = 0;
+        }
+    }
+    else
+    {
+        _batch += num_sqls;
+
+        // 批量提交
+        if (_batch >= mooon::argument::batch->value() || (interval > 1))
+        {
+            _mysql.commit();
+            _interval_count += _batch;
+            _batch = 0;
+
+            if (interval >= mooon::argument::efficiency->value())
+            {
+                MYLOG_INFO("[%s:%u] efficiency: %d (%d, %ds)\n", log_tag.c_str(), offset, _interval_count/interval, _interval_count, interval);
+                _begin_time = end_time;
+                _interval_count = 0;
+            }
+        }
+    }
+}
+
 bool CDbProcess::file_handled(const std::string& filename) const
 {
     // 是否为已处理过的文件，如果是则跳过
@@ -452,8 +664,9 @@ bool CDbProcess::connect_db()
         _mysql.enable_auto_reconnect();
         _mysql.open();
 
-        // 如果批量提交则需要禁用自动提交
-        if (mooon::argument::batch->value() > 1)
+        // 如果批量提交则需要禁用自动提交，
+        // 并行入库时这个连接只偶尔使用，批量提交会使事务长时间不提交，所以不用
+        if ((mooon::argument::batch->value() > 1) && (mooon::argument::replay_threads->value() <= 1))
         {
             try
             {
@@ -573,6 +786,110 @@ bool CDbProcess::open_progress()
     return true;
 }
 
+bool CDbProcess::open_checkpoints()
+{
+    const std::string checkpoint_filepath = _log_dirpath + std::string("/sql.checkpoint");
+    int checkpoint_fd = open(checkpoint_filepath.c_str(), O_RDWR|O_CREAT, FILE_DEFAULT_PERM);
+    if (-1 == checkpoint_fd)
+    {
+        int errcode = sys::Error::code();
+        MYLOG_ERROR("open %s failed: (%d)%s\n", checkpoint_filepath.c_str(), errcode, sys::Error::to_string(errcode).c_str());
+        return false;
+    }
+
+    // 每个线程一格，格数即为上次运行时的线程数
+    _checkpoint_fd = checkpoint_fd;
+    const off_t file_size = sys::CFileUtils::get_file_size(checkpoint_fd);
+    std::vector<struct Progress> checkpoints(static_cast<std::vector<struct Progress>::size_type>(file_size) / sizeof(struct Progress));
+    if (!checkpoints.empty())
+    {
+        const ssize_t bytes = static_cast<ssize_t>(checkpoints.size() * sizeof(struct Progress));
+        if (pread(checkpoint_fd, &checkpoints[0], bytes, 0) != bytes)
+        {
+            MYLOG_ERROR("read checkpoints(%s) failed: %s\n", checkpoint_filepath.c_str(), sys::Error::to_string().c_str());
+            return false;
+        }
+    }
+
+    _recovery_offset = 0;
+    for (std::vector<struct Progress>::size_type i=0; i<checkpoints.size(); ++i)
+    {
+        const struct Progress& checkpoint = checkpoints[i];
+        if (checkpoint.get_crc32() != checkpoint.crc32)
+        {
+            MYLOG_ERROR("crc32 checkpoint#%zd(%s) failed: %s\n", i, checkpoint_filepath.c_str(), checkpoint.str().c_str());
+            return false;
+        }
+        if ((0 == strcmp(checkpoint.filename, _progress.filename)) && (checkpoint.offset > _progress.offset))
+        {
+            _recovery_offset = std::max(_recovery_offset, checkpoint.offset);
+        }
+    }
+    if (0 == _recovery_offset)
+    {
+        return reset_checkpoints();
+    }
+
+    // 进度之后到_recovery_offset之间的SQL，有的已被执行过，有的没有，须根据检查点判断
+    _checkpoints.swap(checkpoints);
+    MYLOG_INFO("recover %s to %u with %zd checkpoints\n", _progress.str().c_str(), _recovery_offset, _checkpoints.size());
+    return true;
+}
+
+bool CDbProcess::reset_checkpoints()
+{
+    struct Progress checkpoint;
+
+    memset(checkpoint.filename, 0, sizeof(checkpoint.filename));
+    checkpoint.offset = 0;
+    checkpoint.crc32 = checkpoint.get_crc32();
+    _checkpoints.clear();
+    _recovery_offset = 0;
+
+    if (-1 == ftruncate(_checkpoint_fd, 0))
+    {
+        MYLOG_ERROR("truncate checkpoints error: %s\n", sys::Error::to_string().c_str());
+        return false;
+    }
+    // 不并行入库时不需要检查点
+    const int num_checkpoints = (mooon::argument::replay_threads->value() > 1)? mooon::argument::replay_threads->value(): 0;
+    for (int i=0; i<num_checkpoints; ++i)
+    {
+        if (pwrite(_checkpoint_fd, &checkpoint, sizeof(checkpoint), i*sizeof(checkpoint)) != static_cast<ssize_t>(sizeof(checkpoint)))
+        {
+            MYLOG_ERROR("write checkpoint#%d error: %s\n", i, sys::Error::to_string().c_str());
+            return false;
+        }
+    }
+
+    return true;
+}
+
+void CDbProcess::start_replay_workers()
+{
+    const int num_workers = mooon::argument::replay_threads->value();
+
+    if (num_workers > 1)
+    {
+        for (int i=0; i<num_workers; ++i)
+        {
+            CReplayWorker* replay_worker = new CReplayWorker(i, _dbinfo, _checkpoint_fd);
+            replay_worker->start();
+            _replay_workers.push_back(replay_worker);
+        }
+
+        MYLOG_INFO("%d replay workers started: %s\n", num_workers, _dbinfo.str().c_str());
+    }
+}
+
+void CDbProcess::stop_replay_workers()
+{
+    for (std::vector<CReplayWorker*>::size_type i=0; i<_replay_workers.size(); ++i)
+    {
+        _replay_workers[i]->stop();
+    }
+}
+
 void CDbProcess::archive_file(const std::string& filename) const
 {
     const std::string& filepath = get_filepath(filename);
@@ -663,25 +980,34 @@ void CDbProcess::delete_old_history_files()
 
 void CDbProcess::on_report(mooon::observer::IDataReporter* data_reporter, const std::string& current_datetime)
 {
-    if (((_success_num_sqls > 0) && (_success_num_sqls > _last_success_num_sqls)) ||
-        ((_failure_num_sqls > 0) && (_failure_num_sqls > _last_failure_num_sqls)) ||
-        ((_retry_times > 0) && (_retry_times > _last_retry_times)))
+    uint64_t success_num_sqls = get_success_num_sqls();
+    uint64_t failure_num_sqls = get_failure_num_sqls();
+    uint64_t retry_times = get_retry_times();
+
+    // 加上并行入库的各线程的
+    for (std::vector<CReplayWorker*>::size_type i=0; i<_replay_workers.size(); ++i)
+    {
+        success_num_sqls += _replay_workers[i]->get_success_num_sqls();
+        failure_num_sqls += _replay_workers[i]->get_failure_num_sqls();
+        retry_times += _replay_workers[i]->get_retry_times();
+    }
+
+    if (((success_num_sqls > 0) && (success_num_sqls > _last_success_num_sqls)) ||
+        ((failure_num_sqls > 0) && (failure_num_sqls > _last_failure_num_sqls)) ||
+        ((retry_times > 0) && (retry_times > _last_retry_times)))
     {
-        _last_success_num_sqls = _success_num_sqls;
-        _last_failure_num_sqls = _failure_num_sqls;
-        _last_retry_times = _retry_times;
+        _last_success_num_sqls = success_num_sqls;
+        _last_failure_num_sqls = failure_num_sqls;
+        _last_retry_times = retry_times;
 
-        data_reporter->report("[%s]%" PRIu64",%" PRIu64",%" PRIu64"\n", current_datetime.c_str(), _success_num_sqls, _failure_num_sqls, _retry_times);
+        data_reporter->report("[%s]%" PRIu64",%" PRIu64",%" PRIu64"\n", current_datetime.c_str(), success_num_sqls, failure_num_sqls, retry_times);
     }
 }
 
 void CDbProcess::reset()
 {
-    _success_num_sqls = 0;
     _last_success_num_sqls = 0;
-    _failure_num_sqls = 0;
     _last_failure_num_sqls = 0;
-    _retry_times = 0;
     _last_retry_times = 0;
 }
 
@@ -2,6 +2,10 @@
 #ifndef MOOON_DB_PROXY_DB_PROCESS_H
 #define MOOON_DB_PROXY_DB_PROCESS_H
 #include "config_loader.h"
+#include "insert_merger.h"
+#include "replay_worker.h"
+#include "sql_executor.h"
+#include "sql_log_reader.h"
 #include "sql_progress.h"
 #include <mooon/observer/observer_manager.h>
 #include <mooon/sys/mysql_db.h>
@@ -12,7 +16,7 @@
 namespace mooon { namespace db_proxy {
 
 // 父进程不在时自动退出
-class CDbProcess: public mooon::observer::IObservable
+class CDbProcess: public mooon::observer::IObservable, public CSqlExecutor
 {
 public:
     CDbProcess(const struct DbInfo& dbinfo);
@@ -34,6 +38,11 @@ private:
     bool create_history_directory() const;
     void handle_directory();
     bool handle_file(const std::string& filename);
+    bool replay_file(const std::string& filename);
+    bool flush_merged(const std::string& filename, const std::string& log_tag, uint32_t begin_offset, CInsertMerger* insert_merger);
+    bool replay_sql(const std::string& filename, const std::string& log_tag, uint32_t begin_offset, uint32_t offset, const std::string& sql);
+    bool execute_merged(const std::string& filename, const std::string& log_tag, CInsertMerger* insert_merger);
+    bool execute_sql(const std::string& filename, const std::string& log_tag, uint32_t offset, const std::string& sql, int num_sqls, bool* executed);
     bool file_handled(const std::string& filename) const; // 是否已处理过
     bool is_current_file(const std::string& filename) const;
     bool connect_db();
@@ -41,6 +50,8 @@ private:
     bool update_progress(const std::string& filename, uint32_t offset);
     bool get_progress(struct Progress* progress);
     bool open_progress();
+    bool open_checkpoints();
+    bool reset_checkpoints();
     void archive_file(const std::string& filename) const;
 
 private:
@@ -49,6 +60,10 @@ private:
     std::string get_history_dirpath() const;
     void delete_old_history_files(); // 删除过老的历史文件
 
+private: // override CSqlExecutor
+    virtual bool is_stopped();
+    virtual void on_executed(const std::string& log_tag, uint32_t offset, int num_sqls);
+
 private: // override mooon::observer::IObservable
     virtual void on_report(mooon::observer::IDataReporter* data_reporter, const std::string& current_datetime);
 
@@ -60,6 +75,7 @@ private:
     struct Progress _progress;
     struct DbInfo _dbinfo;
     std::string _log_dirpath; // 日志存放目录
+    CSqlLogWatcher _sql_log_watcher; // 监听日志目录，有新的SQL时立即唤醒
     volatile bool _stop_signal_thread;
     sys::CThreadEngine* _signal_thread;
     sys::CMySQLConnection _mysql;
@@ -72,13 +88,24 @@ private:
     int _interval_count; // 效率统计时间段内发生的数目
     int _batch; // 当前事务已写的条数
 
+private: // 并行入库（replay_threads大于1时）
+    void start_replay_workers();
+    void stop_replay_workers();
+    void wait_replay_workers();
+    bool dispatch(const std::string& filename, const std::string& order_key, struct ReplayItem* item);
+    bool recover_sql(const std::string& filename, const std::string& log_tag, uint32_t offset, const std::string& sql);
+    bool update_watermark(const std::string& filename);
+    std::vector<CReplayWorker*> _replay_workers;
+    int _checkpoint_fd; // 检查点文件句柄，每个线程一格，记录它最后执行完的位置
+    std::vector<struct Progress> _checkpoints; // 重启时读到的上次的检查点，恢复完后清空
+    uint32_t _recovery_offset; // 上次已执行到的最大位置，进度到它之间的须按检查点判断是否已执行过
+    uint32_t _dispatched_offset; // 已交给线程执行的位置
+    uint32_t _num_dispatched;
+
 private:
     void reset();
-    uint64_t _success_num_sqls; // 启动以来总共处理过的SQL条数
-    uint64_t _last_success_num_sqls; // 上一次记录的
-    uint64_t _failure_num_sqls;
+    uint64_t _last_success_num_sqls; // 上一次记录的启动以来总共处理过的SQL条数
     uint64_t _last_failure_num_sqls;
-    uint64_t _retry_times; // 重试次数
     uint64_t _last_retry_times;
 };
 
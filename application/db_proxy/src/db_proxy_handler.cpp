@@ -1,6 +1,7 @@
 // Writed by yijian (eyjian@qq.com, eyjian@gmail.com)
 #include "db_proxy_handler.h"
 #include "config_loader.h"
+#include "db_connection_pool.h"
 #include "sql_logger.h"
 #include <mooon/observer/observer_manager.h>
 #include <mooon/sys/datetime_utils.h>
@@ -11,13 +12,11 @@
 #include <thrift/TApplicationException.h>
 #include <vector>
 
-INTEGER_ARG_DECLARE(int32_t, cache_number);
+INTEGER_ARG_DECLARE(uint32_t, coalesce_timeout);
 namespace mooon { namespace db_proxy {
 
 CDbProxyHandler::CDbProxyHandler()
 {
-    atomic_set(&_cached_number, 0);
-
     reset();
     mooon::observer::IObserverManager* observer_mananger = mooon::observer::get();
     if (observer_mananger != NULL)
@@ -31,24 +30,14 @@ CDbProxyHandler::~CDbProxyHandler()
         observer_mananger->deregister_objservee(this);
 }
 
-void CDbProxyHandler::cleanup_cache()
+void CDbProxyHandler::init_cache(uint32_t max_number, uint64_t max_bytes)
 {
-    time_t now = time(NULL);
-    sys::WriteLockHelper write_lock(_cache_table_lock);
-    for (CacheTable::iterator iter=_cache_table.begin(); iter!=_cache_table.end();)
-    {
-        const struct CachedData& cached_data_ref = iter->second;
+    _result_cache.set_limits(max_number, max_bytes);
+}
 
-        if (now < cached_data_ref.cached_seconds+cached_data_ref.timestamp)
-        {
-            ++iter;
-        }
-        else
-        {
-            _cache_table.erase(iter++);
-            atomic_dec(&_cached_number);
-        }
-    }
+void CDbProxyHandler::cleanup_cache()
+{
+    _result_cache.cleanup();
 }
 
 void CDbProxyHandler::query(DBTable& _return, const std::string& sign, const int32_t seq, const int32_t query_index, const std::vector<std::string> & tokens, const int32_t limit, const int32_t limit_start)
@@ -70,13 +59,10 @@ void CDbProxyHandler::query(DBTable& _return, const std::string& sign, const int
 
     try
     {
-        sys::CMySQLConnection* db_connection = config_loader->get_db_connection(query_info.database_index);
-        if (NULL == db_connection)
-        {
-            MYLOG_ERROR("database_index[%d] not exists or cannot connect\n", query_info.database_index);
-            throw apache::thrift::TApplicationException(utils::CStringUtils::format_string("database_index(%d) not exists or cannot connect", query_info.database_index));
-        }
-        else if (tokens.size() > utils::FORMAT_STRING_SIZE)
+        // 缓存命中和等待相同查询的不访问MySQL，所以只在确实要查时才取连接，
+        // 否则连接池满时，缓存命中的也要等待db_pool_timeout，甚至失败
+        CDbConnectionHelper db_connection_helper(query_info.database_index, false);
+        if (tokens.size() > utils::FORMAT_STRING_SIZE)
         {
             MYLOG_ERROR("[%d]too big: %d\n", seq, (int)tokens.size());
             throw apache::thrift::TApplicationException("tokens too many");
@@ -84,7 +70,7 @@ void CDbProxyHandler::query(DBTable& _return, const std::string& sign, const int
         else
         {
             std::vector<std::string> escaped_tokens;
-            escape_tokens(db_connection, tokens, &escaped_tokens);
+            escape_tokens(NULL, tokens, &escaped_tokens); // 不用连接转义
             std::string sql = utils::format_string(query_info.sql_template.c_str(), escaped_tokens);
 
             if (sql.empty())
@@ -104,6 +90,9 @@ void CDbProxyHandler::query(DBTable& _return, const std::string& sign, const int
                 else
                     sql = utils::CStringUtils::format_string("%s LIMIT %d,%d", sql.c_str(), limit_start, limit_);
 
+                CQueryFlight* flight = NULL;
+                bool is_leader = false;
+
                 if (query_info.cached_seconds < 1)
                 {
                     MYLOG_DEBUG("not cache: %s", sql.c_str());
@@ -114,22 +103,68 @@ void CDbProxyHandler::query(DBTable& _return, const std::string& sign, const int
                     {
                         return; // 如果缓存中有，则直接返回
                     }
-                }
 
-                db_connection->query(_return, "%s", sql.c_str());
-                if (_return.empty())
-                {
-                    MYLOG_DEBUG("number of rows: %zd, number of columns: %d\n", _return.size(), 0);
+                    // 相同的查询正在执行时，等待它的结果，而不是再查一次MySQL
+                    if (mooon::argument::coalesce_timeout->value() > 0)
+                    {
+                        flight = _single_flight.join(sql, &is_leader);
+                        if (!is_leader)
+                        {
+                            const bool coalesced = wait_flight(_return, sql, flight);
+                            flight = NULL;
+                            if (coalesced)
+                            {
+                                ++_num_query_success;
+                                return;
+                            }
+
+                            // 超时或执行者失败，自己查
+                        }
+                    }
                 }
-                else
+
+                // 作为执行者时，不管以何种方式失败（包括非DB异常），都须结束flight，
+                // 否则等待者要等到超时，而且之后相同的查询都只能等待这个永不结束的flight
+                try
                 {
-                    MYLOG_DEBUG("number of rows: %zd, number of columns: %zd\n", _return.size(), _return[0].size());
-                }
+                    sys::CMySQLConnection* db_connection = db_connection_helper.reacquire();
+                    if (NULL == db_connection)
+                    {
+                        MYLOG_ERROR("database_index[%d] not exists or cannot connect\n", query_info.database_index);
+                        throw apache::thrift::TApplicationException(utils::CStringUtils::format_string("database_index(%d) not exists or cannot connect", query_info.database_index));
+                    }
 
-                ++_num_query_success;
-                if ((query_info.cached_seconds > 0) && !_return.empty())
+                    db_connection->query(_return, "%s", sql.c_str());
+                    if (_return.empty())
+                    {
+                        MYLOG_DEBUG("number of rows: %zd, number of columns: %d\n", _return.size(), 0);
+                    }
+                    else
+                    {
+                        MYLOG_DEBUG("number of rows: %zd, number of columns: %zd\n", _return.size(), _return[0].size());
+                    }
+
+                    ++_num_query_success;
+                    if (query_info.cached_seconds > 0)
+                    {
+                        CCachedResult* result = new CCachedResult(_return, time(NULL) + query_info.cached_seconds);
+
+                        result->inc_refcount();
+                        if (!_return.empty())
+                            _result_cache.add(sql, result);
+                        if (is_leader)
+                        {
+                            is_leader = false;
+                            finish_flight(sql, flight, result);
+                        }
+                        result->dec_refcount();
+                    }
+                }
+                catch (...)
                 {
-                    add_data_to_cache(_return, sql, query_info.cached_seconds);
+                    if (is_leader)
+                        finish_flight(sql, flight, NULL);
+                    throw;
                 }
             }
         }
@@ -179,7 +214,8 @@ int64_t CDbProxyHandler::update2(const int32_t seq, const int32_t database_index
         }
 
         // DB连接
-        sys::DBConnection* db_connection = config_loader->get_db_connection(database_index);
+        CDbConnectionHelper db_connection_helper(database_index);
+        sys::DBConnection* db_connection = db_connection_helper.get();
         if (NULL == db_connection)
         {
             ++_num_update2_failure;
@@ -261,7 +297,8 @@ int64_t CDbProxyHandler::insert2(const int32_t seq, const int32_t database_index
         }
 
         // DB连接
-        sys::DBConnection* db_connection = config_loader->get_db_connection(database_index);
+        CDbConnectionHelper db_connection_helper(database_index);
+        sys::DBConnection* db_connection = db_connection_helper.get();
         if (NULL == db_connection)
         {
             ++_num_insert2_failure;
@@ -332,7 +369,8 @@ void CDbProxyHandler::query2(DBTable& _return, const int32_t seq, const int32_t
         }
 
         // DB连接
-        sys::DBConnection* db_connection = config_loader->get_db_connection(database_index);
+        CDbConnectionHelper db_connection_helper(database_index);
+        sys::DBConnection* db_connection = db_connection_helper.get();
         if (NULL == db_connection)
         {
             MYLOG_ERROR("[%d]database_index[%d] not exists or cannot connect\n", seq, database_index);
@@ -456,23 +494,36 @@ int64_t CDbProxyHandler::do_update(bool throw_exception, const std::string& sign
             }
             else
             {
-                std::vector<std::string> escaped_tokens;
-                sys::DBConnection* db_connection = config_loader->get_db_connection(update_info.database_index);
-
-                // 转义，以防止SQL注入
-                escape_tokens(db_connection, tokens, &escaped_tokens);
+                // 写SQL日志的（alias不为空）不需要DB连接，
+                // 不为了转义而占用连接池中的连接（连接池满时可能要等待db_pool_timeout毫秒）
+                const bool direct = db_info.alias.empty();
+                CDbConnectionHelper db_connection_helper(update_info.database_index, direct);
+                sys::DBConnection* db_connection = db_connection_helper.get();
 
-                // 根据模板生成SQL
-                const std::string& sql = utils::format_string(update_info.sql_template.c_str(), escaped_tokens);
-                if (sql.empty())
+                if (direct && (NULL == db_connection))
                 {
-                    MYLOG_ERROR("tokens number(%zd) or template error: update_index=%d\n", escaped_tokens.size(), update_index);
+                    MYLOG_ERROR("[%d]database_index[%d] not exists or cannot connect\n", seq, update_info.database_index);
                     if (throw_exception)
-                        throw apache::thrift::TApplicationException(utils::CStringUtils::format_string("tokens number(%zd) or template error: update_index=%d", escaped_tokens.size(), update_index));
+                        throw apache::thrift::TApplicationException(utils::CStringUtils::format_string("database_index(%d) not exists or cannot connect", update_info.database_index));
                 }
                 else
                 {
-                    return write_sql("U1", seq, db_info, db_connection, sql);
+                    // 转义，以防止SQL注入
+                    std::vector<std::string> escaped_tokens;
+                    escape_tokens(db_connection, tokens, &escaped_tokens);
+
+                    // 根据模板生成SQL
+                    const std::string& sql = utils::format_string(update_info.sql_template.c_str(), escaped_tokens);
+                    if (sql.empty())
+                    {
+                        MYLOG_ERROR("tokens number(%zd) or template error: update_index=%d\n", escaped_tokens.size(), update_index);
+                        if (throw_exception)
+                            throw apache::thrift::TApplicationException(utils::CStringUtils::format_string("tokens number(%zd) or template error: update_index=%d", escaped_tokens.size(), update_index));
+                    }
+                    else
+                    {
+                        return write_sql("U1", seq, db_info, db_connection, sql);
+                    }
                 }
             }
         }
@@ -483,60 +534,47 @@ int64_t CDbProxyHandler::do_update(bool throw_exception, const std::string& sign
 
 bool CDbProxyHandler::get_data_from_cache(DBTable& dbtable, const std::string& sql)
 {
-    utils::CMd5Helper md5_helper;
-    md5_helper.update(sql);
-
-    sys::ReadLockHelper read_lock(_cache_table_lock);
-    CacheTable::iterator iter = _cache_table.find(md5_helper.value());
-    if (iter == _cache_table.end())
+    CCachedResult* cached_result = _result_cache.get(sql);
+    if (NULL == cached_result)
     {
-        MYLOG_DEBUG("[%s][%s] not in cache\n", md5_helper.to_string().c_str(), sql.c_str());
         return false;
     }
     else
     {
-        MYLOG_DEBUG("get [%s][%s] from cache\n", md5_helper.to_string().c_str(), sql.c_str());
-        dbtable = iter->second.cached_data;
-        iter->second.timestamp = time(NULL);
+        // 结果是不可变的，在锁外复制给thrift输出
+        dbtable = cached_result->get_table();
+        cached_result->dec_refcount();
         return true;
     }
 }
 
-void CDbProxyHandler::add_data_to_cache(const DBTable& dbtable, const std::string& sql, int cached_seconds)
+bool CDbProxyHandler::wait_flight(DBTable& dbtable, const std::string& sql, CQueryFlight* flight)
 {
-    int32_t cached_number = atomic_read(&_cached_number);
+    CCachedResult* result = flight->wait(mooon::argument::coalesce_timeout->value());
+    flight->dec_refcount();
 
-    if (cached_number > mooon::argument::cache_number->value())
+    if (NULL == result)
     {
-        MYLOG_WARN("too many, can not to cache again: %s\n", sql.c_str());
+        ++_num_query_coalesce_failure;
+        MYLOG_WARN("wait for the same query timeout or failed: %s\n", sql.c_str());
+        return false;
     }
     else
     {
-        utils::CMd5Helper md5_helper;
-        md5_helper.update(sql);
-
-        struct CachedData cached_data;
-        cached_data.timestamp = time(NULL);
-        cached_data.cached_seconds = cached_seconds;
-        cached_data.cached_data = dbtable;
-
-        sys::WriteLockHelper write_lock(_cache_table_lock);
-        std::pair<CacheTable::iterator, bool> ret = _cache_table.insert(std::make_pair(md5_helper.value(), cached_data));
-        if (ret.second)
-        {
-            atomic_inc(&_cached_number);
-            MYLOG_DEBUG("[%s][%s] added into cache\n", md5_helper.to_string().c_str(), sql.c_str());
-        }
-        else
-        {
-            ret.first->second.timestamp = time(NULL);
-            ret.first->second.cached_seconds = cached_seconds;
-            ret.first->second.cached_data = dbtable;
-            MYLOG_DEBUG("[%s][%s] updated into cache\n", md5_helper.to_string().c_str(), sql.c_str());
-        }
+        ++_num_query_coalesced;
+        MYLOG_DEBUG("coalesced: %s\n", sql.c_str());
+        dbtable = result->get_table();
+        result->dec_refcount();
+        return true;
     }
 }
 
+void CDbProxyHandler::finish_flight(const std::string& sql, CQueryFlight* flight, CCachedResult* result)
+{
+    _single_flight.finish(sql, flight, result);
+    flight->dec_refcount();
+}
+
 int64_t CDbProxyHandler::write_sql(const char* tag, int32_t seq, const struct DbInfo& db_info, sys::DBConnection* db_connection, const std::string& sql)
 {
     if (db_info.alias.empty())
@@ -617,9 +655,10 @@ void CDbProxyHandler::on_report(mooon::observer::IDataReporter* data_reporter, c
         (_num_async_update_success != 0) || (_num_async_update_failure != 0) ||
         (_num_insert2_success != 0) || (_num_insert2_failure != 0) ||
         (_num_write_success != 0) || (_num_write_failure != 0) ||
-        (_num_error_update_sql != 0))
+        (_num_error_update_sql != 0) ||
+        (_num_query_coalesced != 0) || (_num_query_coalesce_failure != 0))
     {
-        data_reporter->report("[%s][B]%d,%d,%d,%d,%d,%d,%d,%d,%d,%d,%d,%d,%d,%d,%d,%d,%d\n", current_datetime.c_str(),
+        data_reporter->report("[%s][B]%d,%d,%d,%d,%d,%d,%d,%d,%d,%d,%d,%d,%d,%d,%d,%d,%d,%d,%d\n", current_datetime.c_str(),
             _num_query_success, _num_query_failure,
             _num_query2_success, _num_query2_failure,
             _num_update_success, _num_update_failure,
@@ -628,7 +667,8 @@ void CDbProxyHandler::on_report(mooon::observer::IDataReporter* data_reporter, c
             _num_async_update_success, _num_async_update_failure,
             _num_insert2_success, _num_insert2_failure,
             _num_write_success, _num_write_failure,
-            _num_error_update_sql);
+            _num_error_update_sql,
+            _num_query_coalesced, _num_query_coalesce_failure);
         reset();
     }
 }
@@ -656,6 +696,9 @@ void CDbProxyHandler::reset()
     _num_write_failure = 0;
 
     _num_error_update_sql = 0;
+
+    _num_query_coalesced = 0;
+    _num_query_coalesce_failure = 0;
 }
 
 } // namespace mooon
@@ -2,29 +2,21 @@
 #ifndef MOOON_DB_PROXY_HANDLER_H
 #define MOOON_DB_PROXY_HANDLER_H
 #include "DbProxyService.h" // 执行cmake或make rpc时生成的文件
+#include "result_cache.h"
 #include <mooon/observer/observable.h>
-#include <mooon/sys/atomic.h>
 #include <mooon/sys/mysql_db.h>
-#include <mooon/sys/read_write_lock.h>
-#include <mooon/utils/md5_helper.h>
-#include <tr1/unordered_map>
 namespace mooon { namespace db_proxy {
 
 struct DbInfo;
 
-struct CachedData
-{
-    time_t timestamp; // 时间戳
-    int cached_seconds; // 缓存时长
-    sys::DBTable cached_data; // 被缓存的数据
-};
-
 class CDbProxyHandler: public DbProxyServiceIf, public mooon::observer::IObservable
 {
 public:
     CDbProxyHandler();
     ~CDbProxyHandler();
 
+    // 设置缓存的个数和字节数上限，须在服务启动前调用
+    void init_cache(uint32_t max_number, uint64_t max_bytes);
     // 清理缓存
     void cleanup_cache();
 
@@ -50,17 +42,18 @@ private:
 
     // 从缓存中取数据，如果取到返回true，否则返回false
     bool get_data_from_cache(DBTable& dbtable, const std::string& sql);
-    // 添加到缓存中
-    void add_data_to_cache(const DBTable& dbtable, const std::string& sql, int cached_seconds);
+
+    // 等待相同查询的执行者的结果，取到返回true，超时或执行者失败返回false，会释放flight
+    bool wait_flight(DBTable& dbtable, const std::string& sql, CQueryFlight* flight);
+    // 执行者完成查询，result为NULL表示失败，会释放flight
+    void finish_flight(const std::string& sql, CQueryFlight* flight, CCachedResult* result);
 
     // 入加SQL或写入文件中
     int64_t write_sql(const char* tag, int32_t seq, const struct DbInfo& db_info, sys::DBConnection* db_connection, const std::string& sql);
 
 private:
-    typedef std::tr1::unordered_map<utils::CMd5Helper::Value, struct CachedData, utils::CMd5Helper::ValueHasher, utils::CMd5Helper::ValueComparer> CacheTable;
-    CacheTable _cache_table; // 缓存表
-    mutable sys::CReadWriteLock _cache_table_lock;
-    atomic_t _cached_number; // 缓存的数据笔数
+    CResultCache _result_cache; // 查询结果缓存
+    CSingleFlight _single_flight; // 合并相同的并发查询
 
 private:
     void reset();
@@ -81,6 +74,8 @@ private:
     volatile int _num_write_success; // write_log成功次数
     volatile int _num_write_failure;
     volatile int _num_error_update_sql; // 错误的update类SQL数
+    volatile int _num_query_coalesced; // 等到相同查询结果的次数
+    volatile int _num_query_coalesce_failure; // 等待相同查询超时或对方失败的次数
 };
 
 } // namespace mooon
@@ -0,0 +1,147 @@
+// Writed by yijian (eyjian@qq.com, eyjian@gmail.com)
+#include "insert_merger.h"
+#include <ctype.h>
+#include <strings.h>
+namespace mooon { namespace db_proxy {
+
+static bool is_keyword_at(const std::string& sql, std::string::size_type pos, const char* keyword, std::string::size_type keyword_length)
+{
+    if (sql.size() < pos + keyword_length)
+        return false;
+    if (strncasecmp(sql.c_str()+pos, keyword, keyword_length) != 0)
+        return false;
+
+    // 前后都不能是标识符的字符
+    if ((pos > 0) && (isalnum(sql[pos-1]) || ('_' == sql[pos-1])))
+        return false;
+    if ((sql.size() > pos+keyword_length) && (isalnum(sql[pos+keyword_length]) || ('_' == sql[pos+keyword_length])))
+        return false;
+    return true;
+}
+
+// 返回从pos开始的括号组的结束位置（右括号的下一个位置），括号不匹配返回npos
+static std::string::size_type skip_parentheses(const std::string& sql, std::string::size_type pos)
+{
+    int depth = 0;
+    char quote = '\0'; // 当前所在的引号，为'\0'表示不在引号中
+
+    for (std::string::size_type i=pos; i<sql.size(); ++i)
+    {
+        const char c = sql[i];
+
+        if (quote != '\0')
+        {
+            if (('\\' == c) && (quote != '`'))
+                ++i; // 跳过被转义的字符
+            else if (c == quote)
+                quote = '\0';
+        }
+        else if (('\'' == c) || ('"' == c) || ('`' == c))
+        {
+            quote = c;
+        }
+        else if ('(' == c)
+        {
+            ++depth;
+        }
+        else if (')' == c)
+        {
+            if (0 == --depth)
+                return i + 1;
+        }
+    }
+
+    return std::string::npos;
+}
+
+bool CInsertMerger::split_insert(const std::string& sql, std::string* prefix, std::string* values)
+{
+    std::string::size_type begin = 0;
+    while ((begin < sql.size()) && isspace(sql[begin]))
+        ++begin;
+    if (!is_keyword_at(sql, begin, "INSERT", sizeof("INSERT")-1))
+        return false;
+
+    // VALUES之前不能有引号，因为这里不解析表名和列名之外的内容
+    std::string::size_type values_pos = std::string::npos;
+    for (std::string::size_type i=begin; i<sql.size(); ++i)
+    {
+        if (('\'' == sql[i]) || ('"' == sql[i]))
+            return false;
+        if (is_keyword_at(sql, i, "VALUES", sizeof("VALUES")-1))
+        {
+            values_pos = i;
+            break;
+        }
+    }
+    if (std::string::npos == values_pos)
+        return false;
+
+    // 值部分只能是一个括号括起来的行，之后不能再有其它内容（比如多行或ON DUPLICATE KEY UPDATE）
+    std::string::size_type values_begin = values_pos + sizeof("VALUES") - 1;
+    while ((values_begin < sql.size()) && isspace(sql[values_begin]))
+        ++values_begin;
+    if ((values_begin >= sql.size()) || (sql[values_begin] != '('))
+        return false;
+
+    const std::string::size_type values_end = skip_parentheses(sql, values_begin);
+    if (std::string::npos == values_end)
+        return false;
+    for (std::string::size_type i=values_end; i<sql.size(); ++i)
+    {
+        if (!isspace(sql[i]))
+            return false;
+    }
+
+    prefix->assign(sql, begin, values_pos+sizeof("VALUES")-1-begin);
+    values->assign(sql, values_begin, values_end-values_begin);
+    return true;
+}
+
+CInsertMerger::CInsertMerger(int max_rows, int max_bytes)
+    : _max_rows(max_rows), _max_bytes(max_bytes)
+{
+}
+
+bool CInsertMerger::merge(const std::string& sql, uint32_t offset)
+{
+    std::string prefix;
+    std::string values;
+
+    if (_max_rows < 2)
+        return false;
+    if (!split_insert(sql, &prefix, &values))
+        return false;
+
+    if (_sqls.empty())
+    {
+        _prefix = prefix;
+        _sql = prefix + std::string(" ") + values;
+    }
+    else
+    {
+        if (prefix != _prefix)
+            return false;
+        if (static_cast<int>(_sqls.size()) >= _max_rows)
+            return false;
+        if (static_cast<int>(_sql.size()+1+values.size()) > _max_bytes)
+            return false;
+
+        _sql += std::string(",") + values;
+    }
+
+    _sqls.push_back(sql);
+    _offsets.push_back(offset);
+    return true;
+}
+
+void CInsertMerger::clear()
+{
+    _prefix.clear();
+    _sql.clear();
+    _sqls.clear();
+    _offsets.clear();
+}
+
+} // namespace db_proxy
+} // namespace mooon
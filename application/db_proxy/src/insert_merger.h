@@ -0,0 +1,56 @@
+// Writed by yijian (eyjian@qq.com, eyjian@gmail.com)
+#ifndef MOOON_DB_PROXY_INSERT_MERGER_H
+#define MOOON_DB_PROXY_INSERT_MERGER_H
+#include <stdint.h>
+#include <string>
+#include <vector>
+namespace mooon { namespace db_proxy {
+
+// 将连续的、相同表相同列的单行INSERT合并成一条多行INSERT，
+// 如：INSERT INTO t (a,b) VALUES ("1","2") 和 INSERT INTO t (a,b) VALUES ("3","4")
+// 合并成：INSERT INTO t (a,b) VALUES ("1","2"),("3","4")
+//
+// 只合并相邻的，遇到不可合并的须先执行已合并的，所以不改变SQL的执行顺序。
+// 合并的条数和字节数都有上限，以免超过MySQL的max_allowed_packet。
+class CInsertMerger
+{
+public:
+    // 取得单行INSERT的前缀（到VALUES为止，合并时作为比较用）和值部分（括号括起来的一行），
+    // 不是单行的INSERT、带ON DUPLICATE KEY UPDATE等无法合并的返回false
+    static bool split_insert(const std::string& sql, std::string* prefix, std::string* values);
+
+public:
+    // max_rows小于2时不做合并
+    CInsertMerger(int max_rows, int max_bytes);
+
+    // 合并成功返回true，
+    // 返回false表示不可合并或已达上限，这时须先执行已合并的并调用clear()，然后再试一次，
+    // 如果还是返回false，则sql只能单独执行。
+    // offset为sql在日志文件中的结束位置
+    bool merge(const std::string& sql, uint32_t offset);
+    void clear();
+
+    bool empty() const { return _sqls.empty(); }
+    int get_rows() const { return static_cast<int>(_sqls.size()); }
+
+    // 合并后的SQL
+    const std::string& get_sql() const { return _sql; }
+    // 最后一条被合并的SQL的结束位置
+    uint32_t get_offset() const { return _offsets.back(); }
+
+    // 被合并的各条原始SQL和它们的结束位置，合并后的执行失败时（比如某行主键冲突），用来逐条执行
+    const std::vector<std::string>& get_sqls() const { return _sqls; }
+    const std::vector<uint32_t>& get_offsets() const { return _offsets; }
+
+private:
+    const int _max_rows;
+    const int _max_bytes;
+    std::string _prefix;
+    std::string _sql;
+    std::vector<std::string> _sqls;
+    std::vector<uint32_t> _offsets;
+};
+
+} // namespace db_proxy
+} // namespace mooon
+#endif // MOOON_DB_PROXY_INSERT_MERGER_H
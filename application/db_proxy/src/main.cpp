@@ -26,6 +26,11 @@ INTEGER_ARG_DEFINE(uint8_t, num_io_threads, 1, 1, 50, "number of IO threads");
 // 工作线程数
 INTEGER_ARG_DEFINE(uint8_t, num_work_threads, 1, 1, 50, "number of work threads");
 
+// 每个DB的连接池大小，即到每个DB的最大连接数，和工作线程数无关
+INTEGER_ARG_DEFINE(uint16_t, db_pool_size, 8, 1, 1000, "max number of connections per database");
+// 连接池中的连接都被占用时，最多等待多少毫秒
+INTEGER_ARG_DEFINE(uint32_t, db_pool_timeout, 1000, 1, 600000, "milliseconds to wait for a pooled connection");
+
 // sql日志文件大小，建议大小不小于（1024*1024*100），更小的值是为了方便开发时的测试
 INTEGER_ARG_DEFINE(int32_t, sql_file_size, (1024*1024*500), (1024*10), std::numeric_limits<int>::max(), "size of single sql log file");
 // 多少行刷新一次，如果值为0则由Linux系统控制，lines的值会严重影响性能，值为0时性能较好，值为1时数据最安全，顶多丢一笔数据
@@ -35,9 +40,25 @@ INTEGER_ARG_DEFINE(int32_t, lines, 0, 0, 1000000, "flush sql log after N lines")
 INTEGER_ARG_DEFINE(uint8_t, batch, 1, 1, std::numeric_limits<uint8_t>::max(), "number of batch commit");
 // 效率数据定时输出间隔，单位为秒
 INTEGER_ARG_DEFINE(uint16_t, efficiency, 60, 2, std::numeric_limits<uint8_t>::max(), "interval to output efficiency (seconds)");
+// 入库时最多将多少条相邻的、同表同列的单行INSERT合并成一条多行INSERT，值为1时不合并（默认）。
+// 合并并不完全等价于逐条执行：
+// 1) 非严格sql_mode下，多行INSERT将NULL写入NOT NULL列时存入隐式默认值而不报错，逐条执行则报错；
+// 2) 非事务表（如MyISAM）上合并的INSERT失败时，出错行之前的行已写入，逐条重试时会被再次插入。
+INTEGER_ARG_DEFINE(uint16_t, merge_rows, 1, 1, 10000, "max number of INSERTs merged into one when replaying sql log, 1 (default) to disable; "
+                   "caution: under non-strict sql_mode a multi-row INSERT stores the implicit default instead of failing on NULL into NOT NULL, "
+                   "and on non-transactional tables a failed merged INSERT keeps the rows before the failing one, which the row-by-row retry inserts again");
+// 合并后的INSERT的最大字节数，须小于MySQL的max_allowed_packet
+INTEGER_ARG_DEFINE(int32_t, merge_bytes, (1024*1024), 1024, (1024*1024*64), "max bytes of a merged INSERT");
+// 并行入库的线程数（每个线程一个DB连接），同一表（或SQL开头用/*key:xxx*/指定的顺序键）的SQL由同一个线程按顺序执行，值为1时不并行
+INTEGER_ARG_DEFINE(uint8_t, replay_threads, 1, 1, 64, "number of threads to replay sql log, statements of the same table are replayed in order");
 
 // 缓存多少笔数据
 INTEGER_ARG_DEFINE(int32_t, cache_number, 200000, 1, 200000000, "the number of data cached");
+// 缓存最多占用多少MB内存（估算值），
+// 缓存分成16个分片，每个分片各占1/16，所以单个结果集超过cache_megabytes/16的不会被缓存
+INTEGER_ARG_DEFINE(uint32_t, cache_megabytes, 1024, 1, 1048576, "max megabytes of data cached, a single result bigger than 1/16 of it is not cached");
+// 缓存未命中时，相同的并发查询等待第一个查询结果的最长毫秒数，0表示不合并
+INTEGER_ARG_DEFINE(uint32_t, coalesce_timeout, 1000, 0, 60000, "milliseconds to wait for the same query in flight, 0 to disable");
 // 清理缓存频率，单位为秒
 INTEGER_ARG_DEFINE(int32_t, cleanup_frequency, 10, 1, 3600, "the frequency to cleanup the cached data");
 
@@ -248,7 +269,8 @@ bool CMainHelper::init(int argc, char* argv[])
 
     // 创建信号线程
     _signal_thread = new mooon::sys::CThreadEngine(mooon::sys::bind(&CMainHelper::signal_thread, this));
-    // 创建清理缓存线程
+    // 设置缓存上限，再创建清理缓存线程
+    _thrift_server.get()->init_cache(mooon::argument::cache_number->value(), static_cast<uint64_t>(mooon::argument::cache_megabytes->value())*1024*1024);
     _cleanup_cache_thread = new mooon::sys::CThreadEngine(mooon::sys::bind(&CMainHelper::cleanup_cache_thread, this));
 
     try
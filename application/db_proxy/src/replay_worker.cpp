@@ -0,0 +1,274 @@
+// Writed by yijian (eyjian@qq.com, eyjian@gmail.com)
+#include "replay_worker.h"
+#include "db_connection_pool.h"
+#include "sql_progress.h"
+#include <ctype.h>
+#include <mooon/sys/log.h>
+#include <mooon/sys/utils.h>
+#include <mooon/utils/args_parser.h>
+#include <string.h>
+#include <zlib.h>
+
+INTEGER_ARG_DECLARE(uint8_t, auto_exit);
+namespace mooon { namespace db_proxy {
+
+// 取得pos开始的一个单词（表名可能被`括起来），pos指向单词之后
+static std::string next_word(const std::string& sql, std::string::size_type* pos)
+{
+    std::string::size_type i = *pos;
+    while ((i < sql.size()) && isspace(sql[i]))
+        ++i;
+
+    std::string word;
+    for (; i<sql.size(); ++i)
+    {
+        const char c = sql[i];
+        if (isspace(c) || ('(' == c) || (',' == c) || (';' == c))
+            break;
+        if (c != '`')
+            word.push_back(static_cast<char>(tolower(c)));
+    }
+
+    *pos = i;
+    return word;
+}
+
+std::string CReplayWorker::get_order_key(const std::string& sql)
+{
+    std::string::size_type pos = 0;
+    while ((pos < sql.size()) && isspace(sql[pos]))
+        ++pos;
+
+    // 用户指定的顺序键，比如在update的sql_template前加上/*key:%s*/
+    if (0 == sql.compare(pos, sizeof("/*key:")-1, "/*key:"))
+    {
+        const std::string::size_type key_begin = pos + sizeof("/*key:") - 1;
+        const std::string::size_type key_end = sql.find("*/", key_begin);
+        if (key_end != std::string::npos)
+            return sql.substr(key_begin, key_end-key_begin);
+    }
+
+    const std::string& verb = next_word(sql, &pos);
+    std::string word = next_word(sql, &pos);
+    if ((verb == "insert") || (verb == "replace"))
+    {
+        while ((word == "low_priority") || (word == "delayed") || (word == "high_priority") || (word == "ignore"))
+            word = next_word(sql, &pos);
+        if (word == "into")
+            word = next_word(sql, &pos);
+    }
+    else if (verb == "update")
+    {
+        while ((word == "low_priority") || (word == "ignore"))
+            word = next_word(sql, &pos);
+
+        // 多表UPDATE涉及不止一个表，取不到单一的顺序键
+        std::string::size_type set_pos = pos;
+        for (std::string next=next_word(sql, &set_pos); next!="set"; next=next_word(sql, &set_pos))
+        {
+            if (next.empty() || (next == "join"))
+                return std::string("");
+        }
+    }
+    else if (verb == "delete")
+    {
+        while ((word == "low_priority") || (word == "quick") || (word == "ignore"))
+            word = next_word(sql, &pos);
+        if (word != "from")
+            return std::string("");
+        word = next_word(sql, &pos);
+    }
+    else
+    {
+        return std::string("");
+    }
+
+    // 同一个表可能带库名（db.t）也可能不带（t），去掉库名使它们的顺序键相同，
+    // 不同库中的同名表因此也会是同一个顺序键，这只是少了并行，不影响顺序
+    const std::string::size_type dot_pos = word.rfind('.');
+    if (dot_pos != std::string::npos)
+        word.erase(0, dot_pos+1);
+    return word;
+}
+
+int CReplayWorker::get_worker_index(const std::string& order_key, int num_workers)
+{
+    const uLong crc = ::crc32(0L, (const unsigned char*)order_key.data(), order_key.size());
+    return static_cast<int>(crc % static_cast<uLong>(num_workers));
+}
+
+CReplayWorker::CReplayWorker(int index, const struct DbInfo& dbinfo, int checkpoint_fd)
+    : _index(index), _dbinfo(dbinfo), _checkpoint_fd(checkpoint_fd), _stop(false), _thread(NULL), _mysql(NULL)
+{
+}
+
+CReplayWorker::~CReplayWorker()
+{
+    stop();
+    if (_thread != NULL)
+    {
+        _thread->join();
+        delete _thread;
+    }
+
+    for (std::list<struct ReplayItem*>::iterator iter=_items.begin(); iter!=_items.end(); ++iter)
+        delete *iter;
+    delete _mysql;
+}
+
+void CReplayWorker::start()
+{
+    _thread = new sys::CThreadEngine(sys::bind(&CReplayWorker::run, this));
+}
+
+void CReplayWorker::stop()
+{
+    sys::LockHelper<sys::CLock> lock_helper(_lock);
+    _stop = true;
+    _event.broadcast();
+}
+
+void CReplayWorker::set_filename(const std::string& filename)
+{
+    sys::LockHelper<sys::CLock> lock_helper(_lock);
+    _filename = filename;
+    _log_tag = _dbinfo.alias + std::string("/") + filename + utils::CStringUtils::format_string("#%d", _index);
+}
+
+bool CReplayWorker::push(struct ReplayItem* item)
+{
+    sys::LockHelper<sys::CLock> lock_helper(_lock);
+
+    while (!_stop && (_items.size() >= MAX_PENDING_ITEMS))
+        _event.wait(_lock);
+    if (_stop)
+    {
+        delete item;
+        return false;
+    }
+
+    _items.push_back(item);
+    _event.broadcast();
+    return true;
+}
+
+void CReplayWorker::wait_idle()
+{
+    sys::LockHelper<sys::CLock> lock_helper(_lock);
+
+    while (!_stop && !_items.empty())
+        _event.wait(_lock);
+}
+
+uint32_t CReplayWorker::get_pending_offset()
+{
+    sys::LockHelper<sys::CLock> lock_helper(_lock);
+    return _items.empty()? UINT32_MAX: _items.front()->begin_offset;
+}
+
+void CReplayWorker::run()
+{
+    MYLOG_INFO("replay worker#%d started: %s\n", _index, _dbinfo.str().c_str());
+
+    while (!_stop)
+    {
+        struct ReplayItem* item = NULL;
+
+        {
+            sys::LockHelper<sys::CLock> lock_helper(_lock);
+            while (!_stop && _items.empty())
+                _event.wait(_lock);
+            if (_stop)
+                break;
+            item = _items.front();
+        }
+
+        if ((NULL == _mysql) && !connect_db())
+        {
+            sys::CUtils::millisleep(1000);
+            continue;
+        }
+        if (!execute_item(item))
+        {
+            break; // 被停止
+        }
+
+        {
+            sys::LockHelper<sys::CLock> lock_helper(_lock);
+            _items.pop_front();
+            _event.broadcast();
+        }
+
+        delete item;
+    }
+
+    MYLOG_INFO("replay worker#%d exit: %s\n", _index, _dbinfo.str().c_str());
+}
+
+bool CReplayWorker::connect_db()
+{
+    _mysql = CDbConnectionPool::create_connection(&_dbinfo);
+    return _mysql != NULL;
+}
+
+bool CReplayWorker::execute_item(const struct ReplayItem* item)
+{
+    bool executed = false;
+
+    if (!execute_sql(_mysql, _log_tag, item->offsets.back(), item->sql, static_cast<int>(item->offsets.size()), &executed))
+    {
+        return false;
+    }
+
+    // 合并后的失败（比如其中一行主键冲突）会导致所有行都未入库，这时再逐条执行
+    if (!executed && (item->sqls.size() > 1))
+    {
+        MYLOG_WARN("[%s:%u]%zd merged rows failed, to execute one by one\n", _log_tag.c_str(), item->offsets.back(), item->sqls.size());
+        for (std::vector<std::string>::size_type i=0; i<item->sqls.size(); ++i)
+        {
+            if (!execute_sql(_mysql, _log_tag, item->offsets[i], item->sqls[i], 1, &executed))
+            {
+                return false;
+            }
+
+            write_checkpoint(item->offsets[i]);
+        }
+    }
+    else
+    {
+        // 和单进程入库一样，执行失败的不再重试，所以也记入检查点
+        write_checkpoint(item->offsets.back());
+    }
+
+    return true;
+}
+
+bool CReplayWorker::is_stopped()
+{
+    if ((mooon::argument::auto_exit->value() != 0) && (1 == getppid()))
+    {
+        // 父进程不在时和db_process一起退出
+        stop();
+    }
+
+    return _stop;
+}
+
+void CReplayWorker::write_checkpoint(uint32_t offset)
+{
+    struct Progress checkpoint;
+
+    memset(checkpoint.filename, 0, sizeof(checkpoint.filename));
+    strncpy(checkpoint.filename, _filename.c_str(), sizeof(checkpoint.filename)-1);
+    checkpoint.offset = offset;
+    checkpoint.crc32 = checkpoint.get_crc32();
+
+    const off_t checkpoint_offset = static_cast<off_t>(_index * sizeof(checkpoint));
+    if (pwrite(_checkpoint_fd, &checkpoint, sizeof(checkpoint), checkpoint_offset) != static_cast<ssize_t>(sizeof(checkpoint)))
+    {
+        MYLOG_ERROR("[%s:%u]write checkpoint error: %s\n", _log_tag.c_str(), offset, sys::Error::to_string().c_str());
+    }
+}
+
+} // namespace db_proxy
+} // namespace mooon
@@ -0,0 +1,85 @@
+// Writed by yijian (eyjian@qq.com, eyjian@gmail.com)
+#ifndef MOOON_DB_PROXY_REPLAY_WORKER_H
+#define MOOON_DB_PROXY_REPLAY_WORKER_H
+#include "config_loader.h"
+#include "sql_executor.h"
+#include <list>
+#include <mooon/sys/event.h>
+#include <mooon/sys/lock.h>
+#include <mooon/sys/mysql_db.h>
+#include <mooon/sys/thread_engine.h>
+#include <vector>
+namespace mooon { namespace db_proxy {
+
+// 并行入库时交给入库线程的一项，为单条SQL或合并后的多条INSERT
+struct ReplayItem
+{
+    uint32_t begin_offset; // 在日志文件中的开始位置
+    std::string sql;
+    std::vector<std::string> sqls; // 合并前的各条SQL，合并的执行失败时用来逐条执行，单条SQL时为空
+    std::vector<uint32_t> offsets; // 各条SQL在日志文件中的结束位置，单条SQL时只有一个
+};
+
+// 并行入库的线程，每个线程有自己的DB连接和待入库队列。
+//
+// 顺序键相同的SQL总是交给同一个线程，按在日志文件中的顺序执行，
+// 每执行完一项，就将它的结束位置写到检查点文件中属于本线程的那一格，
+// 重启时据此判断哪些SQL已执行过，使得不会重复执行，也不会漏掉。
+class CReplayWorker: public CSqlExecutor
+{
+public:
+    // 取得SQL的顺序键：如果SQL以注释/*key:xxx*/开头，则为xxx，
+    // 否则为INSERT、REPLACE、UPDATE或DELETE的表名（小写，不含库名），取不到时返回空
+    static std::string get_order_key(const std::string& sql);
+
+    // 顺序键对应的线程，只依赖顺序键和线程数，所以重启后仍然相同
+    static int get_worker_index(const std::string& order_key, int num_workers);
+
+public:
+    // checkpoint_fd为检查点文件，由调用者打开和关闭
+    CReplayWorker(int index, const struct DbInfo& dbinfo, int checkpoint_fd);
+    ~CReplayWorker();
+
+    void start();
+    void stop();
+
+    // 开始处理一个新的日志文件，须在空闲时调用
+    void set_filename(const std::string& filename);
+
+    // 加入待入库队列，队列满时等待，item由入库线程删除，已停止时返回false
+    bool push(struct ReplayItem* item);
+
+    // 等待队列中的都执行完
+    void wait_idle();
+
+    // 队列中最早一项的开始位置，队列为空时返回UINT32_MAX
+    uint32_t get_pending_offset();
+
+private:
+    void run();
+    bool connect_db();
+    bool execute_item(const struct ReplayItem* item);
+    void write_checkpoint(uint32_t offset);
+
+private:
+    enum { MAX_PENDING_ITEMS = 1000 };
+    const int _index;
+    const struct DbInfo _dbinfo;
+    const int _checkpoint_fd;
+    std::string _filename;
+    std::string _log_tag;
+    volatile bool _stop;
+    sys::CThreadEngine* _thread;
+    sys::CMySQLConnection* _mysql;
+
+    sys::CLock _lock;
+    sys::CEvent _event; // 队列的变化（加入、执行完和停止）都广播
+    std::list<struct ReplayItem*> _items; // 正在执行的一项在执行完后才从队列中删除
+
+private: // override CSqlExecutor
+    virtual bool is_stopped();
+};
+
+} // namespace db_proxy
+} // namespace mooon
+#endif // MOOON_DB_PROXY_REPLAY_WORKER_H
@@ -0,0 +1,293 @@
+// Writed by yijian (eyjian@qq.com, eyjian@gmail.com)
+#include "result_cache.h"
+#include <mooon/sys/datetime_utils.h>
+#include <mooon/sys/log.h>
+namespace mooon { namespace db_proxy {
+
+// 估算一个结果集占用的内存字节数
+static size_t estimate_bytes(const sys::DBTable& table)
+{
+    size_t bytes = sizeof(sys::DBTable) + table.capacity() * sizeof(sys::DBRow);
+
+    for (sys::DBTable::size_type row=0; row<table.size(); ++row)
+    {
+        const sys::DBRow& db_row = table[row];
+
+        bytes += db_row.capacity() * sizeof(std::string);
+        for (sys::DBRow::size_type col=0; col<db_row.size(); ++col)
+            bytes += db_row[col].capacity();
+    }
+
+    return bytes;
+}
+
+CCachedResult::CCachedResult(const sys::DBTable& table, time_t expire_time)
+    : _table(table), _expire_time(expire_time)
+{
+    _bytes = estimate_bytes(_table);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+utils::CMd5Helper::Value CResultCache::get_key(const std::string& sql)
+{
+    utils::CMd5Helper md5_helper;
+    md5_helper.update(sql);
+    return md5_helper.value();
+}
+
+CResultCache::CResultCache()
+    : _max_number(0), _max_bytes(0)
+{
+}
+
+CResultCache::~CResultCache()
+{
+    for (int i=0; i<NUM_SHARDS; ++i)
+    {
+        struct Shard& shard = _shards[i];
+        for (EntryList::iterator iter=shard.entry_list.begin(); iter!=shard.entry_list.end(); ++iter)
+            iter->result->dec_refcount();
+    }
+}
+
+void CResultCache::set_limits(uint32_t max_number, uint64_t max_bytes)
+{
+    _max_number = (max_number + NUM_SHARDS - 1) / NUM_SHARDS;
+    _max_bytes = (max_bytes + NUM_SHARDS - 1) / NUM_SHARDS;
+    MYLOG_INFO("cache limits per shard: %u results, %" PRIu64" bytes\n", _max_number, _max_bytes);
+}
+
+CCachedResult* CResultCache::get(const std::string& sql)
+{
+    const utils::CMd5Helper::Value key = get_key(sql);
+    struct Shard* shard = get_shard(key);
+    CCachedResult* result = NULL;
+    std::vector<CCachedResult*> removed_results;
+
+    {
+        sys::LockHelper<sys::CLock> lock_helper(shard->lock);
+        EntryTable::iterator iter = shard->entry_table.find(key);
+
+        if (iter == shard->entry_table.end())
+        {
+            MYLOG_DEBUG("[%s] not in cache\n", sql.c_str());
+        }
+        else if (iter->second->result->get_expire_time() <= time(NULL))
+        {
+            MYLOG_DEBUG("[%s] expired in cache\n", sql.c_str());
+            remove_entry(shard, iter->second, &removed_results);
+        }
+        else
+        {
+            // 移到表头
+            shard->entry_list.splice(shard->entry_list.begin(), shard->entry_list, iter->second);
+            result = iter->second->result;
+            result->inc_refcount();
+            MYLOG_DEBUG("get [%s] from cache\n", sql.c_str());
+        }
+    }
+
+    for (std::vector<CCachedResult*>::size_type i=0; i<removed_results.size(); ++i)
+        removed_results[i]->dec_refcount();
+    return result;
+}
+
+void CResultCache::add(const std::string& sql, const sys::DBTable& table, int cached_seconds)
+{
+    // 在锁外复制结果集
+    CCachedResult* result = new CCachedResult(table, time(NULL) + cached_seconds);
+
+    result->inc_refcount();
+    add(sql, result);
+    result->dec_refcount();
+}
+
+void CResultCache::add(const std::string& sql, CCachedResult* result)
+{
+    const utils::CMd5Helper::Value key = get_key(sql);
+    struct Shard* shard = get_shard(key);
+    std::vector<CCachedResult*> removed_results;
+
+    result->inc_refcount(); // 缓存持有的引用
+    if ((0 == _max_number) || (result->get_bytes() > _max_bytes))
+    {
+        if (_max_number > 0)
+        {
+            MYLOG_WARN("too big (%zd > %" PRIu64" bytes per shard), can not to cache: %s\n", result->get_bytes(), _max_bytes, sql.c_str());
+        }
+
+        removed_results.push_back(result);
+    }
+    else
+    {
+        sys::LockHelper<sys::CLock> lock_helper(shard->lock);
+
+        EntryTable::iterator iter = shard->entry_table.find(key);
+        if (iter != shard->entry_table.end())
+            remove_entry(shard, iter->second, &removed_results);
+
+        struct Entry entry;
+        entry.key = key;
+        entry.result = result;
+        shard->entry_list.push_front(entry);
+        shard->entry_list.front().expire_iter = shard->expire_map.insert(std::make_pair(result->get_expire_time(), shard->entry_list.begin()));
+        shard->entry_table.insert(std::make_pair(key, shard->entry_list.begin()));
+        ++shard->number;
+        shard->bytes += result->get_bytes();
+        MYLOG_DEBUG("[%s] added into cache\n", sql.c_str());
+
+        // 淘汰最久未用的
+        while ((shard->number > _max_number) || (shard->bytes > _max_bytes))
+        {
+            EntryList::iterator last = shard->entry_list.end();
+            remove_entry(shard, --last, &removed_results);
+        }
+    }
+
+    for (std::vector<CCachedResult*>::size_type i=0; i<removed_results.size(); ++i)
+        removed_results[i]->dec_refcount();
+}
+
+void CResultCache::cleanup()
+{
+    const time_t now = time(NULL);
+    int num_removed = 0;
+
+    for (int i=0; i<NUM_SHARDS; ++i)
+    {
+        struct Shard* shard = &_shards[i];
+        std::vector<CCachedResult*> removed_results;
+
+        {
+            sys::LockHelper<sys::CLock> lock_helper(shard->lock);
+            while (!shard->expire_map.empty() && (shard->expire_map.begin()->first <= now))
+                remove_entry(shard, shard->expire_map.begin()->second, &removed_results);
+        }
+
+        num_removed += static_cast<int>(removed_results.size());
+        for (std::vector<CCachedResult*>::size_type j=0; j<removed_results.size(); ++j)
+            removed_results[j]->dec_refcount();
+    }
+
+    MYLOG_DEBUG("%d expired removed, %u cached with %" PRIu64" bytes\n", num_removed, get_number(), get_bytes());
+}
+
+uint32_t CResultCache::get_number() const
+{
+    uint32_t number = 0;
+    for (int i=0; i<NUM_SHARDS; ++i)
+        number += _shards[i].number; // 只用于统计，不加锁
+    return number;
+}
+
+uint64_t CResultCache::get_bytes() const
+{
+    uint64_t bytes = 0;
+    for (int i=0; i<NUM_SHARDS; ++i)
+        bytes += _shards[i].bytes; // 只用于统计，不加锁
+    return bytes;
+}
+
+struct CResultCache::Shard* CResultCache::get_shard(const utils::CMd5Helper::Value& key)
+{
+    return &_shards[key.low_8bytes % NUM_SHARDS];
+}
+
+void CResultCache::remove_entry(struct Shard* shard, EntryList::iterator entry_iter, std::vector<CCachedResult*>* results)
+{
+    CCachedResult* result = entry_iter->result;
+
+    shard->bytes -= result->get_bytes();
+    --shard->number;
+    shard->expire_map.erase(entry_iter->expire_iter);
+    shard->entry_table.erase(entry_iter->key);
+    shard->entry_list.erase(entry_iter);
+    results->push_back(result);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+CQueryFlight::CQueryFlight()
+    : _finished(false), _result(NULL)
+{
+}
+
+CQueryFlight::~CQueryFlight()
+{
+    if (_result != NULL)
+        _result->dec_refcount();
+}
+
+CCachedResult* CQueryFlight::wait(uint32_t timeout_milliseconds)
+{
+    const uint64_t deadline = sys::current_milliseconds() + timeout_milliseconds;
+    sys::LockHelper<sys::CLock> lock_helper(_lock);
+
+    while (!_finished)
+    {
+        const uint64_t now = sys::current_milliseconds();
+        if (now >= deadline)
+            return NULL;
+        _event.timed_wait(_lock, static_cast<uint32_t>(deadline - now));
+    }
+    if (_result != NULL)
+        _result->inc_refcount();
+    return _result;
+}
+
+void CQueryFlight::finish(CCachedResult* result)
+{
+    sys::LockHelper<sys::CLock> lock_helper(_lock);
+
+    if (result != NULL)
+        result->inc_refcount();
+    _result = result;
+    _finished = true;
+    _event.broadcast();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+CSingleFlight::~CSingleFlight()
+{
+    for (FlightTable::iterator iter=_flight_table.begin(); iter!=_flight_table.end(); ++iter)
+        iter->second->dec_refcount();
+}
+
+CQueryFlight* CSingleFlight::join(const std::string& sql, bool* is_leader)
+{
+    const utils::CMd5Helper::Value key = CResultCache::get_key(sql);
+    sys::LockHelper<sys::CLock> lock_helper(_lock);
+    std::pair<FlightTable::iterator, bool> ret = _flight_table.insert(std::make_pair(key, static_cast<CQueryFlight*>(NULL)));
+
+    *is_leader = ret.second;
+    if (ret.second)
+    {
+        ret.first->second = new CQueryFlight;
+        ret.first->second->inc_refcount(); // 表持有的引用
+    }
+
+    ret.first->second->inc_refcount(); // 调用者持有的引用
+    return ret.first->second;
+}
+
+void CSingleFlight::finish(const std::string& sql, CQueryFlight* flight, CCachedResult* result)
+{
+    const utils::CMd5Helper::Value key = CResultCache::get_key(sql);
+    bool erased = false;
+
+    {
+        sys::LockHelper<sys::CLock> lock_helper(_lock);
+        FlightTable::iterator iter = _flight_table.find(key);
+        if ((iter != _flight_table.end()) && (iter->second == flight))
+        {
+            _flight_table.erase(iter);
+            erased = true;
+        }
+    }
+
+    flight->finish(result);
+    if (erased)
+        flight->dec_refcount();
+}
+
+} // namespace db_proxy
+} // namespace mooon
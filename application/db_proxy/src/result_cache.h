@@ -0,0 +1,149 @@
+// Writed by yijian (eyjian@qq.com, eyjian@gmail.com)
+#ifndef MOOON_DB_PROXY_RESULT_CACHE_H
+#define MOOON_DB_PROXY_RESULT_CACHE_H
+#include <list>
+#include <map>
+#include <mooon/sys/event.h>
+#include <mooon/sys/lock.h>
+#include <mooon/sys/ref_countable.h>
+#include <mooon/sys/simple_db.h>
+#include <mooon/utils/md5_helper.h>
+#include <tr1/unordered_map>
+#include <vector>
+namespace mooon { namespace db_proxy {
+
+// 被缓存的查询结果，创建后不再修改，通过引用计数在多个线程间共享，
+// 所以命中时不需要在锁内复制整个结果集
+class CCachedResult: public sys::CRefCountable
+{
+public:
+    CCachedResult(const sys::DBTable& table, time_t expire_time);
+
+    const sys::DBTable& get_table() const { return _table; }
+    time_t get_expire_time() const { return _expire_time; }
+    size_t get_bytes() const { return _bytes; }
+
+private:
+    const sys::DBTable _table;
+    const time_t _expire_time;
+    size_t _bytes; // 估算的占用内存字节数
+};
+
+// 按SQL的MD5值分片的LRU缓存，每个分片一把锁，
+// 每个结果有自己的过期时间（加入时的时间加上cached_seconds，命中不会延长），
+// 按个数和字节数两个上限淘汰最久未用的。
+class CResultCache
+{
+public:
+    // 缓存和查询合并共用的键，为SQL的MD5值
+    static utils::CMd5Helper::Value get_key(const std::string& sql);
+
+public:
+    CResultCache();
+    ~CResultCache();
+
+    // 设置个数和字节数上限，须在使用前调用，未调用时不缓存任何结果，
+    // 上限平分到各分片，所以单个结果集超过max_bytes/NUM_SHARDS的不会被缓存
+    void set_limits(uint32_t max_number, uint64_t max_bytes);
+
+    // 取得未过期的结果，没有返回NULL，
+    // 返回的结果已增加了引用计数，用完后须调用它的dec_refcount()
+    CCachedResult* get(const std::string& sql);
+
+    // 加入或替换，结果会被复制一份
+    void add(const std::string& sql, const sys::DBTable& table, int cached_seconds);
+    // 加入或替换，缓存会增加result的引用计数
+    void add(const std::string& sql, CCachedResult* result);
+
+    // 删除所有已过期的，只访问过期的，不扫描整个缓存
+    void cleanup();
+
+    uint32_t get_number() const;
+    uint64_t get_bytes() const;
+
+private:
+    enum { NUM_SHARDS = 16 };
+
+    struct Entry;
+    typedef std::list<struct Entry> EntryList; // 表头为最近使用的
+    typedef std::multimap<time_t, EntryList::iterator> ExpireMap;
+    typedef std::tr1::unordered_map<utils::CMd5Helper::Value, EntryList::iterator, utils::CMd5Helper::ValueHasher, utils::CMd5Helper::ValueComparer> EntryTable;
+
+    struct Entry
+    {
+        utils::CMd5Helper::Value key;
+        CCachedResult* result;
+        ExpireMap::iterator expire_iter;
+    };
+
+    struct Shard
+    {
+        sys::CLock lock;
+        EntryList entry_list;
+        ExpireMap expire_map;
+        EntryTable entry_table;
+        uint32_t number;
+        uint64_t bytes;
+
+        Shard()
+            : number(0), bytes(0)
+        {
+        }
+    };
+
+private:
+    struct Shard* get_shard(const utils::CMd5Helper::Value& key);
+
+    // 须在分片的锁内调用，被删除的结果放到results中，以在锁外释放
+    void remove_entry(struct Shard* shard, EntryList::iterator entry_iter, std::vector<CCachedResult*>* results);
+
+private:
+    uint32_t _max_number; // 单个分片的上限
+    uint64_t _max_bytes;  // 单个分片的上限
+    struct Shard _shards[NUM_SHARDS];
+};
+
+// 一次正在执行的查询，相同查询的并发调用者等待它的结果
+class CQueryFlight: public sys::CRefCountable
+{
+public:
+    CQueryFlight();
+    ~CQueryFlight();
+
+    // 等待执行者的结果，返回的结果已增加了引用计数，超时或执行失败返回NULL
+    CCachedResult* wait(uint32_t timeout_milliseconds);
+
+    // 执行者完成，result为NULL表示执行失败
+    void finish(CCachedResult* result);
+
+private:
+    sys::CLock _lock;
+    sys::CEvent _event;
+    bool _finished;
+    CCachedResult* _result;
+};
+
+// 合并相同的并发查询（single flight）：
+// 缓存未命中时，第一个调用者执行查询，其它相同查询的调用者等待它的结果，
+// 以免热点数据过期时大量相同的查询同时打到MySQL
+class CSingleFlight
+{
+public:
+    ~CSingleFlight();
+
+    // 返回的flight已增加了引用计数，用完后须调用它的dec_refcount()，
+    // is_leader为true表示是第一个调用者，须执行查询并调用finish()
+    CQueryFlight* join(const std::string& sql, bool* is_leader);
+
+    // 第一个调用者完成，result为NULL表示执行失败，之后相同的查询开始新的一轮
+    void finish(const std::string& sql, CQueryFlight* flight, CCachedResult* result);
+
+private:
+    typedef std::tr1::unordered_map<utils::CMd5Helper::Value, CQueryFlight*, utils::CMd5Helper::ValueHasher, utils::CMd5Helper::ValueComparer> FlightTable;
+    sys::CLock _lock;
+    FlightTable _flight_table; // 表中的flight持有一个引用
+};
+
+} // namespace db_proxy
+} // namespace mooon
+#endif // MOOON_DB_PROXY_RESULT_CACHE_H
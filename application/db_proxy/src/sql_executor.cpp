@@ -0,0 +1,68 @@
+// Writed by yijian (eyjian@qq.com, eyjian@gmail.com)
+#include "sql_executor.h"
+#include <mooon/sys/log.h>
+#include <mooon/sys/utils.h>
+namespace mooon { namespace db_proxy {
+
+CSqlExecutor::CSqlExecutor()
+    : _success_num_sqls(0), _failure_num_sqls(0), _retry_times(0)
+{
+}
+
+CSqlExecutor::~CSqlExecutor()
+{
+}
+
+bool CSqlExecutor::execute_sql(sys::CMySQLConnection* mysql, const std::string& log_tag, uint32_t offset, const std::string& sql, int num_sqls, bool* executed)
+{
+    *executed = false;
+
+    // 操作DB异常时不断重试
+    while (!is_stopped())
+    {
+        try
+        {
+            const int rows = mysql->update("%s", sql.c_str());
+            on_executed(log_tag, offset, num_sqls);
+
+            *executed = true;
+            _success_num_sqls += num_sqls;
+            if (0 == rows)
+            {
+                // rows为0可能是失败，比如update时没有满足where条件的记录存在时
+                MYLOG_WARN("[UPDATE_WARNING][%s:%u][%s] ok: %d, %" PRIu64"\n", log_tag.c_str(), offset, sql.c_str(), rows, _success_num_sqls);
+            }
+            else
+            {
+                MYLOG_DEBUG("[%s:%u][%s] ok: %d, %" PRIu64"\n", log_tag.c_str(), offset, sql.c_str(), rows, _success_num_sqls);
+            }
+
+            return true;
+        }
+        catch (sys::CDBException& ex)
+        {
+            MYLOG_ERROR("[%s:%u]%s\n", log_tag.c_str(), offset, ex.str().c_str());
+
+            // 网络类需要重试，直到成功
+            if (!mysql->is_disconnected_exception(ex))
+            {
+                // 合并的失败后会逐条执行，由逐条执行时计数
+                if (1 == num_sqls)
+                    ++_failure_num_sqls;
+                return true;
+            }
+
+            ++_retry_times;
+            sys::CUtils::millisleep(1000);
+        }
+    }
+
+    return false;
+}
+
+void CSqlExecutor::on_executed(const std::string& log_tag, uint32_t offset, int num_sqls)
+{
+}
+
+} // namespace db_proxy
+} // namespace mooon
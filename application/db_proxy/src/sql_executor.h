@@ -0,0 +1,42 @@
+// Writed by yijian (eyjian@qq.com, eyjian@gmail.com)
+#ifndef MOOON_DB_PROXY_SQL_EXECUTOR_H
+#define MOOON_DB_PROXY_SQL_EXECUTOR_H
+#include <mooon/sys/mysql_db.h>
+#include <string>
+namespace mooon { namespace db_proxy {
+
+// 执行从SQL日志中读到的SQL，为db_process（CDbProcess）和并行入库的线程（CReplayWorker）共用：
+// 网络类错误时每秒重试一次，直到成功或被停止，其它错误不重试，
+// 并统计成功和失败的SQL条数以及重试次数
+class CSqlExecutor
+{
+public:
+    CSqlExecutor();
+    virtual ~CSqlExecutor();
+
+    uint64_t get_success_num_sqls() const { return _success_num_sqls; }
+    uint64_t get_failure_num_sqls() const { return _failure_num_sqls; }
+    uint64_t get_retry_times() const { return _retry_times; }
+
+protected:
+    // num_sqls为sql包含的日志中的SQL条数，合并的INSERT时大于1，
+    // *executed为true表示执行成功，为false表示非网络类错误而失败，
+    // 返回false表示在执行成功之前被停止
+    bool execute_sql(sys::CMySQLConnection* mysql, const std::string& log_tag, uint32_t offset, const std::string& sql, int num_sqls, bool* executed);
+
+private:
+    // 每次执行（包括重试）之前调用，返回true表示停止
+    virtual bool is_stopped() = 0;
+
+    // 执行成功后调用，在重试的范围内，所以抛出的CDBException同样会导致重试
+    virtual void on_executed(const std::string& log_tag, uint32_t offset, int num_sqls);
+
+private:
+    uint64_t _success_num_sqls; // 只用于统计，不加锁
+    uint64_t _failure_num_sqls;
+    uint64_t _retry_times;
+};
+
+} // namespace db_proxy
+} // namespace mooon
+#endif // MOOON_DB_PROXY_SQL_EXECUTOR_H
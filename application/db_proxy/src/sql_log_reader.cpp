@@ -0,0 +1,196 @@
+// Writed by yijian (eyjian@qq.com, eyjian@gmail.com)
+#include "sql_log_reader.h"
+#include "config_loader.h"
+#include <errno.h>
+#include <limits.h>
+#include <mooon/sys/datetime_utils.h>
+#include <mooon/sys/log.h>
+#include <mooon/sys/utils.h>
+#include <poll.h>
+#include <string.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+namespace mooon { namespace db_proxy {
+
+CSqlLogReader::CSqlLogReader(int fd, uint32_t offset)
+    : _fd(fd), _offset(offset), _buffer(BUFFER_SIZE), _begin(0), _end(0)
+{
+}
+
+int CSqlLogReader::read_sql(std::string* sql)
+{
+    while (true)
+    {
+        const size_t available = _end - _begin;
+
+        if (available >= sizeof(int32_t))
+        {
+            int32_t length = 0;
+            memcpy(&length, &_buffer[_begin], sizeof(length));
+            if (length < 0)
+            {
+                MYLOG_ERROR("invalid sql length(%d) at %u\n", length, _offset);
+                errno = EINVAL;
+                return -1;
+            }
+
+            const size_t record_size = sizeof(length) + static_cast<size_t>(length);
+            if (available >= record_size)
+            {
+                sql->assign(&_buffer[_begin+sizeof(length)], length);
+                _begin += record_size;
+                _offset += static_cast<uint32_t>(record_size);
+                return 1;
+            }
+            if (record_size > _buffer.size())
+            {
+                _buffer.resize(record_size);
+            }
+        }
+
+        // 将不完整的部分移到缓冲区头部，再读入更多
+        if (_begin > 0)
+        {
+            if (available > 0)
+                memmove(&_buffer[0], &_buffer[_begin], available);
+            _begin = 0;
+            _end = available;
+        }
+
+        const ssize_t bytes = read(_fd, &_buffer[_end], _buffer.size()-_end);
+        if (-1 == bytes)
+        {
+            if (EINTR == errno)
+                continue;
+            return -1;
+        }
+        if (0 == bytes)
+        {
+            return 0;
+        }
+
+        _end += static_cast<size_t>(bytes);
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+CSqlLogWatcher::CSqlLogWatcher()
+    : _inotify_fd(-1), _dir_wd(-1), _file_wd(-1)
+{
+}
+
+CSqlLogWatcher::~CSqlLogWatcher()
+{
+    if (_inotify_fd != -1)
+        close(_inotify_fd);
+}
+
+void CSqlLogWatcher::watch(const std::string& log_dirpath)
+{
+    _inotify_fd = inotify_init1(IN_NONBLOCK|IN_CLOEXEC);
+    if (-1 == _inotify_fd)
+    {
+        MYLOG_WARN("inotify_init1 error to poll %s: %s\n", log_dirpath.c_str(), sys::Error::to_string().c_str());
+    }
+    else if (-1 == (_dir_wd = inotify_add_watch(_inotify_fd, log_dirpath.c_str(), IN_CREATE|IN_MOVED_TO)))
+    {
+        MYLOG_WARN("inotify_add_watch %s error to poll: %s\n", log_dirpath.c_str(), sys::Error::to_string().c_str());
+        close(_inotify_fd);
+        _inotify_fd = -1;
+    }
+    else
+    {
+        MYLOG_INFO("watching %s\n", log_dirpath.c_str());
+    }
+}
+
+void CSqlLogWatcher::watch_file(const std::string& log_filepath)
+{
+    if (-1 == _inotify_fd)
+    {
+        return;
+    }
+
+    // 文件被删除后监听已被内核自动取消，这时inotify_rm_watch会报EINVAL，忽略即可
+    if (_file_wd != -1)
+    {
+        (void)inotify_rm_watch(_inotify_fd, _file_wd);
+        _file_wd = -1;
+    }
+
+    // 失败时仍可由目录的监听或等待超时发现新的SQL
+    _file_wd = inotify_add_watch(_inotify_fd, log_filepath.c_str(), IN_MODIFY);
+    if (-1 == _file_wd)
+    {
+        MYLOG_WARN("inotify_add_watch %s error: %s\n", log_filepath.c_str(), sys::Error::to_string().c_str());
+    }
+}
+
+bool CSqlLogWatcher::wait(uint32_t timeout_milliseconds)
+{
+    if (-1 == _inotify_fd)
+    {
+        sys::CUtils::millisleep(timeout_milliseconds);
+        return false;
+    }
+
+    const uint64_t deadline = sys::current_milliseconds() + timeout_milliseconds;
+    char buffer[sizeof(struct inotify_event)*64 + NAME_MAX + 1] __attribute__ ((aligned(__alignof__(struct inotify_event))));
+    while (true)
+    {
+        const uint64_t now = sys::current_milliseconds();
+        if (now >= deadline)
+        {
+            return false;
+        }
+
+        struct pollfd fds[1];
+        fds[0].fd = _inotify_fd;
+        fds[0].events = POLLIN;
+        fds[0].revents = 0;
+        if (poll(fds, 1, static_cast<int>(deadline-now)) <= 0)
+        {
+            return false;
+        }
+
+        // 取走所有事件，目录中只关心SQL日志文件的创建
+        bool changed = false;
+        while (true)
+        {
+            const ssize_t bytes = read(_inotify_fd, buffer, sizeof(buffer));
+            if (bytes <= 0)
+            {
+                break;
+            }
+
+            for (const char* ptr=buffer; ptr<buffer+bytes; )
+            {
+                const struct inotify_event* event = reinterpret_cast<const struct inotify_event*>(ptr);
+                if (event->mask & IN_Q_OVERFLOW)
+                {
+                    // 事件队列溢出，事件已丢失，只能当作有变化
+                    changed = true;
+                }
+                else if (event->wd == _file_wd)
+                {
+                    if (event->mask & IN_IGNORED)
+                        _file_wd = -1; // 文件已被删除
+                    else
+                        changed = true;
+                }
+                else if ((event->wd == _dir_wd) && (event->len > 0) && is_sql_log_filename(event->name))
+                {
+                    changed = true;
+                }
+                ptr += sizeof(struct inotify_event) + event->len;
+            }
+        }
+        if (changed)
+        {
+            return true;
+        }
+    }
+}
+
+} // namespace db_proxy
+} // namespace mooon
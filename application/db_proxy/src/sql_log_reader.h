@@ -0,0 +1,61 @@
+// Writed by yijian (eyjian@qq.com, eyjian@gmail.com)
+#ifndef MOOON_DB_PROXY_SQL_LOG_READER_H
+#define MOOON_DB_PROXY_SQL_LOG_READER_H
+#include <stdint.h>
+#include <string>
+#include <vector>
+namespace mooon { namespace db_proxy {
+
+// 带缓冲的SQL日志读取器，一次read()读入多条SQL，
+// 日志文件中每条SQL的格式为：4字节的长度 + SQL语句（见CSqlLogger::write_log）
+class CSqlLogReader
+{
+public:
+    // fd已定位到offset处，由调用者打开和关闭
+    CSqlLogReader(int fd, uint32_t offset);
+
+    // 读取一条完整的SQL，返回1表示读到，
+    // 返回0表示暂无完整的一条（正在写入的不完整部分留在缓冲区中，下次接着读），返回-1表示出错
+    int read_sql(std::string* sql);
+
+    // 已读取的完整SQL的结束位置
+    uint32_t get_offset() const { return _offset; }
+
+private:
+    enum { BUFFER_SIZE = 1024*1024 };
+    const int _fd;
+    uint32_t _offset;
+    std::vector<char> _buffer; // 长度超过BUFFER_SIZE的SQL会使它变大
+    size_t _begin; // 缓冲区中未取走数据的开始位置
+    size_t _end;   // 缓冲区中未取走数据的结束位置
+};
+
+// 基于inotify监听日志目录中SQL日志文件的创建，及正在读取的SQL日志文件的写入，
+// 使得db_process在有新的SQL时能立即被唤醒，而不是固定的每秒轮询一次，
+// 同目录下的进度文件和检查点文件由db_process自己频繁写，所以不监听整个目录的写入，
+// inotify不可用时退化为sleep
+class CSqlLogWatcher
+{
+public:
+    CSqlLogWatcher();
+    ~CSqlLogWatcher();
+
+    // 开始监听log_dirpath目录中文件的创建（含移入）
+    void watch(const std::string& log_dirpath);
+
+    // 开始监听log_filepath文件的写入，同时取消对上一个文件的监听
+    void watch_file(const std::string& log_filepath);
+
+    // 等待SQL日志文件有变化，最多等待timeout_milliseconds毫秒，
+    // 返回true表示有变化（可能是在上次调用之后、本次调用之前发生的），false表示超时
+    bool wait(uint32_t timeout_milliseconds);
+
+private:
+    int _inotify_fd;
+    int _dir_wd;  // 目录的监听
+    int _file_wd; // 正在读取的SQL日志文件的监听
+};
+
+} // namespace db_proxy
+} // namespace mooon
+#endif // MOOON_DB_PROXY_SQL_LOG_READER_H
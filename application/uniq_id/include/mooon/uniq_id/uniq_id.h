@@ -19,6 +19,7 @@
 #ifndef MOOON_UNIQ_ID_H
 #define MOOON_UNIQ_ID_H
 #include <mooon/net/udp_socket.h>
+#include <mooon/sys/lock.h>
 #include <mooon/utils/exception.h>
 #include <mooon/utils/string_utils.h>
 #include <stdint.h>
@@ -73,16 +74,34 @@ union UniqID
 const char* label2string(uint8_t label, char str[3], bool uppercase=true);
 std::string label2string(uint8_t label, bool uppercase=true);
 
+struct MessageHead;
+class CSeqPrefetcher;
 class CUniqId
 {
+    friend class CSeqPrefetcher;
+
 public:
     // agent_nodes 以逗号分隔的agent节点字符串，如：192.168.31.21:6200,192.168.31.22:6200,192.168.31.23:6200
     // timeout_milliseconds 接收agent返回超时值
     // retry_times 从一个agent取失败时，改从多少其它agent取，如果值为0表示不重试
     // polling 是否轮询取agent，效率会比随机高一点
+    //
+    // 有多个agent时，会统计每个agent的延迟和丢包（EWMA），每次从两个候选中选代价小的（power of two choices），
+    // 连续失败的agent会被剔除一段时间，到期后放一个请求探测，成功则恢复，失败则剔除更长时间
     CUniqId(const std::string& agent_nodes, uint32_t timeout_milliseconds=200, uint8_t retry_times=5, bool polling=false) throw (utils::CException);
     ~CUniqId();
 
+    // 开启客户端预取模式（默认不开启），开启后一次向agent租赁range_size个连续的seq，
+    // get_uniq_id、get_unqi_seq、get_local_uniq_id、get_label_and_seq和get_transaction_id均直接从本地租到的seq段中分配，
+    // 当前段剩余不超过low_watermark个时，由后台线程预取下一段，这样大多数调用无需和agent交互
+    //
+    // range_size 每次租赁的seq个数，UniqAgent的steps参数值不能比它小，num超过range_size的调用仍直接向agent取
+    // low_watermark 剩余多少个时开始预取下一段，为0时取range_size的四分之一
+    //
+    // 注意：预取模式下get_uniq_id也是在本地组装的，同get_local_uniq_id，
+    // 未用完的seq在CUniqId析构时被丢弃，不影响唯一性
+    void enable_prefetch(uint16_t range_size=10000, uint16_t low_watermark=0) throw (utils::CException, sys::CSyscallException);
+
     // 取得机器Label（标签），用于唯一区分机器，同一时间两台机器不会出现相同的Label
     uint8_t get_label() throw (utils::CException, sys::CSyscallException);
 
@@ -101,6 +120,11 @@ public:
     // 由于seq一小时内只有10亿的容量，如果不够用，则可以将分钟设置到user参数，这样就扩容1分钟10亿的容量。
     uint64_t get_uniq_id(uint8_t user=0, uint64_t current_seconds=0) throw (utils::CException, sys::CSyscallException);
 
+    // 一次交互取num个ID，agent只回第一个ID和个数，其余的ID只是seq依次加1，
+    // 对不支持该请求的老版本agent，自动改用get_local_uniq_id批量取
+    // UniqAgent的steps参数值不能比num值小，最好是num的10倍或以上
+    void get_uniq_id(uint16_t num, std::vector<uint64_t>* id_vec, uint8_t user=0, uint64_t current_seconds=0) throw (utils::CException, sys::CSyscallException);
+
     // 和get_uniq_id的区别在于，get_local_uniq_id只从agent取得Label和Seq，组装是在本地完成的，相当于分担了agent的部分工作。
     uint64_t get_local_uniq_id(uint8_t user=0, uint64_t current_seconds=0) throw (utils::CException, sys::CSyscallException);
     // UniqAgent的steps参数值，不能比num值小，最好是num的10倍或以上
@@ -133,7 +157,25 @@ public:
     void get_transaction_id(uint16_t num, std::vector<std::string>* id_vec, const char* format, va_list& va) throw (utils::CException, sys::CSyscallException);
 
 private:
-    const struct sockaddr_in& pick_agent() const;
+    // 每个agent的统计，用来选择agent
+    struct AgentStat
+    {
+        double latency;        // 延迟的EWMA，单位为微秒
+        double loss;           // 失败率的EWMA，取值0~1
+        uint32_t failures;     // 连续失败次数
+        uint64_t eject_until;  // 剔除到什么时候（毫秒），为0表示未被剔除
+
+        AgentStat()
+            : latency(0), loss(0), failures(0), eject_until(0)
+        {
+        }
+    };
+
+    int pick_agent();
+    double get_agent_cost(int index) const;
+    void update_agent(int index, bool ok, uint64_t microseconds);
+    void exchange(net::CUdpSocket* udp_socket, const struct MessageHead& request, struct MessageHead* response) throw (utils::CException, sys::CSyscallException);
+    void request_label_and_seq(net::CUdpSocket* udp_socket, uint32_t echo, uint8_t* label, uint32_t* seq, uint16_t num) throw (utils::CException, sys::CSyscallException);
 
 private:
     uint32_t _echo;
@@ -142,7 +184,12 @@ private:
     uint8_t _retry_times;
     bool _polling; // 是否轮询选择UniqAgent，否则随机方式，轮询方式选择开销小
     std::vector<struct sockaddr_in> _agents_addr;
+    sys::CLock _agents_lock; // 保护_agents_stat和_pick_factor，预取线程也会访问
+    std::vector<struct AgentStat> _agents_stat;
+    unsigned int _pick_factor;
     net::CUdpSocket* _udp_socket;
+    bool _batch_unsupported; // agent不支持批量取ID请求
+    CSeqPrefetcher* _prefetcher; // 不为NULL时表示开启了预取模式
 };
 
 } // namespace mooon {
@@ -18,6 +18,7 @@
  */
 #include "mooon/uniq_id/uniq_id.h"
 #include "protocol.h"
+#include <algorithm>
 #include <fcntl.h>
 #include <mooon/net/epoller.h>
 #include <mooon/net/udp_socket.h>
@@ -25,7 +26,9 @@
 #include <mooon/sys/close_helper.h>
 #include <mooon/sys/datetime_utils.h>
 #include <mooon/sys/main_template.h>
+#include <mooon/sys/lock.h>
 #include <mooon/sys/safe_logger.h>
+#include <mooon/sys/thread_engine.h>
 #include <mooon/sys/utils.h>
 #include <mooon/utils/args_parser.h>
 #include <mooon/utils/string_utils.h>
@@ -45,6 +48,19 @@ INTEGER_ARG_DEFINE(uint16_t, port, 6200, 1000, 65535, "listen port");
 INTEGER_ARG_DEFINE(uint8_t, label, 0, 0, LABEL_MAX, "unique label of a machine");
 INTEGER_ARG_DEFINE(uint32_t, steps, 100000, 1, 100000000, "steps to store");
 
+// 工作线程数，每个工作线程有独立的SO_REUSEPORT套接字，由内核按来源地址分派请求，
+// 同一来源（IP和端口）的请求总是落在同一个工作线程上
+INTEGER_ARG_DEFINE(uint8_t, threads, 1, 1, 64, "number of worker threads");
+// 工作线程每次从共享的sequence中预留的块大小，取值不能大于steps，
+// 以保证重启时跳过的2倍steps能覆盖所有已分配出去的sequence
+INTEGER_ARG_DEFINE(uint16_t, block, 1000, 1, 65535, "sequence block reserved by a worker thread at a time");
+// 持久化模式，为1时每次保存的是预留窗口（当前sequence加上steps）的结束值，并调用一次fdatasync，
+// 已分配出去的sequence总是小于已落盘的值，机器掉电重启后从落盘的值继续即不会产生重复的ID，
+// 每分配steps个sequence才需要一次fdatasync；为0时不同步，重启时跳过2倍的steps。
+// 注意批量取（num或block）接近或超过steps时，几乎每次分配都要fdatasync，吞吐受磁盘同步延迟限制，
+// 所以steps应远大于num和block
+INTEGER_ARG_DEFINE(uint8_t, durable, 0, 0, 1, "store sequence with fdatasync");
+
 // Label过期时长参数，所有节点的expire值必须保持相同，包括master节点和所有agent节点
 //
 // expire用来控制Label的回收重利用，取值应当越大越好，比如可以30天则取30天，可以取7天则7天等，
@@ -63,7 +79,8 @@ namespace mooon {
 // 常量
 enum
 {
-    SEQUENCE_BLOCK_VERSION = 1
+    SEQUENCE_BLOCK_VERSION = 1,
+    SEQUENCE_BLOCK_VERSION_DURABLE = 2 // 持久化模式保存的块，其中的sequence为已落盘的窗口结束值
 };
 
 #pragma pack(4)
@@ -109,29 +126,40 @@ struct SeqBlock
 };
 #pragma pack()
 
-class CUniqAgent: public sys::IMainHelper
+// 工作线程缓存的Label信息，只在Label发生变化时才从CUniqAgent刷新，
+// 这样工作线程处理请求时无需访问共享状态
+struct LabelInfo
+{
+    uint32_t label;
+    time_t timestamp;
+    bool io_error;
+
+    LabelInfo()
+        : label(0), timestamp(0), io_error(false)
+    {
+    }
+};
+
+class CUniqAgent;
+
+// 工作线程，每个有独立的套接字、收发缓冲区和sequence块
+class CUniqWorker
 {
 public:
-    CUniqAgent();
-    ~CUniqAgent();
+    CUniqWorker(CUniqAgent* agent, int index);
+    ~CUniqWorker();
 
-private:
-    virtual bool init(int argc, char* argv[]);
-    virtual bool run();
-    virtual void fini();
+    void listen(const std::string& ip, uint16_t port);
+    net::CUdpSocket* get_udp_socket() const { return _udp_socket; }
+    void run();
 
 private:
-    std::string get_sequence_path() const;
-    int get_label(bool asynchronous);
-    bool parse_master_nodes();
-    bool restore_sequence();
-    bool store_sequence();
+    bool handle_request(int bytes_received);
+    void refresh_label_info();
     uint32_t inc_sequence(uint16_t deta=1);
-    uint64_t get_uniq_id(const struct MessageHead* request);
-    void rent_label();
+    uint64_t get_uniq_id(uint8_t user, time_t current_time, uint16_t num=1);
     bool label_expired() const;
-    bool io_error() const { return _io_error; }
-    const struct sockaddr_in& get_master_addr() const;
+    bool io_error() const { return _label_info.io_error; }
 
 private:
     void prepare_response_error(int errcode);
@@ -139,23 +167,23 @@ private:
     int prepare_response_get_uniq_id();
     int prepare_response_get_uniq_seq();
     int prepare_response_get_label_and_seq();
+    int prepare_response_get_uniq_ids();
 
 private:
-    int on_response_error();
-    int on_response_label();
-
-private:
-    uint32_t _echo;
-    std::vector<struct sockaddr_in> _masters_addr;
+    CUniqAgent* _agent;
+    int _index;
     net::CEpoller _epoller;
     net::CUdpSocket* _udp_socket;
-    uint32_t _sequence_start;
-    struct SeqBlock _seq_block;
-    std::string _sequence_path;
-    int _sequence_fd;
     time_t _current_time; // 当前时间
-    time_t _last_rent_time; // 最后一次向master发起rent_label的时间
-    bool _io_error; // IO出错标记，将不能继续服务
+    time_t _last_rent_time; // 最后一次向master发起rent_label的时间，只有0号工作线程续租
+
+private:
+    // 本线程预留的sequence块，取值范围为[_block_next, _block_end)，
+    // 不够用时整块丢弃再向CUniqAgent申请，保证本线程分配的sequence单调递增
+    uint32_t _block_next;
+    uint32_t _block_end;
+    int _label_version;
+    struct LabelInfo _label_info;
 
 private:
     // old系列变量用来解决seq用完问题，
@@ -165,13 +193,71 @@ private:
     int _old_day;
     int _old_month;
     int _old_year;
+    struct tm _old_tm;
+    time_t _old_time;
 
 private:
     struct sockaddr_in _from_addr;
     const struct MessageHead* _message_head;
-    char _request_buffer[SOCKET_BUFFER_SIZE];
-    char _response_buffer[SOCKET_BUFFER_SIZE];
+    char* _request_buffer;  // 指向_request_buffers中当前处理的请求
+    char* _response_buffer; // 指向_response_buffers中当前准备的响应
     size_t _response_size;
+
+private:
+    // 批量收发，一次系统调用处理多个请求和响应
+    char _request_buffers[net::UDP_BATCH_MAX][SOCKET_BUFFER_SIZE];
+    char _response_buffers[net::UDP_BATCH_MAX][SOCKET_BUFFER_SIZE];
+    net::udp_packet_t _request_packets[net::UDP_BATCH_MAX];
+    net::udp_packet_t _response_packets[net::UDP_BATCH_MAX];
+};
+
+// 持有所有工作线程共享的状态：sequence文件、Label和master列表，
+// 工作线程只在申请sequence块和Label发生变化时才需要加锁访问
+class CUniqAgent: public sys::IMainHelper
+{
+public:
+    CUniqAgent();
+    ~CUniqAgent();
+
+public: // 供工作线程调用
+    int get_label_version() const { return atomic_read(&_label_version); }
+    void get_label_info(struct LabelInfo* label_info);
+    uint32_t reserve_sequence(uint16_t number);
+    void rent_label(net::CUdpSocket* udp_socket, time_t current_time);
+    void on_response_error(net::CUdpSocket* udp_socket, const struct MessageHead* response, const struct sockaddr_in& from_addr);
+    void on_response_label(const struct MessageHead* response, const struct sockaddr_in& from_addr, time_t current_time);
+
+private:
+    virtual bool init(int argc, char* argv[]);
+    virtual bool run();
+    virtual void fini();
+
+private:
+    std::string get_sequence_path() const;
+    int get_label(net::CUdpSocket* udp_socket, bool asynchronous);
+    bool parse_master_nodes();
+    bool restore_sequence(net::CUdpSocket* udp_socket);
+    bool store_sequence(uint16_t deta=0);
+    uint32_t inc_sequence(uint16_t deta=1);
+    bool label_expired() const;
+    const struct sockaddr_in& get_master_addr() const;
+    void label_changed() { atomic_inc(&_label_version); }
+
+private:
+    sys::CLock _lock; // 保护以下所有成员
+    uint32_t _echo;
+    std::vector<struct sockaddr_in> _masters_addr;
+    uint32_t _sequence_start;
+    uint32_t _sequence_limit; // 持久化模式下已落盘的窗口结束值，分配的sequence总小于它
+    struct SeqBlock _seq_block;
+    std::string _sequence_path;
+    int _sequence_fd;
+    time_t _current_time; // 当前时间，仅在init时使用
+    bool _io_error; // IO出错标记，将不能继续服务
+    atomic_t _label_version; // Label、timestamp或_io_error每变化一次增一
+
+private:
+    std::vector<CUniqWorker*> _workers;
 };
 
 extern "C" int main(int argc, char* argv[])
@@ -180,23 +266,22 @@ extern "C" int main(int argc, char* argv[])
     return sys::main_template(&agent, argc, argv);
 }
 
+////////////////////////////////////////////////////////////////////////////////
 CUniqAgent::CUniqAgent()
-    : _echo(0), _udp_socket(NULL), _sequence_fd(-1), _current_time(0), _last_rent_time(0), _io_error(false),
-      _old_seq(0), _old_hour(-1), _old_day(-1), _old_month(-1), _old_year(-1),
-      _message_head(NULL)
+    : _echo(0), _sequence_fd(-1), _current_time(0), _io_error(false)
 {
+    atomic_set(&_label_version, 0);
     _sequence_start = 0;
+    _sequence_limit = 0;
     _sequence_path = get_sequence_path();
-
-    memset(&_from_addr, 0, sizeof(_from_addr));
-    memset(&_request_buffer, 0, sizeof(_request_buffer));
-    memset(&_response_buffer, 0, sizeof(_response_buffer));
-    _response_size = 0;
 }
 
 CUniqAgent::~CUniqAgent()
 {
-    delete _udp_socket;
+    for (std::vector<CUniqWorker*>::size_type i=0; i<_workers.size(); ++i)
+        delete _workers[i];
+    _workers.clear();
+
     if (_sequence_fd != -1)
         close(_sequence_fd);
 }
@@ -222,6 +307,11 @@ bool CUniqAgent::init(int argc, char* argv[])
         fprintf(stderr, "parameter[expire] should greater than interval with 10 and double\n");
         return false;
     }
+    if (argument::block->value() > argument::steps->value())
+    {
+        fprintf(stderr, "parameter[block] should not greater than steps\n");
+        return false;
+    }
 
     if (!parse_master_nodes())
     {
@@ -233,14 +323,18 @@ bool CUniqAgent::init(int argc, char* argv[])
         sys::g_logger = sys::create_safe_logger();
         _current_time = time(NULL);
 
-        _epoller.create(10);
-        _udp_socket = new net::CUdpSocket;
-        _udp_socket->listen(argument::ip->value(), argument::port->value(), true);
-        MYLOG_INFO("listen on %s:%d\n", argument::ip->c_value(), argument::port->value());
-        _epoller.set_events(_udp_socket, EPOLLIN);
+        // 先只创建0号工作线程的套接字，
+        // 以保证restore_sequence同步租赁Label时，master的响应不会被分派到其它套接字上
+        for (int i=0; i<argument::threads->value(); ++i)
+            _workers.push_back(new CUniqWorker(this, i));
+        _workers[0]->listen(argument::ip->value(), argument::port->value());
 
-        if (!restore_sequence())
+        if (!restore_sequence(_workers[0]->get_udp_socket()))
             return false;
+
+        for (std::vector<CUniqWorker*>::size_type i=1; i<_workers.size(); ++i)
+            _workers[i]->listen(argument::ip->value(), argument::port->value());
+        MYLOG_INFO("listen on %s:%d with %d threads\n", argument::ip->c_value(), argument::port->value(), static_cast<int>(_workers.size()));
         return true;
     }
     catch (sys::CSyscallException& ex)
@@ -256,130 +350,59 @@ bool CUniqAgent::init(int argc, char* argv[])
 
 bool CUniqAgent::run()
 {
-    while (true)
+    // 0号工作线程在主线程中运行，其它的各自一个线程
+    std::vector<sys::CThreadEngine*> thread_engines;
+    for (std::vector<CUniqWorker*>::size_type i=1; i<_workers.size(); ++i)
     {
-        const int milliseconds = 10000;
-        int n = _epoller.timed_wait(milliseconds);
-
-        // 不需要那么精确的时间
-        _current_time = time(NULL);
-        if (_current_time - _last_rent_time > static_cast<time_t>(argument::interval->value()))
-        {
-            // 间隔的向master发一个续租请求
-            rent_label();
-            _last_rent_time = _current_time;
-        }
+        sys::CThreadEngine* thread_engine = new sys::CThreadEngine(sys::bind(&CUniqWorker::run, _workers[i]));
+        thread_engines.push_back(thread_engine);
+    }
 
-        if (0 == n)
-        {
-            // timeout, do nothing
-        }
-        else
-        {
-            // 循环，可以减少对CEpoller::timed_wait的调用
-            for (int i=0; i<10000; ++i)
-            {
-                try
-                {
-                    // Linux 2.6.33开始支持recvmsg
-                    // glibc 2.12开始支持recvmmsg
-//#if __GLIBC__ == 2 && __GLIBC_MINOR__ == 12
-//                    int k;
-//                    const unsigned int vlen = 100;
-//                    char bufs[vlen][SOCKET_BUFFER_SIZE];
-//                    struct mmsghdr msgs[vlen];
-//                    int n = recvmmsg(_udp_socket->get_fd(), msgs, vlen, MSG_DONTWAIT, NULL);
-//#else
-                    int bytes_received = _udp_socket->receive_from(_request_buffer, sizeof(_request_buffer), &_from_addr);
-//#endif
-                    if (-1 == bytes_received)
-                    {
-                        // WOULDBLOCK
-                        break;
-                    }
-                    else if (bytes_received < static_cast<int>(sizeof(struct MessageHead)))
-                    {
-                        MYLOG_ERROR("invalid size (%d) from %s: %s\n", bytes_received, net::to_string(_from_addr).c_str(), strerror(errno));
-                    }
-                    else
-                    {
-                        _message_head = reinterpret_cast<struct MessageHead*>(_request_buffer);
-                        MYLOG_DEBUG("%s from %s", _message_head->str().c_str(), net::to_string(_from_addr).c_str());
+    _workers[0]->run();
+    for (std::vector<sys::CThreadEngine*>::size_type i=0; i<thread_engines.size(); ++i)
+    {
+        thread_engines[i]->join();
+        delete thread_engines[i];
+    }
 
-                        if (bytes_received != _message_head->len)
-                        {
-                            MYLOG_ERROR("invalid size (%d/%d) from %s: %s\n", bytes_received, _message_head->len.to_int(), net::to_string(_from_addr).c_str(), strerror(errno));
-                        }
-                        else
-                        {
-                            int errcode = 0;
-                            std::string errmsg;
+    return true;
+}
 
-                            // Request from client
-                            if (REQUEST_LABEL == _message_head->type)
-                            {
-                                errcode = prepare_response_get_label();
-                            }
-                            else if (REQUEST_UNIQ_ID == _message_head->type)
-                            {
-                                errcode = prepare_response_get_uniq_id();
-                            }
-                            else if (REQUEST_UNIQ_SEQ == _message_head->type)
-                            {
-                                errcode = prepare_response_get_uniq_seq();
-                            }
-                            else if (REQUEST_LABEL_AND_SEQ == _message_head->type)
-                            {
-                                errcode = prepare_response_get_label_and_seq();
-                            }
-                            // Response from master
-                            else if (RESPONSE_ERROR == _message_head->type)
-                            {
-                                errcode = on_response_error();
-                            }
-                            else if (RESPONSE_LABEL == _message_head->type)
-                            {
-                                errcode = on_response_label();
-                            }
-                            else
-                            {
-                                errcode = ERROR_INVALID_TYPE;
-                                MYLOG_ERROR("invalid message type: %s\n", _message_head->str().c_str());
-                            }
-                            if ((errcode != 0) && (errcode != -1))
-                            {
-                                prepare_response_error(errcode);
-                            }
+void CUniqAgent::fini()
+{
+}
 
-                            if (errcode != -1)
-                            {
-                                try
-                                {
-                                    _udp_socket->send_to(_response_buffer, _response_size, _from_addr);
-                                    MYLOG_DEBUG("send to %s ok\n", net::to_string(_from_addr).c_str());
-                                }
-                                catch (sys::CSyscallException& ex)
-                                {
-                                    MYLOG_ERROR("send to %s failed: %s\n", net::to_string(_from_addr).c_str(), ex.str().c_str());
-                                }
-                            }
-                        }
-                    }
-                }
-                catch (sys::CSyscallException& ex)
-                {
-                    MYLOG_ERROR("receive_from failed: %s\n", ex.str().c_str());
-                    break;
-                }
-            } // while (true)
-        } // if (0 == n)
-    } // while (true)
+void CUniqAgent::get_label_info(struct LabelInfo* label_info)
+{
+    sys::LockHelper<sys::CLock> lh(_lock);
+    label_info->label = _seq_block.label;
+    label_info->timestamp = static_cast<time_t>(_seq_block.timestamp);
+    label_info->io_error = _io_error;
+}
 
-    return true;
+// 从共享的sequence中预留number个连续的sequence，返回起始值，返回0表示出错
+uint32_t CUniqAgent::reserve_sequence(uint16_t number)
+{
+    sys::LockHelper<sys::CLock> lh(_lock);
+    if (_io_error)
+        return 0;
+    return inc_sequence(number);
 }
 
-void CUniqAgent::fini()
+void CUniqAgent::rent_label(net::CUdpSocket* udp_socket, time_t current_time)
 {
+    if (!argument::master_nodes->value().empty())
+    {
+        sys::LockHelper<sys::CLock> lh(_lock);
+        _current_time = current_time;
+        int label = get_label(udp_socket, true);
+
+        if (label > 0)
+        {
+            _seq_block.update_label(label);
+            label_changed();
+        }
+    }
 }
 
 std::string CUniqAgent::get_sequence_path() const
@@ -387,7 +410,7 @@ std::string CUniqAgent::get_sequence_path() const
     return sys::CUtils::get_program_path() + std::string("/.uniq.seq");
 }
 
-int CUniqAgent::get_label(bool asynchronous)
+int CUniqAgent::get_label(net::CUdpSocket* udp_socket, bool asynchronous)
 {
 	if (argument::master_nodes->value().empty())
 	{
@@ -395,21 +418,25 @@ int CUniqAgent::get_label(bool asynchronous)
 	}
 	else
 	{
-		struct MessageHead* request = reinterpret_cast<struct MessageHead*>(_request_buffer);
-		struct MessageHead* response = reinterpret_cast<struct MessageHead*>(_response_buffer);
+	    struct sockaddr_in from_addr;
+		struct MessageHead request;
+		struct MessageHead response;
 		const struct sockaddr_in& master_addr = get_master_addr();
 
+		memset(&from_addr, 0, sizeof(from_addr));
+		request.magic = 0;
         // 遇到错误ERROR_LABEL_NOT_HOLD时，需要重试一次
         for (int k=0; k<2; ++k)
         {
             try
             {
-                request->len = sizeof(struct MessageHead);
-                request->type = REQUEST_LABEL;
-                request->echo = _echo++;
-                request->value1 = _seq_block.label;
-                request->value2 = 0;
-                _udp_socket->send_to(_request_buffer, sizeof(struct MessageHead), master_addr);
+                request.len = sizeof(struct MessageHead);
+                request.type = REQUEST_LABEL;
+                request.echo = _echo++;
+                request.value1 = _seq_block.label;
+                request.value2 = 0;
+                request.value3 = 0;
+                udp_socket->send_to(&request, sizeof(struct MessageHead), master_addr);
 
                 if (asynchronous)
                 {
@@ -417,49 +444,49 @@ int CUniqAgent::get_label(bool asynchronous)
                 }
                 else
                 {
-                    int bytes = _udp_socket->timed_receive_from(_response_buffer, sizeof(struct MessageHead), &_from_addr, 2000);
+                    int bytes = udp_socket->timed_receive_from(&response, sizeof(struct MessageHead), &from_addr, 2000);
                     if (bytes != sizeof(struct MessageHead))
                     {
                         MYLOG_ERROR("timed_receive_from return %d(%d)\n", bytes, static_cast<int>(sizeof(struct MessageHead)));
                         break;
                     }
 
-                    if (RESPONSE_ERROR == response->type)
+                    if (RESPONSE_ERROR == response.type)
                     {
-                        MYLOG_ERROR("(%d)get label[%u] error: %s\n", k, _seq_block.label, response->str().c_str());
-                        if (response->value1.to_int() != ERROR_LABEL_NOT_HOLD)
+                        MYLOG_ERROR("(%d)get label[%u] error: %s\n", k, _seq_block.label, response.str().c_str());
+                        if (response.value1.to_int() != ERROR_LABEL_NOT_HOLD)
                             break;
 
                         // 需要重新租赁Label，故重置
                         _seq_block.update_label(0);
                         continue;
                     }
-                    else if ((RESPONSE_LABEL == response->type) && (response->echo == _echo-1))
+                    else if ((RESPONSE_LABEL == response.type) && (response.echo == _echo-1))
                     {
-                        if (response->value1.to_int() > 0)
+                        if (response.value1.to_int() > 0)
                         {
                             // 续成功
                             _seq_block.timestamp = static_cast<uint64_t>(_current_time);
-                            int label = static_cast<int>(response->value1.to_int());
+                            int label = static_cast<int>(response.value1.to_int());
                             MYLOG_INFO("rent label[%d] ok\n", label);
                             return label;
                         }
                         else
                         {
-                            MYLOG_ERROR("invalid label[%d] from %s\n", (int)response->value1.to_int(), net::to_string(_from_addr).c_str());
+                            MYLOG_ERROR("invalid label[%d] from %s\n", (int)response.value1.to_int(), net::to_string(from_addr).c_str());
                             break;
                         }
                     }
                     else
                     {
-                        MYLOG_ERROR("invalid response[%s] for request[%s] from %s\n", response->str().c_str(), request->str().c_str(), net::to_string(_from_addr).c_str());
+                        MYLOG_ERROR("invalid response[%s] for request[%s] from %s\n", response.str().c_str(), request.str().c_str(), net::to_string(from_addr).c_str());
                         break;
                     }
                 }
             }
             catch (sys::CSyscallException& ex)
             {
-                MYLOG_ERROR("rent label from %s faield: %s\n", net::to_string(_from_addr).c_str(), ex.str().c_str());
+                MYLOG_ERROR("rent label from %s faield: %s\n", net::to_string(from_addr).c_str(), ex.str().c_str());
                 break;
             }
         } // for
@@ -505,7 +532,7 @@ bool CUniqAgent::parse_master_nodes()
     return true;
 }
 
-bool CUniqAgent::restore_sequence()
+bool CUniqAgent::restore_sequence(net::CUdpSocket* udp_socket)
 {
     int label = 0;
 
@@ -522,7 +549,7 @@ bool CUniqAgent::restore_sequence()
     {
         MYLOG_INFO("%s empty\n", _sequence_path.c_str());
 
-        label = get_label(false);
+        label = get_label(udp_socket, false);
         if ((label < 1) || (label > LABEL_MAX))
         {
             MYLOG_ERROR("invalid label[%d]\n", label);
@@ -565,7 +592,7 @@ bool CUniqAgent::restore_sequence()
             else if (label_expired())
             {
                 // 如果已过期，则需要重新租赁一个
-                label = get_label(false);
+                label = get_label(udp_socket, false);
                 if ((label < 1) || (label > LABEL_MAX))
                 {
                     MYLOG_ERROR("invalid label[%d] from master to store\n", label);
@@ -574,8 +601,16 @@ bool CUniqAgent::restore_sequence()
             }
 
             _sequence_fd = ch.release();
-            // 多加一次steps，原因是store时未调用fsync
-            _sequence_start = _seq_block.sequence + (2 * argument::steps->value());
+            if ((SEQUENCE_BLOCK_VERSION_DURABLE == _seq_block.version) && (argument::durable->value() != 0))
+            {
+                // 落盘的是已同步的窗口结束值，之前分配的都比它小
+                _sequence_start = _seq_block.sequence;
+            }
+            else
+            {
+                // 多加一次steps，原因是store时未调用fsync
+                _sequence_start = _seq_block.sequence + (2 * argument::steps->value());
+            }
             _seq_block.sequence = _sequence_start;
             _seq_block.update_label(static_cast<uint32_t>(label));
 
@@ -584,39 +619,53 @@ bool CUniqAgent::restore_sequence()
     }
 }
 
-bool CUniqAgent::store_sequence()
+bool CUniqAgent::store_sequence(uint16_t deta)
 {
-    _seq_block.update_magic();
+    struct SeqBlock seq_block = _seq_block;
+    if (0 == argument::durable->value())
+    {
+        seq_block.version = SEQUENCE_BLOCK_VERSION;
+    }
+    else
+    {
+        // 预留一个窗口，落盘的是窗口的结束值，窗口内的sequence分配时无需再落盘
+        const uint64_t limit = static_cast<uint64_t>(_seq_block.sequence) + argument::steps->value() + deta;
+        seq_block.version = SEQUENCE_BLOCK_VERSION_DURABLE;
+        seq_block.sequence = (limit > UINT32_MAX)? UINT32_MAX: static_cast<uint32_t>(limit);
+    }
+    seq_block.update_magic();
 
-    ssize_t byes_written = pwrite(_sequence_fd, &_seq_block, sizeof(_seq_block), 0);
-    if (byes_written != sizeof(_seq_block))
+    ssize_t byes_written = pwrite(_sequence_fd, &seq_block, sizeof(seq_block), 0);
+    if (byes_written != sizeof(seq_block))
     {
         _io_error = true; // 遇到IO错误时，标记为不可继续服务
-        MYLOG_ERROR("store %s to %s failed: %s\n", _seq_block.str().c_str(), _sequence_path.c_str(), strerror(errno));
+        label_changed();
+        MYLOG_ERROR("store %s to %s failed: %s\n", seq_block.str().c_str(), _sequence_path.c_str(), strerror(errno));
         return false;
     }
-    else
+    else if (0 == argument::durable->value())
     {
-        MYLOG_DEBUG("store %s ok\n", _seq_block.str().c_str());
-
-#if 1
+        MYLOG_DEBUG("store %s ok\n", seq_block.str().c_str());
         _sequence_start = _seq_block.sequence;
         return true;
-#else
-        // fsync严重影响性能
-        if (-1 == fsync(_sequence_fd))
+    }
+    else
+    {
+        // 每个窗口只同步一次，fdatasync比fsync少同步一次元数据
+        if (-1 == fdatasync(_sequence_fd))
         {
             _io_error = true;
-            MYLOG_ERROR("fsync %s to %s failed: %s\n", _seq_block.str().c_str(), _sequence_path.c_str(), strerror(errno));
+            label_changed();
+            MYLOG_ERROR("fdatasync %s to %s failed: %s\n", seq_block.str().c_str(), _sequence_path.c_str(), strerror(errno));
             return false;
         }
         else
         {
             _sequence_start = _seq_block.sequence;
-            MYLOG_INFO("store %s to %s ok\n", _seq_block.str().c_str(), _sequence_path.c_str());
+            _sequence_limit = seq_block.sequence;
+            MYLOG_DEBUG("store %s to %s ok\n", seq_block.str().c_str(), _sequence_path.c_str());
             return true;
         }
-#endif
     }
 }
 
@@ -625,8 +674,28 @@ uint32_t CUniqAgent::inc_sequence(uint16_t deta)
     bool stored = true;
 	uint32_t sequence = 0;
 
-	if ((_seq_block.sequence < _sequence_start) ||
-	    (_seq_block.sequence - _sequence_start > argument::steps->value()))
+	if (argument::durable->value() != 0)
+	{
+	    // 落盘的窗口结束值最大只能为UINT32_MAX，所以在分配之前就回绕到1（排除0），
+	    // 再按回绕后的值判断是否需要落盘新窗口，使回绕后分配的sequence也总在已落盘的窗口内，
+	    // 也避免了接近UINT32_MAX时窗口被截断导致每次分配都要落盘
+	    const uint32_t number = (deta <= 1)? 1: deta;
+	    if ((0 == _seq_block.sequence) || (static_cast<uint64_t>(_seq_block.sequence) + number > UINT32_MAX))
+	    {
+	        MYLOG_INFO("sequence overflow: %u->1(%u)\n", _seq_block.sequence, number);
+	        _seq_block.sequence = 1;
+	    }
+
+	    // 要分配的超出已落盘的窗口时，需要先落盘下一个窗口
+	    if ((_seq_block.sequence < _sequence_start) ||
+	        (static_cast<uint64_t>(_seq_block.sequence) + number > _sequence_limit))
+	    {
+	        MYLOG_DEBUG("seq_block.sequence=%u, sequence_limit=%u, deta=%u\n", _seq_block.sequence, _sequence_limit, number);
+	        stored = store_sequence(deta);
+	    }
+	}
+	else if ((_seq_block.sequence < _sequence_start) ||
+	         (_seq_block.sequence - _sequence_start > argument::steps->value()))
 	{
 	    MYLOG_DEBUG("seq_block.sequence=%u, sequence_start=%u, steps=%u\n", _seq_block.sequence, _sequence_start, argument::steps->value());
 	    stored = store_sequence();
@@ -664,9 +733,284 @@ uint32_t CUniqAgent::inc_sequence(uint16_t deta)
     return sequence;
 }
 
-uint64_t CUniqAgent::get_uniq_id(const struct MessageHead* request)
+bool CUniqAgent::label_expired() const
+{
+    if (argument::master_nodes->value().empty())
+        return false;
+
+    bool expired = _current_time - static_cast<time_t>(_seq_block.timestamp) > static_cast<time_t>(argument::expire->value());
+    if (expired)
+    {
+        MYLOG_ERROR("Label[%u] expired(%u): %s\n", _seq_block.label, argument::expire->value(), sys::CDatetimeUtils::to_datetime(static_cast<time_t>(_seq_block.timestamp)).c_str());
+    }
+    return expired;
+}
+
+// 轮询方式
+const struct sockaddr_in& CUniqAgent::get_master_addr() const
+{
+    static uint32_t i = 0;
+    return _masters_addr[i++ % _masters_addr.size()];
+}
+
+void CUniqAgent::on_response_error(net::CUdpSocket* udp_socket, const struct MessageHead* response, const struct sockaddr_in& from_addr)
+{
+    MYLOG_ERROR("%s from %s\n", response->str().c_str(), net::to_string(from_addr).c_str());
+
+    if (ERROR_LABEL_NOT_HOLD == response->value1.to_int())
+    {
+        // 需要重新租赁Label，故重置
+        sys::LockHelper<sys::CLock> lh(_lock);
+        _seq_block.update_label(0);
+        label_changed();
+        get_label(udp_socket, true);
+    }
+}
+
+void CUniqAgent::on_response_label(const struct MessageHead* response, const struct sockaddr_in& from_addr, time_t current_time)
+{
+    MYLOG_INFO("%s from %s\n", response->str().c_str(), net::to_string(from_addr).c_str());
+
+    sys::LockHelper<sys::CLock> lh(_lock);
+    uint32_t old_label = _seq_block.label;
+    _seq_block.update_label(static_cast<uint32_t>(response->value1.to_int()));
+    _seq_block.timestamp = static_cast<uint64_t>(current_time);
+
+    // Lable发生变化时，立即保存
+    if (old_label != _seq_block.label)
+    {
+        MYLOG_DEBUG("Label change from %u to %u\n", old_label, _seq_block.label);
+        (void)store_sequence();
+    }
+
+    label_changed();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+CUniqWorker::CUniqWorker(CUniqAgent* agent, int index)
+    : _agent(agent), _index(index), _udp_socket(NULL), _current_time(0), _last_rent_time(0),
+      _block_next(0), _block_end(0), _label_version(-1),
+      _old_seq(0), _old_hour(-1), _old_day(-1), _old_month(-1), _old_year(-1), _old_time(0),
+      _message_head(NULL)
+{
+    memset(&_old_tm, 0, sizeof(_old_tm));
+    memset(&_from_addr, 0, sizeof(_from_addr));
+    memset(_request_buffers, 0, sizeof(_request_buffers));
+    memset(_response_buffers, 0, sizeof(_response_buffers));
+    _request_buffer = _request_buffers[0];
+    _response_buffer = _response_buffers[0];
+    _response_size = 0;
+
+    for (int i=0; i<net::UDP_BATCH_MAX; ++i)
+    {
+        _request_packets[i].buffer = _request_buffers[i];
+        _request_packets[i].buffer_size = sizeof(_request_buffers[i]);
+        _response_packets[i].buffer = _response_buffers[i];
+    }
+}
+
+CUniqWorker::~CUniqWorker()
+{
+    delete _udp_socket;
+}
+
+void CUniqWorker::listen(const std::string& ip, uint16_t port)
+{
+    _epoller.create(10);
+    _udp_socket = new net::CUdpSocket;
+    _udp_socket->listen(ip, port, true, argument::threads->value() > 1);
+    _epoller.set_events(_udp_socket, EPOLLIN);
+}
+
+void CUniqWorker::run()
+{
+    while (true)
+    {
+        const int milliseconds = 10000;
+        int n = _epoller.timed_wait(milliseconds);
+
+        // 不需要那么精确的时间
+        _current_time = time(NULL);
+        if ((0 == _index) &&
+            (_current_time - _last_rent_time > static_cast<time_t>(argument::interval->value())))
+        {
+            // 间隔的向master发一个续租请求
+            _agent->rent_label(_udp_socket, _current_time);
+            _last_rent_time = _current_time;
+        }
+
+        if (0 == n)
+        {
+            // timeout, do nothing
+        }
+        else
+        {
+            // 循环，可以减少对CEpoller::timed_wait的调用，
+            // 每次通过recvmmsg收一批请求，处理完后通过sendmmsg一次发出所有响应
+            for (int i=0; i<100; ++i)
+            {
+                try
+                {
+                    int number = _udp_socket->receive_batch(_request_packets, net::UDP_BATCH_MAX);
+                    if (0 == number)
+                    {
+                        // WOULDBLOCK
+                        break;
+                    }
+
+                    int response_number = 0;
+                    refresh_label_info();
+                    for (int j=0; j<number; ++j)
+                    {
+                        _request_buffer = _request_buffers[j];
+                        _response_buffer = _response_buffers[response_number];
+                        _from_addr = _request_packets[j].addr;
+
+                        if (handle_request(static_cast<int>(_request_packets[j].bytes)))
+                        {
+                            _response_packets[response_number].buffer_size = _response_size;
+                            _response_packets[response_number].addr = _from_addr;
+                            ++response_number;
+                        }
+                    }
+                    if (response_number > 0)
+                    {
+                        try
+                        {
+                            int sent = _udp_socket->send_batch(_response_packets, response_number);
+                            if (sent < response_number)
+                            {
+                                MYLOG_ERROR("send %d/%d responses\n", sent, response_number);
+                            }
+                        }
+                        catch (sys::CSyscallException& ex)
+                        {
+                            MYLOG_ERROR("send %d responses failed: %s\n", response_number, ex.str().c_str());
+                        }
+                    }
+                    if (number < net::UDP_BATCH_MAX)
+                    {
+                        // 已经收空
+                        break;
+                    }
+                }
+                catch (sys::CSyscallException& ex)
+                {
+                    MYLOG_ERROR("receive_batch failed: %s\n", ex.str().c_str());
+                    break;
+                }
+            } // for
+        } // if (0 == n)
+    } // while (true)
+}
+
+// 处理_request_buffer中的一个请求，如果需要响应，返回true，响应存放在_response_buffer中
+bool CUniqWorker::handle_request(int bytes_received)
+{
+    if (bytes_received < static_cast<int>(sizeof(struct MessageHead)))
+    {
+        MYLOG_ERROR("invalid size (%d) from %s\n", bytes_received, net::to_string(_from_addr).c_str());
+        return false;
+    }
+
+    _message_head = reinterpret_cast<struct MessageHead*>(_request_buffer);
+    MYLOG_DEBUG("%s from %s", _message_head->str().c_str(), net::to_string(_from_addr).c_str());
+
+    if (bytes_received != _message_head->len)
+    {
+        MYLOG_ERROR("invalid size (%d/%d) from %s\n", bytes_received, _message_head->len.to_int(), net::to_string(_from_addr).c_str());
+        return false;
+    }
+
+    int errcode = 0;
+
+    // Request from client
+    if (REQUEST_LABEL == _message_head->type)
+    {
+        errcode = prepare_response_get_label();
+    }
+    else if (REQUEST_UNIQ_ID == _message_head->type)
+    {
+        errcode = prepare_response_get_uniq_id();
+    }
+    else if (REQUEST_UNIQ_SEQ == _message_head->type)
+    {
+        errcode = prepare_response_get_uniq_seq();
+    }
+    else if (REQUEST_LABEL_AND_SEQ == _message_head->type)
+    {
+        errcode = prepare_response_get_label_and_seq();
+    }
+    else if (REQUEST_UNIQ_IDS == _message_head->type)
+    {
+        errcode = prepare_response_get_uniq_ids();
+    }
+    // Response from master，可能被分派到任意一个工作线程
+    else if (RESPONSE_ERROR == _message_head->type)
+    {
+        _agent->on_response_error(_udp_socket, _message_head, _from_addr);
+        refresh_label_info();
+        errcode = -1;
+    }
+    else if (RESPONSE_LABEL == _message_head->type)
+    {
+        _agent->on_response_label(_message_head, _from_addr, _current_time);
+        refresh_label_info();
+        errcode = -1;
+    }
+    else
+    {
+        errcode = ERROR_INVALID_TYPE;
+        MYLOG_ERROR("invalid message type: %s\n", _message_head->str().c_str());
+    }
+    if ((errcode != 0) && (errcode != -1))
+    {
+        prepare_response_error(errcode);
+    }
+
+    return errcode != -1;
+}
+
+// 先读版本号再取信息，这样取信息之后发生的变化在下次调用时总能被发现
+void CUniqWorker::refresh_label_info()
+{
+    const int label_version = _agent->get_label_version();
+    if (label_version != _label_version)
+    {
+        _agent->get_label_info(&_label_info);
+        _label_version = label_version;
+    }
+}
+
+uint32_t CUniqWorker::inc_sequence(uint16_t deta)
+{
+    const uint32_t number = (deta <= 1)? 1: deta;
+
+    if (_block_end - _block_next < number)
+    {
+        // 剩余的不够用时整块丢弃，以保证本线程分配的sequence单调递增，
+        // 丢弃的sequence不会再被使用，和重启时跳过steps一样不影响唯一性
+        const uint16_t block = static_cast<uint16_t>(std::max<uint32_t>(number, argument::block->value()));
+        const uint32_t sequence = _agent->reserve_sequence(block);
+        if (0 == sequence)
+        {
+            refresh_label_info(); // 可能遇到了IO错误
+            return 0;
+        }
+
+        _block_next = sequence;
+        _block_end = sequence + block;
+    }
+
+    const uint32_t sequence = _block_next;
+    _block_next += number;
+    return sequence;
+}
+
+// 取num个ID，返回第一个，其余的ID只是seq依次加1
+uint64_t CUniqWorker::get_uniq_id(uint8_t user, time_t current_time, uint16_t num)
 {
-    uint32_t seq = inc_sequence();
+    uint32_t seq = inc_sequence(num);
 
     if (0 == seq)
     {
@@ -674,26 +1018,21 @@ uint64_t CUniqAgent::get_uniq_id(const struct MessageHead* request)
     }
     else
     {
-    	static struct tm old_tm;
-    	static time_t old_time = 0;
-
-    	struct tm* now = &old_tm;
-        time_t current_time = static_cast<time_t>(request->value3.to_int());
+    	struct tm* now = &_old_tm;
         if (0 == current_time)
         {
         	current_time = _current_time;
         }
-        if (current_time - old_time > 30) // current_time != old_time
+        if (current_time - _old_time > 30) // current_time != old_time
         {
         	// 由于只取小时，因此理论上每小时调用一次localtime即可
-        	now = localtime(&current_time); // localtime和localtime_r开销较大
-        	old_tm = *now; // Rember
-        	old_time = current_time; // Rember
+        	localtime_r(&current_time, &_old_tm); // localtime和localtime_r开销较大，多线程时只能用localtime_r
+        	_old_time = current_time; // Rember
         }
 
         union UniqID uniq_id;
-        uniq_id.id.user = static_cast<uint8_t>(request->value1.to_int());
-        uniq_id.id.label = static_cast<uint8_t>(_seq_block.label);
+        uniq_id.id.user = user;
+        uniq_id.id.label = static_cast<uint8_t>(_label_info.label);
         uniq_id.id.year = (now->tm_year+1900) - BASE_YEAR;
         uniq_id.id.month = now->tm_mon+1;
         uniq_id.id.day = now->tm_mday;
@@ -711,7 +1050,7 @@ uint64_t CUniqAgent::get_uniq_id(const struct MessageHead* request)
         }
         else
         {
-            _old_seq = seq;
+            _old_seq = seq + ((num > 1)? num-1: 0);
             _old_hour = uniq_id.id.hour;
             _old_day = uniq_id.id.day;
             _old_month = uniq_id.id.month;
@@ -721,40 +1060,20 @@ uint64_t CUniqAgent::get_uniq_id(const struct MessageHead* request)
     }
 }
 
-void CUniqAgent::rent_label()
-{
-    if (!argument::master_nodes->value().empty())
-    {
-        int label = get_label(true);
-
-        if (label > 0)
-        {
-            _seq_block.update_label(label);
-        }
-    }
-}
-
-bool CUniqAgent::label_expired() const
+bool CUniqWorker::label_expired() const
 {
     if (argument::master_nodes->value().empty())
         return false;
 
-    bool expired = _current_time - static_cast<time_t>(_seq_block.timestamp) > static_cast<time_t>(argument::expire->value());
+    bool expired = _current_time - _label_info.timestamp > static_cast<time_t>(argument::expire->value());
     if (expired)
     {
-        MYLOG_ERROR("Label[%u] expired(%u): %s\n", _seq_block.label, argument::expire->value(), sys::CDatetimeUtils::to_datetime(static_cast<time_t>(_seq_block.timestamp)).c_str());
+        MYLOG_ERROR("Label[%u] expired(%u): %s\n", _label_info.label, argument::expire->value(), sys::CDatetimeUtils::to_datetime(_label_info.timestamp).c_str());
     }
     return expired;
 }
 
-// 轮询方式
-const struct sockaddr_in& CUniqAgent::get_master_addr() const
-{
-    static uint32_t i = 0;
-    return _masters_addr[i++ % _masters_addr.size()];
-}
-
-void CUniqAgent::prepare_response_error(int errcode)
+void CUniqWorker::prepare_response_error(int errcode)
 {
     struct MessageHead* request = reinterpret_cast<struct MessageHead*>(_request_buffer);
     struct MessageHead* response = reinterpret_cast<struct MessageHead*>(_response_buffer);
@@ -770,7 +1089,7 @@ void CUniqAgent::prepare_response_error(int errcode)
     MYLOG_DEBUG("prepare %s ok\n", response->str().c_str());
 }
 
-int CUniqAgent::prepare_response_get_label()
+int CUniqWorker::prepare_response_get_label()
 {
     if (label_expired())
     {
@@ -789,7 +1108,7 @@ int CUniqAgent::prepare_response_get_label()
         response->len = sizeof(struct MessageHead);
         response->type = RESPONSE_LABEL;
         response->echo = request->echo;
-        response->value1 = _seq_block.label;
+        response->value1 = _label_info.label;
         response->value2 = 0;
         response->value3 = 0;
 
@@ -798,7 +1117,7 @@ int CUniqAgent::prepare_response_get_label()
     }
 }
 
-int CUniqAgent::prepare_response_get_uniq_id()
+int CUniqWorker::prepare_response_get_uniq_id()
 {
     if (label_expired())
     {
@@ -813,7 +1132,7 @@ int CUniqAgent::prepare_response_get_uniq_id()
         struct MessageHead* request = reinterpret_cast<struct MessageHead*>(_request_buffer);
         struct MessageHead* response = reinterpret_cast<struct MessageHead*>(_response_buffer);
 
-        uint64_t uniq_id = get_uniq_id(request);
+        uint64_t uniq_id = get_uniq_id(static_cast<uint8_t>(request->value1.to_int()), static_cast<time_t>(request->value3.to_int()));
         if (0 == uniq_id)
         {
             return ERROR_STORE_SEQ;
@@ -838,7 +1157,7 @@ int CUniqAgent::prepare_response_get_uniq_id()
     }
 }
 
-int CUniqAgent::prepare_response_get_uniq_seq()
+int CUniqWorker::prepare_response_get_uniq_seq()
 {
     if (label_expired())
     {
@@ -875,7 +1194,7 @@ int CUniqAgent::prepare_response_get_uniq_seq()
     }
 }
 
-int CUniqAgent::prepare_response_get_label_and_seq()
+int CUniqWorker::prepare_response_get_label_and_seq()
 {
     if (label_expired())
     {
@@ -902,7 +1221,7 @@ int CUniqAgent::prepare_response_get_label_and_seq()
             response->len = sizeof(struct MessageHead);
             response->type = RESPONSE_LABEL_AND_SEQ;
             response->echo = request->echo;
-            response->value1 = _seq_block.label;
+            response->value1 = _label_info.label;
             response->value2 = seq;
             response->value3 = 0;
 
@@ -912,38 +1231,48 @@ int CUniqAgent::prepare_response_get_label_and_seq()
     }
 }
 
-int CUniqAgent::on_response_error()
+int CUniqWorker::prepare_response_get_uniq_ids()
 {
-    struct MessageHead* response = reinterpret_cast<struct MessageHead*>(_request_buffer);
-    MYLOG_ERROR("%s from %s\n", response->str().c_str(), net::to_string(_from_addr).c_str());
-
-    if (ERROR_LABEL_NOT_HOLD == response->value1.to_int())
+    if (label_expired())
     {
-        // 需要重新租赁Label，故重置
-        _seq_block.update_label(0);
-        get_label(true);
+        return ERROR_LABEL_EXPIRED;
     }
-
-    return -1;
-}
-
-int CUniqAgent::on_response_label()
-{
-    struct MessageHead* response = reinterpret_cast<struct MessageHead*>(_request_buffer);
-    MYLOG_INFO("%s from %s\n", response->str().c_str(), net::to_string(_from_addr).c_str());
-
-    uint32_t old_label = _seq_block.label;
-    _seq_block.update_label(static_cast<uint32_t>(response->value1.to_int()));
-    _seq_block.timestamp = static_cast<uint64_t>(_current_time);
-
-    // Lable发生变化时，立即保存
-    if (old_label != _seq_block.label)
+    else if (io_error())
     {
-        MYLOG_DEBUG("Label change from %u to %u\n", old_label, _seq_block.label);
-        (void)store_sequence();
+        return ERROR_STORE_SEQ;
     }
+    else
+    {
+        struct MessageHead* request = reinterpret_cast<struct MessageHead*>(_request_buffer);
+        struct MessageHead* response = reinterpret_cast<struct MessageHead*>(_response_buffer);
+        uint16_t num = static_cast<uint16_t>(request->value1.to_int());
+        if (0 == num)
+            num = 1;
 
-    return -1;
+        uint64_t uniq_id = get_uniq_id(static_cast<uint8_t>(request->value2.to_int()), static_cast<time_t>(request->value3.to_int()), num);
+        if (0 == uniq_id)
+        {
+            return ERROR_STORE_SEQ;
+        }
+        else if (1 == uniq_id)
+        {
+            return ERROR_OVERFLOW;
+        }
+        else
+        {
+            // 只回第一个ID和个数，一个包即可容纳任意个数
+            _response_size = sizeof(struct MessageHead);
+            response->len = sizeof(struct MessageHead);
+            response->type = RESPONSE_UNIQ_IDS;
+            response->echo = request->echo;
+            response->value1 = num;
+            response->value2 = 0;
+            response->value3 = uniq_id;
+
+            MYLOG_DEBUG("prepare %s ok\n", response->str().c_str());
+            return 0;
+        }
+    }
 }
 
 } // namespace mooon {
@@ -24,9 +24,12 @@
 #include <mooon/net/utils.h>
 #include <mooon/sys/close_helper.h>
 #include <mooon/sys/datetime_utils.h>
+#include <mooon/sys/event.h>
+#include <mooon/sys/lock.h>
 #include <mooon/sys/main_template.h>
 #include <mooon/sys/mysql_db.h>
 #include <mooon/sys/safe_logger.h>
+#include <mooon/sys/thread_engine.h>
 #include <mooon/sys/utils.h>
 #include <mooon/utils/args_parser.h>
 #include <mooon/utils/string_utils.h>
@@ -36,6 +39,14 @@
 
 // 允许两个master同时运行，
 // 通过MySQL的事务、表锁和唯一键保证数据的安全和一致性。
+//
+// 租约表（t_label_online）在内存中保留一份，续租只修改内存，
+// 由后台线程每隔flush秒将续租批量写回MySQL（一条UPDATE），并重新加载t_label_online，
+// 因此不管agent有多少，DB的负载基本恒定。
+// 分配Label仍然同步走MySQL事务，以保证多个master之间以及master重启前后Label的互斥，
+// 内存中找不到时（比如Label由另一个master分配）也会回查MySQL。
+// 续租在内存中最多滞后flush秒写入MySQL，而Label要在过期并经过冻结期后才会被回收，
+// 所以只要flush远小于expire，master重启丢失未写回的续租也不会导致Label被错误回收。
 
 // 日志控制：
 // 可通过设置环境变量MOOON_LOG_LEVEL和MOOON_LOG_SCREEN来控制日志级别和是否在屏幕上输出日志
@@ -64,6 +75,8 @@ INTEGER_ARG_DEFINE(uint32_t, expire, LABEL_EXPIRED_SECONDS, 1, 4294967295U, "lab
 // 如果expire的值为7天，则timeout的值可以取1小时，
 // 如果expire的值为30天，则timeout的值可以取12小时
 INTEGER_ARG_DEFINE(uint32_t, timeout, 3600, 1, 36000, "timeout seconds");
+// 多长间隔将内存中的续租批量写回MySQL，并从MySQL重新加载租约表，值必须小于expire
+INTEGER_ARG_DEFINE(uint32_t, flush, 10, 1, 3600, "seconds to write back leases");
 
 ////////////////////////////////////////////////////////////////////////////////
 namespace mooon {
@@ -161,16 +174,20 @@ private:
 
 private:
     bool check_parameter();
+    sys::CMySQLConnection* create_mysql() const;
     bool init_mysql();
     bool generate_labels();
-    bool load_labels();
+    bool load_labels(sys::CMySQLConnection* mysql);
     int alloc_label();
-    int get_label() const;
-    bool hold_valid_label(uint8_t label) const;
+    int get_label();
+    bool hold_valid_label(uint8_t label);
+    void renew_label(uint8_t label);
 
 private:
-    void on_timeout();
-    time_t get_expire_time() const;
+    void flush_proc();
+    void flush_leases(sys::CMySQLConnection* mysql);
+    void recycle_labels(sys::CMySQLConnection* mysql, time_t current_time);
+    time_t get_expire_time(time_t current_time) const;
     void prepare_response_error(int errcode);
     int prepare_response_get_label();
 
@@ -178,7 +195,16 @@ private:
     time_t _current_time;
     net::CUdpSocket* _udp_socket;
     sys::CMySQLConnection* _mysql;
-    std::map<uint8_t, struct LabelInfo> _label_info_map; // 申请续租的
+
+private:
+    // 下列成员由_lease_lock保护，和后台写回线程共享
+    sys::CLock _lease_lock;
+    sys::CEvent _flush_event;
+    volatile bool _stop;
+    std::map<uint8_t, struct LabelInfo> _lease_map; // 内存中的租约表，对应t_label_online
+    std::map<uint8_t, struct LabelInfo> _label_info_map; // 申请续租的，待写回MySQL
+    sys::CMySQLConnection* _flush_mysql; // 写回线程专用的连接
+    sys::CThreadEngine* _flush_thread;
 
 private:
     struct sockaddr_in _from_addr;
@@ -195,7 +221,7 @@ extern "C" int main(int argc, char* argv[])
 }
 
 CUniqMaster::CUniqMaster()
-    : _current_time(0), _udp_socket(NULL), _mysql(NULL), _message_head(NULL)
+    : _current_time(0), _udp_socket(NULL), _mysql(NULL), _stop(false), _flush_mysql(NULL), _flush_thread(NULL), _message_head(NULL)
 {
     memset(&_from_addr, 0, sizeof(_from_addr));
     memset(&_request_buffer, 0, sizeof(_request_buffer));
@@ -207,6 +233,7 @@ CUniqMaster::~CUniqMaster()
 {
     delete _udp_socket;
     delete _mysql;
+    delete _flush_mysql;
 }
 
 bool CUniqMaster::init(int argc, char* argv[])
@@ -229,10 +256,14 @@ bool CUniqMaster::init(int argc, char* argv[])
             return false;
         if (!generate_labels())
             return false;
+        if (!load_labels(_mysql))
+            return false;
 
         _udp_socket = new net::CUdpSocket;
         _udp_socket->listen(argument::ip->value(), argument::port->value());
         MYLOG_INFO("listen on %s:%d\n", argument::ip->c_value(), argument::port->value());
+
+        _flush_thread = new sys::CThreadEngine(sys::bind(&CUniqMaster::flush_proc, this));
         return true;
     }
     catch (sys::CSyscallException& ex)
@@ -248,8 +279,6 @@ bool CUniqMaster::init(int argc, char* argv[])
 
 bool CUniqMaster::run()
 {
-    time_t old_time = 0;
-
     while (true)
     {
         int events_returned = 0;
@@ -258,12 +287,7 @@ bool CUniqMaster::run()
 
         bool not_timeout = net::CUtils::timed_poll(_udp_socket->get_fd(), events_requested, milliseconds, &events_returned);
         _current_time = time(NULL);
-        if (!not_timeout)
-        {
-            if (_current_time - old_time > static_cast<time_t>(argument::timeout->value()))
-                on_timeout();
-        }
-        else
+        if (not_timeout)
         {
             int bytes_received = _udp_socket->receive_from(_request_buffer, sizeof(_request_buffer), &_from_addr);
             if (bytes_received < static_cast<int>(sizeof(struct MessageHead)))
@@ -316,36 +340,67 @@ bool CUniqMaster::run()
 
 void CUniqMaster::fini()
 {
+    if (_flush_thread != NULL)
+    {
+        {
+            sys::LockHelper<sys::CLock> lock_helper(_lease_lock);
+            _stop = true;
+            _flush_event.signal();
+        }
+
+        // 退出前写回线程会将未写回的续租写入MySQL
+        _flush_thread->join();
+        delete _flush_thread;
+        _flush_thread = NULL;
+    }
 }
 
 bool CUniqMaster::check_parameter()
 {
+    if (argument::flush->value() >= argument::expire->value())
+    {
+        fprintf(stderr, "parameter[flush] should be less than parameter[expire]\n");
+        return false;
+    }
+
     return true;
 }
 
-bool CUniqMaster::init_mysql()
+sys::CMySQLConnection* CUniqMaster::create_mysql() const
 {
-    _mysql = new sys::CMySQLConnection;
-    _mysql->set_host(argument::db_host->value(), argument::db_port->value());
-    _mysql->set_db_name(argument::db_name->value());
-    _mysql->set_user(argument::db_user->value(), argument::db_pass->value());
-    //_mysql->set_charset();
-    _mysql->enable_auto_reconnect();
+    sys::CMySQLConnection* mysql = new sys::CMySQLConnection;
+    mysql->set_host(argument::db_host->value(), argument::db_port->value());
+    mysql->set_db_name(argument::db_name->value());
+    mysql->set_user(argument::db_user->value(), argument::db_pass->value());
+    //mysql->set_charset();
+    mysql->enable_auto_reconnect();
 
     try
     {
-        _mysql->open();
-        MYLOG_INFO("connect %s ok\n", _mysql->str().c_str());
-        _mysql->enable_autocommit(false); // 为false表示开启事务
-        return true;
+        mysql->open();
+        MYLOG_INFO("connect %s ok\n", mysql->str().c_str());
+        mysql->enable_autocommit(false); // 为false表示开启事务
+        return mysql;
     }
     catch (sys::CDBException& ex)
     {
-        MYLOG_ERROR("connect %s failed: %s\n", _mysql->str().c_str(), ex.str().c_str());
-        return false;
+        MYLOG_ERROR("connect %s failed: %s\n", mysql->str().c_str(), ex.str().c_str());
+        delete mysql;
+        return NULL;
     }
 }
 
+// _mysql由主线程分配Label使用，_flush_mysql由写回线程使用
+bool CUniqMaster::init_mysql()
+{
+    _mysql = create_mysql();
+    if (NULL == _mysql)
+        return false;
+
+    _flush_mysql = create_mysql();
+    return _flush_mysql != NULL;
+}
+
 bool CUniqMaster::generate_labels()
 {
     bool need_rollback = false;
@@ -388,6 +443,55 @@ bool CUniqMaster::generate_labels()
     }
 }
 
+// 从t_label_online加载租约表到内存，
+// 以MySQL中的为准，但同一IP在内存中有更新的（还未写回的）续租时间则保留内存中的
+bool CUniqMaster::load_labels(sys::CMySQLConnection* mysql)
+{
+    try
+    {
+        sys::DBTable db_table;
+        std::map<uint8_t, struct LabelInfo> lease_map;
+
+        mysql->query(db_table, "SELECT f_label,f_ip,f_time FROM t_label_online");
+        mysql->commit(); // 结束查询所在的事务，否则下次查询看不到其它连接（如另一个master）的修改
+        for (sys::DBTable::size_type row=0; row<db_table.size(); ++row)
+        {
+            const sys::DBRow& db_row = db_table[row];
+            time_t lease_time = 0;
+
+            if (!sys::CDatetimeUtils::datetime_struct_from_string(db_row[2].c_str(), &lease_time))
+            {
+                MYLOG_ERROR("invalid time of Label[%s]: %s\n", db_row[0].c_str(), db_row[2].c_str());
+                continue;
+            }
+
+            const struct LabelInfo label_info(static_cast<uint8_t>(atoi(db_row[0].c_str())), db_row[1], lease_time);
+            lease_map.insert(std::make_pair(label_info.label, label_info));
+        }
+
+        sys::LockHelper<sys::CLock> lock_helper(_lease_lock);
+        for (std::map<uint8_t, struct LabelInfo>::iterator iter=lease_map.begin(); iter!=lease_map.end(); ++iter)
+        {
+            std::map<uint8_t, struct LabelInfo>::const_iterator old_iter = _lease_map.find(iter->first);
+            if ((old_iter != _lease_map.end()) &&
+                (old_iter->second.ip == iter->second.ip) &&
+                (old_iter->second.lease_time > iter->second.lease_time))
+            {
+                iter->second.lease_time = old_iter->second.lease_time;
+            }
+        }
+
+        _lease_map.swap(lease_map);
+        MYLOG_DEBUG("load %d labels\n", static_cast<int>(_lease_map.size()));
+        return true;
+    }
+    catch (sys::CDBException& ex)
+    {
+        MYLOG_ERROR("load labels failed: %s\n", ex.str().c_str());
+        return false;
+    }
+}
+
 // 返回-1表示DB错误
 // 返回0表示无可用的Label
 // 返回大于0的值表示分配Label成功
@@ -432,7 +536,12 @@ int CUniqMaster::alloc_label()
 
                 MYLOG_DEBUG("Label[%s] return %d\n", label_str.c_str(), n);
                 _mysql->commit();
-                return static_cast<int>(atoi(label_str.c_str()));
+
+                const int label = atoi(label_str.c_str());
+                const struct LabelInfo label_info(static_cast<uint8_t>(label), _from_addr.sin_addr.s_addr, _current_time);
+                sys::LockHelper<sys::CLock> lock_helper(_lease_lock);
+                _lease_map[label_info.label] = label_info;
+                return label;
             }
         }
     }
@@ -456,13 +565,27 @@ int CUniqMaster::alloc_label()
     }
 }
 
-// 根据IP取它的未过期的Label
+// 根据IP取它的未过期的Label，先查内存，内存中没有时再查MySQL
 // 成功返回Lable， 没找到则返回0，DB错误返回-1
-int CUniqMaster::get_label() const
+int CUniqMaster::get_label()
 {
+    const time_t expire_time = _current_time - argument::expire->value();
+
+    {
+        sys::LockHelper<sys::CLock> lock_helper(_lease_lock);
+        for (std::map<uint8_t, struct LabelInfo>::const_iterator iter=_lease_map.begin(); iter!=_lease_map.end(); ++iter)
+        {
+            const struct LabelInfo& label_info = iter->second;
+            if ((label_info.ip == _from_addr.sin_addr.s_addr) && (label_info.lease_time >= expire_time))
+            {
+                MYLOG_INFO("%s hold label[%d]\n", net::to_string(_from_addr.sin_addr).c_str(), (int)label_info.label);
+                return label_info.label;
+            }
+        }
+    }
+
     try
     {
-        time_t expire_time = _current_time - argument::expire->value();
         const std::string str = _mysql->query("SELECT f_label FROM t_label_online WHERE f_ip=\"%s\" AND f_time>=\"%s\"", net::to_string(_from_addr.sin_addr).c_str(), sys::CDatetimeUtils::to_datetime(expire_time).c_str());
 
         if (str.empty())
@@ -473,7 +596,11 @@ int CUniqMaster::get_label() const
         else
         {
             MYLOG_INFO("%s hold label[%s]\n", net::to_string(_from_addr.sin_addr).c_str(), str.c_str());
-            return atoi(str.c_str());
+
+            const struct LabelInfo label_info(static_cast<uint8_t>(atoi(str.c_str())), _from_addr.sin_addr.s_addr, _current_time);
+            sys::LockHelper<sys::CLock> lock_helper(_lease_lock);
+            _lease_map[label_info.label] = label_info;
+            return label_info.label;
         }
     }
     catch (sys::CDBException& ex)
@@ -483,15 +610,33 @@ int CUniqMaster::get_label() const
     }
 }
 
-// 判断是否持有指定的Label，而且需要在有效期内
-bool CUniqMaster::hold_valid_label(uint8_t label) const
+// 判断是否持有指定的Label，而且需要在有效期内，
+// 先查内存，内存中不符合时再以MySQL为准（Label可能是另一个master分配的）
+bool CUniqMaster::hold_valid_label(uint8_t label)
 {
-    time_t expire_time = _current_time - argument::expire->value();
-    const std::string str = _mysql->query("SELECT f_ip FROM t_label_online WHERE f_label=%d AND f_time>=\"%s\"", (int)label, sys::CDatetimeUtils::to_datetime(expire_time).c_str());
+    const time_t expire_time = _current_time - argument::expire->value();
+
+    {
+        sys::LockHelper<sys::CLock> lock_helper(_lease_lock);
+        std::map<uint8_t, struct LabelInfo>::const_iterator iter = _lease_map.find(label);
+        if ((iter != _lease_map.end()) &&
+            (iter->second.ip == _from_addr.sin_addr.s_addr) &&
+            (iter->second.lease_time >= expire_time))
+        {
+            return true;
+        }
+    }
 
+    const std::string str = _mysql->query("SELECT f_ip FROM t_label_online WHERE f_label=%d AND f_time>=\"%s\"", (int)label, sys::CDatetimeUtils::to_datetime(expire_time).c_str());
     if (!str.empty())
     {
-        return str == net::to_string(_from_addr.sin_addr);
+        if (str != net::to_string(_from_addr.sin_addr))
+            return false;
+
+        const struct LabelInfo label_info(label, _from_addr.sin_addr.s_addr, _current_time);
+        sys::LockHelper<sys::CLock> lock_helper(_lease_lock);
+        _lease_map[label] = label_info;
+        return true;
     }
     else
     {
@@ -500,53 +645,114 @@ bool CUniqMaster::hold_valid_label(uint8_t label) const
     }
 }
 
-void CUniqMaster::on_timeout()
+// 续租只记在内存中，由写回线程批量写入MySQL
+void CUniqMaster::renew_label(uint8_t label)
 {
-    int num_rows = 0;
-    bool need_commit = false;
-    bool need_rollback = false; // 是否需要回滚
+    const struct LabelInfo label_info(label, _from_addr.sin_addr.s_addr, _current_time);
+    sys::LockHelper<sys::CLock> lock_helper(_lease_lock);
 
-    try
+    _lease_map[label] = label_info;
+    _label_info_map[label] = label_info;
+}
+
+// 写回线程，
+// 每隔flush秒将续租批量写回MySQL并重新加载租约表，每隔timeout秒回收过期的Label
+void CUniqMaster::flush_proc()
+{
+    time_t old_time = 0;
+
+    while (true)
     {
-        // 需先更新续租
-        for (std::map<uint8_t, struct LabelInfo>::iterator iter=_label_info_map.begin(); iter!=_label_info_map.end(); ++iter)
+        bool stop = false;
         {
-            try
-            {
-                const struct LabelInfo& label_info = iter->second;
-                const std::string ip_str = net::ip2string(label_info.ip);
-                const std::string time_str = sys::CDatetimeUtils::to_datetime(label_info.lease_time);
-
-                num_rows = _mysql->update("UPDATE t_label_online SET f_time=\"%s\" WHERE f_label=%d AND f_ip=\"%s\" AND f_time<\"%s\"", time_str.c_str(), (int)label_info.label, ip_str.c_str(), time_str.c_str());
-                MYLOG_DEBUG("update t_label_online ok: (%d)%s\n", num_rows, label_info.str().c_str());
-                need_commit = true;
-            }
-            catch (sys::CDBException& ex)
-            {
-                MYLOG_ERROR("[%s]=>%s", ex.sql(), ex.str().c_str());
-            }
+            sys::LockHelper<sys::CLock> lock_helper(_lease_lock);
+            if (!_stop)
+                _flush_event.timed_wait(_lease_lock, argument::flush->value() * 1000);
+            stop = _stop;
         }
 
-        if (need_commit)
+        // 需先写回续租，再清理超时未续租的，否则可能冲突
+        flush_leases(_flush_mysql);
+        if (stop)
+            break;
+
+        const time_t current_time = time(NULL);
+        if (current_time - old_time > static_cast<time_t>(argument::timeout->value()))
         {
-            _mysql->commit();
-            need_commit = false;
-            _label_info_map.clear();
+            recycle_labels(_flush_mysql, current_time);
+            old_time = current_time;
         }
+
+        (void)load_labels(_flush_mysql);
+    }
+}
+
+// 将所有续租合并成一条UPDATE写回，
+// f_ip作为条件，以免覆盖已被回收并重新分配给其它IP的Label，GREATEST保证续租时间不会倒退
+void CUniqMaster::flush_leases(sys::CMySQLConnection* mysql)
+{
+    std::map<uint8_t, struct LabelInfo> label_info_map;
+    {
+        sys::LockHelper<sys::CLock> lock_helper(_lease_lock);
+        label_info_map.swap(_label_info_map);
+    }
+    if (label_info_map.empty())
+    {
+        return;
+    }
+
+    std::string case_str;
+    std::string in_str;
+    for (std::map<uint8_t, struct LabelInfo>::const_iterator iter=label_info_map.begin(); iter!=label_info_map.end(); ++iter)
+    {
+        const struct LabelInfo& label_info = iter->second;
+        const std::string ip_str = net::ip2string(label_info.ip);
+        const std::string time_str = sys::CDatetimeUtils::to_datetime(label_info.lease_time);
+
+        case_str += utils::CStringUtils::format_string(" WHEN %d THEN \"%s\"", (int)label_info.label, time_str.c_str());
+        if (!in_str.empty())
+            in_str += ",";
+        in_str += utils::CStringUtils::format_string("(%d,\"%s\")", (int)label_info.label, ip_str.c_str());
+    }
+
+    try
+    {
+        const uint64_t num_rows = mysql->update("UPDATE t_label_online SET f_time=GREATEST(f_time,CAST(CASE f_label%s END AS DATETIME)) WHERE (f_label,f_ip) IN (%s)", case_str.c_str(), in_str.c_str());
+        mysql->commit();
+        MYLOG_DEBUG("update t_label_online ok: %d/%d\n", static_cast<int>(num_rows), static_cast<int>(label_info_map.size()));
     }
     catch (sys::CDBException& ex)
     {
-        MYLOG_ERROR("commit failed: %s", ex.str().c_str());
+        MYLOG_ERROR("[%s]=>%s", ex.sql(), ex.str().c_str());
+
+        try
+        {
+            mysql->rollback();
+        }
+        catch (sys::CDBException& ex)
+        {
+            MYLOG_ERROR("rollback failed: %s", ex.str().c_str());
+        }
+
+        // 放回去下次重试，期间有更新的续租则保留更新的
+        sys::LockHelper<sys::CLock> lock_helper(_lease_lock);
+        for (std::map<uint8_t, struct LabelInfo>::const_iterator iter=label_info_map.begin(); iter!=label_info_map.end(); ++iter)
+            _label_info_map.insert(*iter);
     }
+}
+
+void CUniqMaster::recycle_labels(sys::CMySQLConnection* mysql, time_t current_time)
+{
+    int num_rows = 0;
+    bool need_rollback = false; // 是否需要回滚
 
-    // 再清理超时未续租的，否则可能冲突
     try
     {
         static uint64_t timeout_count = 0; // 控制重复日志量
-        time_t expire_time = get_expire_time();
+        time_t expire_time = get_expire_time(current_time);
 
         sys::DBTable db_table;
-        _mysql->query(db_table, "SELECT f_ip,f_label,f_time FROM t_label_online WHERE f_time<\"%s\"", sys::CDatetimeUtils::to_datetime(expire_time).c_str());
+        mysql->query(db_table, "SELECT f_ip,f_label,f_time FROM t_label_online WHERE f_time<\"%s\"", sys::CDatetimeUtils::to_datetime(expire_time).c_str());
         if (db_table.empty())
         {
             if (0 == timeout_count++ % 10000)
@@ -561,7 +767,7 @@ void CUniqMaster::on_timeout()
             // 锁住表: LOCK TABLES t_label_online WRITE;
             // 开始事务: START TRANSACTION;
             // 事务包含了锁操作
-            //_mysql->update("%s", "LOCK TABLES t_label_online WRITE");
+            //mysql->update("%s", "LOCK TABLES t_label_online WRITE");
 
             for (sys::DBTable::size_type row=0; row<db_table.size(); ++row)
             {
@@ -572,7 +778,7 @@ void CUniqMaster::on_timeout()
 
                 // 如果另一连接进入了事务，则update会被阻塞
                 // 如果一个连接已完成了DELETE，则调用后返回值为0
-                num_rows = _mysql->update("DELETE FROM t_label_online WHERE f_label=%s", label_str.c_str());
+                num_rows = mysql->update("DELETE FROM t_label_online WHERE f_label=%s", label_str.c_str());
                 if (0 == num_rows)
                 {
                     need_rollback = false;
@@ -584,12 +790,19 @@ void CUniqMaster::on_timeout()
                     MYLOG_INFO("[%d] Label[%s] expired(%u) for %s with %s\n", num_rows, label_str.c_str(), argument::expire->value(), ip_str.c_str(), time_str.c_str());
 
                     // 回收
-                    num_rows = _mysql->update("INSERT INTO t_label_pool (f_label) VALUES (%s)", label_str.c_str());
+                    num_rows = mysql->update("INSERT INTO t_label_pool (f_label) VALUES (%s)", label_str.c_str());
                     // 日志
-                    _mysql->update("INSERT INTO t_label_log(f_label,f_ip,f_event,f_time) VALUES (%s,\"%s\",%d,\"%s\")", label_str.c_str(), ip_str.c_str(), LABEL_RECYCLED, sys::CDatetimeUtils::to_datetime(_current_time).c_str());
+                    mysql->update("INSERT INTO t_label_log(f_label,f_ip,f_event,f_time) VALUES (%s,\"%s\",%d,\"%s\")", label_str.c_str(), ip_str.c_str(), LABEL_RECYCLED, sys::CDatetimeUtils::to_datetime(current_time).c_str());
                     MYLOG_INFO("Label[%s] recycled from %s, expired at %s\n", label_str.c_str(), ip_str.c_str(), time_str.c_str());
 
-                    _mysql->commit();
+                    mysql->commit();
+                    need_rollback = false;
+
+                    // 从内存中删除，冻结期远大于flush，内存中的续租时间不会比expire_time新
+                    sys::LockHelper<sys::CLock> lock_helper(_lease_lock);
+                    std::map<uint8_t, struct LabelInfo>::iterator iter = _lease_map.find(static_cast<uint8_t>(atoi(label_str.c_str())));
+                    if ((iter != _lease_map.end()) && (iter->second.lease_time < expire_time))
+                        _lease_map.erase(iter);
                 }
             } // for
         }
@@ -603,7 +816,7 @@ void CUniqMaster::on_timeout()
         {
             try
             {
-                _mysql->rollback();
+                mysql->rollback();
             }
             catch (sys::CDBException& ex)
             {
@@ -615,33 +828,33 @@ void CUniqMaster::on_timeout()
 
 // 一个Label过期未续租时，不是立即回收，
 // 而是在过期后仍然冻结一段时间，以保证回收的足够安全，这有点类似于TCP的TIME_WAIT状态
-time_t CUniqMaster::get_expire_time() const
+time_t CUniqMaster::get_expire_time(time_t current_time) const
 {
     time_t  expire_time;
 
     if (argument::expire->value() < 3600) // 小于1小时，则冻结时间为过期时间的2倍，此种情况主要用于测试
     {
-        expire_time = _current_time - (2 * argument::expire->value());
+        expire_time = current_time - (2 * argument::expire->value());
     }
     else if (argument::expire->value() < 3600*24) // 小于一天，则冻结时间为过期时间加2小时，此种情况主要用于测试
     {
-        expire_time = _current_time - (3600*2 + argument::expire->value());
+        expire_time = current_time - (3600*2 + argument::expire->value());
     }
     else if (argument::expire->value() < 3600*24*7) // 小于一周，则冻结时间为过期时间加上2天
     {
-        expire_time = _current_time - ((3600*24*2) + argument::expire->value());
+        expire_time = current_time - ((3600*24*2) + argument::expire->value());
     }
     else if (argument::expire->value() < 3600*24*30) // 过期时间小于1个月，则冻结时间加上3天
     {
-        expire_time = _current_time - ((3600*24*3) + argument::expire->value());
+        expire_time = current_time - ((3600*24*3) + argument::expire->value());
     }
     else if (argument::expire->value() < 3600*24*90) // 过期时间小于3个月，则冻结时间加上5天
     {
-        expire_time = _current_time - ((3600*24*5) + argument::expire->value());
+        expire_time = current_time - ((3600*24*5) + argument::expire->value());
     }
     else // 冻结时间加上10天
     {
-        expire_time = _current_time - ((3600*24*10) + argument::expire->value());
+        expire_time = current_time - ((3600*24*10) + argument::expire->value());
     }
 
     return expire_time;
@@ -713,13 +926,7 @@ int CUniqMaster::prepare_response_get_label()
         response->value2 = 0;
         MYLOG_INFO("%s => %s\n", response->str().c_str(), net::to_string(_from_addr).c_str());
 
-        struct LabelInfo label_info(label, _from_addr.sin_addr.s_addr, _current_time);
-        std::pair<std::map<uint8_t, struct LabelInfo>::iterator, bool> ret = _label_info_map.insert(std::make_pair(label, label_info));
-        if (!ret.second)
-        {
-            struct LabelInfo& label_info_ref = ret.first->second;
-            label_info_ref.lease_time = _current_time;
-        }
+        renew_label(static_cast<uint8_t>(label));
     }
 
     return 0;
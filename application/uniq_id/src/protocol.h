@@ -45,12 +45,14 @@ enum
     REQUEST_UNIQ_ID = 2,
     REQUEST_UNIQ_SEQ = 3,
     REQUEST_LABEL_AND_SEQ = 4,
+    REQUEST_UNIQ_IDS = 5,  // 一次取value1个ID，value2为user，value3为时间（为0时取agent的时间）
 
     RESPONSE_ERROR = 100,
     RESPONSE_LABEL = 101,
     RESPONSE_UNIQ_ID = 102,
     RESPONSE_UNIQ_SEQ = 103,
-    RESPONSE_LABEL_AND_SEQ = 104
+    RESPONSE_LABEL_AND_SEQ = 104,
+    RESPONSE_UNIQ_IDS = 105 // value1为个数，value3为第一个ID，其余的ID只是seq依次加1
 };
 
 ////////////////////////////////////////////////////////////////////////////////
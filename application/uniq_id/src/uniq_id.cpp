@@ -18,8 +18,13 @@
  */
 #include "mooon/uniq_id/uniq_id.h"
 #include "protocol.h"
+#include <algorithm>
 #include <iomanip>
 #include <mooon/net/udp_socket.h>
+#include <mooon/sys/datetime_utils.h>
+#include <mooon/sys/event.h>
+#include <mooon/sys/lock.h>
+#include <mooon/sys/thread_engine.h>
 #include <mooon/utils/integer_utils.h>
 #include <mooon/utils/tokener.h>
 #include <mooon/utils/string_utils.h>
@@ -29,6 +34,14 @@
 #include <time.h>
 namespace mooon {
 
+// agent选择相关的常量
+enum
+{
+    EJECT_FAILURES = 3,      // 连续失败多少次剔除
+    EJECT_MILLISECONDS = 2000 // 剔除多长时间后探测
+};
+static const double EWMA_ALPHA = 0.1;
+
 const char* label2string(uint8_t label, char str[3], bool uppercase)
 {
     if (uppercase)
@@ -45,10 +58,178 @@ std::string label2string(uint8_t label, bool uppercase)
     return str;
 }
 
+// 预取模式下，从agent租到的一段连续seq
+struct SeqRange
+{
+    uint8_t label;
+    uint32_t seq;       // 下一个可分配的seq
+    uint32_t remaining; // 剩余可分配的个数
+
+    SeqRange()
+        : label(0), seq(0), remaining(0)
+    {
+    }
+};
+
+// 客户端预取seq段，
+// 调用者从当前段分配，后台线程用独立的套接字向agent租赁下一段
+class CSeqPrefetcher
+{
+public:
+    CSeqPrefetcher(CUniqId* uniq_id, uint16_t range_size, uint16_t low_watermark) throw (sys::CSyscallException);
+    ~CSeqPrefetcher();
+
+    // 从本地的seq段分配num个连续的seq，num大于range_size时返回false，由调用者直接向agent取
+    bool get_label_and_seq(uint8_t* label, uint32_t* seq, uint16_t num) throw (utils::CException, sys::CSyscallException);
+
+private:
+    void run();
+    void request_prefetch();
+
+private:
+    CUniqId* _uniq_id;
+    uint16_t _range_size;
+    uint16_t _low_watermark;
+    net::CUdpSocket _udp_socket; // 后台线程专用，CUniqId::_udp_socket只供调用者线程使用
+    uint32_t _echo;
+
+private:
+    sys::CLock _lock;           // 保护以下成员
+    sys::CEvent _request_event; // 通知后台线程预取
+    sys::CEvent _ready_event;   // 通知调用者预取已完成
+    struct SeqRange _current;
+    struct SeqRange _next;
+    bool _next_ready;
+    bool _requested;
+    bool _stop;
+    int _errcode;         // 最近一次预取失败的错误码，为0表示没有出错
+    std::string _errmsg;
+    sys::CThreadEngine* _thread_engine;
+};
+
+CSeqPrefetcher::CSeqPrefetcher(CUniqId* uniq_id, uint16_t range_size, uint16_t low_watermark) throw (sys::CSyscallException)
+    : _uniq_id(uniq_id), _range_size(range_size), _low_watermark(low_watermark),
+      _next_ready(false), _requested(false), _stop(false), _errcode(0), _thread_engine(NULL)
+{
+    _echo = sys::CUtils::get_random_number(0, 100000U);
+    if (0 == _low_watermark)
+        _low_watermark = _range_size / 4;
+
+    _thread_engine = new sys::CThreadEngine(sys::bind(&CSeqPrefetcher::run, this));
+}
+
+CSeqPrefetcher::~CSeqPrefetcher()
+{
+    {
+        sys::LockHelper<sys::CLock> lh(_lock);
+        _stop = true;
+        _request_event.signal();
+    }
+
+    // 如果正在预取，需要等它超时或完成
+    _thread_engine->join();
+    delete _thread_engine;
+}
+
+bool CSeqPrefetcher::get_label_and_seq(uint8_t* label, uint32_t* seq, uint16_t num) throw (utils::CException, sys::CSyscallException)
+{
+    if (0 == num)
+        num = 1;
+    if (num > _range_size)
+        return false;
+
+    sys::LockHelper<sys::CLock> lh(_lock);
+    while (_current.remaining < num)
+    {
+        if (_next_ready)
+        {
+            // 当前段不够时整段丢弃，以保证分配的seq是连续的
+            _current = _next;
+            _next_ready = false;
+        }
+        else if (_errcode != 0)
+        {
+            // 预取失败，报告给调用者，下次调用时重新预取
+            const int errcode = _errcode;
+            const std::string errmsg = _errmsg;
+            _errcode = 0;
+            THROW_EXCEPTION(errmsg, errcode);
+        }
+        else
+        {
+            request_prefetch();
+            _ready_event.wait(_lock);
+        }
+    }
+
+    *label = _current.label;
+    *seq = _current.seq;
+    _current.seq += num;
+    _current.remaining -= num;
+    if ((_current.remaining <= _low_watermark) && !_next_ready)
+        request_prefetch();
+    return true;
+}
+
+void CSeqPrefetcher::request_prefetch()
+{
+    if (!_requested)
+    {
+        _requested = true;
+        _request_event.signal();
+    }
+}
+
+void CSeqPrefetcher::run()
+{
+    while (true)
+    {
+        {
+            sys::LockHelper<sys::CLock> lh(_lock);
+            while (!_requested && !_stop)
+                _request_event.wait(_lock);
+            if (_stop)
+                break;
+        }
+
+        struct SeqRange range;
+        int errcode = 0;
+        std::string errmsg;
+        try
+        {
+            _uniq_id->request_label_and_seq(&_udp_socket, _echo++, &range.label, &range.seq, _range_size);
+            range.remaining = _range_size;
+        }
+        catch (utils::CException& ex)
+        {
+            errcode = ex.errcode();
+            errmsg = ex.what();
+            if (0 == errcode)
+                errcode = ERROR_MISMATCH;
+        }
+
+        sys::LockHelper<sys::CLock> lh(_lock);
+        _requested = false;
+        if (0 == errcode)
+        {
+            _next = range;
+            _next_ready = true;
+        }
+        else
+        {
+            _errcode = errcode;
+            _errmsg = errmsg;
+        }
+        _ready_event.broadcast();
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////
 CUniqId::CUniqId(const std::string& agent_nodes, uint32_t timeout_milliseconds, uint8_t retry_times, bool polling) throw (utils::CException)
-    : _echo(0), _agent_nodes(agent_nodes), _timeout_milliseconds(timeout_milliseconds), _retry_times(retry_times), _polling(polling), _udp_socket(NULL)
+    : _echo(0), _agent_nodes(agent_nodes), _timeout_milliseconds(timeout_milliseconds), _retry_times(retry_times), _polling(polling), _udp_socket(NULL), _batch_unsupported(false), _prefetcher(NULL)
 {
     _echo = sys::CUtils::get_random_number(0, 100000U); // 初始化一个随机值，这样不同实例不同
+    _pick_factor = _echo;
     _udp_socket = new net::CUdpSocket;
 
     utils::CEnhancedTokenerEx tokener;
@@ -75,13 +256,33 @@ CUniqId::CUniqId(const std::string& agent_nodes, uint32_t timeout_milliseconds,
         memset(agent_addr.sin_zero, 0, sizeof(agent_addr.sin_zero));
         _agents_addr.push_back(agent_addr);
     }
+
+    _agents_stat.resize(_agents_addr.size());
 }
 
 CUniqId::~CUniqId()
 {
+    delete _prefetcher;
     delete _udp_socket;
 }
 
+void CUniqId::enable_prefetch(uint16_t range_size, uint16_t low_watermark) throw (utils::CException, sys::CSyscallException)
+{
+    if (0 == range_size)
+    {
+        THROW_EXCEPTION("invalid range_size parameter", ERROR_PARAMETER);
+    }
+    if (low_watermark >= range_size)
+    {
+        THROW_EXCEPTION("invalid low_watermark parameter", ERROR_PARAMETER);
+    }
+
+    if (NULL == _prefetcher)
+    {
+        _prefetcher = new CSeqPrefetcher(this, range_size, low_watermark);
+    }
+}
+
 uint8_t CUniqId::get_label() throw (utils::CException, sys::CSyscallException)
 {
     uint32_t echo = _echo++;
@@ -98,18 +299,8 @@ uint8_t CUniqId::get_label() throw (utils::CException, sys::CSyscallException)
     {
         try
         {
-            struct sockaddr_in from_addr;
-            const struct sockaddr_in& agent_addr = pick_agent();
-            int bytes = _udp_socket->send_to(&request, sizeof(request), agent_addr);
-            if (bytes != sizeof(request))
-                THROW_SYSCALL_EXCEPTION("invalid size", bytes, "send_to");
-
-            bytes = _udp_socket->timed_receive_from(&response, sizeof(response), &from_addr, _timeout_milliseconds);
-            if (bytes != sizeof(response))
-            {
-                THROW_SYSCALL_EXCEPTION("invalid size", bytes, "receive_from");
-            }
-            else if (RESPONSE_ERROR == response.type)
+            exchange(_udp_socket, request, &response);
+            if (RESPONSE_ERROR == response.type)
             {
                 THROW_EXCEPTION("store sequence block error", static_cast<int>(response.value1.to_int()));
             }
@@ -139,6 +330,14 @@ uint8_t CUniqId::get_label() throw (utils::CException, sys::CSyscallException)
 
 uint32_t CUniqId::get_unqi_seq(uint16_t num) throw (utils::CException, sys::CSyscallException)
 {
+    if (_prefetcher != NULL)
+    {
+        uint8_t label = 0;
+        uint32_t seq = 0;
+        if (_prefetcher->get_label_and_seq(&label, &seq, num))
+            return seq;
+    }
+
     uint32_t echo = _echo++;
     struct MessageHead response;
     struct MessageHead request;
@@ -153,18 +352,8 @@ uint32_t CUniqId::get_unqi_seq(uint16_t num) throw (utils::CException, sys::CSys
     {
         try
         {
-            struct sockaddr_in from_addr;
-            const struct sockaddr_in& agent_addr = pick_agent();
-            int bytes = _udp_socket->send_to(&request, sizeof(request), agent_addr);
-            if (bytes != sizeof(request))
-                THROW_SYSCALL_EXCEPTION("invalid size", bytes, "send_to");
-
-            bytes = _udp_socket->timed_receive_from(&response, sizeof(response), &from_addr, _timeout_milliseconds);
-            if (bytes != sizeof(response))
-            {
-                THROW_SYSCALL_EXCEPTION("invalid size", bytes, "receive_from");
-            }
-            else if (RESPONSE_ERROR == response.type)
+            exchange(_udp_socket, request, &response);
+            if (RESPONSE_ERROR == response.type)
             {
                 THROW_EXCEPTION("store sequence block error", static_cast<int>(response.value1.to_int()));
             }
@@ -193,6 +382,12 @@ uint32_t CUniqId::get_unqi_seq(uint16_t num) throw (utils::CException, sys::CSys
 
 uint64_t CUniqId::get_uniq_id(uint8_t user, uint64_t current_seconds) throw (utils::CException, sys::CSyscallException)
 {
+    if (_prefetcher != NULL)
+    {
+        // 预取模式下在本地组装
+        return get_local_uniq_id(user, current_seconds);
+    }
+
     uint32_t echo = _echo++;
     struct MessageHead response;
     struct MessageHead request;
@@ -207,18 +402,8 @@ uint64_t CUniqId::get_uniq_id(uint8_t user, uint64_t current_seconds) throw (uti
     {
         try
         {
-            struct sockaddr_in from_addr;
-            const struct sockaddr_in& agent_addr = pick_agent();
-            int bytes = _udp_socket->send_to(&request, sizeof(request), agent_addr);
-            if (bytes != sizeof(request))
-                THROW_SYSCALL_EXCEPTION("invalid size", bytes, "send_to");
-
-            bytes = _udp_socket->timed_receive_from(&response, sizeof(response), &from_addr, _timeout_milliseconds);
-            if (bytes != sizeof(response))
-            {
-                THROW_SYSCALL_EXCEPTION("invalid size", bytes, "receive_from");
-            }
-            else if (RESPONSE_ERROR == response.type)
+            exchange(_udp_socket, request, &response);
+            if (RESPONSE_ERROR == response.type)
             {
                 THROW_EXCEPTION("store sequence block error", static_cast<int>(response.value1.to_int()));
             }
@@ -245,6 +430,74 @@ uint64_t CUniqId::get_uniq_id(uint8_t user, uint64_t current_seconds) throw (uti
     return 0;
 }
 
+void CUniqId::get_uniq_id(uint16_t num, std::vector<uint64_t>* id_vec, uint8_t user, uint64_t current_seconds) throw (utils::CException, sys::CSyscallException)
+{
+    if ((_prefetcher != NULL) || _batch_unsupported)
+    {
+        get_local_uniq_id(num, id_vec, user, current_seconds);
+        return;
+    }
+    if (0 == num)
+    {
+        num = 1;
+    }
+
+    uint32_t echo = _echo++;
+    struct MessageHead response;
+    struct MessageHead request;
+    request.len = sizeof(request);
+    request.type = REQUEST_UNIQ_IDS;
+    request.echo = echo;
+    request.value1 = num;
+    request.value2 = user;
+    request.value3 = current_seconds;
+
+    for (uint8_t retry=0; retry<_retry_times+1; ++retry)
+    {
+        try
+        {
+            exchange(_udp_socket, request, &response);
+            if ((RESPONSE_ERROR == response.type) && (ERROR_INVALID_TYPE == response.value1.to_int()))
+            {
+                // 老版本的agent，以后都改用LABEL_AND_SEQ请求
+                _batch_unsupported = true;
+                get_local_uniq_id(num, id_vec, user, current_seconds);
+                return;
+            }
+            else if (RESPONSE_ERROR == response.type)
+            {
+                THROW_EXCEPTION("store sequence block error", static_cast<int>(response.value1.to_int()));
+            }
+            else if (response.type != RESPONSE_UNIQ_IDS)
+            {
+                THROW_EXCEPTION("error response ids", response.type.to_int());
+            }
+            else if ((response.echo.to_int() != echo) || (response.value1.to_int() != num))
+            {
+                THROW_EXCEPTION("mismatch response ids", ERROR_MISMATCH);
+            }
+            else
+            {
+                union UniqID uniq_id;
+                uniq_id.value = response.value3.to_int();
+
+                const uint32_t seq = uniq_id.id.seq;
+                for (uint16_t i=0; i<num; ++i)
+                {
+                    uniq_id.id.seq = seq + i; // 只取低29位，和agent分配时的截断一致
+                    id_vec->push_back(uniq_id.value);
+                }
+                return;
+            }
+        }
+        catch (utils::CException&)
+        {
+            if ((retry == _retry_times) || (0 == _retry_times))
+                throw;
+        }
+    }
+}
+
 uint64_t CUniqId::get_local_uniq_id(uint8_t user, uint64_t current_seconds) throw (utils::CException, sys::CSyscallException)
 {
     uint8_t label = 0;
@@ -294,7 +547,14 @@ void CUniqId::get_local_uniq_id(uint16_t num, std::vector<uint64_t>* id_vec, uin
 
 void CUniqId::get_label_and_seq(uint8_t* label, uint32_t* seq, uint16_t num) throw (utils::CException, sys::CSyscallException)
 {
-    uint32_t echo = _echo++;
+    if ((_prefetcher != NULL) && _prefetcher->get_label_and_seq(label, seq, num))
+        return;
+
+    request_label_and_seq(_udp_socket, _echo++, label, seq, num);
+}
+
+void CUniqId::request_label_and_seq(net::CUdpSocket* udp_socket, uint32_t echo, uint8_t* label, uint32_t* seq, uint16_t num) throw (utils::CException, sys::CSyscallException)
+{
     struct MessageHead response;
     struct MessageHead request;
     request.len = sizeof(request);
@@ -308,18 +568,8 @@ void CUniqId::get_label_and_seq(uint8_t* label, uint32_t* seq, uint16_t num) thr
     {
         try
         {
-            struct sockaddr_in from_addr;
-            const struct sockaddr_in& agent_addr = pick_agent();
-            int bytes = _udp_socket->send_to(&request, sizeof(request), agent_addr);
-            if (bytes != sizeof(request))
-                THROW_SYSCALL_EXCEPTION("invalid size", bytes, "send_to");
-
-            bytes = _udp_socket->timed_receive_from(&response, sizeof(response), &from_addr, _timeout_milliseconds);
-            if (bytes != sizeof(response))
-            {
-                THROW_SYSCALL_EXCEPTION("invalid size", bytes, "receive_from");
-            }
-            else if (RESPONSE_ERROR == response.type)
+            exchange(udp_socket, request, &response);
+            if (RESPONSE_ERROR == response.type)
             {
                 THROW_EXCEPTION("store sequence block error", static_cast<int>(response.value1.to_int()));
             }
@@ -494,26 +744,118 @@ void CUniqId::get_transaction_id(uint16_t num, std::vector<std::string>* id_vec,
     } // for
 }
 
-const struct sockaddr_in& CUniqId::pick_agent() const
+// 从两个候选agent中选代价小的，候选只从未被剔除的agent中选，
+// 如果全部被剔除，则选最早到期的那个去探测
+int CUniqId::pick_agent()
 {
     MOOON_ASSERT(!_agents_addr.empty());
 
     if (1 == _agents_addr.size())
     {
-        return _agents_addr[0];
+        return 0;
     }
-    else if (_polling)
+    else
     {
-        static uint32_t factor = 0;
-        register uint32_t index = factor++;
-        return _agents_addr[index % _agents_addr.size()];
+        sys::LockHelper<sys::CLock> lh(_agents_lock);
+        const uint64_t now = sys::current_milliseconds();
+        const int agents_number = static_cast<int>(_agents_addr.size());
+        std::vector<int> candidates;
+        int earliest = 0;
+
+        for (int i=0; i<agents_number; ++i)
+        {
+            if (_agents_stat[i].eject_until <= now)
+                candidates.push_back(i);
+            if (_agents_stat[i].eject_until < _agents_stat[earliest].eject_until)
+                earliest = i;
+        }
+
+        int index = earliest;
+        if (1 == candidates.size())
+        {
+            index = candidates[0];
+        }
+        else if (candidates.size() > 1)
+        {
+            // 轮询方式取相邻的两个，否则随机取两个不同的
+            const int m = static_cast<int>(candidates.size());
+            const int first = _polling? static_cast<int>(_pick_factor++ % m): rand_r(&_pick_factor) % m;
+            const int second = _polling? (first + 1) % m: (first + 1 + rand_r(&_pick_factor) % (m - 1)) % m;
+            index = candidates[first];
+            if (get_agent_cost(candidates[second]) < get_agent_cost(index))
+                index = candidates[second];
+        }
+
+        if (_agents_stat[index].eject_until > 0)
+        {
+            // 探测被剔除的agent，在结果出来之前不再选它
+            _agents_stat[index].eject_until = now + EJECT_MILLISECONDS;
+        }
+        return index;
     }
-    else
+}
+
+// 一次调用的预期代价：延迟加上失败时要付出的超时
+double CUniqId::get_agent_cost(int index) const
+{
+    const struct AgentStat& stat = _agents_stat[index];
+    return stat.latency + stat.loss * _timeout_milliseconds * 1000;
+}
+
+void CUniqId::update_agent(int index, bool ok, uint64_t microseconds)
+{
+    if (_agents_stat.size() > 1)
     {
-        static unsigned int i = 0;
-        register std::vector<struct sockaddr_in>::size_type index = sys::CUtils::get_random_number(i++, _agents_addr.size());
-        return _agents_addr[index];
+        sys::LockHelper<sys::CLock> lh(_agents_lock);
+        struct AgentStat& stat = _agents_stat[index];
+
+        if (ok)
+        {
+            stat.latency = (0 == stat.latency)? microseconds: stat.latency*(1-EWMA_ALPHA) + microseconds*EWMA_ALPHA;
+            stat.loss = stat.loss * (1-EWMA_ALPHA);
+            stat.failures = 0;
+            stat.eject_until = 0;
+        }
+        else
+        {
+            stat.loss = stat.loss*(1-EWMA_ALPHA) + EWMA_ALPHA;
+            if (++stat.failures >= EJECT_FAILURES)
+            {
+                // 探测失败时剔除更长时间，最长为EJECT_MILLISECONDS的16倍
+                const uint32_t shift = std::min<uint32_t>(stat.failures - EJECT_FAILURES, 4);
+                stat.eject_until = sys::current_milliseconds() + (static_cast<uint64_t>(EJECT_MILLISECONDS) << shift);
+            }
+        }
     }
 }
 
+// 选一个agent发送请求并等待响应，同时统计该agent的延迟和失败
+void CUniqId::exchange(net::CUdpSocket* udp_socket, const struct MessageHead& request, struct MessageHead* response) throw (utils::CException, sys::CSyscallException)
+{
+    struct sockaddr_in from_addr;
+    const int index = pick_agent();
+    const uint64_t start_microseconds = sys::CDatetimeUtils::get_current_microseconds();
+
+    try
+    {
+        int bytes = udp_socket->send_to(&request, sizeof(request), _agents_addr[index]);
+        if (bytes != sizeof(request))
+            THROW_SYSCALL_EXCEPTION("invalid size", bytes, "send_to");
+
+        bytes = udp_socket->timed_receive_from(response, sizeof(*response), &from_addr, _timeout_milliseconds);
+        if (bytes != sizeof(*response))
+            THROW_SYSCALL_EXCEPTION("invalid size", bytes, "receive_from");
+    }
+    catch (utils::CException&)
+    {
+        update_agent(index, false, 0);
+        throw;
+    }
+
+    // 出错响应（如Label过期）说明该agent暂时不能服务，也当作失败，
+    // 但老版本agent不支持的请求类型除外
+    const bool ok = (response->type != RESPONSE_ERROR) || (ERROR_INVALID_TYPE == response->value1.to_int());
+    update_agent(index, ok, sys::CDatetimeUtils::get_current_microseconds() - start_microseconds);
+}
+
 } // namespace mooon {
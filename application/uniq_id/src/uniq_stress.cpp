@@ -17,30 +17,170 @@
  * Author: eyjian@qq.com or eyjian@gmail.com
  */
 #include <mooon/uniq_id/uniq_id.h>
+#include <mooon/sys/datetime_utils.h>
 #include <mooon/sys/stop_watch.h>
 #include <mooon/sys/thread_engine.h>
+#include <mooon/utils/args_parser.h>
 #include <mooon/utils/string_utils.h>
+#include <math.h>
+#include <stdlib.h>
 #include <time.h>
 #include <vector>
 
 // UniqId压力测试工具
+//
+// 闭环模式（位置参数，见下面的Usage），每个线程收到响应后才发下一个请求，只统计总的吞吐，
+// 开环模式（--参数），按目标速率在计划的时间点发请求，不受响应快慢影响，
+// 延迟从计划的时间点开始算，这样排队的时间也计算在内（避免coordinated omission），
+// 如：uniq_stress --agents=127.0.0.1:6200 --rate=20000 --duration=10 --threads=4 --arrival=poisson --format=json
+
+// 开环模式的参数
+STRING_ARG_DEFINE(agents, "", "agent nodes, e.g., 127.0.0.1:6200,127.0.0.1:6201");
+INTEGER_ARG_DEFINE(uint32_t, rate, 1000, 1, 10000000, "target requests per second of all threads");
+INTEGER_ARG_DEFINE(uint32_t, duration, 10, 1, 86400, "seconds to run");
+INTEGER_ARG_DEFINE(uint16_t, threads, 1, 1, 1000, "number of threads, every thread has its own socket");
+STRING_ARG_DEFINE(arrival, "poisson", "arrival distribution: poisson or constant");
+STRING_ARG_DEFINE(format, "text", "output format: text or json");
+INTEGER_ARG_DEFINE(uint32_t, timeout, 200, 1, 60000, "receive timeout in milliseconds");
+INTEGER_ARG_DEFINE(uint8_t, retry, 0, 0, 10, "retry times");
+INTEGER_ARG_DEFINE(uint16_t, prefetch, 0, 0, 65535, "prefetch range, 0 to disable");
+
+// HDR风格的直方图：小于SUB_BUCKETS的值精确计数，
+// 更大的值按2的幂分段，每段再线性分成SUB_BUCKETS/2个桶，相对误差不超过2/SUB_BUCKETS
+class CLatencyHistogram
+{
+public:
+    enum
+    {
+        SUB_BUCKET_BITS = 7,
+        SUB_BUCKETS = 1 << SUB_BUCKET_BITS,
+        HALF_SUB_BUCKETS = SUB_BUCKETS / 2,
+        MAX_SHIFT = 40 // 可记录的最大值约为2^47
+    };
+
+public:
+    CLatencyHistogram()
+        : _counts(SUB_BUCKETS + MAX_SHIFT*HALF_SUB_BUCKETS, 0), _total(0), _sum(0), _min(0), _max(0)
+    {
+    }
+
+    void record(uint64_t value)
+    {
+        ++_counts[get_index(value)];
+        if ((0 == _total) || (value < _min))
+            _min = value;
+        if (value > _max)
+            _max = value;
+        _sum += value;
+        ++_total;
+    }
+
+    void merge(const CLatencyHistogram& other)
+    {
+        if (other._total > 0)
+        {
+            for (std::vector<uint64_t>::size_type i=0; i<_counts.size(); ++i)
+                _counts[i] += other._counts[i];
+            if ((0 == _total) || (other._min < _min))
+                _min = other._min;
+            if (other._max > _max)
+                _max = other._max;
+            _sum += other._sum;
+            _total += other._total;
+        }
+    }
+
+    // percentile取值0~100，返回所在桶的上界，但不超过最大值
+    uint64_t get_percentile(double percentile) const
+    {
+        const uint64_t rank = static_cast<uint64_t>(ceil(percentile * _total / 100));
+        uint64_t count = 0;
+
+        for (std::vector<uint64_t>::size_type i=0; i<_counts.size(); ++i)
+        {
+            count += _counts[i];
+            if ((count > 0) && (count >= rank))
+                return std::min(get_highest_value(i), _max);
+        }
+        return _max;
+    }
+
+    uint64_t get_total() const { return _total; }
+    uint64_t get_min() const { return _min; }
+    uint64_t get_max() const { return _max; }
+    double get_mean() const { return (0 == _total)? 0: static_cast<double>(_sum) / _total; }
+
+private:
+    static std::vector<uint64_t>::size_type get_index(uint64_t value)
+    {
+        if (value < SUB_BUCKETS)
+            return value;
+
+        // 使(value >> shift)落在[HALF_SUB_BUCKETS, SUB_BUCKETS)内
+        const int msb = 63 - __builtin_clzll(value);
+        const int shift = std::min(msb - (SUB_BUCKET_BITS-1), static_cast<int>(MAX_SHIFT));
+        const uint64_t sub = std::min<uint64_t>(value >> shift, SUB_BUCKETS-1);
+        return SUB_BUCKETS + (shift-1)*HALF_SUB_BUCKETS + (sub-HALF_SUB_BUCKETS);
+    }
+
+    static uint64_t get_highest_value(std::vector<uint64_t>::size_type index)
+    {
+        if (index < SUB_BUCKETS)
+            return index;
+
+        const uint64_t k = index - SUB_BUCKETS;
+        const int shift = static_cast<int>(k / HALF_SUB_BUCKETS) + 1;
+        const uint64_t sub = k%HALF_SUB_BUCKETS + HALF_SUB_BUCKETS;
+        return ((sub+1) << shift) - 1;
+    }
+
+private:
+    std::vector<uint64_t> _counts;
+    uint64_t _total;
+    uint64_t _sum;
+    uint64_t _min;
+    uint64_t _max;
+};
+
+// 开环模式每个线程的结果
+struct OpenLoopResult
+{
+    CLatencyHistogram histogram; // 单位为微秒
+    uint64_t errors;
+
+    OpenLoopResult()
+        : errors(0)
+    {
+    }
+};
 
 static void usage();
-static void thread_proc(uint64_t times, const char* agent_nodes, bool polling);
+static void thread_proc(uint64_t times, const char* agent_nodes, bool polling, uint16_t prefetch_range);
+static int open_loop_main(int argc, char* argv[]);
+static void open_loop_proc(uint64_t start_microseconds, double thread_rate, unsigned int seed, struct OpenLoopResult* result);
+static void print_open_loop_result(const struct OpenLoopResult& result, uint64_t elapsed_microseconds);
 
 // Usage1: uniq_stress agent_nodes
 // Usage2: uniq_stress agent_nodes times
 // Usage3: uniq_stress agent_nodes times concurrency
 // Usage4: uniq_stress agent_nodes times concurrency poll
+// Usage5: uniq_stress agent_nodes times concurrency poll prefetch_range
+// Usage6: uniq_stress --agents=agent_nodes --rate=requests_per_second ...（开环模式，--help查看所有参数）
 int main(int argc, char* argv[])
 {
-	if ((argc != 2) && (argc != 3) && (argc != 4) && (argc != 5))
+    if ((argc >= 2) && (0 == strncmp(argv[1], "--", 2)))
+    {
+        return open_loop_main(argc, argv);
+    }
+
+	if ((argc != 2) && (argc != 3) && (argc != 4) && (argc != 5) && (argc != 6))
 	{
 		usage();
 		exit(1);
 	}
 
 	bool polling = false;
+	uint16_t prefetch_range = 0; // 为0表示不开启预取模式
 	uint64_t times = 1;
 	uint64_t concurrency = 1;
 	const char* agent_nodes = argv[1];
@@ -58,9 +198,14 @@ int main(int argc, char* argv[])
     {
         polling = true;
     }
+    if (argc >= 6)
+    {
+        if (!mooon::utils::CStringUtils::string2int(argv[5], prefetch_range))
+            prefetch_range = 0;
+    }
 
     fprintf(stdout, "agent_nodes: %s\n", agent_nodes);
-    fprintf(stdout, "times: %" PRIu64", concurrency: %" PRIu64"\n", times, concurrency);
+    fprintf(stdout, "times: %" PRIu64", concurrency: %" PRIu64", prefetch_range: %d\n", times, concurrency, (int)prefetch_range);
 
     try
     {
@@ -70,7 +215,7 @@ int main(int argc, char* argv[])
         mooon::sys::CStopWatch stop_watch;
         for (i=0; i<concurrency; ++i)
         {
-            thread_engine = new mooon::sys::CThreadEngine(mooon::sys::bind(&thread_proc, times, agent_nodes, polling));
+            thread_engine = new mooon::sys::CThreadEngine(mooon::sys::bind(&thread_proc, times, agent_nodes, polling, prefetch_range));
             thread_pool[i] = thread_engine;
         }
         for (i=0; i<concurrency; ++i)
@@ -99,22 +244,39 @@ void usage()
 	fprintf(stderr, "Usage2: uniq_stress agent_nodes times\n");
 	fprintf(stderr, "Usage3: uniq_stress agent_nodes times concurrency\n");
 	fprintf(stderr, "Usage4: uniq_stress agent_nodes times concurrency poll\n");
+	fprintf(stderr, "Usage5: uniq_stress agent_nodes times concurrency poll prefetch_range\n");
+	fprintf(stderr, "Usage6: uniq_stress --agents=agent_nodes --rate=requests_per_second ... (open-loop, see --help)\n");
 }
 
-void thread_proc(uint64_t times, const char* agent_nodes, bool polling)
+void thread_proc(uint64_t times, const char* agent_nodes, bool polling, uint16_t prefetch_range)
 {
     uint32_t timeout_milliseconds = 200;
     uint8_t retry_times = 5;
 
+    // 每个线程复用同一个CUniqId，即固定的来源端口，
+    // 这样多线程的agent会由SO_REUSEPORT将各压测线程分派到不同的工作线程上
+    mooon::CUniqId* uniq_id = NULL;
+    try
+    {
+        uniq_id = new mooon::CUniqId(agent_nodes, timeout_milliseconds, retry_times, polling);
+        if (prefetch_range > 0)
+            uniq_id->enable_prefetch(prefetch_range);
+    }
+    catch (mooon::utils::CException& ex)
+    {
+        fprintf(stderr, "%s\n", ex.str().c_str());
+        delete uniq_id;
+        return;
+    }
+
     for (uint64_t i=0; i<times; ++i)
     {
         try
         {
-            mooon::CUniqId uniq_id(agent_nodes, timeout_milliseconds, retry_times, polling);
 #if 1
-            uint64_t uid = uniq_id.get_uniq_id();
+            uint64_t uid = uniq_id->get_uniq_id();
 #else
-            uint64_t uid = uniq_id.get_local_uniq_id();
+            uint64_t uid = uniq_id->get_local_uniq_id();
 #endif
             union mooon::UniqID uid_struct;
             uid_struct.value = uid;
@@ -133,4 +295,153 @@ void thread_proc(uint64_t times, const char* agent_nodes, bool polling)
             break;
         }
     }
+
+    delete uniq_id;
+}
+
+int open_loop_main(int argc, char* argv[])
+{
+    std::string errmsg;
+    if (!mooon::utils::parse_arguments(argc, argv, &errmsg))
+    {
+        fprintf(stderr, "%s\n", errmsg.c_str());
+        return 1;
+    }
+    if (mooon::argument::agents->value().empty())
+    {
+        fprintf(stderr, "parameter[agents] is empty\n");
+        return 1;
+    }
+    if ((mooon::argument::arrival->value() != "poisson") && (mooon::argument::arrival->value() != "constant"))
+    {
+        fprintf(stderr, "parameter[arrival] should be poisson or constant\n");
+        return 1;
+    }
+
+    try
+    {
+        const uint16_t threads = mooon::argument::threads->value();
+        const double thread_rate = static_cast<double>(mooon::argument::rate->value()) / threads;
+        std::vector<struct OpenLoopResult> results(threads);
+        std::vector<mooon::sys::CThreadEngine*> thread_pool(threads);
+
+        // 所有线程共用一个起始时间，稍微推后以等待线程都创建好
+        const uint64_t start_microseconds = mooon::sys::CDatetimeUtils::get_current_microseconds() + 10000;
+        for (uint16_t i=0; i<threads; ++i)
+        {
+            const unsigned int seed = static_cast<unsigned int>(start_microseconds) + i;
+            thread_pool[i] = new mooon::sys::CThreadEngine(mooon::sys::bind(&open_loop_proc, start_microseconds, thread_rate, seed, &results[i]));
+        }
+
+        struct OpenLoopResult result;
+        for (uint16_t i=0; i<threads; ++i)
+        {
+            thread_pool[i]->join();
+            delete thread_pool[i];
+            result.histogram.merge(results[i].histogram);
+            result.errors += results[i].errors;
+        }
+
+        const uint64_t end_microseconds = mooon::sys::CDatetimeUtils::get_current_microseconds();
+        print_open_loop_result(result, end_microseconds - start_microseconds);
+        return 0;
+    }
+    catch (mooon::sys::CSyscallException& ex)
+    {
+        fprintf(stderr, "%s\n", ex.str().c_str());
+        return 1;
+    }
+}
+
+// 按计划的时间点发请求：constant为等间隔，poisson为指数分布的间隔，
+// 落后于计划时立即发出，延迟从计划的时间点算起
+void open_loop_proc(uint64_t start_microseconds, double thread_rate, unsigned int seed, struct OpenLoopResult* result)
+{
+    const bool poisson = ("poisson" == mooon::argument::arrival->value());
+    const double interval = 1000000.0 / thread_rate; // 平均间隔微秒数
+    const uint64_t end_microseconds = start_microseconds + static_cast<uint64_t>(mooon::argument::duration->value()) * 1000000;
+    double scheduled = static_cast<double>(start_microseconds);
+    mooon::CUniqId* uniq_id = NULL;
+
+    try
+    {
+        uniq_id = new mooon::CUniqId(mooon::argument::agents->value(), mooon::argument::timeout->value(), mooon::argument::retry->value());
+        if (mooon::argument::prefetch->value() > 0)
+            uniq_id->enable_prefetch(mooon::argument::prefetch->value());
+    }
+    catch (mooon::utils::CException& ex)
+    {
+        fprintf(stderr, "%s\n", ex.str().c_str());
+        delete uniq_id;
+        return;
+    }
+
+    while (true)
+    {
+        const uint64_t scheduled_microseconds = static_cast<uint64_t>(scheduled);
+        if (scheduled_microseconds >= end_microseconds)
+            break;
+
+        uint64_t now = mooon::sys::CDatetimeUtils::get_current_microseconds();
+        if (now < scheduled_microseconds)
+        {
+            const uint64_t wait_microseconds = scheduled_microseconds - now;
+            struct timespec ts;
+            ts.tv_sec = static_cast<time_t>(wait_microseconds / 1000000);
+            ts.tv_nsec = static_cast<long>((wait_microseconds % 1000000) * 1000);
+            while ((-1 == nanosleep(&ts, &ts)) && (EINTR == errno));
+        }
+
+        try
+        {
+            (void)uniq_id->get_uniq_id();
+        }
+        catch (mooon::utils::CException& ex)
+        {
+            ++result->errors;
+        }
+
+        now = mooon::sys::CDatetimeUtils::get_current_microseconds();
+        result->histogram.record((now > scheduled_microseconds)? now - scheduled_microseconds: 0);
+
+        if (poisson)
+        {
+            // 取(0, 1]内的均匀随机数，避免log(0)
+            const double u = (rand_r(&seed) + 1.0) / (RAND_MAX + 1.0);
+            scheduled += -log(u) * interval;
+        }
+        else
+        {
+            scheduled += interval;
+        }
+    }
+
+    delete uniq_id;
+}
+
+void print_open_loop_result(const struct OpenLoopResult& result, uint64_t elapsed_microseconds)
+{
+    const CLatencyHistogram& histogram = result.histogram;
+    const double achieved_rate = (0 == elapsed_microseconds)? 0: histogram.get_total() * 1000000.0 / elapsed_microseconds;
+
+    if ("json" == mooon::argument::format->value())
+    {
+        // 单行JSON，方便脚本收集并比较不同版本的结果
+        fprintf(stdout, "{\"mode\":\"open-loop\",\"arrival\":\"%s\",\"threads\":%d,\"target_rate\":%u,\"achieved_rate\":%.2f,"
+                        "\"duration_seconds\":%.3f,\"requests\":%" PRIu64",\"errors\":%" PRIu64","
+                        "\"latency_us\":{\"min\":%" PRIu64",\"mean\":%.2f,\"p50\":%" PRIu64",\"p90\":%" PRIu64",\"p99\":%" PRIu64",\"p999\":%" PRIu64",\"max\":%" PRIu64"}}\n",
+                mooon::argument::arrival->c_value(), (int)mooon::argument::threads->value(), mooon::argument::rate->value(), achieved_rate,
+                elapsed_microseconds / 1000000.0, histogram.get_total(), result.errors,
+                histogram.get_min(), histogram.get_mean(), histogram.get_percentile(50), histogram.get_percentile(90),
+                histogram.get_percentile(99), histogram.get_percentile(99.9), histogram.get_max());
+    }
+    else
+    {
+        fprintf(stdout, "arrival: %s, threads: %d, target: %u/s, achieved: %.2f/s, requests: %" PRIu64", errors: %" PRIu64"\n",
+                mooon::argument::arrival->c_value(), (int)mooon::argument::threads->value(), mooon::argument::rate->value(), achieved_rate,
+                histogram.get_total(), result.errors);
+        fprintf(stdout, "latency(us): min=%" PRIu64", mean=%.2f, p50=%" PRIu64", p90=%" PRIu64", p99=%" PRIu64", p999=%" PRIu64", max=%" PRIu64"\n",
+                histogram.get_min(), histogram.get_mean(), histogram.get_percentile(50), histogram.get_percentile(90),
+                histogram.get_percentile(99), histogram.get_percentile(99.9), histogram.get_max());
+    }
 }
@@ -42,6 +42,16 @@ public:
     virtual size_t get_data_size() const = 0;
 };
 
+/***
+  * 上报统计，各计数从agent创建时开始累计
+  */
+typedef struct TReportStats
+{
+    uint32_t spilled;  /** 存入磁盘溢出队列的上报数 */
+    uint32_t replayed; /** 从磁盘溢出队列中取出发送的上报数 */
+    uint32_t dropped;  /** 因队列满而丢弃的上报数 */
+}report_stats_t;
+
 class IAgent
 {
 public:
@@ -60,6 +70,9 @@ public:
     virtual bool report(const char* data, size_t data_size, uint32_t timeout_millisecond=0) = 0;
     virtual bool report(uint32_t timeout_millisecond, const char* format, ...) = 0;
 
+    /** 取得上报统计 */
+    virtual void get_report_stats(TReportStats* stats) const = 0;
+
     virtual bool register_command_processor(ICommandProcessor* processor) = 0;
     virtual void deregister_command_processor(ICommandProcessor* processor) = 0;
 };
@@ -72,6 +85,19 @@ extern sys::ILogger* logger;
 
 typedef struct TAgentInfo
 {
+    TAgentInfo()
+     :queue_size(1000)
+     ,connect_timeout_milliseconds(2000)
+     ,heartbeat_hook(NULL)
+     ,batch_bytes(0)
+     ,batch_milliseconds(10)
+     ,compress_algorithm(compress_none)
+     ,spill_bytes(0)
+     ,spill_threshold(0)
+     ,replay_rate(0)
+    {
+    }
+
     /***
       * 上报队列大小，如果队列满，会导致消息丢失或report调用阻塞
       */
@@ -89,6 +115,48 @@ typedef struct TAgentInfo
       * 在destroy时，会自动将它删除
       */
     IHeartbeatHook* heartbeat_hook;
+
+    /***
+      * 批量上报的最大字节数，为0表示不合并，每条上报单独发送，
+      * 否则多条上报合并成一个U_BATCH_REPORT_MESSAGE消息发送，要求center支持解码
+      */
+    uint32_t batch_bytes;
+
+    /***
+      * 批量上报的最长等待毫秒数，
+      * 第一条上报进入批量后，最迟这么长时间后即使未攒满batch_bytes也会发出
+      */
+    uint32_t batch_milliseconds;
+
+    /***
+      * 批量上报的压缩算法，仅在batch_bytes不为0时有效，
+      * 压缩后不比原数据小时，会自动以不压缩方式发送
+      */
+    compress_algorithm_t compress_algorithm;
+
+    /***
+      * 磁盘溢出文件，在center不可用等情况下暂存上报，
+      * 为空或spill_bytes为0表示不使用，这时队列满后的上报会被丢弃，
+      * 进程重启后，文件中未发送的上报仍会被发送
+      */
+    std::string spill_filename;
+
+    /***
+      * 磁盘溢出文件的大小（不含一页的文件头），溢出文件满后的上报会被丢弃
+      */
+    uint32_t spill_bytes;
+
+    /***
+      * 上报队列中的消息数达到这个值后，新的上报存入磁盘溢出文件，
+      * 为0时取queue_size，只要溢出文件不为空，新的上报都存入它以保证顺序
+      */
+    uint32_t spill_threshold;
+
+    /***
+      * 每秒最多从磁盘溢出文件取出发送的上报数，为0表示不限制，
+      * 用来避免连接恢复后积压的上报冲击center
+      */
+    uint32_t replay_rate;
 }agent_info_t;
 
 /***
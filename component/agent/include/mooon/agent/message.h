@@ -21,6 +21,17 @@
 #include <mooon/agent/message_command.h>
 #include <mooon/net/inttypes.h>
 AGENT_NAMESPACE_BEGIN
+
+/***
+  * 批量上报的压缩算法
+  */
+typedef enum TCompressAlgorithm
+{
+    compress_none = 0, /** 不压缩 */
+    compress_zlib = 1, /** zlib，总是可用 */
+    compress_lz4  = 2  /** LZ4，需要编译时支持（MOOON_HAVE_LZ4），否则退回zlib */
+}compress_algorithm_t;
+
 #pragma pack(4) // 网络消息按4字节对齐
 
 /***
@@ -41,6 +52,29 @@ typedef struct TReportMessage
     char data[0]; /** 需要上报的内容 */
 }report_message_t;
 
+/***
+  * 批量上报头，紧跟在TCommonMessageHeader之后
+  */
+typedef struct TBatchReportHeader
+{
+    nuint8_t compress_algorithm; /** compress_algorithm_t，为compress_none时data未压缩 */
+    nuint8_t reserved;
+    nuint16_t count;             /** 包含的上报条数 */
+    nuint32_t raw_size;          /** data解压后的字节数 */
+    char data[0];
+}batch_report_header_t;
+
+/***
+  * 批量上报消息
+  * data解压后为count个连续的条目，每个条目为：nuint32_t长度 + 上报内容，
+  * 中心端可使用CReportDecoder解码
+  */
+typedef struct TBatchReportMessage
+{
+    net::TCommonMessageHeader header;
+    TBatchReportHeader batch_header;
+}batch_report_message_t;
+
 #pragma pack()
 AGENT_NAMESPACE_END
 #endif // MOOON_AGENT_MESSAGE_H
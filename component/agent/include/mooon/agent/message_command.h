@@ -31,7 +31,8 @@ AGENT_NAMESPACE_BEGIN
 typedef enum TUplinkMessageCommand
 {
     U_SIMPLE_HEARTBEAT_MESSAGE = 1, /** 简单心跳消息 */
-    U_REPORT_MESSAGE           = 2  /** 上报消息 */
+    U_REPORT_MESSAGE           = 2, /** 上报消息 */
+    U_BATCH_REPORT_MESSAGE     = 3  /** 批量上报消息，由多条上报合并而成，可能被压缩 */
 }uplink_message_command_t;
 
 /***
@@ -0,0 +1,79 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Author: eyjian@qq.com or eyjian@gmail.com
+ */
+#ifndef MOOON_AGENT_REPORT_DECODER_H
+#define MOOON_AGENT_REPORT_DECODER_H
+#include <mooon/agent/message.h>
+#include <string>
+AGENT_NAMESPACE_BEGIN
+
+/***
+  * 批量上报消息解码器，供center端使用
+  * 用法：
+  * CReportDecoder decoder;
+  * if (decoder.decode(body, body_size))
+  * {
+  *     const char* data;
+  *     size_t data_size;
+  *     while (decoder.next(&data, &data_size))
+  *     {
+  *         // 处理一条上报
+  *     }
+  * }
+  *
+  * 解码器可重复使用，以复用解压缓冲区
+  */
+class CReportDecoder
+{
+public:
+    /***
+      * @max_raw_size: 解压后允许的最大字节数，超过的消息被拒绝，
+      *  以免按消息中的raw_size分配过大的解压缓冲区
+      */
+    CReportDecoder(size_t max_raw_size=64*1024*1024);
+
+    /***
+      * 解码一个U_BATCH_REPORT_MESSAGE消息的消息体
+      * @body: 消息体，即紧跟在TCommonMessageHeader之后的内容
+      * @body_size: 消息体字节数，即header.size
+      * @return: 如果消息格式不正确（包括条目数和count不一致），或不支持消息所用的压缩算法，返回false
+      */
+    bool decode(const char* body, size_t body_size);
+
+    /***
+      * 取下一条上报，返回的data指向解码器内部或body，在下一次decode之前有效
+      * @return: 如果已没有更多上报，返回false
+      */
+    bool next(const char** data, size_t* data_size);
+
+    /** 得到最近一次decode的上报条数 */
+    uint16_t get_count() const { return _count; }
+
+private:
+    bool check_items() const;
+
+private:
+    const size_t _max_raw_size;
+    std::string _buffer;  // 解压缓冲区
+    const char* _cursor;
+    const char* _end;
+    uint16_t _count;
+};
+
+AGENT_NAMESPACE_END
+#endif // MOOON_AGENT_REPORT_DECODER_H
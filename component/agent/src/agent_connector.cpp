@@ -22,8 +22,9 @@
 #include "agent_thread.h"
 AGENT_NAMESPACE_BEGIN
 
-CAgentConnector::CAgentConnector(CAgentThread* thread)
+CAgentConnector::CAgentConnector(CAgentThread* thread, const TAgentInfo& agent_info)
  :_thread(thread)
+ ,_report_batch(agent_info.batch_bytes, agent_info.batch_milliseconds, agent_info.compress_algorithm)
  ,_send_machine(this)
  ,_recv_machine(thread->get_processor_manager())
 {
@@ -69,9 +70,10 @@ net::epoll_event_t CAgentConnector::handle_error(void* input_ptr, void* ouput_pt
 
 net::epoll_event_t CAgentConnector::handle_input(void* input_ptr, void* ouput_ptr)
 {
-    char recv_buffer[1024];
+    size_t buffer_size = 0;
+    char* recv_buffer = _recv_machine.get_buffer(&buffer_size);
     
-    ssize_t bytes_recved = receive(recv_buffer, sizeof(recv_buffer));
+    ssize_t bytes_recved = receive(recv_buffer, buffer_size);
     if (0 == bytes_recved)
     {
     	AGENT_LOG_DEBUG("%s closed.\n", to_string().c_str());
@@ -84,7 +86,7 @@ net::epoll_event_t CAgentConnector::handle_input(void* input_ptr, void* ouput_pt
         return net::epoll_none;
     }
     
-    return utils::handle_error == _recv_machine.work(recv_buffer, bytes_recved)
+    return utils::handle_error == _recv_machine.work(bytes_recved)
          ? net::epoll_close
          : net::epoll_none;
 }
@@ -106,7 +108,7 @@ net::epoll_event_t CAgentConnector::handle_output(void* input_ptr, void* ouput_p
 
         while (true)
         {
-            const net::TCommonMessageHeader* agent_message = _thread->get_message();
+            const net::TCommonMessageHeader* agent_message = next_message();
             if (NULL == agent_message)
             {
                 // 需要将CReportQueue再次放入Epoller中监控
@@ -143,4 +145,51 @@ net::epoll_event_t CAgentConnector::handle_output(void* input_ptr, void* ouput_p
     }
 }
 
+// 取下一个需要发送的消息，启用批量上报时，上报消息会被合并，
+// 直到批量攒满，或队列已空且批量到期
+const net::TCommonMessageHeader* CAgentConnector::next_message()
+{
+    while (true)
+    {
+        const net::TCommonMessageHeader* agent_message = _thread->get_message();
+        if (NULL == agent_message)
+        {
+            // 未到期的批量留待更多上报或CAgentThread的定时触发
+            if (!_report_batch.is_empty() 
+             && (0 == _report_batch.get_remaining_milliseconds()))
+            {
+                return _report_batch.pack();
+            }
+
+            return NULL;
+        }
+        if (!_report_batch.is_enabled() 
+         || (agent_message->command != U_REPORT_MESSAGE))
+        {
+            // 心跳等其它消息不参与合并
+            return agent_message;
+        }
+
+        const net::TCommonMessageHeader* batch_message = NULL;
+        const report_message_t* report_message = reinterpret_cast<const report_message_t*>(agent_message);
+        if (!_report_batch.is_empty() 
+         && _report_batch.is_overflow(agent_message->size))
+        {
+            batch_message = _report_batch.pack();
+        }
+
+        _report_batch.add(report_message->data, agent_message->size);
+        delete [](char*)agent_message;
+
+        if (batch_message != NULL)
+        {
+            return batch_message;
+        }
+        if (_report_batch.is_full())
+        {
+            return _report_batch.pack();
+        }
+    }
+}
+
 AGENT_NAMESPACE_END
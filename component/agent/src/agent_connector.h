@@ -20,17 +20,27 @@
 #define MOOON_AGENT_CONNECTOR_H
 #include <mooon/agent/message.h>
 #include <mooon/net/tcp_client.h>
-#include <mooon/net/recv_machine.h>
+#include <mooon/net/buffer_recv_machine.h>
 #include <mooon/net/send_machine.h>
 #include "agent_log.h"
 #include "processor_manager.h"
+#include "report_batch.h"
 AGENT_NAMESPACE_BEGIN
 
 class CAgentThread;
 class CAgentConnector: public net::CTcpClient
 {
 public:
-    CAgentConnector(CAgentThread* thread);
+    CAgentConnector(CAgentThread* thread, const TAgentInfo& agent_info);
+
+    /***
+      * 得到批量上报距离必须发出还剩下的毫秒数，
+      * 没有待发的批量上报时返回UINT32_MAX
+      */
+    uint32_t get_batch_remaining_milliseconds() const
+    {
+        return _report_batch.get_remaining_milliseconds();
+    }
         
 private:
     virtual void before_close();
@@ -40,11 +50,13 @@ private:
     net::epoll_event_t handle_error(void* input_ptr, void* ouput_ptr);
     net::epoll_event_t handle_input(void* input_ptr, void* ouput_ptr);
     net::epoll_event_t handle_output(void* input_ptr, void* ouput_ptr);    
+    const net::TCommonMessageHeader* next_message();
     
 private:
     CAgentThread* _thread;        
+    CReportBatch _report_batch;
     net::CSendMachine<CAgentConnector> _send_machine;        
-    net::CRecvMachine<net::TCommonMessageHeader, CProcessorManager> _recv_machine;
+    net::CBufferRecvMachine<net::TCommonMessageHeader, CProcessorManager> _recv_machine;
 };
 
 AGENT_NAMESPACE_END
@@ -112,6 +112,11 @@ bool CAgentContext::report(uint32_t timeout_millisecond, const char* format, ...
 	return report(data, data_bytes, timeout_millisecond);
 }
 
+void CAgentContext::get_report_stats(TReportStats* stats) const
+{
+    _agent_thread->get_report_stats(stats);
+}
+
 bool CAgentContext::register_command_processor(ICommandProcessor* processor)
 {
     return _agent_thread->register_command_processor(processor);
@@ -18,15 +18,25 @@
  */
 #include "agent_thread.h"
 #include <algorithm>
+#include <mooon/sys/datetime_utils.h>
 #include <mooon/utils/tokener.h>
 #include "agent_context.h"
 AGENT_NAMESPACE_BEGIN
 
 CAgentThread::CAgentThread(CAgentContext* context)
  :_context(context)
- ,_connector(this)
+ ,_connector(this, context->get_agent_info())
  ,_report_queue(context->get_agent_info().queue_size + 1, this)
+ ,_replay_tokens(0)
+ ,_replay_milliseconds(0)
 {
+    const TAgentInfo& agent_info = context->get_agent_info();
+    _spill_threshold = (0 == agent_info.spill_threshold)
+                     ? agent_info.queue_size
+                     : std::min(agent_info.spill_threshold, agent_info.queue_size);
+    atomic_set(&_spilled, 0);
+    atomic_set(&_replayed, 0);
+    atomic_set(&_dropped, 0);
     _connector.set_connect_timeout_milliseconds(
             context->get_agent_info().connect_timeout_milliseconds);
 }
@@ -38,16 +48,73 @@ CAgentThread::~CAgentThread()
 
 bool CAgentThread::put_message(const net::TCommonMessageHeader* header, uint32_t timeout_millisecond)
 {
+    if (_spill_queue.is_enabled() && (U_REPORT_MESSAGE == header->command))
+    {
+        const report_message_t* report_message = reinterpret_cast<const report_message_t*>(header);
+        uint64_t deadline = sys::current_milliseconds() + timeout_millisecond;
+
+        while (true)
+        {
+            {
+                // 溢出队列是否为空的判断和存入在同一个锁内，
+                // 以免别的上报在溢出后越过它进入内存队列，保证顺序
+                sys::LockHelper<sys::CLock> lh(_queue_lock);
+                if (_spill_queue.is_empty()
+                 && (_report_queue.size() < _spill_threshold)
+                 && _report_queue.push_back(const_cast<net::TCommonMessageHeader*>(header), 0))
+                {
+                    return true;
+                }
+                if (_spill_queue.push_back(report_message->data, header->size))
+                {
+                    atomic_inc(&_spilled);
+                    delete [](char*)header;
+                    return true;
+                }
+            }
+
+            // 溢出队列也满时，在锁外等待它被取出，和内存队列一样最多等待timeout_millisecond毫秒
+            uint64_t now = sys::current_milliseconds();
+            if ((now >= deadline) || !_spill_queue.wait_space(header->size, static_cast<uint32_t>(deadline - now)))
+            {
+                atomic_inc(&_dropped);
+                return false;
+            }
+        }
+    }
+
     sys::LockHelper<sys::CLock> lh(_queue_lock);
-    return _report_queue.push_back(const_cast<net::TCommonMessageHeader*>(header), timeout_millisecond);
+    if (_report_queue.push_back(const_cast<net::TCommonMessageHeader*>(header), timeout_millisecond))
+    {
+        return true;
+    }
+
+    atomic_inc(&_dropped);
+    return false;
 }
 
 const net::TCommonMessageHeader* CAgentThread::get_message()
 {
     net::TCommonMessageHeader* agent_message = NULL;
-    sys::LockHelper<sys::CLock> lh(_queue_lock);
     
-    _report_queue.pop_front(agent_message);
+    {
+        sys::LockHelper<sys::CLock> lh(_queue_lock);
+        _report_queue.pop_front(agent_message);
+    }
+    
+    // 内存队列中的上报总是比溢出队列中的早
+    if ((NULL == agent_message) 
+     && _spill_queue.is_enabled() 
+     && !_spill_queue.is_empty()
+     && acquire_replay_token())
+    {
+        agent_message = _spill_queue.pop_front();
+        if (agent_message != NULL)
+        {
+            atomic_inc(&_replayed);
+        }
+    }
+    
     return agent_message;
 }
 
@@ -82,6 +149,13 @@ void CAgentThread::set_center(const std::string& domainname_or_iplist, uint16_t
     _center_event.signal();
 }
 
+void CAgentThread::get_report_stats(TReportStats* stats) const
+{
+    stats->spilled = atomic_read(&_spilled);
+    stats->replayed = atomic_read(&_replayed);
+    stats->dropped = atomic_read(&_dropped);
+}
+
 void CAgentThread::run()
 {
     AGENT_LOG_INFO("Agent thread ID is %u.\n", get_thread_id());
@@ -103,8 +177,19 @@ void CAgentThread::run()
                 break;
             }
                         
-            int num = _epoller.timed_wait(_connector.get_connect_timeout_milliseconds());
-            if (0 == num)
+            // 有未发出的批量上报或待取出的溢出上报时，需要在它们到期时醒来将它们发出，
+            // 至少等1毫秒，以免连接不可写时空转
+            uint32_t wait_milliseconds = _connector.get_connect_timeout_milliseconds();
+            uint32_t wake_milliseconds = std::max<uint32_t>(1, std::min(
+                    _connector.get_batch_remaining_milliseconds(), get_replay_wait_milliseconds()));
+            bool timer_wait = wake_milliseconds < wait_milliseconds;
+            
+            int num = _epoller.timed_wait(timer_wait? wake_milliseconds: wait_milliseconds);
+            if ((0 == num) && timer_wait)
+            {
+                enable_connector_write();
+            }
+            else if (0 == num)
             {
                 // timeout to send heartbeat
                 AGENT_LOG_DEBUG("Agent timeout to send heartbeat.\n");
@@ -149,11 +234,18 @@ void CAgentThread::run()
     }
     
     _epoller.destroy();
+    _spill_queue.destroy();
     AGENT_LOG_INFO("Agent thread[%u] exited.\n", get_thread_id());
 }
 
 void CAgentThread::before_start() throw (utils::CException, sys::CSyscallException)
 {
+    const TAgentInfo& agent_info = _context->get_agent_info();
+    if (!agent_info.spill_filename.empty() && (agent_info.spill_bytes > 0))
+    {
+        _spill_queue.create(agent_info.spill_filename, agent_info.spill_bytes);
+    }
+
     _epoller.create(1024);
     enable_queue_read();
 }
@@ -356,4 +448,50 @@ std::string CAgentThread::wait_domainname_or_iplist_ready(uint16_t* port)
     return domainname_or_iplist;
 }
 
+// 令牌桶限速，最多积攒1秒的令牌
+bool CAgentThread::acquire_replay_token()
+{
+    const uint32_t replay_rate = _context->get_agent_info().replay_rate;
+    if (0 == replay_rate)
+    {
+        return true;
+    }
+
+    uint64_t now = sys::current_milliseconds();
+    if (0 == _replay_milliseconds)
+    {
+        _replay_tokens = 1000;
+    }
+    else if (now > _replay_milliseconds)
+    {
+        _replay_tokens = std::min<uint64_t>(_replay_tokens + (now - _replay_milliseconds) * replay_rate
+                                          , static_cast<uint64_t>(replay_rate) * 1000);
+    }
+
+    _replay_milliseconds = now;
+    if (_replay_tokens < 1000)
+    {
+        return false;
+    }
+
+    _replay_tokens -= 1000;
+    return true;
+}
+
+// 得到距离可以从溢出队列取下一条上报的毫秒数，溢出队列为空时返回UINT32_MAX
+uint32_t CAgentThread::get_replay_wait_milliseconds()
+{
+    const uint32_t replay_rate = _context->get_agent_info().replay_rate;
+    if (!_spill_queue.is_enabled() || _spill_queue.is_empty())
+    {
+        return UINT32_MAX;
+    }
+    if ((0 == replay_rate) || (_replay_tokens >= 1000))
+    {
+        return 0;
+    }
+
+    return static_cast<uint32_t>((1000 - _replay_tokens + replay_rate - 1) / replay_rate);
+}
+
 AGENT_NAMESPACE_END
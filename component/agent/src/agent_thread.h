@@ -20,6 +20,7 @@
 #define MOOON_AGENT_THREAD_H
 #include <list>
 #include <mooon/net/epoller.h>
+#include <mooon/sys/atomic.h>
 #include <mooon/sys/lock.h>
 #include <mooon/sys/thread.h>
 #include <mooon/agent/agent.h>
@@ -27,6 +28,7 @@
 #include "center_host.h"
 #include "processor_manager.h"
 #include "report_queue.h"
+#include "spill_queue.h"
 AGENT_NAMESPACE_BEGIN
 
 class CAgentContext;
@@ -43,6 +45,7 @@ public:
     bool register_command_processor(ICommandProcessor* processor);
     void deregister_command_processor(ICommandProcessor* processor);
     void set_center(const std::string& domainname_or_iplist, uint16_t port);
+    void get_report_stats(TReportStats* stats) const;
     
     CProcessorManager* get_processor_manager()
     {
@@ -62,6 +65,8 @@ private:
     void send_heartbeat();
     bool connect_center();
     std::string wait_domainname_or_iplist_ready(uint16_t* port);
+    bool acquire_replay_token();
+    uint32_t get_replay_wait_milliseconds();
 
 private:
     TAgentInfo _agent_info;
@@ -71,6 +76,15 @@ private:
     CAgentConnector _connector;
     CReportQueue _report_queue;
     CProcessorManager _processor_manager;
+
+private: // 磁盘溢出
+    CSpillQueue _spill_queue;
+    uint32_t _spill_threshold;
+    uint64_t _replay_tokens;       // 以千分之一条为单位的令牌数
+    uint64_t _replay_milliseconds; // 上一次补充令牌的时间
+    atomic_t _spilled;
+    atomic_t _replayed;
+    atomic_t _dropped;
     
 private:
     sys::CEvent _center_event;
@@ -17,6 +17,7 @@
  * Author: eyjian@qq.com or eyjian@gmail.com
  */
 #include <mooon/agent/message.h>
+#include <mooon/agent/report_decoder.h>
 #include <mooon/server/server.h>
 #include <mooon/net/recv_machine.h>
 #include <mooon/sys/main_template.h>
@@ -87,9 +88,30 @@ private:
                           , char** response_buffer
                           , size_t* response_size)
     {
-        fprintf(stdout, "command=%u, total size=%u: %s\n"
-              , request_header.command.to_int(), request_header.size.to_int()
-              , request_body);
+        if (U_BATCH_REPORT_MESSAGE == request_header.command.to_int())
+        {
+            const char* data;
+            size_t data_size;
+
+            if (!_report_decoder.decode(request_body, request_header.size.to_int()))
+            {
+                delete []request_body;
+                return false;
+            }
+            fprintf(stdout, "command=%u, total size=%u, reports=%u\n"
+                  , request_header.command.to_int(), request_header.size.to_int()
+                  , _report_decoder.get_count());
+            while (_report_decoder.next(&data, &data_size))
+            {
+                fprintf(stdout, "\t%.*s\n", (int)data_size, data);
+            }
+        }
+        else
+        {
+            fprintf(stdout, "command=%u, total size=%u: %s\n"
+                  , request_header.command.to_int(), request_header.size.to_int()
+                  , request_body);
+        }
         delete []request_body; // 别忘记了
 
         *response_size = sizeof("mooon") + sizeof(net::TCommonMessageHeader);
@@ -105,6 +127,7 @@ private:
 
 private:
     server::IConnection* _connection;
+    CReportDecoder _report_decoder;
 };
 
 #else
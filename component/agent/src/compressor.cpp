@@ -0,0 +1,128 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Author: eyjian@qq.com or eyjian@gmail.com
+ */
+#include "compressor.h"
+#include <zlib.h>
+#if MOOON_HAVE_LZ4==1
+#include <lz4.h>
+#endif // MOOON_HAVE_LZ4
+AGENT_NAMESPACE_BEGIN
+
+bool is_compress_supported(compress_algorithm_t algorithm)
+{
+    switch (algorithm)
+    {
+    case compress_none:
+    case compress_zlib:
+        return true;
+#if MOOON_HAVE_LZ4==1
+    case compress_lz4:
+        return true;
+#endif // MOOON_HAVE_LZ4
+    default:
+        return false;
+    }
+}
+
+size_t compress_bound(compress_algorithm_t algorithm, size_t size)
+{
+    switch (algorithm)
+    {
+    case compress_zlib:
+        return compressBound(size);
+#if MOOON_HAVE_LZ4==1
+    case compress_lz4:
+        return LZ4_compressBound(static_cast<int>(size));
+#endif // MOOON_HAVE_LZ4
+    default:
+        return size;
+    }
+}
+
+size_t uncompress_bound(compress_algorithm_t algorithm, size_t size)
+{
+    switch (algorithm)
+    {
+    case compress_zlib:
+        return size * 1032; // deflate的最大压缩比为1032:1
+#if MOOON_HAVE_LZ4==1
+    case compress_lz4:
+        return size * 255; // LZ4的最大压缩比接近255:1
+#endif // MOOON_HAVE_LZ4
+    default:
+        return size;
+    }
+}
+
+bool compress_data(compress_algorithm_t algorithm, const char* src, size_t src_size, char* dst, size_t* dst_size)
+{
+    switch (algorithm)
+    {
+    case compress_zlib:
+    {
+        // 上报对时延敏感，取最快的压缩级别
+        uLongf dst_len = *dst_size;
+        if (compress2(reinterpret_cast<Bytef*>(dst), &dst_len
+                    , reinterpret_cast<const Bytef*>(src), src_size, Z_BEST_SPEED) != Z_OK)
+            return false;
+
+        *dst_size = dst_len;
+        return true;
+    }
+#if MOOON_HAVE_LZ4==1
+    case compress_lz4:
+    {
+        int dst_len = LZ4_compress_default(src, dst, static_cast<int>(src_size), static_cast<int>(*dst_size));
+        if (dst_len <= 0)
+            return false;
+
+        *dst_size = dst_len;
+        return true;
+    }
+#endif // MOOON_HAVE_LZ4
+    default:
+        return false;
+    }
+}
+
+bool uncompress_data(compress_algorithm_t algorithm, const char* src, size_t src_size, char* dst, size_t raw_size)
+{
+    switch (algorithm)
+    {
+    case compress_zlib:
+    {
+        uLongf dst_len = raw_size;
+        if (uncompress(reinterpret_cast<Bytef*>(dst), &dst_len
+                     , reinterpret_cast<const Bytef*>(src), src_size) != Z_OK)
+            return false;
+
+        return dst_len == raw_size;
+    }
+#if MOOON_HAVE_LZ4==1
+    case compress_lz4:
+    {
+        int dst_len = LZ4_decompress_safe(src, dst, static_cast<int>(src_size), static_cast<int>(raw_size));
+        return (dst_len >= 0) && (static_cast<size_t>(dst_len) == raw_size);
+    }
+#endif // MOOON_HAVE_LZ4
+    default:
+        return false;
+    }
+}
+
+AGENT_NAMESPACE_END
@@ -0,0 +1,50 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Author: eyjian@qq.com or eyjian@gmail.com
+ */
+#ifndef MOOON_AGENT_COMPRESSOR_H
+#define MOOON_AGENT_COMPRESSOR_H
+#include <mooon/agent/message.h>
+AGENT_NAMESPACE_BEGIN
+
+/** 当前编译是否支持指定的压缩算法 */
+extern bool is_compress_supported(compress_algorithm_t algorithm);
+
+/** 得到压缩size字节数据所需的最大缓冲区字节数 */
+extern size_t compress_bound(compress_algorithm_t algorithm, size_t size);
+
+/***
+  * 得到size字节压缩数据解压后最多的字节数，
+  * 用于在解压前拒绝不可能的raw_size，以免按伪造的raw_size分配巨大的内存
+  */
+extern size_t uncompress_bound(compress_algorithm_t algorithm, size_t size);
+
+/***
+  * 压缩数据
+  * @dst_size: 输入为dst的容量，输出为压缩后的字节数
+  * @return: 出错或dst容量不够时返回false
+  */
+extern bool compress_data(compress_algorithm_t algorithm, const char* src, size_t src_size, char* dst, size_t* dst_size);
+
+/***
+  * 解压数据，dst的容量必须为raw_size
+  * @return: 出错或解压后的字节数不等于raw_size时返回false
+  */
+extern bool uncompress_data(compress_algorithm_t algorithm, const char* src, size_t src_size, char* dst, size_t raw_size);
+
+AGENT_NAMESPACE_END
+#endif // MOOON_AGENT_COMPRESSOR_H
@@ -0,0 +1,116 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Author: eyjian@qq.com or eyjian@gmail.com
+ */
+#include "report_batch.h"
+#include <mooon/sys/datetime_utils.h>
+#include "agent_log.h"
+#include "compressor.h"
+AGENT_NAMESPACE_BEGIN
+
+// 太小的批量压缩收益不大，直接发送
+#define COMPRESS_MIN_BYTES 256
+
+CReportBatch::CReportBatch(uint32_t batch_bytes, uint32_t batch_milliseconds, compress_algorithm_t compress_algorithm)
+ :_batch_bytes(batch_bytes)
+ ,_batch_milliseconds(batch_milliseconds)
+ ,_compress_algorithm(compress_algorithm)
+ ,_count(0)
+ ,_first_milliseconds(0)
+{
+    if (!is_compress_supported(_compress_algorithm))
+    {
+        AGENT_LOG_WARN("Compress algorithm[%d] not supported, use zlib instead.\n", _compress_algorithm);
+        _compress_algorithm = compress_zlib;
+    }
+    if (_batch_bytes > 0)
+    {
+        _buffer.reserve(_batch_bytes + REPORT_MAX + sizeof(nuint32_t));
+    }
+}
+
+bool CReportBatch::is_full() const
+{
+    return (_buffer.size() >= _batch_bytes) || (UINT16_MAX == _count);
+}
+
+bool CReportBatch::is_overflow(size_t data_size) const
+{
+    return _buffer.size() + sizeof(nuint32_t) + data_size > _batch_bytes;
+}
+
+void CReportBatch::add(const char* data, size_t data_size)
+{
+    nuint32_t item_size;
+
+    item_size = static_cast<uint32_t>(data_size);
+
+    if (0 == _count)
+        _first_milliseconds = sys::current_milliseconds();
+    _buffer.append(reinterpret_cast<const char*>(&item_size), sizeof(item_size));
+    _buffer.append(data, data_size);
+    ++_count;
+}
+
+uint32_t CReportBatch::get_remaining_milliseconds() const
+{
+    if (is_empty())
+        return UINT32_MAX;
+
+    uint64_t elapsed_milliseconds = sys::current_milliseconds() - _first_milliseconds;
+    return elapsed_milliseconds >= _batch_milliseconds
+         ? 0
+         : static_cast<uint32_t>(_batch_milliseconds - elapsed_milliseconds);
+}
+
+net::TCommonMessageHeader* CReportBatch::pack()
+{
+    bool compress = (_compress_algorithm != compress_none) && (_buffer.size() >= COMPRESS_MIN_BYTES);
+    size_t data_capacity = compress
+                         ? compress_bound(_compress_algorithm, _buffer.size())
+                         : _buffer.size();
+    char* message_buffer = new char[sizeof(TBatchReportMessage) + data_capacity];
+    TBatchReportMessage* batch_message = reinterpret_cast<TBatchReportMessage*>(message_buffer);
+    size_t data_size = data_capacity;
+
+    // 压缩失败或压缩后不比原数据小时，以不压缩方式发送
+    if (compress
+     && compress_data(_compress_algorithm, _buffer.data(), _buffer.size(), batch_message->batch_header.data, &data_size)
+     && (data_size < _buffer.size()))
+    {
+        batch_message->batch_header.compress_algorithm = static_cast<uint8_t>(_compress_algorithm);
+    }
+    else
+    {
+        data_size = _buffer.size();
+        batch_message->batch_header.compress_algorithm = static_cast<uint8_t>(compress_none);
+        memcpy(batch_message->batch_header.data, _buffer.data(), data_size);
+    }
+
+    batch_message->header.size = sizeof(TBatchReportHeader) + data_size;
+    batch_message->header.command = U_BATCH_REPORT_MESSAGE;
+    batch_message->batch_header.reserved = 0;
+    batch_message->batch_header.count = _count;
+    batch_message->batch_header.raw_size = static_cast<uint32_t>(_buffer.size());
+    AGENT_LOG_DEBUG("Packed %u reports, %zu bytes to %zu bytes.\n", _count, _buffer.size(), data_size);
+
+    _count = 0;
+    _buffer.clear();
+    return &batch_message->header;
+}
+
+AGENT_NAMESPACE_END
@@ -0,0 +1,67 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Author: eyjian@qq.com or eyjian@gmail.com
+ */
+#ifndef MOOON_AGENT_REPORT_BATCH_H
+#define MOOON_AGENT_REPORT_BATCH_H
+#include <mooon/agent/message.h>
+#include <string>
+AGENT_NAMESPACE_BEGIN
+
+/***
+  * 批量上报，将多条小的上报合并成一个TBatchReportMessage，
+  * 攒够batch_bytes字节或第一条加入后超过batch_milliseconds毫秒即应发出
+  * 非线程安全，只被agent线程使用
+  */
+class CReportBatch
+{
+public:
+    CReportBatch(uint32_t batch_bytes, uint32_t batch_milliseconds, compress_algorithm_t compress_algorithm);
+
+    bool is_enabled() const { return _batch_bytes > 0; }
+    bool is_empty() const { return 0 == _count; }
+    bool is_full() const;
+
+    /** 再加入data_size字节的上报是否会超出批量大小 */
+    bool is_overflow(size_t data_size) const;
+
+    /** 加入一条上报，数据会被复制 */
+    void add(const char* data, size_t data_size);
+
+    /***
+      * 得到距离必须发出还剩下的毫秒数
+      * @return: 为空时返回UINT32_MAX，已到期返回0
+      */
+    uint32_t get_remaining_milliseconds() const;
+
+    /***
+      * 将已加入的上报打包成一个TBatchReportMessage，并清空批量
+      * @return: 返回的消息需要以delete []方式释放
+      */
+    net::TCommonMessageHeader* pack();
+
+private:
+    uint32_t _batch_bytes;
+    uint32_t _batch_milliseconds;
+    compress_algorithm_t _compress_algorithm;
+    uint16_t _count;
+    uint64_t _first_milliseconds; // 第一条上报加入的时间
+    std::string _buffer;          // 未压缩的条目
+};
+
+AGENT_NAMESPACE_END
+#endif // MOOON_AGENT_REPORT_BATCH_H
@@ -0,0 +1,144 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Author: eyjian@qq.com or eyjian@gmail.com
+ */
+#include <mooon/agent/report_decoder.h>
+#include "agent_log.h"
+#include "compressor.h"
+AGENT_NAMESPACE_BEGIN
+
+CReportDecoder::CReportDecoder(size_t max_raw_size)
+ :_max_raw_size(max_raw_size)
+ ,_cursor(NULL)
+ ,_end(NULL)
+ ,_count(0)
+{
+}
+
+bool CReportDecoder::decode(const char* body, size_t body_size)
+{
+    _cursor = _end = NULL;
+    _count = 0;
+    if (body_size < sizeof(TBatchReportHeader))
+    {
+        AGENT_LOG_ERROR("Invalid batch report size: %zu.\n", body_size);
+        return false;
+    }
+
+    const TBatchReportHeader* batch_header = reinterpret_cast<const TBatchReportHeader*>(body);
+    compress_algorithm_t compress_algorithm = static_cast<compress_algorithm_t>(batch_header->compress_algorithm);
+    const char* data = batch_header->data;
+    size_t data_size = body_size - sizeof(TBatchReportHeader);
+    size_t raw_size = batch_header->raw_size;
+
+    if (compress_none == compress_algorithm)
+    {
+        if (data_size != raw_size)
+        {
+            AGENT_LOG_ERROR("Batch report size mismatch: %zu/%zu.\n", data_size, raw_size);
+            return false;
+        }
+
+        _cursor = data;
+    }
+    else
+    {
+        if (!is_compress_supported(compress_algorithm))
+        {
+            AGENT_LOG_ERROR("Compress algorithm[%d] not supported.\n", compress_algorithm);
+            return false;
+        }
+
+        // raw_size来自网络，先检查再分配
+        if ((raw_size > _max_raw_size) || (raw_size > uncompress_bound(compress_algorithm, data_size)))
+        {
+            AGENT_LOG_ERROR("Invalid batch report raw size: algorithm[%d], %zu bytes to %zu bytes, max %zu bytes.\n"
+                          , compress_algorithm, data_size, raw_size, _max_raw_size);
+            return false;
+        }
+
+        _buffer.resize(raw_size);
+        if (!uncompress_data(compress_algorithm, data, data_size, &_buffer[0], raw_size))
+        {
+            AGENT_LOG_ERROR("Uncompress batch report error: algorithm[%d], %zu bytes to %zu bytes.\n"
+                          , compress_algorithm, data_size, raw_size);
+            return false;
+        }
+
+        _cursor = _buffer.data();
+    }
+
+    _end = _cursor + raw_size;
+    _count = batch_header->count;
+    if (!check_items())
+    {
+        _cursor = _end = NULL;
+        _count = 0;
+        return false;
+    }
+
+    return true;
+}
+
+bool CReportDecoder::next(const char** data, size_t* data_size)
+{
+    if (_end - _cursor < static_cast<ptrdiff_t>(sizeof(nuint32_t)))
+        return false;
+
+    const nuint32_t* item_size = reinterpret_cast<const nuint32_t*>(_cursor);
+    size_t size = item_size->to_int();
+    if (static_cast<size_t>(_end - _cursor) - sizeof(nuint32_t) < size)
+    {
+        AGENT_LOG_ERROR("Truncated batch report item: %zu.\n", size);
+        _cursor = _end;
+        return false;
+    }
+
+    *data = _cursor + sizeof(nuint32_t);
+    *data_size = size;
+    _cursor += sizeof(nuint32_t) + size;
+    return true;
+}
+
+// 条目须正好为count个，且正好占满解压后的数据
+bool CReportDecoder::check_items() const
+{
+    size_t count = 0;
+    const char* cursor = _cursor;
+
+    while (_end - cursor >= static_cast<ptrdiff_t>(sizeof(nuint32_t)))
+    {
+        const nuint32_t* item_size = reinterpret_cast<const nuint32_t*>(cursor);
+        size_t size = item_size->to_int();
+        if (static_cast<size_t>(_end - cursor) - sizeof(nuint32_t) < size)
+            break;
+
+        cursor += sizeof(nuint32_t) + size;
+        ++count;
+    }
+
+    if ((cursor != _end) || (count != _count))
+    {
+        AGENT_LOG_ERROR("Batch report items mismatch: %zu/%u items, %zu/%zu bytes.\n"
+                      , count, _count, static_cast<size_t>(cursor - _cursor), static_cast<size_t>(_end - _cursor));
+        return false;
+    }
+
+    return true;
+}
+
+AGENT_NAMESPACE_END
@@ -0,0 +1,233 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Author: eyjian@qq.com or eyjian@gmail.com
+ */
+#include "spill_queue.h"
+#include <fcntl.h>
+#include <mooon/sys/close_helper.h>
+#include <mooon/sys/datetime_utils.h>
+#include "agent_log.h"
+AGENT_NAMESPACE_BEGIN
+
+#define SPILL_MAGIC       0x4D535051 // "MSPQ"
+#define SPILL_HEADER_SIZE 4096       // 文件头占一页，数据区从这之后开始
+
+// 文件头，head和tail为单调递增的逻辑偏移，对capacity取模得到数据区中的位置
+struct CSpillQueue::TSpillHeader
+{
+    uint32_t magic;
+    uint32_t capacity;
+    uint64_t head;
+    uint64_t tail;
+    uint32_t number;
+};
+
+CSpillQueue::CSpillQueue()
+ :_waiter_number(0)
+ ,_mmap(NULL)
+ ,_header(NULL)
+ ,_data(NULL)
+{
+}
+
+CSpillQueue::~CSpillQueue()
+{
+    destroy();
+}
+
+void CSpillQueue::create(const std::string& filename, uint32_t capacity) throw (sys::CSyscallException)
+{
+    int fd = open(filename.c_str(), O_RDWR|O_CREAT, FILE_DEFAULT_PERM);
+    if (-1 == fd)
+        THROW_SYSCALL_EXCEPTION(NULL, errno, "open");
+
+    sys::CloseHelper<int> ch(fd);
+    TSpillHeader header;
+    ssize_t bytes = pread(fd, &header, sizeof(header), 0);
+    if (-1 == bytes)
+        THROW_SYSCALL_EXCEPTION(NULL, errno, "pread");
+
+    // 已有的文件有效时沿用它的大小，以免丢失其中的数据
+    struct stat st;
+    if (-1 == fstat(fd, &st))
+        THROW_SYSCALL_EXCEPTION(NULL, errno, "fstat");
+    bool valid = (sizeof(header) == static_cast<size_t>(bytes))
+              && (SPILL_MAGIC == header.magic)
+              && (header.capacity > 0)
+              && (static_cast<uint64_t>(st.st_size) >= SPILL_HEADER_SIZE + static_cast<uint64_t>(header.capacity))
+              && (header.tail >= header.head)
+              && (header.tail - header.head <= header.capacity);
+    if (valid)
+    {
+        if (header.capacity != capacity)
+        {
+            AGENT_LOG_WARN("Spill file[%s] capacity is %u, not %u.\n", filename.c_str(), header.capacity, capacity);
+        }
+
+        capacity = header.capacity;
+    }
+    else
+    {
+        if (bytes > 0)
+        {
+            AGENT_LOG_WARN("Spill file[%s] is invalid, reset it.\n", filename.c_str());
+        }
+        if (-1 == ftruncate(fd, SPILL_HEADER_SIZE + static_cast<off_t>(capacity)))
+            THROW_SYSCALL_EXCEPTION(NULL, errno, "ftruncate");
+    }
+
+    _mmap = sys::CMMap::map_both(fd, SPILL_HEADER_SIZE + capacity);
+    _header = static_cast<TSpillHeader*>(_mmap->addr);
+    _data = static_cast<char*>(_mmap->addr) + SPILL_HEADER_SIZE;
+    if (!valid)
+    {
+        _header->capacity = capacity;
+        _header->head = 0;
+        _header->tail = 0;
+        _header->number = 0;
+        _header->magic = SPILL_MAGIC;
+    }
+
+    AGENT_LOG_INFO("Spill file[%s] opened with %u reports.\n", filename.c_str(), _header->number);
+}
+
+void CSpillQueue::destroy()
+{
+    if (_mmap != NULL)
+    {
+        try
+        {
+            sys::CMMap::sync_flush(_mmap);
+            sys::CMMap::unmap(_mmap);
+        }
+        catch (sys::CSyscallException& syscall_ex)
+        {
+            AGENT_LOG_ERROR("Close spill file error: %s.\n", syscall_ex.str().c_str());
+        }
+
+        _mmap = NULL;
+        _header = NULL;
+        _data = NULL;
+    }
+}
+
+bool CSpillQueue::is_empty() const
+{
+    sys::LockHelper<sys::CLock> lh(_lock);
+    return (NULL == _header) || (_header->head == _header->tail);
+}
+
+uint32_t CSpillQueue::get_number() const
+{
+    sys::LockHelper<sys::CLock> lh(_lock);
+    return (NULL == _header)? 0: _header->number;
+}
+
+bool CSpillQueue::push_back(const char* data, size_t data_size)
+{
+    uint32_t item_size = static_cast<uint32_t>(data_size);
+    sys::LockHelper<sys::CLock> lh(_lock);
+
+    if (!has_space(data_size))
+        return false;
+
+    // 先写数据再移动tail，这样进程在中途退出也不会留下半条上报
+    write_bytes(_header->tail, &item_size, sizeof(item_size));
+    write_bytes(_header->tail + sizeof(item_size), data, data_size);
+    _header->tail += sizeof(item_size) + data_size;
+    ++_header->number;
+    return true;
+}
+
+net::TCommonMessageHeader* CSpillQueue::pop_front()
+{
+    uint32_t item_size = 0;
+    sys::LockHelper<sys::CLock> lh(_lock);
+
+    if (_header->head == _header->tail)
+        return NULL;
+
+    read_bytes(_header->head, &item_size, sizeof(item_size));
+    if (item_size > _header->tail - _header->head - sizeof(item_size))
+    {
+        AGENT_LOG_ERROR("Spill file corrupted: %u/%" PRIu64", discard %u reports.\n"
+                      , item_size, _header->tail - _header->head, _header->number);
+        _header->head = _header->tail;
+        _header->number = 0;
+        return NULL;
+    }
+
+    char* buffer = new char[sizeof(net::TCommonMessageHeader) + item_size];
+    report_message_t* report_message = reinterpret_cast<report_message_t*>(buffer);
+    report_message->header.size = item_size;
+    report_message->header.command = U_REPORT_MESSAGE;
+    read_bytes(_header->head + sizeof(item_size), report_message->data, item_size);
+
+    _header->head += sizeof(item_size) + item_size;
+    --_header->number;
+    if (_waiter_number > 0)
+        _event.broadcast();
+    return &report_message->header;
+}
+
+bool CSpillQueue::wait_space(size_t data_size, uint32_t timeout_millisecond)
+{
+    uint64_t deadline = sys::current_milliseconds() + timeout_millisecond;
+    sys::LockHelper<sys::CLock> lh(_lock);
+
+    if (sizeof(uint32_t) + data_size > _header->capacity)
+        return false;
+
+    while (!has_space(data_size))
+    {
+        uint64_t now = sys::current_milliseconds();
+        if (now >= deadline)
+            return false;
+
+        ++_waiter_number;
+        (void)_event.timed_wait(_lock, static_cast<uint32_t>(deadline - now));
+        --_waiter_number;
+    }
+
+    return true;
+}
+
+bool CSpillQueue::has_space(size_t data_size) const
+{
+    return _header->tail - _header->head + sizeof(uint32_t) + data_size <= _header->capacity;
+}
+
+// 环形写入，可能被分成两段
+void CSpillQueue::write_bytes(uint64_t offset, const void* bytes, size_t size)
+{
+    size_t position = static_cast<size_t>(offset % _header->capacity);
+    size_t first_size = std::min<size_t>(size, _header->capacity - position);
+
+    memcpy(_data + position, bytes, first_size);
+    memcpy(_data, static_cast<const char*>(bytes) + first_size, size - first_size);
+}
+
+void CSpillQueue::read_bytes(uint64_t offset, void* bytes, size_t size) const
+{
+    size_t position = static_cast<size_t>(offset % _header->capacity);
+    size_t first_size = std::min<size_t>(size, _header->capacity - position);
+
+    memcpy(bytes, _data + position, first_size);
+    memcpy(static_cast<char*>(bytes) + first_size, _data, size - first_size);
+}
+
+AGENT_NAMESPACE_END
@@ -0,0 +1,93 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Author: eyjian@qq.com or eyjian@gmail.com
+ */
+#ifndef MOOON_AGENT_SPILL_QUEUE_H
+#define MOOON_AGENT_SPILL_QUEUE_H
+#include <mooon/agent/message.h>
+#include <mooon/sys/event.h>
+#include <mooon/sys/lock.h>
+#include <mooon/sys/mmap.h>
+AGENT_NAMESPACE_BEGIN
+
+/***
+  * 磁盘溢出队列，在内存上报队列积压时暂存上报
+  * 基于文件映射实现的环形队列，文件头保存读写位置，进程重启后未取出的上报仍然保留，
+  * 但未调用destroy的情况下，如果操作系统崩溃，最近写入的数据可能丢失
+  * 线程安全，report线程写入，agent线程取出
+  */
+class CSpillQueue
+{
+public:
+    CSpillQueue();
+    ~CSpillQueue();
+
+    /***
+      * 打开溢出文件，不存在时创建，已存在并且有效时保留其中的数据
+      * @filename: 溢出文件路径
+      * @capacity: 环形队列的字节数，如果已有的文件有效，则以文件中的大小为准
+      * @exception: 如果出错，抛出CSyscallException异常
+      */
+    void create(const std::string& filename, uint32_t capacity) throw (sys::CSyscallException);
+
+    /***
+      * 将数据刷到磁盘并关闭溢出文件
+      * 不会抛出任何异常
+      */
+    void destroy();
+
+    bool is_enabled() const { return _mmap != NULL; }
+    bool is_empty() const;
+
+    /** 得到队列中的上报条数 */
+    uint32_t get_number() const;
+
+    /***
+      * 存入一条上报，数据会被复制
+      * @return: 空间不足时返回false
+      */
+    bool push_back(const char* data, size_t data_size);
+
+    /***
+      * 等待队列有足够存入data_size字节上报的空间，最多等待timeout_millisecond毫秒
+      * @return: 有空间时返回true，超时或上报比整个队列还大时返回false
+      */
+    bool wait_space(size_t data_size, uint32_t timeout_millisecond);
+
+    /***
+      * 取出一条上报
+      * @return: 队列为空时返回NULL，否则返回report_message_t的消息头，需要以delete []方式释放
+      */
+    net::TCommonMessageHeader* pop_front();
+
+private:
+    bool has_space(size_t data_size) const; // 须在_lock内调用
+    void write_bytes(uint64_t offset, const void* bytes, size_t size);
+    void read_bytes(uint64_t offset, void* bytes, size_t size) const;
+
+private:
+    struct TSpillHeader;
+    mutable sys::CLock _lock;
+    sys::CEvent _event;       // 有上报被取出时唤醒等待空间的
+    int32_t _waiter_number;   // 等待空间的个数
+    sys::mmap_t* _mmap;
+    TSpillHeader* _header;
+    char* _data;
+};
+
+AGENT_NAMESPACE_END
+#endif // MOOON_AGENT_SPILL_QUEUE_H
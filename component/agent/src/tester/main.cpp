@@ -16,6 +16,7 @@
  *
  * Author: eyjian@qq.com or eyjian@gmail.com
  */
+#include <algorithm>
 #include <mooon/agent/agent.h>
 #include <mooon/sys/main_template.h>
 #include <mooon/sys/utils.h>
@@ -25,6 +26,18 @@
 STRING_ARG_DEFINE(center_ip, "127.0.0.1", "center IP");
 // 命令行参数--center_port，指定center的端口号
 INTEGER_ARG_DEFINE(uint16_t, center_port, 10000, 2048, 65535, "center port");
+// 命令行参数--batch_bytes，批量上报的最大字节数，为0表示不合并
+INTEGER_ARG_DEFINE(uint32_t, batch_bytes, 0, 0, 1048576, "batch bytes");
+// 命令行参数--compress，批量上报的压缩算法：0不压缩，1为zlib，2为LZ4
+INTEGER_ARG_DEFINE(uint8_t, compress, 0, 0, 2, "compress algorithm");
+// 命令行参数--reports，每轮上报的条数
+INTEGER_ARG_DEFINE(uint32_t, reports, 1, 1, 100000, "reports per round");
+// 命令行参数--spill_file，磁盘溢出文件，为空表示不使用
+STRING_ARG_DEFINE(spill_file, "", "spill file");
+// 命令行参数--spill_bytes，磁盘溢出文件大小
+INTEGER_ARG_DEFINE(uint32_t, spill_bytes, 1048576, 4096, 1073741824, "spill bytes");
+// 命令行参数--replay_rate，每秒最多从溢出文件取出的上报数，为0表示不限制
+INTEGER_ARG_DEFINE(uint32_t, replay_rate, 0, 0, 1000000, "replay rate");
 
 AGENT_NAMESPACE_BEGIN
 
@@ -90,9 +103,14 @@ private:
     virtual bool init(int argc, char* argv[])
     {
         TAgentInfo agent_info;
-        agent_info.queue_size = 100;
+        agent_info.queue_size = std::max<uint32_t>(100, mooon::argument::reports->value());
         agent_info.connect_timeout_milliseconds = 2000;
         agent_info.heartbeat_hook = new CHeartbeatHook;
+        agent_info.batch_bytes = mooon::argument::batch_bytes->value();
+        agent_info.compress_algorithm = static_cast<compress_algorithm_t>(mooon::argument::compress->value());
+        agent_info.spill_filename = mooon::argument::spill_file->value();
+        agent_info.spill_bytes = mooon::argument::spill_bytes->value();
+        agent_info.replay_rate = mooon::argument::replay_rate->value();
         
         _agent = agent::create(agent_info);
         if (NULL == _agent)
@@ -112,7 +130,12 @@ private:
             // 记得size()是不包含结尾符的，这里需要将结尾符也发送过去，
             // 这样接收端就不用再添加结尾符了，
             // 因为需要+1，否则对端的valgrind会报“Invalid read of size 1”
-            _agent->report(report.data(), report.size()+1);
+            for (uint32_t i=0; i<mooon::argument::reports->value(); ++i)
+                _agent->report(report.data(), report.size()+1);
+
+            TReportStats stats;
+            _agent->get_report_stats(&stats);
+            fprintf(stdout, "spilled: %u, replayed: %u, dropped: %u\n", stats.spilled, stats.replayed, stats.dropped);
             //_agent->report(0, "%s", report.data());
         }
         
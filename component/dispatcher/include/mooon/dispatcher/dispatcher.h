@@ -73,6 +73,31 @@ public:
     /** 设置重连接次数 */
     virtual void set_reconnect_times(int32_t reconnect_times) = 0;
 
+    /***
+      * 设置流水线发送窗口，即同一连接上最多允许多少个已发送但还未收到应答的消息，
+      * 只对能通过IReplyHandler::get_message_sequence取得序列号的Buffer消息有效
+      * @window: 窗口大小，为0表示不启用（默认），消息发送完即释放
+      * @timeout_milliseconds: 每个消息等待应答的超时毫秒数，为0表示不超时，
+      *  超时或连接断开后按SenderInfo::resend_times重发，精度约为100毫秒
+      */
+    virtual void set_pipeline_window(uint16_t window, uint32_t timeout_milliseconds) = 0;
+
+    /***
+      * 通知收到了序列号为sequence的消息的应答，消息将被移出窗口并释放，
+      * 只能在IReplyHandler::handle_reply中调用
+      * @return: 如果窗口中有该序列号的消息，则返回true，否则返回false
+      */
+    virtual bool complete_message(uint32_t sequence) = 0;
+
+    /***
+      * 得到未完成的消息数，包括队列中的、正在发送的和窗口中等待应答的，
+      * 可作为Sender负载的度量
+      */
+    virtual uint32_t get_outstanding_messages() const = 0;
+
+    /** 是否可用，即连接已建立并且队列未满 */
+    virtual bool is_available() const = 0;
+
     /***
       * 推送消息
       * @message: 需要推送的消息
@@ -82,6 +107,7 @@ public:
       */
     virtual bool push_message(file_message_t* message, uint32_t milliseconds=0) = 0;
     virtual bool push_message(buffer_message_t* message, uint32_t milliseconds=0) = 0;
+    virtual bool push_message(splice_message_t* message, uint32_t milliseconds=0) = 0;
 };
 
 //////////////////////////////////////////////////////////////////////////
@@ -142,6 +168,48 @@ public:
     virtual ISender* get_sender(const net::ip_node_t& ip_node) = 0;    
 };
 
+//////////////////////////////////////////////////////////////////////////
+// ISenderGroup
+
+/***
+  * Sender组选择Sender的策略
+  */
+typedef enum
+{
+    group_least_outstanding, /** 选未完成消息数最少的 */
+    group_power_of_two,      /** 随机取两个，选其中未完成消息数较少的，成员多时开销比前者小 */
+    group_consistent_hash    /** 按调用者给的键一致性哈希，同一个键总是选中同一个Sender，除非它不可用 */
+}sender_group_policy_t;
+
+/***
+  * Sender组，由若干Managed类型的Sender组成，推送消息时按策略从中选择一个，
+  * 连接未建立或队列已满的Sender会被自动跳过，都不可用时选未完成消息数最少的
+  */
+class ISenderGroup
+{
+public:
+    virtual ~ISenderGroup() {}
+
+    /***
+      * 将Key对应的Managed Sender加入组，Sender须由IManagedSenderTable::open_sender创建
+      * @return: 如果已在组中，则返回false，否则返回true
+      */
+    virtual bool add_sender(uint16_t key) = 0;
+
+    /** 将Key对应的Sender移出组 */
+    virtual void remove_sender(uint16_t key) = 0;
+
+    /***
+      * 推送消息到组中的一个Sender
+      * @hash_key: 一致性哈希策略使用的键，其它策略忽略
+      * @milliseconds: 同ISender::push_message
+      * @return: 如果组为空或消息未能存入队列，则返回false，这时消息仍由调用者释放
+      */
+    virtual bool push_message(file_message_t* message, uint64_t hash_key=0, uint32_t milliseconds=0) = 0;
+    virtual bool push_message(buffer_message_t* message, uint64_t hash_key=0, uint32_t milliseconds=0) = 0;
+    virtual bool push_message(splice_message_t* message, uint64_t hash_key=0, uint32_t milliseconds=0) = 0;
+};
+
 //////////////////////////////////////////////////////////////////////////
 // IDispatcher
 /***
@@ -161,6 +229,29 @@ public:
 
     /** 设置重连接间隔秒数 */
     virtual void set_reconnect_seconds(uint32_t seconds) = 0;
+
+    /***
+      * 设置以MSG_ZEROCOPY方式发送的Buffer消息的最小字节数，0表示不使用（默认），
+      * 零拷贝对小消息不划算，建议不小于32KB，
+      * 使用零拷贝的消息要等内核通知发送完成后才会被释放，需要4.14及以上版本内核
+      */
+    virtual void set_zerocopy_threshold(uint32_t bytes) = 0;
+
+    /***
+      * 设置一次writev最多合并发送的Buffer消息个数，默认为64，
+      * 值为1时不合并，超过IOV_MAX时取IOV_MAX
+      */
+    virtual void set_coalesce_messages(uint16_t count) = 0;
+
+    /***
+      * 创建Sender组，组的成员为Managed类型的Sender
+      * @policy: 选择Sender的策略
+      * @return: 返回创建好的Sender组，不再使用时须调用destroy_sender_group销毁
+      */
+    virtual ISenderGroup* create_sender_group(sender_group_policy_t policy) = 0;
+
+    /** 销毁Sender组，不影响组中的Sender */
+    virtual void destroy_sender_group(ISenderGroup* sender_group) = 0;
 };
 
 //////////////////////////////////////////////////////////////////////////
@@ -38,11 +38,23 @@ typedef struct
     char data[0];     /** 需要发送的消息 */
 }buffer_message_t;
 
+/***
+  * 分发转发类型消息结构，以splice将fd中的数据转发到Sender的连接，数据不经过用户空间，
+  * fd可以是套接字或管道，调用者须保证fd中有消息长度所指定的字节数可读，
+  * 并且在消息被释放之前不关闭fd，fd不会被关闭
+  */
+typedef struct
+{
+    int fd;           /** 数据来源的文件描述符 */
+}splice_message_t;
+
 extern file_message_t* create_file_message(size_t file_size);
 extern buffer_message_t* create_buffer_message(size_t data_length);
+extern splice_message_t* create_splice_message(size_t data_length);
 
 extern void destroy_file_message(file_message_t* file_messsage);
 extern void destroy_buffer_message(buffer_message_t* buffer_messsage);
+extern void destroy_splice_message(splice_message_t* splice_messsage);
 
 DISPATCHER_NAMESPACE_END
 #endif // MOOON_DISPATCHER_MESSAGE_H
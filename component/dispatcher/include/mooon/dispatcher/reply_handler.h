@@ -64,6 +64,16 @@ public:
       * @current 当次发送出去的字节数
       */
     virtual void send_progress(size_t total, size_t finished, size_t current) {}
+
+    /***
+      * Splice类型消息的来源在消息发送完之前结束或出错，消息被丢弃，不会重发
+      * @total 消息总的字节数
+      * @finished 已经发送出去的字节数，这部分无法撤回
+      * @errcode 来源出错时的错误码，来源结束（比如管道的写端已关闭）时为0
+      * @return 如果返回false，则关闭连接（比如对端按长度接收，不完整的消息会使之后的消息错位），
+      *         否则在原连接上接着发送下一个消息
+      */
+    virtual bool send_aborted(size_t total, size_t finished, int errcode) { return true; }
         
     /***
       * 和目标的连接断开
@@ -96,6 +106,22 @@ public:
       */
     virtual utils::handle_result_t handle_reply(size_t data_size) { return utils::handle_error; }
 
+    /***
+      * 取得消息的序列号，仅在ISender::set_pipeline_window启用了窗口时调用，
+      * 消息发送完后据此保留在窗口中，直到以相同的序列号调用ISender::complete_message
+      * @data: 消息内容
+      * @length: 消息字节数
+      * @sequence: 输出参数，存储消息的序列号
+      * @return: 如果返回false，则消息不需要等待应答，发送完即释放
+      */
+    virtual bool get_message_sequence(const char* data, size_t length, uint32_t* sequence) { return false; }
+
+    /***
+      * 窗口中的消息等待应答超时或连接断开，且已达到重发次数，消息将被丢弃
+      * @sequence: 被丢弃消息的序列号
+      */
+    virtual void message_timeout(uint32_t sequence) {}
+
     /***
       * 得到状态值
       */
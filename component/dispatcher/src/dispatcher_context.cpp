@@ -16,6 +16,7 @@
  *
  * Author: JianYi, eyjian@qq.com or eyjian@gmail.com
  */
+#include <limits.h>
 #include <sstream>
 #include <mooon/sys/utils.h>
 #include "dispatcher_context.h"
@@ -35,6 +36,8 @@ CDispatcherContext::CDispatcherContext(uint16_t thread_count, uint32_t timeout_s
     ,_thread_pool(NULL)
 {    
 	set_reconnect_seconds(2); // 默认重连接间隔秒数
+    set_zerocopy_threshold(0); // 默认不使用零拷贝发送
+    set_coalesce_messages(64); // 默认一次最多合并发送64个消息
 
     _thread_count = thread_count;
     if (_thread_count < 1)
@@ -79,6 +82,31 @@ void CDispatcherContext::set_reconnect_seconds(uint32_t seconds)
 	atomic_set(&_reconnect_seconds, seconds);
 }
 
+void CDispatcherContext::set_zerocopy_threshold(uint32_t bytes)
+{
+    atomic_set(&_zerocopy_threshold, bytes);
+}
+
+void CDispatcherContext::set_coalesce_messages(uint16_t count)
+{
+    if (count < 1)
+        count = 1;
+    else if (count > IOV_MAX)
+        count = IOV_MAX;
+
+    atomic_set(&_coalesce_messages, count);
+}
+
+ISenderGroup* CDispatcherContext::create_sender_group(sender_group_policy_t policy)
+{
+    return new CSenderGroup(_managed_sender_table, policy);
+}
+
+void CDispatcherContext::destroy_sender_group(ISenderGroup* sender_group)
+{
+    delete sender_group;
+}
+
 bool CDispatcherContext::create_thread_pool()
 {        
     try
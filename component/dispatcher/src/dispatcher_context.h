@@ -26,6 +26,7 @@
 #include <mooon/sys/thread_pool.h>
 
 #include "send_thread.h"
+#include "sender_group.h"
 #include "dispatcher_log.h"
 #include "managed_sender_table.h"
 #include "default_reply_handler.h"
@@ -51,11 +52,25 @@ public:
     	return static_cast<uint32_t>(atomic_read(&_reconnect_seconds));
     }
 
+    uint32_t get_zerocopy_threshold() const
+    {
+        return static_cast<uint32_t>(atomic_read(&_zerocopy_threshold));
+    }
+
+    uint16_t get_coalesce_messages() const
+    {
+        return static_cast<uint16_t>(atomic_read(&_coalesce_messages));
+    }
+
 private: // IDispatcher
     virtual IManagedSenderTable* get_managed_sender_table();
     virtual IUnmanagedSenderTable* get_unmanaged_sender_table();
     virtual uint16_t get_thread_number() const;
     virtual void set_reconnect_seconds(uint32_t seconds);
+    virtual void set_zerocopy_threshold(uint32_t bytes);
+    virtual void set_coalesce_messages(uint16_t count);
+    virtual ISenderGroup* create_sender_group(sender_group_policy_t policy);
+    virtual void destroy_sender_group(ISenderGroup* sender_group);
 
 private:        
     bool create_thread_pool();  
@@ -67,6 +82,8 @@ private:
     uint16_t _thread_count;
     uint32_t _timeout_seconds;
     atomic_t _reconnect_seconds;
+    atomic_t _zerocopy_threshold;
+    atomic_t _coalesce_messages;
     CSendThreadPool* _thread_pool;
     CManagedSenderTable* _managed_sender_table;
     CUnmanagedSenderTable* _unmanaged_sender_table;      
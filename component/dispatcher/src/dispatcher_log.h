@@ -39,6 +39,7 @@ typedef enum
 {
     DISPATCH_FILE,   /** 需要发送的是一个文件 */
     DISPATCH_BUFFER, /** 需要发送的是一个Buffer */
+    DISPATCH_SPLICE, /** 需要以splice转发的是一个fd中的数据 */
     DISPATCH_STOP    /** 停止Sender消息 */
 }dispatch_type_t;
 
@@ -48,7 +49,7 @@ typedef enum
 typedef struct
 {
     dispatch_type_t type; /** 分发消息类型 */
-    size_t length;        /** 文件大小或content的字节数 */
+    size_t length;        /** 文件大小、content或需要转发的字节数 */
     char data[0];
 }message_t;
 
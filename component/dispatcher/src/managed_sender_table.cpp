@@ -16,6 +16,7 @@
  *
  * Author: eyjian@qq.com or eyjian@gmail.com
  */
+#include <vector>
 #include <mooon/net/utils.h>
 #include <mooon/sys/close_helper.h>
 #include <mooon/utils/string_utils.h>
@@ -28,21 +29,18 @@ DISPATCHER_NAMESPACE_BEGIN
 CManagedSenderTable::~CManagedSenderTable()
 {
     //clear_sender();
-    delete []_sender_table;
-    delete []_lock_array;
+    for (int i=0; i<PAGE_NUMBER; ++i)
+    {
+        delete []_sender_pages[i];
+    }
 }
 
 CManagedSenderTable::CManagedSenderTable(CDispatcherContext* context)
     :CSenderTable(context)
 {
-    _table_size = std::numeric_limits<uint16_t>::max();
-
-    _lock_array = new sys::CLock[_table_size];
-    _sender_table = new CManagedSender*[_table_size];
-    
-    for (int i=0; i<_table_size; ++i)
+    for (int i=0; i<PAGE_NUMBER; ++i)
     {
-        _sender_table[i] = NULL;
+        _sender_pages[i] = NULL;
     }
 }
 
@@ -60,9 +58,9 @@ ISender* CManagedSenderTable::open_sender(const SenderInfo& sender_info)
     }
 
     CManagedSender* sender = NULL;
-    sys::LockHelper<sys::CLock> lock(_lock_array[sender_info.key]);
+    sys::LockHelper<sys::CLock> lock(_lock);
 
-    if (NULL == _sender_table[sender_info.key])
+    if (NULL == load_sender(sender_info.key))
     {    
         sender = new CManagedSender(sender_info);            
         sender->inc_refcount();
@@ -71,7 +69,7 @@ ISender* CManagedSenderTable::open_sender(const SenderInfo& sender_info)
         sender->attach_sender_table(this);
         sender_info.reply_handler->attach(sender);
                 
-        _sender_table[sender_info.key] = sender;    
+        store_sender(sender_info.key, sender);
         get_context()->add_sender(sender);
     }
 
@@ -83,15 +81,18 @@ void CManagedSenderTable::close_sender(ISender* sender)
     CManagedSender* sender_ = static_cast<CManagedSender*>(sender);
     uint16_t key = sender_->get_sender_info().key;
 
-    sys::LockHelper<sys::CLock> lock(_lock_array[key]);                
+    sys::LockHelper<sys::CLock> lock(_lock);                
     if (sender_->is_in_table())
     {
         sender_->shutdown();
         sender_->set_in_table(false);
-        _sender_table[key] = NULL;
+        store_sender(key, NULL);
+        release_removed(sender_);
+    }
+    else
+    {
+        (void)sender_->dec_refcount();
     }
-
-    (void)sender_->dec_refcount();
 }
 
 void CManagedSenderTable::release_sender(ISender* sender)
@@ -99,12 +100,26 @@ void CManagedSenderTable::release_sender(ISender* sender)
     CManagedSender* sender_ = static_cast<CManagedSender*>(sender);
     uint16_t key = sender_->get_sender_info().key;
 
-    sys::LockHelper<sys::CLock> lock(_lock_array[key]);    
-    if (sender_->is_in_table() && sender_->dec_refcount())
+    // 读者只会增引用计数，所以持锁时看到的1就是最后一个引用
+    sys::LockHelper<sys::CLock> lock(_lock);    
+    if (sender_->is_in_table())
+    {
+        if (1 == sender_->get_refcount())
+        {
+            // Sender将被删除，须先从表中摘除，
+            // 并标记为不在表中，以免摘除前取到它的读者释放时再摘除一次（可能已是同key的新Sender）
+            sender_->set_in_table(false);
+            store_sender(key, NULL);
+            release_removed(sender_);
+        }
+        else
+        {
+            (void)sender_->dec_refcount();
+        }
+    }
+    else
     {
-        // 因为走到这里，说明Sender已经被deleted
-        // ，所以没必要再sender_->set_in_table(false);
-        _sender_table[key] = NULL;
+        (void)sender_->dec_refcount();
     }
 }
 
@@ -113,43 +128,84 @@ void CManagedSenderTable::remove_sender(ISender* sender)
     CManagedSender* sender_ = static_cast<CManagedSender*>(sender);
     uint16_t key = sender_->get_sender_info().key;
     
-    sys::LockHelper<sys::CLock> lock(_lock_array[key]);                
+    sys::LockHelper<sys::CLock> lock(_lock);                
     if (sender_->is_in_table())
     {
         sender_->set_in_table(false);
-        _sender_table[key] = NULL;
+        store_sender(key, NULL);
+        release_removed(sender_);
+    }
+    else
+    {
+        (void)sender_->dec_refcount();
     }
-
-    (void)sender_->dec_refcount();
 }
 
 ISender* CManagedSenderTable::get_sender(uint16_t key)
 {
-    CManagedSender* sender = NULL;
-    sys::LockHelper<sys::CLock> lock(_lock_array[key]);
+    int phase = read_lock();
+    CManagedSender* sender = load_sender(key);
 
-    if (_sender_table[key] != NULL)
+    if (sender != NULL)
     {
-        sender = _sender_table[key];
         sender->inc_refcount();
     }
 
+    read_unlock(phase);
     return sender;
 }
 
 void CManagedSenderTable::clear_sender()
 {
-    // 下面这个循环最大可能为65535次，但只有更新发送表时才发生，所以对性能影响可以忽略
-    for (uint16_t key=0; key<_table_size; ++key)
+    std::vector<CManagedSender*> senders;
+    sys::LockHelper<sys::CLock> lock(_lock);
+
+    for (int i=0; i<PAGE_NUMBER; ++i)
     {
-        sys::LockHelper<sys::CLock> lock(_lock_array[key]);
-        if (_sender_table[key] != NULL)
+        if (NULL == _sender_pages[i]) continue;
+        for (int j=0; j<PAGE_SIZE; ++j)
         {
-            _sender_table[key]->shutdown();
-            _sender_table[key]->dec_refcount();
-            _sender_table[key] = NULL;
+            CManagedSender* sender = (*_sender_pages[i])[j];
+            if (sender != NULL)
+            {
+                sender->shutdown();
+                senders.push_back(sender);
+                store_sender((uint16_t)((i << PAGE_BITS) | j), NULL);
+            }
         }
     }
+
+    // 只需等待一次读者离开
+    synchronize();
+    for (std::vector<CManagedSender*>::size_type i=0; i<senders.size(); ++i)
+    {
+        senders[i]->dec_refcount();
+    }
+}
+
+CManagedSender* CManagedSenderTable::load_sender(uint16_t key) const
+{
+    sender_page_t* page = __atomic_load_n(&_sender_pages[key >> PAGE_BITS], __ATOMIC_ACQUIRE);
+    return (NULL == page)? NULL: __atomic_load_n(&(*page)[key & (PAGE_SIZE-1)], __ATOMIC_ACQUIRE);
+}
+
+void CManagedSenderTable::store_sender(uint16_t key, CManagedSender* sender)
+{
+    sender_page_t* page = _sender_pages[key >> PAGE_BITS];
+    if (NULL == page)
+    {
+        if (NULL == sender) return;
+
+        page = new sender_page_t[1];
+        for (int i=0; i<PAGE_SIZE; ++i)
+        {
+            (*page)[i] = NULL;
+        }
+
+        __atomic_store_n(&_sender_pages[key >> PAGE_BITS], page, __ATOMIC_RELEASE);
+    }
+
+    __atomic_store_n(&(*page)[key & (PAGE_SIZE-1)], sender, __ATOMIC_RELEASE);
 }
 
 DISPATCHER_NAMESPACE_END
@@ -25,7 +25,9 @@ DISPATCHER_NAMESPACE_BEGIN
 class CDispatcherContext;
 class CManagedSenderTable: public IManagedSenderTable, public CSenderTable
 {        
-    typedef CManagedSender** sender_table_t;
+    // Key分两级索引，页在第一次用到时才分配，内存随实际使用的Key增长
+    enum { PAGE_BITS = 8, PAGE_SIZE = 1 << PAGE_BITS, PAGE_NUMBER = 65536 / PAGE_SIZE };
+    typedef CManagedSender* sender_page_t[PAGE_SIZE];
     
 public:
     ~CManagedSenderTable();
@@ -43,11 +45,11 @@ private: // IManagedSenderTable
 
 private:
     void clear_sender();
+    CManagedSender* load_sender(uint16_t key) const;
+    void store_sender(uint16_t key, CManagedSender* sender);
 
 private:        
-    uint16_t _table_size;
-    sys::CLock* _lock_array;
-    sender_table_t _sender_table;        
+    sender_page_t* _sender_pages[PAGE_NUMBER];
 };
 
 DISPATCHER_NAMESPACE_END
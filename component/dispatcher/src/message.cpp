@@ -58,6 +58,17 @@ buffer_message_t* create_buffer_message(size_t data_length)
     return reinterpret_cast<buffer_message_t*>(message->data);
 }
 
+splice_message_t* create_splice_message(size_t data_length)
+{
+    char* message_buffer = new char[sizeof(message_t)+sizeof(splice_message_t)];
+    message_t* message = reinterpret_cast<message_t*>(message_buffer);
+
+    message->type = DISPATCH_SPLICE;
+    message->length = data_length;
+
+    return reinterpret_cast<splice_message_t*>(message->data);
+}
+
 void destroy_message(message_t* message)
 {
     char* message_buffer = reinterpret_cast<char*>(message);
@@ -76,4 +87,10 @@ void destroy_buffer_message(buffer_message_t* buffer_messsage)
     delete []reinterpret_cast<char*>(message_buffer);
 }
 
+void destroy_splice_message(splice_message_t* splice_messsage)
+{
+    char* message_buffer = reinterpret_cast<char*>(splice_messsage)-sizeof(message_t);
+    delete []reinterpret_cast<char*>(message_buffer);
+}
+
 DISPATCHER_NAMESPACE_END
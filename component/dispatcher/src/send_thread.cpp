@@ -18,6 +18,7 @@
  */
 #include <sstream>
 #include <mooon/net/utils.h>
+#include <mooon/sys/datetime_utils.h>
 #include <mooon/sys/utils.h>
 #include "send_thread.h"
 #include "dispatcher_context.h"
@@ -37,6 +38,16 @@ time_t CSendThread::get_current_time() const
     return _current_time;
 }
 
+uint32_t CSendThread::get_zerocopy_threshold() const
+{
+    return _context->get_zerocopy_threshold();
+}
+
+uint16_t CSendThread::get_coalesce_messages() const
+{
+    return _context->get_coalesce_messages();
+}
+
 void CSendThread::add_sender(CSender* sender)
 {
 	DISPATCHER_LOG_DEBUG("Thread[%u,%u] added %s.\n", get_index(), get_thread_id(), sender->to_string().c_str());
@@ -45,6 +56,11 @@ void CSendThread::add_sender(CSender* sender)
     _epoller.wakeup();
 }
 
+void CSendThread::watch_inflight(CSender* sender)
+{
+    _inflight_senders.insert(sender);
+}
+
 void CSendThread::run()
 {
     // 更新当前时间
@@ -57,8 +73,10 @@ void CSendThread::run()
     {
         _timeout_manager.check_timeout(_current_time);
     }
+    check_inflight_timeout();
 
-    int events_count = _epoller.timed_wait(2000);
+    // 有消息在等待应答时，缩短等待时长以及时处理超时
+    int events_count = _epoller.timed_wait(_inflight_senders.empty()? 2000: 100);
     if (0 == events_count)
     {
         // 超时处理
@@ -265,10 +283,33 @@ void CSendThread::check_unconnected_queue()
     }
 }
 
+void CSendThread::check_inflight_timeout()
+{
+    if (_inflight_senders.empty()) return;
+
+    uint64_t current_milliseconds = sys::current_milliseconds();
+    std::set<CSender*>::iterator iter = _inflight_senders.begin();
+    while (iter != _inflight_senders.end())
+    {
+        CSender* sender = *iter;
+        if (sender->check_inflight_timeout(current_milliseconds))
+        {
+            // 有消息需要重发，或腾出了窗口空间
+            _epoller.set_events(sender, EPOLLIN|EPOLLOUT);
+        }
+
+        if (sender->has_inflight_messages())
+            ++iter;
+        else
+            _inflight_senders.erase(iter++);
+    }
+}
+
 void CSendThread::remove_sender(CSender* sender)
 {    
     _epoller.del_events(sender);                
     _timeout_manager.remove(sender);
+    _inflight_senders.erase(sender);
 
     CSenderTable* sender_table = sender->get_sender_table();
     sender_table->close_sender(sender);
@@ -304,6 +345,7 @@ void CSendThread::sender_reconnect(CSender* sender)
     sender->close();
     _epoller.del_events(sender);
     _timeout_manager.remove(sender);
+    _inflight_senders.erase(sender);
     _reconnect_queue.push_back(sender);
 }
 
@@ -19,6 +19,7 @@
 #ifndef MOOON_DISPATCHER_SEND_THREAD_H
 #define MOOON_DISPATCHER_SEND_THREAD_H
 #include <list>
+#include <set>
 #include <mooon/net/epoller.h>
 #include <mooon/sys/pool_thread.h>
 #include <mooon/utils/timeout_manager.h>
@@ -35,7 +36,10 @@ class CSendThread: public sys::CPoolThread, public utils::ITimeoutHandler<CSende
 public:
     CSendThread();
     time_t get_current_time() const;
+    uint32_t get_zerocopy_threshold() const;
+    uint16_t get_coalesce_messages() const;
     void add_sender(CSender* sender);
+    void watch_inflight(CSender* sender);
     virtual void set_parameter(void* parameter);
 
     net::CEpoller& get_epoller() const { return _epoller; }
@@ -57,6 +61,7 @@ private:
 private:
     void check_reconnect_queue(); // 处理_reconnect_queue
     void check_unconnected_queue(); // 处理_unconnected_queue
+    void check_inflight_timeout(); // 处理_inflight_senders
     void remove_sender(CSender* sender);
     void sender_connect(CSender* sender);
     void sender_reconnect(CSender* sender);
@@ -84,6 +89,7 @@ private:
     sys::CLock _unconnected_lock;
     CSenderQueue _reconnect_queue; // 重连接队列
     CSenderQueue _unconnected_queue; // 待连接队列
+    std::set<CSender*> _inflight_senders; // 窗口中有需超时检查的消息的Sender
     CDispatcherContext* _context;
     utils::CTimeoutManager<CSender> _timeout_manager;
 };
@@ -16,6 +16,11 @@
  *
  * Author: eyjian@qq.com or eyjian@gmail.com
  */
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/stat.h>
+#include <algorithm>
+#include <mooon/sys/datetime_utils.h>
 #include <mooon/utils/string_utils.h>
 #include "sender.h"
 #include "send_thread.h"
@@ -32,16 +37,29 @@ CSender::CSender()
     ,_cur_resend_times(0)
     ,_current_offset(0)
     ,_current_message(NULL)
+    ,_current_zerocopy(false)
+    ,_splice_source(this)
+    ,_splice_direct(-1)
+    ,_splice_pipe_bytes(0)
+    ,_pipeline_window(0)
+    ,_pipeline_timeout(0)
+    ,_window_blocked(false)
 {
     /***
       * 默认构造函数，不做实际用，仅为满足CListQueue的空闲头结点需求
       */    
     _sender_info.reply_handler = NULL;
+    _splice_pipe[0] = -1;
+    _splice_pipe[1] = -1;
+    atomic_set(&_outstanding_messages, 0);
 }
 
 CSender::~CSender()
 {    
     clear_message();    
+    release_zerocopy_messages();
+    close_splice_pipe();
+    _splice_source.detach();
     delete _sender_info.reply_handler; // 注意此处的性能
 }
 
@@ -53,7 +71,17 @@ CSender::CSender(const SenderInfo& sender_info)
     ,_cur_resend_times(0)
     ,_current_offset(0)
     ,_current_message(NULL)
+    ,_current_zerocopy(false)
+    ,_splice_source(this)
+    ,_splice_direct(-1)
+    ,_splice_pipe_bytes(0)
+    ,_pipeline_window(0)
+    ,_pipeline_timeout(0)
+    ,_window_blocked(false)
 {   
+    _splice_pipe[0] = -1;
+    _splice_pipe[1] = -1;
+    atomic_set(&_outstanding_messages, 0);
     set_peer(sender_info.ip_node);
     memcpy(&_sender_info, &sender_info, sizeof(SenderInfo));    
 
@@ -79,6 +107,35 @@ void CSender::set_reconnect_times(int32_t reconnect_times)
 	_sender_info.reconnect_times = reconnect_times;
 }
 
+void CSender::set_pipeline_window(uint16_t window, uint32_t timeout_milliseconds)
+{
+    _pipeline_window = window;
+    _pipeline_timeout = timeout_milliseconds;
+}
+
+bool CSender::check_inflight_timeout(uint64_t current_milliseconds)
+{
+    bool timeout = false;
+    InflightMessageList::iterator iter = _inflight_messages.begin();
+
+    while (iter != _inflight_messages.end())
+    {
+        if ((0 == iter->deadline) || (iter->deadline > current_milliseconds))
+        {
+            ++iter;
+        }
+        else
+        {
+            DISPATCHER_LOG_DEBUG("%s message %u timeout.\n", to_string().c_str(), iter->sequence);
+            timeout = true;
+            resend_or_drop(*iter);
+            _inflight_messages.erase(iter++);
+        }
+    }
+
+    return timeout;
+}
+
 void CSender::shutdown()
 {
     _to_shutdown = true;
@@ -98,11 +155,35 @@ void CSender::attach_sender_table(CSenderTable* sender_table)
 
 void CSender::before_close()
 {    
+    // 未完成的MSG_ZEROCOPY页面由内核持有引用，连接关闭后消息即可释放
+    release_zerocopy_messages();
+
+    // 重连后再发送时，如果来源仍无数据会重新关注
+    if (_send_thread != NULL)
+    {
+        _splice_source.unwatch(_send_thread->get_epoller());
+    }
+
+    // 等待应答的消息在新连接上重发
+    while (!_inflight_messages.empty())
+    {
+        _inflight_messages.front().zerocopy = false;
+        resend_or_drop(_inflight_messages.front());
+        _inflight_messages.pop_front();
+    }
+    for (InflightMessageList::iterator iter=_resend_messages.begin(); iter!=_resend_messages.end(); ++iter)
+    {
+        iter->zerocopy = false;
+    }
+
+    _window_blocked = false;
     _sender_info.reply_handler->sender_closed();
 }
 
 void CSender::after_connect()
 {
+    // 新连接的MSG_ZEROCOPY编号从0开始
+    _zerocopy.reset();
     _sender_info.reply_handler->sender_connected();
 }
 
@@ -113,11 +194,30 @@ void CSender::on_connect_failure()
 
 void CSender::clear_message()
 {
+    // 删除窗口中和待重发的消息
+    while (!_inflight_messages.empty())
+    {
+        free_inflight_message(_inflight_messages.front());
+        _inflight_messages.pop_front();
+    }
+    while (!_resend_messages.empty())
+    {
+        free_inflight_message(_resend_messages.front());
+        _resend_messages.pop_front();
+    }
+
+    // 删除合并发送中还未开始发送的消息
+    while (!_coalesced_messages.empty())
+    {
+        release_message(_coalesced_messages.front());
+        _coalesced_messages.pop_front();
+    }
+
     // 删除列队中的所有消息
     message_t* message;
     while (_send_queue.pop_front(message))
     {              
-        destroy_message(message);
+        release_message(message);
     }
 }
 
@@ -179,6 +279,23 @@ utils::handle_result_t CSender::do_handle_reply()
 bool CSender::get_current_message()
 {
     if (_current_message != NULL) return _current_message;
+    if (!_coalesced_messages.empty())
+    {
+        // 已调用过before_send
+        _current_message = _coalesced_messages.front();
+        _coalesced_messages.pop_front();
+        return true;
+    }
+    if (!_resend_messages.empty())
+    {
+        // 超时或连接断开后重发，也已调用过before_send
+        _current_message = _resend_messages.front().message;
+        _current_zerocopy = _resend_messages.front().zerocopy;
+        _cur_resend_times = _resend_messages.front().resend_times;
+        _resend_messages.pop_front();
+        return true;
+    }
+
     bool retval = _send_queue.pop_front(_current_message);
     if (retval)
         _sender_info.reply_handler->before_send();
@@ -188,9 +305,28 @@ bool CSender::get_current_message()
 
 void CSender::free_current_message()
 {
+    // 须在消息释放之前，因为消息释放后来源fd可能被关闭
+    _splice_source.unwatch(_send_thread->get_epoller());
+
     reset_resend_times();
-    destroy_message(_current_message);
+    if (_current_zerocopy)
+    {
+        // 内核可能仍在引用消息的内存，等收到完成通知后再释放
+        _zerocopy_messages.push_back(std::make_pair(_zerocopy.get_next_id(), _current_message));
+        _current_zerocopy = false;
+    }
+    else
+    {
+        release_message(_current_message);
+    }
     
+    if (_splice_pipe_bytes > 0)
+    {
+        // 丢弃中转管道中残留的数据
+        close_splice_pipe();
+    }
+
+    _splice_direct = -1;
     _current_message = NULL;            
     _current_offset = 0;
 }
@@ -201,7 +337,10 @@ void CSender::reset_current_message(bool finish)
     {    
         if (finish)
         {    
-            free_current_message();
+            if (!track_current_message())
+            {
+                free_current_message();
+            }
         }
         else
         {
@@ -229,6 +368,12 @@ net::epoll_event_t CSender::do_send_message(void* input_ptr, uint32_t events, vo
     // 优先处理完本队列中的所有消息
     for (;;)
     {
+        if ((NULL == _current_message) && _coalesced_messages.empty() && is_window_full())
+        {
+            // 窗口已满，等收到应答或超时腾出空间后再发送
+            _window_blocked = true;
+            return net::epoll_read;
+        }
         if (!get_current_message())
         {
             // 队列里没有了
@@ -252,8 +397,49 @@ net::epoll_event_t CSender::do_send_message(void* input_ptr, uint32_t events, vo
         {
             // 发送Buffer
             buffer_message_t* buffer_message = (buffer_message_t*)(_current_message->data);
-            retval = send(buffer_message->data+_current_offset, _current_message->length-_current_offset);
+            uint16_t coalesce_messages = _send_thread->get_coalesce_messages();
+            uint32_t zerocopy_threshold = _send_thread->get_zerocopy_threshold();
+
+            if (can_coalesce(_current_message->length-_current_offset, coalesce_messages, zerocopy_threshold))
+            {
+                // 和队列中紧随其后的Buffer消息一起以writev发送
+                retval = do_send_coalesced(coalesce_messages, zerocopy_threshold);
+                if (-1 == retval)
+                {
+                    return net::epoll_read_write; // wouldblock
+                }
+                if (!move_coalesced_offset((size_t)retval))
+                {
+                    // 未全部发送，需要等待下一轮回
+                    return net::epoll_read_write;
+                }
+
+                continue;
+            }
+
+            retval = do_send_buffer(buffer_message->data+_current_offset, _current_message->length-_current_offset);
         }   
+        else if (DISPATCH_SPLICE == _current_message->type)
+        {
+            // 转发fd中的数据，断开重连后从断点处接着发
+            int source_errcode = 0;
+            retval = do_send_splice(&source_errcode);
+            if (splice_source_blocked == retval)
+            {
+                // 等来源可读时再发，期间不关注连接的可写事件
+                return net::epoll_read;
+            }
+            if (splice_source_closed == retval)
+            {
+                // 问题出在来源而不是连接，丢弃消息，不重连也不重发
+                if (!abort_current_message(source_errcode))
+                {
+                    return net::epoll_close;
+                }
+
+                continue;
+            }
+        }
         else
         {
             MYLOG_DEBUG("%s received message %d.\n", to_string().c_str(), _current_message->type);
@@ -283,6 +469,332 @@ net::epoll_event_t CSender::do_send_message(void* input_ptr, uint32_t events, vo
     return net::epoll_close;
 }
 
+ssize_t CSender::do_send_buffer(const char* buffer, size_t buffer_size)
+{
+    uint32_t zerocopy_threshold = _send_thread->get_zerocopy_threshold();
+
+    if (_zerocopy.need_zerocopy(get_fd(), buffer_size, zerocopy_threshold))
+    {
+        bool zerocopy;
+        ssize_t retval = send_zerocopy(buffer, buffer_size, zerocopy);
+        if (zerocopy)
+        {
+            _zerocopy.on_zerocopy_sent();
+            _current_zerocopy = true;
+        }
+
+        return retval;
+    }
+
+    return send(buffer, buffer_size);
+}
+
+ssize_t CSender::do_send_splice(int* source_errcode)
+{
+    splice_message_t* splice_message = (splice_message_t*)(_current_message->data);
+    size_t size = _current_message->length - _current_offset;
+    ssize_t retval;
+
+    if (-1 == _splice_direct)
+    {
+        struct stat st;
+        _splice_direct = ((0 == fstat(splice_message->fd, &st)) && S_ISFIFO(st.st_mode))? 1: 0;
+    }
+    if (1 == _splice_direct)
+    {
+        // 来源是管道，直接转到连接
+        retval = send_splice(splice_message->fd, size);
+        if (0 == retval)
+        {
+            *source_errcode = 0; // 管道的写端已关闭
+            return splice_source_closed;
+        }
+        if ((-1 == retval) && wait_splice_source(splice_message->fd))
+        {
+            return splice_source_blocked;
+        }
+
+        return retval;
+    }
+
+    // 来源不是管道，先从来源转到中转管道，再从中转管道转到连接
+    if (-1 == _splice_pipe[0])
+    {
+        if (-1 == pipe2(_splice_pipe, O_NONBLOCK|O_CLOEXEC))
+        {
+            THROW_SYSCALL_EXCEPTION(NULL, errno, "pipe2");
+        }
+
+        // 默认64KB偏小，尽量调大以减少系统调用次数，失败不影响使用
+        (void)fcntl(_splice_pipe[1], F_SETPIPE_SZ, 1024*1024);
+    }
+    if (_splice_pipe_bytes < size)
+    {
+        retval = splice(splice_message->fd, NULL, _splice_pipe[1], NULL, size-_splice_pipe_bytes, SPLICE_F_MOVE|SPLICE_F_NONBLOCK);
+        if (retval > 0)
+        {
+            _splice_pipe_bytes += (size_t)retval;
+        }
+        else if (0 == _splice_pipe_bytes)
+        {
+            // 中转管道中的已发送完，才处理来源的结束、出错或暂无数据，
+            // 否则先发送中转管道中的，下次再从来源转时会再遇到
+            if (0 == retval)
+            {
+                *source_errcode = 0;
+                return splice_source_closed;
+            }
+            if (EAGAIN == errno)
+            {
+                _splice_source.watch(_send_thread->get_epoller(), splice_message->fd);
+                return splice_source_blocked;
+            }
+            if (errno != EINTR)
+            {
+                *source_errcode = errno;
+                return splice_source_closed;
+            }
+        }
+    }
+    if (0 == _splice_pipe_bytes)
+    {
+        return -1; // 被信号中断，等下一轮回
+    }
+
+    retval = send_splice(_splice_pipe[0], _splice_pipe_bytes);
+    if (retval > 0)
+    {
+        _splice_pipe_bytes -= (size_t)retval;
+    }
+
+    return retval;
+}
+
+bool CSender::wait_splice_source(int fd)
+{
+    // 管道直接转到连接时，splice返回EAGAIN可能是管道空，也可能是连接不可写，
+    // 管道空时关注管道的可读事件，否则关注连接的可写事件
+    struct pollfd pfd;
+    pfd.fd = fd;
+    pfd.events = POLLIN;
+    pfd.revents = 0;
+    if (poll(&pfd, 1, 0) != 0)
+    {
+        return false; // 管道有数据、写端已关闭或出错，下次splice会遇到
+    }
+
+    _splice_source.watch(_send_thread->get_epoller(), fd);
+    return true;
+}
+
+bool CSender::abort_current_message(int errcode)
+{
+    DISPATCHER_LOG_ERROR("%s aborted message at %zd/%zd: %s.\n"
+        , to_string().c_str()
+        , (size_t)_current_offset, _current_message->length
+        , (0 == errcode)? "source closed": sys::Error::to_string(errcode).c_str());
+
+    bool keep = _sender_info.reply_handler->send_aborted(_current_message->length, _current_offset, errcode);
+    free_current_message();
+    return keep;
+}
+
+void CSender::close_splice_pipe()
+{
+    if (_splice_pipe[0] != -1)
+    {
+        ::close(_splice_pipe[0]);
+        ::close(_splice_pipe[1]);
+        _splice_pipe[0] = -1;
+        _splice_pipe[1] = -1;
+    }
+
+    _splice_pipe_bytes = 0;
+}
+
+bool CSender::can_coalesce(size_t buffer_size, uint16_t coalesce_messages, uint32_t zerocopy_threshold) const
+{
+    // 大消息走零拷贝
+    if (coalesce_messages < 2)
+    {
+        return false;
+    }
+
+    return (0 == zerocopy_threshold) || (buffer_size < zerocopy_threshold);
+}
+
+ssize_t CSender::do_send_coalesced(uint16_t coalesce_messages, uint32_t zerocopy_threshold)
+{
+    // 从队列中取出紧随其后的Buffer消息，遇到文件消息或大消息即停止，以保持消息的顺序
+    message_t* message;
+    size_t max_messages = coalesce_messages;
+    if (!_resend_messages.empty())
+    {
+        // 待重发的消息先于队列中的消息发送
+        max_messages = 1;
+    }
+    else if (_pipeline_window > 0)
+    {
+        // 不超出窗口的剩余空间
+        size_t inflight_messages = _inflight_messages.size();
+        max_messages = std::min(max_messages, (inflight_messages < _pipeline_window)? _pipeline_window-inflight_messages: 1);
+    }
+    while ((_coalesced_messages.size()+1 < max_messages) && _send_queue.front(message))
+    {
+        if ((message->type != DISPATCH_BUFFER)
+         || !can_coalesce(message->length, coalesce_messages, zerocopy_threshold))
+        {
+            break;
+        }
+
+        _send_queue.pop_front();
+        _coalesced_messages.push_back(message);
+        _sender_info.reply_handler->before_send();
+    }
+
+    struct iovec iov;
+    buffer_message_t* buffer_message = (buffer_message_t*)(_current_message->data);
+
+    _iov.clear();
+    iov.iov_base = buffer_message->data + _current_offset;
+    iov.iov_len = _current_message->length - _current_offset;
+    _iov.push_back(iov);
+    for (std::list<message_t*>::iterator iter=_coalesced_messages.begin(); iter!=_coalesced_messages.end(); ++iter)
+    {
+        buffer_message = (buffer_message_t*)((*iter)->data);
+        iov.iov_base = buffer_message->data;
+        iov.iov_len = (*iter)->length;
+        _iov.push_back(iov);
+    }
+
+    return writev(&_iov[0], (int)_iov.size());
+}
+
+bool CSender::move_coalesced_offset(size_t size)
+{
+    // 发送的字节可能跨越多个消息，逐个推进，保持每个消息的回调和重发语义
+    while (get_current_message())
+    {
+        size_t current = std::min(size, _current_message->length - _current_offset);
+
+        size -= current;
+        _current_offset += current;
+        if (current > 0)
+        {
+            _sender_info.reply_handler->send_progress(_current_message->length, _current_offset, current);
+        }
+        if (_current_offset < _current_message->length)
+        {
+            return false;
+        }
+
+        _sender_info.reply_handler->send_completed();
+        reset_current_message(true);
+        if (_coalesced_messages.empty())
+        {
+            // 本批全部发送完毕
+            break;
+        }
+    }
+
+    return true;
+}
+
+void CSender::release_done_zerocopy_messages()
+{
+    // 按发送顺序释放已完成的消息
+    while (!_zerocopy_messages.empty()
+        && _zerocopy.is_done(_zerocopy_messages.front().first))
+    {
+        release_message(_zerocopy_messages.front().second);
+        _zerocopy_messages.pop_front();
+    }
+}
+
+void CSender::release_zerocopy_messages()
+{
+    while (!_zerocopy_messages.empty())
+    {
+        release_message(_zerocopy_messages.front().second);
+        _zerocopy_messages.pop_front();
+    }
+
+    // 连接断开后，重发的消息从头开始，不再关联旧连接上的编号
+    _current_zerocopy = false;
+}
+
+void CSender::release_message(message_t* message)
+{
+    atomic_dec(&_outstanding_messages);
+    destroy_message(message);
+}
+
+bool CSender::is_window_full() const
+{
+    return (_pipeline_window > 0) && (_inflight_messages.size() >= _pipeline_window);
+}
+
+bool CSender::track_current_message()
+{
+    uint32_t sequence;
+    if ((0 == _pipeline_window) || (_current_message->type != DISPATCH_BUFFER))
+    {
+        return false;
+    }
+
+    buffer_message_t* buffer_message = (buffer_message_t*)(_current_message->data);
+    if (!_sender_info.reply_handler->get_message_sequence(buffer_message->data, _current_message->length, &sequence))
+    {
+        return false;
+    }
+
+    // 保留在窗口中直到收到应答
+    InflightMessage inflight_message;
+    inflight_message.sequence = sequence;
+    inflight_message.resend_times = _cur_resend_times;
+    inflight_message.zerocopy = _current_zerocopy;
+    inflight_message.deadline = (0 == _pipeline_timeout)? 0: sys::current_milliseconds() + _pipeline_timeout;
+    inflight_message.message = _current_message;
+    _inflight_messages.push_back(inflight_message);
+    if (inflight_message.deadline > 0)
+    {
+        _send_thread->watch_inflight(this);
+    }
+
+    reset_resend_times();
+    _current_message = NULL;
+    _current_offset = 0;
+    _current_zerocopy = false;
+    return true;
+}
+
+void CSender::resend_or_drop(InflightMessage& inflight_message)
+{
+    if ((_sender_info.resend_times < 0) || (inflight_message.resend_times < _sender_info.resend_times))
+    {
+        ++inflight_message.resend_times;
+        _resend_messages.push_back(inflight_message);
+    }
+    else
+    {
+        _sender_info.reply_handler->message_timeout(inflight_message.sequence);
+        free_inflight_message(inflight_message);
+    }
+}
+
+void CSender::free_inflight_message(const InflightMessage& inflight_message)
+{
+    if (inflight_message.zerocopy)
+    {
+        // 以当前编号为准，不早于该消息最后一次发送所需的编号
+        _zerocopy_messages.push_back(std::make_pair(_zerocopy.get_next_id(), inflight_message.message));
+    }
+    else
+    {
+        release_message(inflight_message.message);
+    }
+}
+
 net::epoll_event_t CSender::handle_epoll_event(void* input_ptr, uint32_t events, void* output_ptr)
 {    
     utils::CTimeoutManager<CSender>* timeout_manager;
@@ -291,6 +803,22 @@ net::epoll_event_t CSender::handle_epoll_event(void* input_ptr, uint32_t events,
     
     try
     {
+        // MSG_ZEROCOPY的完成通知放在错误队列中，以EPOLLERR报告
+        if ((EPOLLERR & events) && _zerocopy.is_enabled())
+        {
+            _zerocopy.handle_completion(get_fd());
+            release_done_zerocopy_messages();
+            if (0 == get_socket_error_code())
+            {
+                events &= ~EPOLLERR;
+                if (0 == (events & (EPOLLIN|EPOLLOUT|EPOLLHUP)))
+                {
+                    timeout_manager->push(this, get_send_thread()->get_current_time());
+                    return net::epoll_none;
+                }
+            }
+        }
+
         do
         {           
             if (EPOLLHUP & events)
@@ -333,6 +861,13 @@ net::epoll_event_t CSender::handle_epoll_event(void* input_ptr, uint32_t events,
                 }
                 
                 timeout_manager->push(this, get_send_thread()->get_current_time());
+                if (_window_blocked && !is_window_full())
+                {
+                    // 收到应答腾出了窗口空间，恢复发送
+                    _window_blocked = false;
+                    return net::epoll_read_write;
+                }
+
                 return net::epoll_none;                
             }
             else if (EPOLLOUT & events)
@@ -376,7 +911,15 @@ bool CSender::do_push_message(ConcreteMessage* concrete_message, uint32_t millis
     char* message_buffer = reinterpret_cast<char*>(concrete_message) - sizeof(message_t);
     message_t* message = reinterpret_cast<message_t*>(message_buffer);
 
-    return _send_queue.push_back(message, milliseconds);
+    // 先计数，以免消息被发送线程释放后才计入
+    atomic_inc(&_outstanding_messages);
+    if (!_send_queue.push_back(message, milliseconds))
+    {
+        atomic_dec(&_outstanding_messages);
+        return false;
+    }
+
+    return true;
 }
 
 bool CSender::push_message(file_message_t* message, uint32_t milliseconds)
@@ -389,4 +932,47 @@ bool CSender::push_message(buffer_message_t* message, uint32_t milliseconds)
     return do_push_message(message, milliseconds);
 }
 
+bool CSender::push_message(splice_message_t* message, uint32_t milliseconds)
+{
+    return do_push_message(message, milliseconds);
+}
+
+uint32_t CSender::get_outstanding_messages() const
+{
+    int outstanding_messages = atomic_read(&_outstanding_messages);
+    return (outstanding_messages > 0)? static_cast<uint32_t>(outstanding_messages): 0;
+}
+
+bool CSender::is_available() const
+{
+    return is_connect_established() && !_send_queue.is_full();
+}
+
+bool CSender::complete_message(uint32_t sequence)
+{
+    // 应答通常按发送顺序到达，从头开始找
+    for (InflightMessageList::iterator iter=_inflight_messages.begin(); iter!=_inflight_messages.end(); ++iter)
+    {
+        if (iter->sequence == sequence)
+        {
+            free_inflight_message(*iter);
+            _inflight_messages.erase(iter);
+            return true;
+        }
+    }
+
+    // 已超时待重发的消息，收到迟到的应答后不再重发
+    for (InflightMessageList::iterator iter=_resend_messages.begin(); iter!=_resend_messages.end(); ++iter)
+    {
+        if (iter->sequence == sequence)
+        {
+            free_inflight_message(*iter);
+            _resend_messages.erase(iter);
+            return true;
+        }
+    }
+
+    return false;
+}
+
 DISPATCHER_NAMESPACE_END
@@ -19,10 +19,14 @@
 #ifndef MOOON_DISPATCHER_SENDER_H
 #define MOOON_DISPATCHER_SENDER_H
 #include <sys/uio.h>
+#include <list>
+#include <vector>
 #include <mooon/net/tcp_client.h>
+#include <mooon/sys/atomic.h>
 #include <mooon/utils/listable.h>
 #include <mooon/utils/timeoutable.h>
 #include "send_queue.h"
+#include "splice_source.h"
 DISPATCHER_NAMESPACE_BEGIN
 
 class CSendThread;
@@ -37,6 +41,17 @@ class CSender: public ISender, public net::CTcpClient, public utils::CTimeoutabl
         ra_continue // 消息未发送完毕，需要继续发送
     }reset_action_t;
 
+    // 流水线窗口中的消息
+    struct InflightMessage
+    {
+        uint32_t sequence;     // 消息序列号，由IReplyHandler::get_message_sequence取得
+        int resend_times;      // 已经重发的次数
+        bool zerocopy;         // 是否以MSG_ZEROCOPY发送过
+        uint64_t deadline;     // 等待应答的截止时间（毫秒），为0表示不超时
+        message_t* message;
+    };
+    typedef std::list<InflightMessage> InflightMessageList;
+
 public:    
     CSender(); // 默认构造函数，不做实际用，仅为满足CListQueue的空闲头结点需求
     virtual ~CSender();                
@@ -46,6 +61,14 @@ public:
     virtual std::string to_string() const;
     virtual const SenderInfo& get_sender_info() const { return _sender_info; }
     virtual void set_reconnect_times(int32_t reconnect_times);
+    virtual void set_pipeline_window(uint16_t window, uint32_t timeout_milliseconds);
+
+    /***
+      * 检查窗口中等待应答超时的消息，超时的按重发策略转入重发列表或丢弃
+      * @return: 如果有消息超时，返回true，这时需要重新关注EPOLLOUT
+      */
+    bool check_inflight_timeout(uint64_t current_milliseconds);
+    bool has_inflight_messages() const { return !_inflight_messages.empty(); }
 
     void shutdown();
     bool to_shutdown() const { return _to_shutdown; }
@@ -66,6 +89,10 @@ private: // ISender
     virtual std::string str() const { return to_string(); }     
     virtual bool push_message(file_message_t* message, uint32_t milliseconds);
     virtual bool push_message(buffer_message_t* message, uint32_t milliseconds);
+    virtual bool push_message(splice_message_t* message, uint32_t milliseconds);
+    virtual bool complete_message(uint32_t sequence);
+    virtual uint32_t get_outstanding_messages() const;
+    virtual bool is_available() const;
     
 private:
     void clear_message();    
@@ -77,6 +104,21 @@ private:
     void reset_current_message(bool finish);
     utils::handle_result_t do_handle_reply();
     net::epoll_event_t do_send_message(void* input_ptr, uint32_t events, void* output_ptr);
+    ssize_t do_send_buffer(const char* buffer, size_t buffer_size);
+    ssize_t do_send_splice(int* source_errcode);
+    bool wait_splice_source(int fd);
+    bool abort_current_message(int errcode);
+    void close_splice_pipe();
+    bool can_coalesce(size_t buffer_size, uint16_t coalesce_messages, uint32_t zerocopy_threshold) const;
+    ssize_t do_send_coalesced(uint16_t coalesce_messages, uint32_t zerocopy_threshold);
+    bool move_coalesced_offset(size_t size);
+    void release_done_zerocopy_messages();
+    void release_zerocopy_messages();
+    void release_message(message_t* message);
+    bool is_window_full() const;
+    bool track_current_message();
+    void resend_or_drop(InflightMessage& inflight_message);
+    void free_inflight_message(const InflightMessage& inflight_message);
     template <typename ConcreteMessage>
     bool do_push_message(ConcreteMessage* concrete_message, uint32_t milliseconds);
     
@@ -96,6 +138,35 @@ private:
     volatile int _cur_resend_times;    // 当前已经连续重发的次数
     volatile size_t _current_offset;      // 当前已经发送的字节数
     message_t* _current_message; // 当前正在发送的消息
+    atomic_t _outstanding_messages; // 已入队但还未释放的消息数
+
+private: // writev合并发送
+    std::list<message_t*> _coalesced_messages; // 跟在当前消息之后，已从队列取出合并发送的Buffer消息，均未开始发送
+    std::vector<struct iovec> _iov;
+
+private: // MSG_ZEROCOPY
+    typedef std::list<std::pair<uint32_t, message_t*> > ZeroCopyMessageList;
+    net::CZeroCopyState _zerocopy;
+    bool _current_zerocopy;      // 当前消息是否以MSG_ZEROCOPY发送过
+    ZeroCopyMessageList _zerocopy_messages; // 已发送完，但等待内核完成通知的消息，及其完成所需的编号
+
+private: // splice转发
+    enum
+    {
+        splice_source_blocked = -2, // do_send_splice的返回值，来源暂无数据，已关注来源的可读事件
+        splice_source_closed  = -3  // do_send_splice的返回值，来源已结束或出错
+    };
+    CSpliceSource _splice_source; // 来源暂无数据时关注来源的可读事件
+    int8_t _splice_direct;   // 当前消息的来源是否为管道，-1表示还未判断
+    int _splice_pipe[2];     // 来源不是管道时使用的中转管道
+    size_t _splice_pipe_bytes; // 中转管道中还未发送的字节数，连接断开后接着发送
+
+private: // 流水线窗口
+    volatile uint16_t _pipeline_window;     // 为0表示不启用
+    volatile uint32_t _pipeline_timeout;    // 等待应答的超时毫秒数，为0表示不超时
+    bool _window_blocked;                   // 是否因窗口满而暂停了发送
+    InflightMessageList _inflight_messages; // 已发送完，等待应答的消息，按发送顺序
+    InflightMessageList _resend_messages;   // 超时或连接断开后需要重发的消息，优先于队列中的消息发送
 };
 
 DISPATCHER_NAMESPACE_END
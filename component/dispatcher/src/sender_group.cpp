@@ -16,11 +16,252 @@
  *
  * Author: eyjian@qq.com or eyjian@gmail.com
  */
+#include <algorithm>
+#include <pthread.h>
+#include <mooon/sys/datetime_utils.h>
 #include "sender_group.h"
 DISPATCHER_NAMESPACE_BEGIN
 
-CSenderGroup::CSenderGroup()
+// 每个Sender在哈希环上的虚拟节点数，使各Sender分到的键更均匀
+static const int VIRTUAL_NODES = 100;
+
+// 64位整数的混合函数（MurmurHash3的fmix64）
+static uint32_t hash_uint64(uint64_t x)
+{
+    x ^= x >> 33;
+    x *= UINT64_C(0xff51afd7ed558ccd);
+    x ^= x >> 33;
+    x *= UINT64_C(0xc4ceb9fe1a85ec53);
+    x ^= x >> 33;
+    return static_cast<uint32_t>(x);
+}
+
+// 每个线程独立的伪随机数，避免多线程争用
+static uint32_t thread_random()
+{
+    static __thread uint64_t seed = 0;
+    if (0 == seed)
+    {
+        seed = sys::current_milliseconds() ^ static_cast<uint64_t>(pthread_self()) ^ UINT64_C(0x9e3779b97f4a7c15);
+    }
+
+    seed ^= seed << 13;
+    seed ^= seed >> 7;
+    seed ^= seed << 17;
+    return static_cast<uint32_t>(seed);
+}
+
+CSenderGroup::CSenderGroup(IManagedSenderTable* sender_table, sender_group_policy_t policy)
+    :_sender_table(sender_table)
+    ,_policy(policy)
+{
+    atomic_set(&_cursor, 0);
+}
+
+bool CSenderGroup::add_sender(uint16_t key)
+{
+    sys::WriteLockHelper write_lock(_lock);
+    if (std::find(_keys.begin(), _keys.end(), key) != _keys.end())
+    {
+        return false;
+    }
+
+    _keys.push_back(key);
+    rebuild_hash_ring();
+    return true;
+}
+
+void CSenderGroup::remove_sender(uint16_t key)
+{
+    sys::WriteLockHelper write_lock(_lock);
+    std::vector<uint16_t>::iterator iter = std::find(_keys.begin(), _keys.end(), key);
+
+    if (iter != _keys.end())
+    {
+        _keys.erase(iter);
+        rebuild_hash_ring();
+    }
+}
+
+bool CSenderGroup::push_message(file_message_t* message, uint64_t hash_key, uint32_t milliseconds)
+{
+    return do_push_message(message, hash_key, milliseconds);
+}
+
+bool CSenderGroup::push_message(buffer_message_t* message, uint64_t hash_key, uint32_t milliseconds)
+{
+    return do_push_message(message, hash_key, milliseconds);
+}
+
+bool CSenderGroup::push_message(splice_message_t* message, uint64_t hash_key, uint32_t milliseconds)
+{
+    return do_push_message(message, hash_key, milliseconds);
+}
+
+ISender* CSenderGroup::select_sender(uint64_t hash_key)
+{
+    sys::ReadLockHelper read_lock(_lock);
+    if (_keys.empty())
+    {
+        return NULL;
+    }
+
+    if (group_power_of_two == _policy)
+    {
+        return select_power_of_two();
+    }
+    if (group_consistent_hash == _policy)
+    {
+        return select_consistent_hash(hash_key);
+    }
+
+    return select_least_outstanding();
+}
+
+ISender* CSenderGroup::select_least_outstanding()
+{
+    ISender* selected = NULL;
+    bool selected_available = false;
+    uint32_t selected_outstanding = 0;
+    std::vector<uint16_t>::size_type start = static_cast<uint32_t>(atomic_inc_return(&_cursor)) % _keys.size();
+
+    for (std::vector<uint16_t>::size_type i=0; i<_keys.size(); ++i)
+    {
+        ISender* sender = _sender_table->get_sender(_keys[(start+i) % _keys.size()]);
+        if (NULL == sender)
+        {
+            continue;
+        }
+
+        // 可用的优先，其次比较未完成的消息数
+        bool available = sender->is_available();
+        uint32_t outstanding = sender->get_outstanding_messages();
+        if ((NULL == selected)
+         || (available && !selected_available)
+         || ((available == selected_available) && (outstanding < selected_outstanding)))
+        {
+            if (selected != NULL)
+            {
+                _sender_table->release_sender(selected);
+            }
+
+            selected = sender;
+            selected_available = available;
+            selected_outstanding = outstanding;
+        }
+        else
+        {
+            _sender_table->release_sender(sender);
+        }
+    }
+
+    return selected;
+}
+
+ISender* CSenderGroup::select_power_of_two()
+{
+    std::vector<uint16_t>::size_type size = _keys.size();
+    std::vector<uint16_t>::size_type first = thread_random() % size;
+    std::vector<uint16_t>::size_type second = (size > 1)? (first + 1 + thread_random() % (size-1)) % size: first;
+
+    ISender* sender1 = _sender_table->get_sender(_keys[first]);
+    ISender* sender2 = (second == first)? NULL: _sender_table->get_sender(_keys[second]);
+    bool available1 = (sender1 != NULL) && sender1->is_available();
+    bool available2 = (sender2 != NULL) && sender2->is_available();
+
+    if (!available1 && !available2)
+    {
+        // 两个都不可用，退回到全部比较
+        if (sender1 != NULL) _sender_table->release_sender(sender1);
+        if (sender2 != NULL) _sender_table->release_sender(sender2);
+        return select_least_outstanding();
+    }
+    if (available1 && available2)
+    {
+        if (sender2->get_outstanding_messages() < sender1->get_outstanding_messages())
+        {
+            std::swap(sender1, sender2);
+        }
+    }
+    else if (!available1)
+    {
+        std::swap(sender1, sender2);
+    }
+
+    if (sender2 != NULL)
+    {
+        _sender_table->release_sender(sender2);
+    }
+
+    return sender1;
+}
+
+ISender* CSenderGroup::select_consistent_hash(uint64_t hash_key)
 {
+    std::vector<uint16_t> tried_keys;
+    HashRing::const_iterator iter = std::lower_bound(_hash_ring.begin(), _hash_ring.end(), std::make_pair(hash_uint64(hash_key), (uint16_t)0));
+
+    // 顺时针找第一个可用的Sender，这样某个Sender不可用时只有它的键会迁移
+    for (HashRing::size_type i=0; (i<_hash_ring.size()) && (tried_keys.size()<_keys.size()); ++i, ++iter)
+    {
+        if (iter == _hash_ring.end())
+        {
+            iter = _hash_ring.begin();
+        }
+        if (std::find(tried_keys.begin(), tried_keys.end(), iter->second) != tried_keys.end())
+        {
+            continue;
+        }
+
+        tried_keys.push_back(iter->second);
+        ISender* sender = _sender_table->get_sender(iter->second);
+        if (sender != NULL)
+        {
+            if (sender->is_available())
+            {
+                return sender;
+            }
+
+            _sender_table->release_sender(sender);
+        }
+    }
+
+    return select_least_outstanding();
+}
+
+void CSenderGroup::rebuild_hash_ring()
+{
+    _hash_ring.clear();
+    if (_policy != group_consistent_hash)
+    {
+        return;
+    }
+
+    _hash_ring.reserve(_keys.size() * VIRTUAL_NODES);
+    for (std::vector<uint16_t>::size_type i=0; i<_keys.size(); ++i)
+    {
+        for (int j=0; j<VIRTUAL_NODES; ++j)
+        {
+            uint64_t node = (static_cast<uint64_t>(_keys[i]) << 32) | static_cast<uint64_t>(j);
+            _hash_ring.push_back(std::make_pair(hash_uint64(node), _keys[i]));
+        }
+    }
+
+    std::sort(_hash_ring.begin(), _hash_ring.end());
+}
+
+template <typename ConcreteMessage>
+bool CSenderGroup::do_push_message(ConcreteMessage* message, uint64_t hash_key, uint32_t milliseconds)
+{
+    ISender* sender = select_sender(hash_key);
+    if (NULL == sender)
+    {
+        return false;
+    }
+
+    bool retval = sender->push_message(message, milliseconds);
+    _sender_table->release_sender(sender);
+    return retval;
 }
 
 DISPATCHER_NAMESPACE_END
@@ -18,13 +18,45 @@
  */
 #ifndef MOOON_DISPATCHER_SENDER_GROUP_H
 #define MOOON_DISPATCHER_SENDER_GROUP_H
+#include <vector>
+#include <mooon/sys/atomic.h>
+#include <mooon/sys/read_write_lock.h>
 #include "sender.h"
 DISPATCHER_NAMESPACE_BEGIN
 
-class CSenderGroup
+class CSenderGroup: public ISenderGroup
 {
+    // 一致性哈希环上的虚拟节点：哈希值和对应Sender的Key
+    typedef std::vector<std::pair<uint32_t, uint16_t> > HashRing;
+
 public:
-    CSenderGroup();
+    CSenderGroup(IManagedSenderTable* sender_table, sender_group_policy_t policy);
+
+private: // ISenderGroup
+    virtual bool add_sender(uint16_t key);
+    virtual void remove_sender(uint16_t key);
+    virtual bool push_message(file_message_t* message, uint64_t hash_key, uint32_t milliseconds);
+    virtual bool push_message(buffer_message_t* message, uint64_t hash_key, uint32_t milliseconds);
+    virtual bool push_message(splice_message_t* message, uint64_t hash_key, uint32_t milliseconds);
+
+private:
+    // 选出的Sender引用计数已增一，用完须release_sender
+    ISender* select_sender(uint64_t hash_key);
+    ISender* select_least_outstanding();
+    ISender* select_power_of_two();
+    ISender* select_consistent_hash(uint64_t hash_key);
+    void rebuild_hash_ring();
+
+    template <typename ConcreteMessage>
+    bool do_push_message(ConcreteMessage* message, uint64_t hash_key, uint32_t milliseconds);
+
+private:
+    IManagedSenderTable* _sender_table;
+    sender_group_policy_t _policy;
+    sys::CReadWriteLock _lock; // 保护_keys和_hash_ring，成员变动少，推送消息只需读锁
+    std::vector<uint16_t> _keys;
+    HashRing _hash_ring;
+    atomic_t _cursor; // 轮转起点，使负载相同的Sender被轮流选中
 };
 
 DISPATCHER_NAMESPACE_END
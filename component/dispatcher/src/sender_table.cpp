@@ -16,6 +16,7 @@
  *
  * Author: eyjian@qq.com or eyjian@gmail.com
  */
+#include <sched.h>
 #include "sender_table.h"
 DISPATCHER_NAMESPACE_BEGIN
 
@@ -42,6 +43,9 @@ bool check_sender_info(const SenderInfo& sender_info)
 CSenderTable::CSenderTable(CDispatcherContext* context)
     :_context(context)
 {   
+    atomic_set(&_phase, 0);
+    atomic_set(&_readers[0], 0);
+    atomic_set(&_readers[1], 0);
 }
 
 CDispatcherContext* CSenderTable::get_context()
@@ -49,4 +53,43 @@ CDispatcherContext* CSenderTable::get_context()
     return _context;
 }
 
+int CSenderTable::read_lock()
+{
+    for (;;)
+    {
+        int phase = atomic_read(&_phase) & 1;
+        atomic_inc(&_readers[phase]);
+
+        // 登记后阶段未变，写者一定能看到这次登记；
+        // 否则写者可能已错过，重新登记到新阶段
+        if ((atomic_read(&_phase) & 1) == phase)
+        {
+            return phase;
+        }
+
+        atomic_dec(&_readers[phase]);
+    }
+}
+
+void CSenderTable::read_unlock(int phase)
+{
+    atomic_dec(&_readers[phase]);
+}
+
+void CSenderTable::synchronize()
+{
+    // 切换阶段后新进入的读者只能看到摘除之后的表，只需等待旧阶段的读者
+    int phase = atomic_add_return(1, &_phase) - 1;
+    while (atomic_read(&_readers[phase & 1]) != 0)
+    {
+        sched_yield();
+    }
+}
+
+void CSenderTable::release_removed(CSender* sender)
+{
+    synchronize();
+    (void)sender->dec_refcount();
+}
+
 DISPATCHER_NAMESPACE_END
@@ -18,6 +18,7 @@
  */
 #ifndef MOOON_DISPATCHER_SENDER_TABLE_H
 #define MOOON_DISPATCHER_SENDER_TABLE_H
+#include <mooon/sys/atomic.h>
 #include <mooon/sys/lock.h>
 #include "sender.h"
 #include "mooon/dispatcher/dispatcher.h"
@@ -36,8 +37,32 @@ public:
 protected:
     CDispatcherContext* get_context();
 
+protected:
+    /***
+      * 查找Sender不加锁（RCU方式）：读者只登记进出，写者（open/close/release/remove）
+      * 由_lock串行化，从表中摘除Sender后先调用synchronize等待已进入的读者离开，
+      * 再减引用计数，从而保证读者在持有读锁期间对Sender增引用计数是安全的
+      */
+
+    /** 读者进入，返回值须传给read_unlock */
+    int read_lock();
+
+    /** 读者离开 */
+    void read_unlock(int phase);
+
+    /** 等待调用之前进入的读者全部离开，调用者须持有_lock */
+    void synchronize();
+
+    /** 在持有_lock时，对已从表中摘除的Sender减引用计数 */
+    void release_removed(CSender* sender);
+
+protected:
+    sys::CLock _lock; // 串行化写操作
+
 private:
     CDispatcherContext* _context;
+    atomic_t _phase;      // 读者当前登记的阶段，只用最低位
+    atomic_t _readers[2]; // 各阶段中的读者个数
 };
 
 DISPATCHER_NAMESPACE_END
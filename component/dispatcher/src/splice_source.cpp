@@ -0,0 +1,66 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Author: eyjian@qq.com or eyjian@gmail.com
+ */
+#include "sender.h"
+#include "send_thread.h"
+#include "splice_source.h"
+DISPATCHER_NAMESPACE_BEGIN
+
+CSpliceSource::CSpliceSource(CSender* sender)
+    :_sender(sender)
+{
+}
+
+CSpliceSource::~CSpliceSource()
+{
+    // 不能关闭来源fd
+    detach();
+}
+
+void CSpliceSource::watch(net::CEpoller& epoller, int fd)
+{
+    if (get_fd() != fd)
+    {
+        unwatch(epoller);
+        set_fd(fd);
+    }
+
+    epoller.set_events(this, EPOLLIN);
+}
+
+void CSpliceSource::unwatch(net::CEpoller& epoller)
+{
+    if (get_epoll_events() != -1)
+    {
+        epoller.del_events(this);
+    }
+
+    detach();
+}
+
+net::epoll_event_t CSpliceSource::handle_epoll_event(void* input_ptr, uint32_t events, void* ouput_ptr)
+{
+    // 来源可读（包括来源结束或出错），通知CSender接着发送
+    CSendThread* thread = static_cast<CSendThread*>(input_ptr);
+    net::CEpoller& epoller = thread->get_epoller();
+
+    epoller.set_events(_sender, EPOLLIN|EPOLLOUT);
+    return net::epoll_remove;
+}
+
+DISPATCHER_NAMESPACE_END
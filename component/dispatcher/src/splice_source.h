@@ -0,0 +1,51 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Author: eyjian@qq.com or eyjian@gmail.com
+ */
+#ifndef MOOON_DISPATCHER_SPLICE_SOURCE_H
+#define MOOON_DISPATCHER_SPLICE_SOURCE_H
+#include <mooon/net/epoller.h>
+#include "dispatcher_log.h"
+DISPATCHER_NAMESPACE_BEGIN
+
+class CSender;
+
+/***
+  * Splice类型消息的来源，来源暂无数据时代替CSender关注来源fd的可读事件，
+  * 这期间CSender不关注连接的可写事件，来源可读后再通知CSender接着发送
+  */
+class CSpliceSource: public net::CEpollable
+{
+public:
+    CSpliceSource(CSender* sender);
+    ~CSpliceSource();
+
+    /** 关注来源fd的可读事件 */
+    void watch(net::CEpoller& epoller, int fd);
+
+    /** 不再关注，来源fd由消息的调用者关闭，这里不关闭 */
+    void unwatch(net::CEpoller& epoller);
+
+private:
+    virtual net::epoll_event_t handle_epoll_event(void* input_ptr, uint32_t events, void* ouput_ptr);
+
+private:
+    CSender* _sender;
+};
+
+DISPATCHER_NAMESPACE_END
+#endif // MOOON_DISPATCHER_SPLICE_SOURCE_H
@@ -26,11 +26,13 @@ DISPATCHER_NAMESPACE_BEGIN
 CUnmanagedSenderTable::~CUnmanagedSenderTable()
 {
     clear_sender();
+    delete _sender_map;
 }
 
 CUnmanagedSenderTable::CUnmanagedSenderTable(CDispatcherContext* context)
     :CSenderTable(context)
 {
+    _sender_map = new SenderMap;
 }
 
 void CUnmanagedSenderTable::close_sender(CSender* sender)
@@ -47,25 +49,23 @@ ISender* CUnmanagedSenderTable::open_sender(const SenderInfo& sender_info)
     }
 
     sys::LockHelper<sys::CLock> lock(_lock);
-    std::pair<SenderMap::iterator, bool> retval;
-    CUnmanagedSender* sender = new CUnmanagedSender(sender_info);
-    
-    retval = _sender_map.insert(std::make_pair(sender_info.ip_node, sender));
-    if (!retval.second)
+    if (_sender_map->find(sender_info.ip_node) != _sender_map->end())
     {
-        delete sender;
-        sender = NULL;
+        return NULL;
     }
-    else
-    {
-        sender->inc_refcount();
-        sender->set_in_table(true);
 
-        sender->attach_sender_table(this);
-        sender_info.reply_handler->attach(sender);
+    CUnmanagedSender* sender = new CUnmanagedSender(sender_info);
+    SenderMap* sender_map = new SenderMap(*_sender_map);
+    sender_map->insert(std::make_pair(sender_info.ip_node, sender));
+
+    sender->inc_refcount();
+    sender->set_in_table(true);
 
-        get_context()->add_sender(sender);
-    }
+    sender->attach_sender_table(this);
+    sender_info.reply_handler->attach(sender);
+
+    publish_map(sender_map);
+    get_context()->add_sender(sender);
 
     return sender;
 }
@@ -81,7 +81,10 @@ void CUnmanagedSenderTable::close_sender(ISender* sender)
     {
         sender_->shutdown();
         sender_->set_in_table(false);
-        _sender_map.erase(ip_node);        
+
+        SenderMap* sender_map = new SenderMap(*_sender_map);
+        sender_map->erase(ip_node);
+        publish_map(sender_map); // 含等待读者离开
     }
     
     (void)sender_->dec_refcount();    
@@ -92,14 +95,21 @@ void CUnmanagedSenderTable::release_sender(ISender* sender)
     CUnmanagedSender* sender_ = static_cast<CUnmanagedSender*>(sender);    
     const SenderInfo& sender_info = sender->get_sender_info();
     net::ip_node_t ip_node = sender_info.ip_node;
+
+    // 读者只会增引用计数，所以持锁时看到的1就是最后一个引用
     sys::LockHelper<sys::CLock> lock(_lock);
+    if (sender_->is_in_table() && (1 == sender_->get_refcount()))
+    {
+        // Sender将被删除，须先从表中摘除，
+        // 并标记为不在表中，以免摘除前取到它的读者释放时再摘除一次（可能已是同ip_node的新Sender）
+        sender_->set_in_table(false);
 
-    if (sender_->is_in_table() && sender_->dec_refcount())
-    {        
-        // 因为走到这里，说明Sender已经被deleted
-        // ，所以没必要再sender_->set_in_table(false);
-        _sender_map.erase(ip_node);
+        SenderMap* sender_map = new SenderMap(*_sender_map);
+        sender_map->erase(ip_node);
+        publish_map(sender_map);
     }
+
+    (void)sender_->dec_refcount();
 }
 
 void CUnmanagedSenderTable::remove_sender(ISender* sender)
@@ -112,7 +122,10 @@ void CUnmanagedSenderTable::remove_sender(ISender* sender)
     if (sender_->is_in_table())
     {
         sender_->set_in_table(false);
-        _sender_map.erase(ip_node);
+
+        SenderMap* sender_map = new SenderMap(*_sender_map);
+        sender_map->erase(ip_node);
+        publish_map(sender_map);
     }
 
     (void)sender_->dec_refcount();    
@@ -120,31 +133,48 @@ void CUnmanagedSenderTable::remove_sender(ISender* sender)
 
 ISender* CUnmanagedSenderTable::get_sender(const net::ip_node_t& ip_node)
 {
-    sys::LockHelper<sys::CLock> lock(_lock);
+    int phase = read_lock();
     CUnmanagedSender* sender_ = NULL;
+    SenderMap* sender_map = __atomic_load_n(&_sender_map, __ATOMIC_ACQUIRE);
 
-    SenderMap::iterator iter = _sender_map.find(ip_node);
-    if (iter != _sender_map.end())
+    SenderMap::iterator iter = sender_map->find(ip_node);
+    if (iter != sender_map->end())
     {
         sender_ = iter->second;
         sender_->inc_refcount();
     }
 
+    read_unlock(phase);
     return sender_;
 }
 
 void CUnmanagedSenderTable::clear_sender()
 {
     sys::LockHelper<sys::CLock> lock(_lock);
+    SenderMap* sender_map = _sender_map;
 
-    while (!_sender_map.empty())
+    __atomic_store_n(&_sender_map, new SenderMap, __ATOMIC_RELEASE);
+    synchronize();
+    while (!sender_map->empty())
     {
-        SenderMap::iterator iter = _sender_map.begin();
+        SenderMap::iterator iter = sender_map->begin();
         CUnmanagedSender* sender = iter->second;
 
         sender->dec_refcount();
-        _sender_map.erase(iter);
+        sender_map->erase(iter);
     }
+
+    delete sender_map;
+}
+
+void CUnmanagedSenderTable::publish_map(SenderMap* sender_map)
+{
+    SenderMap* old_sender_map = _sender_map;
+
+    // 等待仍在读旧表的读者离开后，旧表及从中摘除的Sender才可释放
+    __atomic_store_n(&_sender_map, sender_map, __ATOMIC_RELEASE);
+    synchronize();
+    delete old_sender_map;
 }
 
 DISPATCHER_NAMESPACE_END
@@ -42,12 +42,13 @@ private: // IUnmanagedSenderTable
     virtual ISender* get_sender(const net::ip_node_t& ip_node);  
     
 private:
+    typedef __gnu_cxx::hash_map<net::ip_node_t, CUnmanagedSender*, net::ip_node_hasher, net::ip_node_comparer> SenderMap;
     void clear_sender();
+    void publish_map(SenderMap* sender_map);
 
 private:
-    typedef __gnu_cxx::hash_map<net::ip_node_t, CUnmanagedSender*, net::ip_node_hasher, net::ip_node_comparer> SenderMap;
-    sys::CLock _lock;
-    SenderMap _sender_map;
+    // 写时复制：写者在副本上修改后整体替换，读者不加锁读取当前的表
+    SenderMap* _sender_map;
 };
 
 DISPATCHER_NAMESPACE_END
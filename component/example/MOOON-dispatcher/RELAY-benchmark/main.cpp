@@ -0,0 +1,252 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Author: eyjian@qq.com or eyjian@gmail.com
+ */
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <mooon/sys/logger.h>
+#include <mooon/sys/stop_watch.h>
+#include <mooon/sys/thread_engine.h>
+#include <mooon/sys/utils.h>
+#include <mooon/utils/args_parser.h>
+#include <mooon/dispatcher/dispatcher.h>
+#include <mooon/dispatcher/message.h>
+
+/***
+  * 转发吞吐量压测：数据先写入一条本机TCP连接（来源），再经dispatcher转发到内置的接收端，
+  * 比较以splice消息直接从来源连接转发，和先recv到Buffer消息再发送两种方式
+  *
+  * 使用示例：./relay_benchmark --mode=splice --chunk=65536 --megabytes=2048
+  *           ./relay_benchmark --mode=buffer --chunk=65536 --megabytes=2048
+  */
+
+STRING_ARG_DEFINE(mode, "splice", "splice or buffer")
+INTEGER_ARG_DEFINE(uint32_t, chunk, 65536, 1, 16777216, "bytes of each message")
+INTEGER_ARG_DEFINE(uint32_t, megabytes, 1024, 1, 1048576, "total megabytes to relay")
+INTEGER_ARG_DEFINE(uint16_t, port, 2017, 1, 65535, "port of the built-in sink")
+
+// 接收端不回应答，只需满足接口
+class CReplyHandler: public mooon::dispatcher::IReplyHandler
+{
+private:
+    virtual void attach(mooon::dispatcher::ISender* sender) {}
+    virtual char* get_buffer() { return _buffer; }
+    virtual size_t get_buffer_length() const { return sizeof(_buffer); }
+    virtual mooon::utils::handle_result_t handle_reply(size_t data_size) { return mooon::utils::handle_continue; }
+
+private:
+    char _buffer[1024];
+};
+
+static int listen_on(uint16_t port)
+{
+    int on = 1;
+    struct sockaddr_in addr;
+    int listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+    if ((-1 == bind(listen_fd, (struct sockaddr*)&addr, sizeof(addr)))
+     || (-1 == listen(listen_fd, 16)))
+    {
+        fprintf(stderr, "listen on 127.0.0.1:%u error: %s.\n", port, strerror(errno));
+        close(listen_fd);
+        return -1;
+    }
+
+    return listen_fd;
+}
+
+// 创建一条本机TCP连接作为数据来源，write_fd写入的数据从read_fd读出
+static bool create_source(int* write_fd, int* read_fd)
+{
+    struct sockaddr_in addr;
+    socklen_t addr_length = sizeof(addr);
+    int listen_fd = listen_on(0);
+    if (-1 == listen_fd)
+    {
+        return false;
+    }
+
+    getsockname(listen_fd, (struct sockaddr*)&addr, &addr_length);
+    *write_fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (-1 == connect(*write_fd, (struct sockaddr*)&addr, addr_length))
+    {
+        fprintf(stderr, "connect source error: %s.\n", strerror(errno));
+        close(listen_fd);
+        return false;
+    }
+
+    *read_fd = accept(listen_fd, NULL, NULL);
+    close(listen_fd);
+    return *read_fd != -1;
+}
+
+// 内置的接收端，读走所有数据
+static void sink(int listen_fd, uint64_t total_bytes)
+{
+    char buffer[262144];
+    uint64_t received_bytes = 0;
+    int fd = accept(listen_fd, NULL, NULL);
+
+    while (received_bytes < total_bytes)
+    {
+        ssize_t retval = read(fd, buffer, sizeof(buffer));
+        if (retval <= 0)
+        {
+            break;
+        }
+
+        received_bytes += retval;
+    }
+
+    close(fd);
+}
+
+static bool full_write(int fd, const char* buffer, size_t size)
+{
+    while (size > 0)
+    {
+        ssize_t retval = write(fd, buffer, size);
+        if (-1 == retval)
+        {
+            if (EINTR == errno) continue;
+            return false;
+        }
+
+        buffer += retval;
+        size -= retval;
+    }
+
+    return true;
+}
+
+static bool full_read(int fd, char* buffer, size_t size)
+{
+    while (size > 0)
+    {
+        ssize_t retval = read(fd, buffer, size);
+        if (retval <= 0)
+        {
+            if ((-1 == retval) && (EINTR == errno)) continue;
+            return false;
+        }
+
+        buffer += retval;
+        size -= retval;
+    }
+
+    return true;
+}
+
+extern "C" int main(int argc, char* argv[])
+{
+    std::string errmsg;
+    if (!mooon::utils::parse_arguments(argc, argv, &errmsg))
+    {
+        fprintf(stderr, "Command parameter error: %s.\n", errmsg.c_str());
+        return 1;
+    }
+
+    bool splice_mode = ("splice" == mooon::argument::mode->value());
+    uint32_t chunk = mooon::argument::chunk->value();
+    uint64_t total_bytes = (uint64_t)mooon::argument::megabytes->value() * 1024 * 1024;
+    uint64_t chunks = (total_bytes + chunk - 1) / chunk;
+    int source_write_fd;
+    int source_read_fd;
+    int listen_fd = listen_on(mooon::argument::port->value());
+    if ((-1 == listen_fd) || !create_source(&source_write_fd, &source_read_fd))
+    {
+        return 1;
+    }
+    if (splice_mode)
+    {
+        // 由dispatcher的发送线程读，不能阻塞
+        fcntl(source_read_fd, F_SETFL, fcntl(source_read_fd, F_GETFL) | O_NONBLOCK);
+    }
+
+    // 日志文件和程序文件放在同一个目录下，只记录警告及以上级别的日志，以免影响压测
+    mooon::sys::CLogger* logger = new mooon::sys::CLogger;
+    logger->create(mooon::sys::CUtils::get_program_path().c_str(), "relay_benchmark.log");
+    logger->set_log_level(mooon::sys::LOG_LEVEL_WARN);
+    mooon::dispatcher::logger = logger;
+
+    mooon::sys::CThreadEngine* sink_thread = new mooon::sys::CThreadEngine(mooon::sys::bind(&sink, listen_fd, chunks * chunk));
+    mooon::dispatcher::IDispatcher* dispatcher = mooon::dispatcher::create(1);
+    mooon::dispatcher::SenderInfo sender_info;
+
+    memset(&sender_info, 0, sizeof(sender_info));
+    sender_info.key = 0;
+    sender_info.ip_node.ip = "127.0.0.1";
+    sender_info.ip_node.port = mooon::argument::port->value();
+    sender_info.queue_size = 64;
+    sender_info.resend_times = 0;
+    sender_info.reconnect_times = 0;
+    sender_info.reply_handler = new CReplyHandler; // 由Sender负责删除
+    mooon::dispatcher::ISender* sender = dispatcher->get_managed_sender_table()->open_sender(sender_info);
+
+    // 先写入来源连接，再推送对应长度的消息，消息按顺序发送，所以各消息取到的正是自己那段数据
+    char* data = new char[chunk];
+    memset(data, 'x', chunk);
+    mooon::sys::CStopWatch stop_watch;
+    for (uint64_t i=0; i<chunks; ++i)
+    {
+        if (!full_write(source_write_fd, data, chunk))
+        {
+            fprintf(stderr, "write source error: %s.\n", strerror(errno));
+            break;
+        }
+
+        if (splice_mode)
+        {
+            mooon::dispatcher::splice_message_t* message = mooon::dispatcher::create_splice_message(chunk);
+            message->fd = source_read_fd;
+            while (!sender->push_message(message, 1000));
+        }
+        else
+        {
+            mooon::dispatcher::buffer_message_t* message = mooon::dispatcher::create_buffer_message(chunk);
+            if (!full_read(source_read_fd, message->data, chunk))
+            {
+                fprintf(stderr, "read source error: %s.\n", strerror(errno));
+                mooon::dispatcher::destroy_buffer_message(message);
+                break;
+            }
+
+            while (!sender->push_message(message, 1000));
+        }
+    }
+
+    delete sink_thread; // 等待接收端收完
+    unsigned int elapsed_microseconds = stop_watch.get_elapsed_microseconds();
+    fprintf(stdout, "mode: %s, chunk: %u, bytes: %" PRIu64 "\n", mooon::argument::mode->value().c_str(), chunk, chunks * chunk);
+    fprintf(stdout, "elapsed: %u us, throughput: %.1f MB/s\n"
+        , elapsed_microseconds, (elapsed_microseconds > 0)? (chunks * chunk) / (double)elapsed_microseconds * 1000000 / (1024*1024): 0.0);
+
+    mooon::dispatcher::destroy(dispatcher);
+    delete []data;
+    close(source_write_fd);
+    close(source_read_fd);
+    close(listen_fd);
+    logger->destroy();
+    return 0;
+}
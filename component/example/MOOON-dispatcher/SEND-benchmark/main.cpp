@@ -0,0 +1,225 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Author: eyjian@qq.com or eyjian@gmail.com
+ */
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <mooon/sys/atomic.h>
+#include <mooon/sys/logger.h>
+#include <mooon/sys/stop_watch.h>
+#include <mooon/sys/thread_engine.h>
+#include <mooon/sys/utils.h>
+#include <mooon/utils/args_parser.h>
+#include <mooon/dispatcher/dispatcher.h>
+#include <mooon/dispatcher/message.h>
+
+/***
+  * 多生产者send_message吞吐量压测：每个生产者线程循环执行
+  * get_sender -> push_message -> release_sender，考察Sender表查找的并发性能，
+  * 消息发往程序内置的接收端，接收端只读不处理
+  *
+  * 使用示例：./send_benchmark --producers=8 --senders=16 --messages=1000000
+  */
+
+INTEGER_ARG_DEFINE(uint16_t, producers, 4, 1, 1024, "number of producer threads")
+INTEGER_ARG_DEFINE(uint16_t, senders, 16, 1, 65535, "number of managed senders, keys are 0 to senders-1")
+INTEGER_ARG_DEFINE(uint32_t, messages, 1000000, 1, 1000000000, "number of messages pushed by each producer")
+INTEGER_ARG_DEFINE(uint32_t, size, 64, 1, 65536, "bytes of each message")
+INTEGER_ARG_DEFINE(uint16_t, threads, 2, 1, 64, "number of dispatcher send threads")
+INTEGER_ARG_DEFINE(uint16_t, port, 2016, 1, 65535, "port of the built-in sink")
+
+// 接收端不回应答，只需满足接口
+class CReplyHandler: public mooon::dispatcher::IReplyHandler
+{
+private:
+    virtual void attach(mooon::dispatcher::ISender* sender) {}
+    virtual char* get_buffer() { return _buffer; }
+    virtual size_t get_buffer_length() const { return sizeof(_buffer); }
+    virtual mooon::utils::handle_result_t handle_reply(size_t data_size) { return mooon::utils::handle_continue; }
+
+private:
+    char _buffer[1024];
+};
+
+static atomic_t sg_pushed;   // 成功存入队列的消息数
+static atomic_t sg_dropped;  // 因队列满而丢弃的消息数
+static volatile bool sg_stop = false;
+
+// 内置的接收端，读走所有数据
+static void sink(int listen_fd)
+{
+    char buffer[65536];
+    int epfd = epoll_create(1024);
+    struct epoll_event event;
+
+    event.events = EPOLLIN;
+    event.data.fd = listen_fd;
+    epoll_ctl(epfd, EPOLL_CTL_ADD, listen_fd, &event);
+
+    while (!sg_stop)
+    {
+        struct epoll_event events[128];
+        int n = epoll_wait(epfd, events, sizeof(events)/sizeof(events[0]), 100);
+
+        for (int i=0; i<n; ++i)
+        {
+            int fd = events[i].data.fd;
+            if (fd == listen_fd)
+            {
+                int conn_fd = accept(listen_fd, NULL, NULL);
+                if (conn_fd != -1)
+                {
+                    event.events = EPOLLIN;
+                    event.data.fd = conn_fd;
+                    epoll_ctl(epfd, EPOLL_CTL_ADD, conn_fd, &event);
+                }
+            }
+            else if (read(fd, buffer, sizeof(buffer)) <= 0)
+            {
+                close(fd);
+            }
+        }
+    }
+
+    close(epfd);
+}
+
+static void produce(mooon::dispatcher::IManagedSenderTable* sender_table, uint16_t index)
+{
+    uint32_t messages = mooon::argument::messages->value();
+    uint16_t senders = mooon::argument::senders->value();
+    uint32_t size = mooon::argument::size->value();
+
+    for (uint32_t i=0; i<messages; ++i)
+    {
+        uint16_t key = static_cast<uint16_t>((index + i) % senders);
+        mooon::dispatcher::ISender* sender = sender_table->get_sender(key);
+        if (NULL == sender)
+        {
+            atomic_inc(&sg_dropped);
+            continue;
+        }
+
+        mooon::dispatcher::buffer_message_t* message = mooon::dispatcher::create_buffer_message(size);
+        memset(message->data, 'x', size);
+        if (sender->push_message(message))
+        {
+            atomic_inc(&sg_pushed);
+        }
+        else
+        {
+            atomic_inc(&sg_dropped);
+            mooon::dispatcher::destroy_buffer_message(message);
+        }
+
+        sender_table->release_sender(sender);
+    }
+}
+
+static int create_sink_listener(uint16_t port)
+{
+    int on = 1;
+    struct sockaddr_in addr;
+    int listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+    if ((-1 == bind(listen_fd, (struct sockaddr*)&addr, sizeof(addr)))
+     || (-1 == listen(listen_fd, 1024)))
+    {
+        fprintf(stderr, "listen on 127.0.0.1:%u error: %s.\n", port, strerror(errno));
+        close(listen_fd);
+        return -1;
+    }
+
+    return listen_fd;
+}
+
+extern "C" int main(int argc, char* argv[])
+{
+    std::string errmsg;
+    if (!mooon::utils::parse_arguments(argc, argv, &errmsg))
+    {
+        fprintf(stderr, "Command parameter error: %s.\n", errmsg.c_str());
+        return 1;
+    }
+
+    int listen_fd = create_sink_listener(mooon::argument::port->value());
+    if (-1 == listen_fd)
+    {
+        return 1;
+    }
+
+    // 日志文件和程序文件放在同一个目录下，只记录警告及以上级别的日志，以免影响压测
+    mooon::sys::CLogger* logger = new mooon::sys::CLogger;
+    logger->create(mooon::sys::CUtils::get_program_path().c_str(), "send_benchmark.log");
+    logger->set_log_level(mooon::sys::LOG_LEVEL_WARN);
+    mooon::dispatcher::logger = logger;
+
+    atomic_set(&sg_pushed, 0);
+    atomic_set(&sg_dropped, 0);
+    mooon::sys::CThreadEngine* sink_thread = new mooon::sys::CThreadEngine(mooon::sys::bind(&sink, listen_fd));
+    mooon::dispatcher::IDispatcher* dispatcher = mooon::dispatcher::create(mooon::argument::threads->value());
+    mooon::dispatcher::IManagedSenderTable* sender_table = dispatcher->get_managed_sender_table();
+
+    for (uint16_t key=0; key<mooon::argument::senders->value(); ++key)
+    {
+        mooon::dispatcher::SenderInfo sender_info;
+
+        memset(&sender_info, 0, sizeof(sender_info));
+        sender_info.key = key;
+        sender_info.ip_node.ip = "127.0.0.1";
+        sender_info.ip_node.port = mooon::argument::port->value();
+        sender_info.queue_size = 10000;
+        sender_info.resend_times = 0;
+        sender_info.reconnect_times = -1;
+        sender_info.reply_handler = new CReplyHandler; // 由Sender负责删除
+        sender_table->open_sender(sender_info);
+    }
+
+    mooon::sys::CStopWatch stop_watch;
+    std::vector<mooon::sys::CThreadEngine*> producers;
+    for (uint16_t i=0; i<mooon::argument::producers->value(); ++i)
+    {
+        producers.push_back(new mooon::sys::CThreadEngine(mooon::sys::bind(&produce, sender_table, i)));
+    }
+    for (std::vector<mooon::sys::CThreadEngine*>::size_type i=0; i<producers.size(); ++i)
+    {
+        producers[i]->join();
+        delete producers[i];
+    }
+
+    unsigned int elapsed_microseconds = stop_watch.get_elapsed_microseconds();
+    uint64_t total = (uint64_t)mooon::argument::producers->value() * mooon::argument::messages->value();
+    fprintf(stdout, "producers: %u, senders: %u, messages: %" PRIu64 ", pushed: %d, dropped: %d\n"
+        , mooon::argument::producers->value(), mooon::argument::senders->value()
+        , total, atomic_read(&sg_pushed), atomic_read(&sg_dropped));
+    fprintf(stdout, "elapsed: %u us, throughput: %.0f msg/s\n"
+        , elapsed_microseconds, (elapsed_microseconds > 0)? total * 1000000.0 / elapsed_microseconds: 0.0);
+
+    mooon::dispatcher::destroy(dispatcher);
+    sg_stop = true;
+    delete sink_thread;
+    close(listen_fd);
+    logger->destroy();
+    return 0;
+}
@@ -17,22 +17,22 @@
  * Author: laocai_liu@qq.com or laocailiu@gmail.com
  */
 
-#include <sys/logger.h>
-#include <sys/main_template.h>
-#include <util/args_parser.h>
-#include <net/util.h>
-#include <dispatcher/dispatcher.h>
+#include <mooon/sys/logger.h>
+#include <mooon/sys/main_template.h>
+#include <mooon/utils/args_parser.h>
+#include <mooon/net/utils.h>
+#include <mooon/dispatcher/dispatcher.h>
 #include "pp_director.h"
 
 #define LOG_FILE_NAME "ppclient.log"
 
 using namespace mooon;
 
-INTEGER_ARG_DEFINE(false, uint16_t, port, 0, 1000, 65535, "ping pong server port")
-STRING_ARG_DEFINE(false, ip, "127.0.0.1", "ping pong server ip")
-INTEGER_ARG_DEFINE(false, uint16_t, thread_count, 1, 1, 2048, "thread count")
-INTEGER_ARG_DEFINE(false, int, sender_count, 0, 1, 20480, "sender count")
-INTEGER_ARG_DEFINE(false, int, bytes_per_send, 0, 0, 2048, "msg bytes one send")
+INTEGER_ARG_DEFINE(uint16_t, port, 2016, 1000, 65535, "ping pong server port")
+STRING_ARG_DEFINE(ip, "127.0.0.1", "ping pong server ip")
+INTEGER_ARG_DEFINE(uint16_t, thread_count, 1, 1, 2048, "thread count")
+INTEGER_ARG_DEFINE(int32_t, sender_count, 1, 1, 20480, "sender count")
+INTEGER_ARG_DEFINE(int32_t, bytes_per_send, 0, 0, 2048, "msg bytes one send")
 
 PP_NAMESPACE_BEGIN
 
@@ -71,14 +71,15 @@ CMainHelper::~CMainHelper()
 bool CMainHelper::init(int argc, char* argv[])
 {
     // 解析命令行参数
-    if (!ArgsParser::parse(argc, argv))
+    std::string errmsg;
+    if (!utils::parse_arguments(argc, argv, &errmsg))
     {
-        fprintf(stderr, "Command parameter error: %s.\n", ArgsParser::g_error_message.c_str());
+        fprintf(stderr, "Command parameter error: %s.\n", errmsg.c_str());
         return false;
     }
 
     // 日志文件存放目录
-    std::string logdir = sys::CUtil::get_program_path();
+    std::string logdir = sys::CUtils::get_program_path();
 
     // 创建日志器
     _logger->create(logdir.c_str(), LOG_FILE_NAME);
@@ -87,22 +88,22 @@ bool CMainHelper::init(int argc, char* argv[])
     dispatcher::logger = _logger;
     pp_logger = _logger;
 
-    PP_LOG_INFO("server host %s:%d\n", ArgsParser::ip->get_value().c_str(), ArgsParser::port->get_value());
+    PP_LOG_INFO("server host %s:%d\n", argument::ip->value().c_str(), argument::port->value());
     PP_LOG_INFO("client thread_count=%d, sender_count=%d, bytes_per_send=%d\n", 
-	ArgsParser::thread_count->get_value(), ArgsParser::sender_count->get_value(), ArgsParser::bytes_per_send->get_value());
+	argument::thread_count->value(), argument::sender_count->value(), argument::bytes_per_send->value());
 
     // 创建MOOON-dispatcher组件实例
-    _dispatcher = dispatcher::create(ArgsParser::thread_count->get_value());
+    _dispatcher = dispatcher::create(argument::thread_count->value());
     if (NULL == _dispatcher)
     {
         return false;
     }
 
     uint32_t int_ip;
-    net::CUtil::string_toipv4(ArgsParser::ip->get_value().c_str(), int_ip);
-    director.set_server_ip_port(int_ip, ArgsParser::port->get_value());
-    director.set_sender_count(ArgsParser::sender_count->get_value());
-    director.set_bytes_per_send(ArgsParser::bytes_per_send->get_value());
+    net::CUtils::string_toipv4(argument::ip->value().c_str(), int_ip);
+    director.set_server_ip_port(int_ip, argument::port->value());
+    director.set_sender_count(argument::sender_count->value());
+    director.set_bytes_per_send(argument::bytes_per_send->value());
     director.set_dispatcher(_dispatcher);
 
     return true;
@@ -17,7 +17,7 @@
  * Author: laocai_liu@qq.com or laocailiu@gmail.com
  */
 
-#include <net/inttypes.h>
+#include <mooon/net/inttypes.h>
 #include "pp_director.h"
 #include "pp_reply_handler.h"
 #include "pp_msg.h"
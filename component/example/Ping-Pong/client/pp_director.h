@@ -20,7 +20,7 @@
 #ifndef MOOON_PP_DIRECTOR_H
 #define MOOON_PP_DIRECTOR_H
 
-#include <dispatcher/dispatcher.h>
+#include <mooon/dispatcher/dispatcher.h>
 #include "pp_log.h"
 
 PP_NAMESPACE_BEGIN
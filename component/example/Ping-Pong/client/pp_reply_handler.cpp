@@ -17,7 +17,7 @@
  * Author: laocai_liu@qq.com or laocailiu@gmail.com
  */
 
-#include <sys/util.h>
+#include <mooon/sys/utils.h>
 #include "pp_reply_handler.h"
 #include "pp_msg.h"
 
@@ -28,7 +28,7 @@ CppReplyHandler::CppReplyHandler()
     ,_offset(0)
     ,_recv_machine(this)
 {
-    _length = sys::CUtil::get_page_size();
+    _length = sys::CUtils::get_page_size();
     _buffer = new char[_length];    
     _msg_body = new char[_length];
 }
@@ -102,13 +102,13 @@ size_t CppReplyHandler::get_buffer_offset() const
     return _offset;
 }
 
-util::handle_result_t CppReplyHandler::handle_reply(size_t data_size)
+utils::handle_result_t CppReplyHandler::handle_reply(size_t data_size)
 {
     // work会调用CppReplyHandler::on_message和CppReplyHandler::on_header
-    util::handle_result_t handle_result = _recv_machine.work(_buffer + _offset
+    utils::handle_result_t handle_result = _recv_machine.work(_buffer + _offset
                                                             , data_size);
-    if (util::handle_finish == handle_result)
-    	return util::handle_continue;
+    if (utils::handle_finish == handle_result)
+    	return utils::handle_continue;
     else
     {
         PP_LOG_ERROR("CppReplyHandler::handle_reply %d", handle_result);
@@ -20,9 +20,9 @@
 #ifndef MOOON_PP_REPLY_HANDLER_H
 #define MOOON_PP_REPLY_HANDLER_H
 
-#include <net/recv_machine.h>
-#include <net/inttypes.h>
-#include <dispatcher/dispatcher.h>
+#include <mooon/net/recv_machine.h>
+#include <mooon/net/inttypes.h>
+#include <mooon/dispatcher/dispatcher.h>
 #include "pp_log.h"
 
 PP_NAMESPACE_BEGIN
@@ -52,7 +52,7 @@ private:
     virtual char* get_buffer();
     virtual size_t get_buffer_length() const;
     virtual size_t get_buffer_offset() const;
-    virtual util::handle_result_t handle_reply(size_t data_size);
+    virtual utils::handle_result_t handle_reply(size_t data_size);
 
 private:
     dispatcher::ISender* _sender;
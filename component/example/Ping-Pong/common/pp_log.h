@@ -20,14 +20,14 @@
 #ifndef MOOON_PP_LOG_H
 #define MOOON_PP_LOG_H
 
-#include <sys/log.h>
+#include <mooon/sys/log.h>
 #include "config.h"
 
 PP_NAMESPACE_BEGIN
 
 #define PP_MODULE_NAME "PINGPONG"
 
-#define PP_LOG_BIN(log, size)         __MYLOG_BIN(pingpong::pp_logger, log, size)
+#define PP_LOG_BIN(log, size)         __MYLOG_BIN(pingpong::pp_logger, PP_MODULE_NAME, log, size)
 #define PP_LOG_TRACE(format, ...)     __MYLOG_TRACE(pingpong::pp_logger, PP_MODULE_NAME, format, ##__VA_ARGS__)
 #define PP_LOG_FATAL(format, ...)     __MYLOG_FATAL(pingpong::pp_logger, PP_MODULE_NAME, format, ##__VA_ARGS__)
 #define PP_LOG_ERROR(format, ...)     __MYLOG_ERROR(pingpong::pp_logger, PP_MODULE_NAME, format, ##__VA_ARGS__)
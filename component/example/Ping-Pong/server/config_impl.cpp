@@ -17,20 +17,23 @@
  * Author: laocai_liu@qq.com or laocailiu@gmail.com
  */
 
-#include <net/util.h>
-#include <sys/util.h>
+#include <mooon/net/utils.h>
+#include <mooon/sys/utils.h>
 #include "config_impl.h"
 #include "pp_log.h"
 
 PP_NAMESPACE_BEGIN
 
-bool CConfigImpl::init(const std::string& ip, uint16_t port)
+bool CConfigImpl::init(const std::string& ip, uint16_t port, bool use_io_uring)
 {
     net::ip_port_pair_t ip_port_pair;
 
+    _use_io_uring = use_io_uring;
+
     ip_port_pair.first = ip.c_str();
     ip_port_pair.second = port;
     _ip_port_pair_array.push_back(ip_port_pair);
+    return true;
 }
 
 const net::ip_port_pair_array_t& CConfigImpl::get_listen_parameter() const
@@ -40,9 +43,9 @@ const net::ip_port_pair_array_t& CConfigImpl::get_listen_parameter() const
 
 uint16_t CConfigImpl::get_thread_number() const
 {
-    PP_LOG_INFO("[CConfigImpl::get_thread_number] %d\n", sys::CUtil::get_cpu_number());
+    PP_LOG_INFO("[CConfigImpl::get_thread_number] %d\n", sys::CUtils::get_cpu_number());
 
-    return (0 == sys::CUtil::get_cpu_number()*2) ? 1 : sys::CUtil::get_cpu_number()*2;
+    return (0 == sys::CUtils::get_cpu_number()*2) ? 1 : sys::CUtils::get_cpu_number()*2;
 }
 
 PP_NAMESPACE_END
@@ -20,7 +20,7 @@
 #ifndef MOOON_PP_CONFIG_IMPL_H
 #define MOOON_PP_CONFIG_IMPL_H
 
-#include <server/server.h>
+#include <mooon/server/server.h>
 #include "config.h"
 
 PP_NAMESPACE_BEGIN
@@ -28,13 +28,15 @@ PP_NAMESPACE_BEGIN
 class CConfigImpl: public server::IConfig
 {
 public:
-    bool init(const std::string& ip, uint16_t port);
+    bool init(const std::string& ip, uint16_t port, bool use_io_uring);
 
 private:
     virtual const net::ip_port_pair_array_t& get_listen_parameter() const;
     virtual uint16_t get_thread_number() const;
+    virtual bool use_io_uring() const { return _use_io_uring; }
 
 private:
+    bool _use_io_uring;
     net::ip_port_pair_array_t _ip_port_pair_array;
 };
 
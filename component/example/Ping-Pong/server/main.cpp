@@ -17,11 +17,11 @@
  * Author: laocai_liu@qq.com or laocailiu@gmail.com
  */
 
-#include <sys/logger.h>
-#include <sys/main_template.h>
-#include <util/string_util.h>
-#include <util/args_parser.h>
-#include <server/server.h>
+#include <mooon/sys/logger.h>
+#include <mooon/sys/main_template.h>
+#include <mooon/utils/string_utils.h>
+#include <mooon/utils/args_parser.h>
+#include <mooon/server/server.h>
 #include "config_impl.h"
 #include "pp_packet_handler.h"
 #include "statistics_print_thread.h"
@@ -30,8 +30,9 @@
 
 using namespace mooon;
 
-INTEGER_ARG_DEFINE(false, uint16_t, port, 0, 1000, 65535, "ping pong server port")
-STRING_ARG_DEFINE(false, ip, "127.0.0.1", "ping pong server ip")
+INTEGER_ARG_DEFINE(uint16_t, port, 2016, 1000, 65535, "ping pong server port")
+STRING_ARG_DEFINE(ip, "127.0.0.1", "ping pong server ip")
+STRING_ARG_DEFINE(backend, "epoll", "event backend: epoll or io_uring, for comparing the msg/s of the two backends")
 
 PP_NAMESPACE_BEGIN
 
@@ -95,14 +96,15 @@ bool CMainHelper::init(int argc, char* argv[])
     _statistics_print = new CStatisticsPrintThread;
     _statistics_print->start();
     // 解析命令行参数
-    if (!ArgsParser::parse(argc, argv))
+    std::string errmsg;
+    if (!utils::parse_arguments(argc, argv, &errmsg))
     {
-        fprintf(stderr, "Command parameter error: %s.\n", ArgsParser::g_error_message.c_str());
+        fprintf(stderr, "Command parameter error: %s.\n", errmsg.c_str());
         return false;
     }
 
     // 日志文件存放目录
-    std::string logdir = sys::CUtil::get_program_path();
+    std::string logdir = sys::CUtils::get_program_path();
 
     // 创建日志器
     _logger->create(logdir.c_str(), LOG_FILE_NAME);
@@ -111,7 +113,7 @@ bool CMainHelper::init(int argc, char* argv[])
     server::logger = _logger;
     pp_logger = _logger;
 
-    _config_impl.init(ArgsParser::ip->get_value(), ArgsParser::port->get_value());
+    _config_impl.init(argument::ip->value(), argument::port->value(), "io_uring" == argument::backend->value());
 
     // 创建一个MOOON-server组件实例
     _server = server::create(&_config_impl, &_factory_impl);
@@ -18,7 +18,7 @@
  */
 
 #include <iostream>
-#include <sys/util.h>
+#include <mooon/sys/utils.h>
 #include "pp_packet_handler.h"
 #include "statistics.h"
 
@@ -27,7 +27,7 @@ PP_NAMESPACE_BEGIN
 CppPakcetHandler::CppPakcetHandler(server::IConnection* connection)
     :_connection(connection), _recv_machine(this)
 {
-    _request_context.request_size = sys::CUtil::get_page_size();
+    _request_context.request_size = sys::CUtils::get_page_size();
     _request_context.request_buffer = new char[_request_context.request_size];
     _response_buffer_capability = _request_context.request_size;
     _response_context.response_buffer = new char[_response_buffer_capability];
@@ -79,7 +79,7 @@ bool CppPakcetHandler::on_message(
             else
             {
                 PP_LOG_ERROR("[CppPakcetHandler::on_message][response buffer is too small error] \
-                             finished_size=%d, pack_size=%d\n"
+                             finished_size=%zu, pack_size=%d\n"
                             , finished_size, pack_size);
                 return false;
             }
@@ -113,35 +113,35 @@ void CppPakcetHandler::reset()
     _recv_ix = 0;
 }
 
-util::handle_result_t CppPakcetHandler::on_handle_request(size_t data_size, server::Indicator& indicator)
+utils::handle_result_t CppPakcetHandler::on_handle_request(size_t data_size, server::Indicator& indicator)
 {
-    util::handle_result_t handle_result = _recv_machine.work(_request_context.request_buffer
+    utils::handle_result_t handle_result = _recv_machine.work(_request_context.request_buffer
                                                                 +_request_context.request_offset
                                                                 , data_size);
 
-    // 成功无响应，则返回util::handle_continue
-    return ((util::handle_finish == handle_result)
+    // 成功无响应，则返回utils::handle_continue
+    return ((utils::handle_finish == handle_result)
          && (NULL == _response_context.response_buffer || 0 == _response_context.response_size))
-         ? handle_result = util::handle_continue
+         ? handle_result = utils::handle_continue
          : handle_result;
 }
 
-util::handle_result_t CppPakcetHandler::on_response_completed(server::Indicator& indicator)
+utils::handle_result_t CppPakcetHandler::on_response_completed(server::Indicator& indicator)
 {
     CStatistics::get_singleton()->inc_pp_msg_count();
 
-    return util::handle_continue;
+    return utils::handle_continue;
 }
 
 int CppPakcetHandler::response_buffer_continue_available(void)
 {
-    MOOON_ASSERT(_response_buffer_capability >= _response_context.response_size);
+    MOOON_ASSERT((size_t)_response_buffer_capability >= _response_context.response_size);
     return (_response_buffer_capability - _response_context.response_size);
 }
 
 int CppPakcetHandler::response_buffer_all_available(void)
 {
-    MOOON_ASSERT(_response_buffer_capability >= _response_context.response_size);
+    MOOON_ASSERT((size_t)_response_buffer_capability >= _response_context.response_size);
     return (_response_buffer_capability - (_response_context.response_size - _response_context.response_offset));
 }
 
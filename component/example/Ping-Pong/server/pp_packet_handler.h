@@ -20,12 +20,12 @@
 #ifndef MOOON_PP_PACKET_HANDLER_H
 #define MOOON_PP_PACKET_HANDLER_H
 
-#include <server/server.h>
-#include <server/connection.h>
-#include <server/message_observer.h>
-#include <server/packet_handler.h>
-#include <net/inttypes.h>
-#include <net/recv_machine.h>
+#include <mooon/server/server.h>
+#include <mooon/server/connection.h>
+#include <mooon/server/message_observer.h>
+#include <mooon/server/packet_handler.h>
+#include <mooon/net/inttypes.h>
+#include <mooon/net/recv_machine.h>
 #include "pp_log.h"
 
 PP_NAMESPACE_BEGIN
@@ -47,8 +47,8 @@ private:
     virtual void reset();
     virtual void on_connection_closed();
     virtual bool on_connection_timeout();
-    virtual util::handle_result_t on_response_completed(server::Indicator& indicator);
-    virtual util::handle_result_t on_handle_request(size_t data_size, server::Indicator& indicator);
+    virtual utils::handle_result_t on_response_completed(server::Indicator& indicator);
+    virtual utils::handle_result_t on_handle_request(size_t data_size, server::Indicator& indicator);
 
 private:
     // response buffer 连续内存大小
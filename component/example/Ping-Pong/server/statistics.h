@@ -20,7 +20,8 @@
 #ifndef MOOON_PP_STATISTICS_H
 #define MOOON_PP_STATISTICS_H
 
-#include <sys/singleton.h>
+#include <mooon/sys/atomic_gcc8.h>
+#include <mooon/sys/singleton.h>
 #include "pp_log.h"
 
 PP_NAMESPACE_BEGIN
@@ -30,21 +31,22 @@ class CStatistics : public sys::CSingleton<CStatistics>
 public:
     CStatistics()
     {
-        _pp_msg_count = 0;
+        atomic8_set(&_pp_msg_count, 0);
         _to_show_max_count = 0;
     }
 
     void inc_pp_msg_count(void)
     {
-        ++_pp_msg_count;
+        // 多个工作线程同时计数
+        atomic8_inc(&_pp_msg_count);
     }
     uint64_t pp_msg_count(void)
     {
-        return _pp_msg_count;
+        return (uint64_t)atomic8_read(&_pp_msg_count);
     }
 
 private:
-    uint64_t _pp_msg_count;
+    atomic8_t _pp_msg_count;
     unsigned int _to_show_max_count;
 };
 
@@ -18,7 +18,7 @@ void CStatisticsPrintThread::run()
         //if (_time_event.timed_wait(_time_event_lock, millisecond))
         _time_event.timed_wait(_time_event_lock, millisecond);
         {
-            PP_LOG_INFO("[CStatisticsPrintThread::run] %lld recv msg count %llu\n", 
+            PP_LOG_INFO("[CStatisticsPrintThread::run] %" PRId64" recv msg count %" PRIu64"\n", 
                 now_to_microseconds(), CStatistics::get_singleton()->pp_msg_count());
         }
     }
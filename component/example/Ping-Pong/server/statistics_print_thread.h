@@ -1,7 +1,7 @@
 #ifndef STATISTICS_PRINT_THREAD_H
 #define STATISTICS_PRINT_THREAD_H
 
-#include <sys/thread.h>
+#include <mooon/sys/thread.h>
 #include "config.h"
 
 PP_NAMESPACE_BEGIN
@@ -65,6 +65,27 @@ public:
 
     /** 得到每个线程的接管队列的大小 */
     virtual uint32_t get_takeover_queue_size() const { return 100; }
+
+    /***
+      * 是否使用io_uring代替epoll驱动连接的收发，
+      * 需要编译时支持（MOOON_HAVE_IO_URING）和6.0及以上版本内核，否则自动退回epoll，
+      * 注意io_uring模式下不支持IPacketHandler将连接切换到其它线程
+      */
+    virtual bool use_io_uring() const { return false; }
+
+    /** 得到io_uring模式下每个线程的接收缓冲区个数，必须为2的幂 */
+    virtual uint16_t get_io_uring_buffer_count() const { return 1024; }
+
+    /** 得到io_uring模式下每个接收缓冲区的字节数 */
+    virtual uint32_t get_io_uring_buffer_size() const { return 4096; }
+
+    /***
+      * 得到以MSG_ZEROCOPY方式发送的Buffer响应的最小字节数，0表示不使用，
+      * 零拷贝对小Buffer不划算，建议不小于32KB，
+      * 使用时IPacketHandler::on_response_completed要等到内核通知发送完成后才会被调用，
+      * 仅对epoll模式有效，需要4.14及以上版本内核，否则仍走普通发送
+      */
+    virtual uint32_t get_zerocopy_threshold() const { return 0; }
 };
 
 SERVER_NAMESPACE_END
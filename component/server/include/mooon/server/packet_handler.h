@@ -19,8 +19,11 @@
 #ifndef MOOON_SERVER_PACKET_HANDLER_H
 #define MOOON_SERVER_PACKET_HANDLER_H
 #include <mooon/server/config.h>
+#include <mooon/sys/ref_countable.h>
 #include <sys/epoll.h>
+#include <algorithm>
 #include <sstream>
+#include <vector>
 SERVER_NAMESPACE_BEGIN
 
 /***
@@ -66,8 +69,76 @@ struct RequestContext
     }
 };
 
+/***
+  * 以引用计数管理的共享Buffer，可同时被多个连接的响应链引用，
+  * 如多个连接同时发送的同一份静态内容，最后一个引用释放时自动删除
+  */
+class CSharedBuffer: public sys::CRefCountable
+{
+public:
+    /***
+      * @buffer: 必须是new []出来的，由CSharedBuffer负责delete []
+      * @size: buffer的字节数
+      */
+    CSharedBuffer(char* buffer, size_t size)
+        :_buffer(buffer), _size(size)
+    {
+    }
+
+    const char* data() const { return _buffer; }
+    size_t size() const { return _size; }
+
+private:
+    // 只能通过dec_refcount删除
+    virtual ~CSharedBuffer()
+    {
+        delete []_buffer;
+    }
+
+private:
+    char* _buffer;
+    size_t _size;
+};
+
+/***
+  * 响应段类型
+  */
+typedef enum
+{
+    segment_buffer, /** 普通Buffer，由IPacketHandler管理生命周期 */
+    segment_file,   /** 文件的一部分，以sendfile发送 */
+    segment_shared  /** 共享Buffer，由引用计数管理生命周期 */
+}response_segment_type_t;
+
+/***
+  * 响应链中的一段
+  */
+struct ResponseSegment
+{
+    response_segment_type_t type;
+    size_t size;           /** 段的字节数 */
+    size_t offset;         /** 段内已发送的字节数 */
+    off_t file_offset;     /** 文件段在文件中的起始位置 */
+
+    union
+    {
+        int fd;                       /** segment_file */
+        const char* buffer;           /** segment_buffer */
+        CSharedBuffer* shared_buffer; /** segment_shared */
+    };
+
+    const char* data() const
+    {
+        return (segment_shared == type)? shared_buffer->data(): buffer;
+    }
+};
+
 /***
   * 响应上下文
+  * 可以响应一个Buffer或一个文件句柄，
+  * 也可以通过add_xxx_segment响应一个由多段组成的链（如头部+Body+文件），
+  * 链中相邻的Buffer段合并以writev发送，文件段以sendfile发送，
+  * 使用响应链时response_size为各段大小之和，is_response_fd和response_buffer不被使用
   */
 struct ResponseContext
 {
@@ -82,17 +153,90 @@ struct ResponseContext
         char* response_buffer; /** 需要发送的数据 */
     };
 
+    size_t response_segment_index;               /** 响应链中正在发送的段 */
+    std::vector<ResponseSegment> response_chain; /** 响应链，为空表示不使用 */
+
     ResponseContext()
+        : response_segment_index(0)
     {
         reset();
     }
 
+    ~ResponseContext()
+    {
+        release_chain();
+    }
+
     void reset()
     {
         is_response_fd  = false;
         response_size   = 0;
         response_offset = 0;
         response_buffer = NULL;
+        release_chain();
+    }
+
+    bool has_chain() const
+    {
+        return !response_chain.empty();
+    }
+
+    /** 添加一个Buffer段，buffer须在发送完成前一直有效 */
+    void add_buffer_segment(const char* buffer, size_t size)
+    {
+        ResponseSegment segment;
+        segment.type = segment_buffer;
+        segment.buffer = buffer;
+        add_segment(segment, size);
+    }
+
+    /** 添加一个文件段，从文件的file_offset处开始发送size字节，fd须在发送完成前一直有效 */
+    void add_file_segment(int fd, off_t file_offset, size_t size)
+    {
+        ResponseSegment segment;
+        segment.type = segment_file;
+        segment.fd = fd;
+        segment.file_offset = file_offset;
+        add_segment(segment, size);
+    }
+
+    /** 添加一个共享Buffer段，会增加shared_buffer的引用计数，该段发送完成后减少 */
+    void add_shared_segment(CSharedBuffer* shared_buffer)
+    {
+        ResponseSegment segment;
+        segment.type = segment_shared;
+        segment.shared_buffer = shared_buffer;
+        shared_buffer->inc_refcount();
+        if (!add_segment(segment, shared_buffer->size()))
+        {
+            shared_buffer->dec_refcount();
+        }
+    }
+
+    /***
+      * 响应链发送了size字节后，更新各段的发送进度，
+      * 发送完的共享Buffer段立即释放引用
+      */
+    void move_chain_offset(size_t size)
+    {
+        while ((size > 0) && (response_segment_index < response_chain.size()))
+        {
+            ResponseSegment& segment = response_chain[response_segment_index];
+            size_t n = std::min(size, segment.size - segment.offset);
+
+            segment.offset += n;
+            size -= n;
+            if (segment.offset == segment.size)
+            {
+                if (segment_shared == segment.type)
+                {
+                    segment.shared_buffer->dec_refcount();
+                    segment.shared_buffer = NULL;
+                }
+
+                ++response_segment_index;
+            }
+        }
     }
 
     std::string to_string() const
@@ -103,10 +247,44 @@ struct ResponseContext
            << response_size << "|"
            << response_offset << "|"
            << response_fd << "|"
-           << &response_buffer;
+           << &response_buffer << "|"
+           << response_segment_index << "/" << response_chain.size();
 
         return ss.str();
     }
+
+private:
+    // 共享Buffer段持有引用，复制会导致重复释放，所以禁止
+    ResponseContext(const ResponseContext&);
+    ResponseContext& operator =(const ResponseContext&);
+
+    bool add_segment(ResponseSegment& segment, size_t size)
+    {
+        if (0 == size)
+        {
+            return false;
+        }
+
+        segment.size = size;
+        segment.offset = 0;
+        response_chain.push_back(segment);
+        response_size += size;
+        return true;
+    }
+
+    void release_chain()
+    {
+        for (size_t i=response_segment_index; i<response_chain.size(); ++i)
+        {
+            if (segment_shared == response_chain[i].type)
+            {
+                response_chain[i].shared_buffer->dec_refcount();
+            }
+        }
+
+        response_chain.clear();
+        response_segment_index = 0;
+    }
 };
 
 /***
@@ -186,6 +364,16 @@ public:
         _response_context.response_offset += offset;
     }
 
+    /***
+      * 响应链发送了offset字节后被调用，
+      * 先更新各段的发送进度，再通过move_response_offset更新总的发送进度
+      */
+    void move_response_chain_offset(size_t offset)
+    {
+        _response_context.move_chain_offset(offset);
+        move_response_offset(offset);
+    }
+
     /***
       * 开始响应前的事件
       */
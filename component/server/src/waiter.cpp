@@ -16,6 +16,9 @@
  *
  * Author: JianYi, eyjian@qq.com
  */
+#include <limits.h>
+#include <sys/uio.h>
+#include <algorithm>
 #include <sstream>
 #include <mooon/net/utils.h>
 #include <mooon/sys/thread.h>
@@ -29,6 +32,10 @@ CWaiter::CWaiter()
     ,_is_in_pool(false) // 只能初始化为false
     ,_thread_index(0)
     ,_packet_handler(NULL)
+#if MOOON_HAVE_IO_URING==1
+    ,_uring_generation(0)
+    ,_uring_recv_state(uring_recv_armed)
+#endif // MOOON_HAVE_IO_URING
 {
 }
 
@@ -44,6 +51,138 @@ void CWaiter::reset()
     _packet_handler->reset();
 }
 
+#if MOOON_HAVE_IO_URING==1
+void CWaiter::inc_uring_generation()
+{
+    _uring_generation = (_uring_generation + 1) & 0x0FFF;
+    _uring_pending.clear();
+    _uring_recv_state = uring_recv_armed; // 新的连接总是先注册recv
+}
+
+net::epoll_event_t CWaiter::handle_uring_recv(void* input_ptr, const char* data, size_t data_size, void* ouput_ptr)
+{
+    CWorkThread* thread = static_cast<CWorkThread *>(input_ptr);
+    thread->update_waiter(this); // 更新时间戳，防止超时
+
+    // 有暂存数据时，新数据排在其后，以保证顺序
+    if ((data != NULL) && !_uring_pending.empty())
+    {
+        _uring_pending.append(data, data_size);
+        data = NULL;
+    }
+
+    const bool from_pending = (NULL == data);
+    const char* feed_data = from_pending? _uring_pending.data(): data;
+    size_t feed_size = from_pending? _uring_pending.size(): data_size;
+    size_t consumed = 0;
+    net::epoll_event_t retval = net::epoll_none;
+
+    try
+    {
+        // 响应未完成前，不能再交给IPacketHandler
+        while ((consumed < feed_size) && !_is_sending && (net::epoll_none == retval))
+        {
+            RequestContext* request_context = _packet_handler->get_request_context();
+            size_t buffer_offset = request_context->request_offset;
+            size_t buffer_size = request_context->request_size;
+            char* buffer = request_context->request_buffer;
+
+            if ((buffer_offset >= buffer_size) || (NULL == buffer))
+            {
+                SERVER_LOG_ERROR("Invalid argument: %s.\n", request_context->to_string().c_str());
+                return net::epoll_close;
+            }
+
+            size_t size = std::min(buffer_size-buffer_offset, feed_size-consumed);
+            memcpy(buffer+buffer_offset, feed_data+consumed, size);
+            consumed += size;
+
+            retval = do_handle_request(size, ouput_ptr);
+            if (net::epoll_write == retval)
+            {
+                // 同epoll模式，收完一个请求后进入响应状态
+                break;
+            }
+        }
+    }
+    catch (sys::CSyscallException& ex)
+    {
+        SERVER_LOG_ERROR("Waiter %s error: %s.\n", to_string().c_str(), ex.str().c_str());
+        return net::epoll_close;
+    }
+
+    if (from_pending)
+        _uring_pending.erase(0, consumed);
+    else if (consumed < feed_size)
+        _uring_pending.append(feed_data+consumed, feed_size-consumed);
+
+    return retval;
+}
+
+net::epoll_event_t CWaiter::handle_uring_send(void* input_ptr, int result, void* ouput_ptr)
+{
+    CWorkThread* thread = static_cast<CWorkThread *>(input_ptr);
+    thread->update_waiter(this); // 更新时间戳，防止超时
+
+    if (result < 0)
+    {
+        if (-EAGAIN == result)
+        {
+            return net::epoll_write;
+        }
+
+        SERVER_LOG_ERROR("Waiter %s send error: %s.\n", to_string().c_str(), strerror(-result));
+        if (-EIO == result)
+        {
+            _packet_handler->on_io_error();
+        }
+
+        return net::epoll_close;
+    }
+
+    try
+    {
+        const ResponseContext* response_context = _packet_handler->get_response_context();
+
+        // 更新已经发送的大小值
+        _packet_handler->move_response_offset((size_t)result);
+        if (response_context->response_size > response_context->response_offset)
+        {
+            // 没有发完，需要继续发
+            return net::epoll_write;
+        }
+
+        return do_response_completed(ouput_ptr);
+    }
+    catch (sys::CSyscallException& ex)
+    {
+        SERVER_LOG_ERROR("Waiter %s error: %s.\n", to_string().c_str(), ex.str().c_str());
+        return net::epoll_close;
+    }
+}
+
+bool CWaiter::get_uring_send_buffer(const char** buffer, size_t* buffer_size)
+{
+    begin_response();
+
+    const ResponseContext* response_context = _packet_handler->get_response_context();
+    size_t size = response_context->response_size;
+    size_t offset = response_context->response_offset;
+
+    if (response_context->is_response_fd
+     || response_context->has_chain()
+     || (NULL == response_context->response_buffer)
+     || (size <= offset))
+    {
+        return false;
+    }
+
+    *buffer = response_context->response_buffer + offset;
+    *buffer_size = size - offset;
+    return true;
+}
+#endif // MOOON_HAVE_IO_URING
+
 bool CWaiter::on_timeout()
 {
     return _packet_handler->on_connection_timeout();
@@ -56,6 +195,8 @@ void CWaiter::on_switch_failure(bool overflow)
 
 void CWaiter::before_close()
 {
+    // 未完成的MSG_ZEROCOPY页面由内核持有引用，连接关闭后Buffer即可释放
+    _zerocopy.reset();
     _packet_handler->on_connection_closed();
 }
 
@@ -67,6 +208,26 @@ net::epoll_event_t CWaiter::handle_epoll_event(void* input_ptr, uint32_t events,
     
     try
     {   
+        // MSG_ZEROCOPY的完成通知放在错误队列中，以EPOLLERR报告
+        if ((EPOLLERR & events) && _zerocopy.is_enabled())
+        {
+            _zerocopy.handle_completion(get_fd());
+            if (0 == get_socket_error_code())
+            {
+                events &= ~EPOLLERR;
+                if (0 == (events & (EPOLLIN|EPOLLOUT|EPOLLHUP)))
+                {
+                    // 只有完成通知，如果在等待完成，则继续结束响应
+                    if (!_is_sending)
+                    {
+                        return net::epoll_none;
+                    }
+
+                    events |= EPOLLOUT;
+                }
+            }
+        }
+
         if (EPOLLHUP & events)
         {
             retval = do_handle_epoll_error((void*)"hang up", ouput_ptr);
@@ -111,11 +272,7 @@ net::epoll_event_t CWaiter::do_handle_epoll_send(void* input_ptr, void* ouput_pt
     size_t offset;
     ssize_t retval;
 
-    if (!_is_sending)
-    {
-        _is_sending = true;
-        _packet_handler->before_response();
-    }
+    begin_response();
 
     const ResponseContext* response_context = _packet_handler->get_response_context();
     size = response_context->response_size;
@@ -135,7 +292,18 @@ net::epoll_event_t CWaiter::do_handle_epoll_send(void* input_ptr, void* ouput_pt
         try
         {
             // 发送文件或数据
-            if (response_context->is_response_fd)
+            if (response_context->has_chain())
+            {
+                // 响应链内部已更新发送进度
+                retval = do_send_response_chain(response_context);
+                if (retval > 0)
+                {
+                    return (response_context->response_size > response_context->response_offset)
+                         ? net::epoll_write
+                         : do_response_completed(ouput_ptr);
+                }
+            }
+            else if (response_context->is_response_fd)
             {
                 // 发送文件
                 off_t file_offset = (off_t)offset;
@@ -151,7 +319,8 @@ net::epoll_event_t CWaiter::do_handle_epoll_send(void* input_ptr, void* ouput_pt
                 const char* buffer = response_context->response_buffer;
                 if (buffer != NULL)
                 {
-                    retval = CTcpWaiter::send(buffer+offset, size-offset);
+                    CWorkThread* thread = static_cast<CWorkThread *>(input_ptr);
+                    retval = do_send_buffer(buffer+offset, size-offset, thread->get_zerocopy_threshold());
                 }
                 else
                 {
@@ -190,6 +359,114 @@ net::epoll_event_t CWaiter::do_handle_epoll_send(void* input_ptr, void* ouput_pt
         }
     }              
 
+    // MSG_ZEROCOPY发送的数据完成前，不能结束响应，因为IPacketHandler会释放或复用Buffer
+    if (_zerocopy.has_pending())
+    {
+        HandOverParam* handover_param = static_cast<HandOverParam*>(ouput_ptr);
+        handover_param->epoll_events = 0; // 只等待EPOLLERR
+        return net::epoll_none;
+    }
+
+    return do_response_completed(ouput_ptr);
+}
+
+ssize_t CWaiter::do_send_buffer(const char* buffer, size_t buffer_size, uint32_t zerocopy_threshold)
+{
+    if (_zerocopy.need_zerocopy(get_fd(), buffer_size, zerocopy_threshold))
+    {
+        bool zerocopy;
+        ssize_t retval = CTcpWaiter::send_zerocopy(buffer, buffer_size, zerocopy);
+        if (zerocopy)
+        {
+            _zerocopy.on_zerocopy_sent();
+        }
+
+        return retval;
+    }
+
+    return CTcpWaiter::send(buffer, buffer_size);
+}
+
+ssize_t CWaiter::do_send_response_chain(const ResponseContext* response_context)
+{
+    struct iovec iov[IOV_MAX];
+    ssize_t total = -1;
+    bool cork = response_context->response_chain.size() > 1;
+
+    // 合并发送，减少小包
+    if (cork)
+    {
+        net::set_tcp_option(get_fd(), true, TCP_CORK);
+    }
+
+    // 一直发送，直到发完或Socket缓冲区满
+    while (response_context->response_segment_index < response_context->response_chain.size())
+    {
+        ssize_t retval;
+        size_t bytes = 0;
+        size_t index = response_context->response_segment_index;
+        const ResponseSegment& segment = response_context->response_chain[index];
+
+        if (segment_file == segment.type)
+        {
+            off_t file_offset = segment.file_offset + (off_t)segment.offset;
+
+            bytes = segment.size - segment.offset;
+            retval = CTcpWaiter::send_file(segment.fd, &file_offset, bytes);
+        }
+        else
+        {
+            // 相邻的Buffer段合并成一次writev
+            int iovcnt = 0;
+            for (; (index < response_context->response_chain.size()) && (iovcnt < IOV_MAX); ++index, ++iovcnt)
+            {
+                const ResponseSegment& buffer_segment = response_context->response_chain[index];
+                if (segment_file == buffer_segment.type)
+                {
+                    break;
+                }
+
+                iov[iovcnt].iov_base = const_cast<char*>(buffer_segment.data()) + buffer_segment.offset;
+                iov[iovcnt].iov_len = buffer_segment.size - buffer_segment.offset;
+                bytes += iov[iovcnt].iov_len;
+            }
+
+            retval = CTcpWaiter::writev(iov, iovcnt);
+        }
+        if (-1 == retval)
+        {
+            // Would block
+            break;
+        }
+
+        total = (-1 == total)? retval: total+retval;
+        _packet_handler->move_response_chain_offset((size_t)retval);
+        if ((size_t)retval < bytes)
+        {
+            // Socket缓冲区已满，等待下次可写
+            break;
+        }
+    }
+
+    if (cork)
+    {
+        net::set_tcp_option(get_fd(), false, TCP_CORK);
+    }
+
+    return total;
+}
+
+void CWaiter::begin_response()
+{
+    if (!_is_sending)
+    {
+        _is_sending = true;
+        _packet_handler->before_response();
+    }
+}
+
+net::epoll_event_t CWaiter::do_response_completed(void* ouput_ptr)
+{
     Indicator indicator;
     indicator.reset = true;
     indicator.thread_index = get_thread_index();
@@ -282,13 +559,18 @@ net::epoll_event_t CWaiter::do_handle_epoll_read(void* input_ptr, void* ouput_pt
                     , buffer+buffer_offset);
 #endif
         
+    return do_handle_request((size_t)retval, ouput_ptr);
+}
+
+net::epoll_event_t CWaiter::do_handle_request(size_t data_size, void* ouput_ptr)
+{
     // 处理收到的数据
     Indicator indicator;
     indicator.reset = false;
     indicator.thread_index = get_thread_index();
     indicator.epoll_events = EPOLLOUT;
 
-    utils::handle_result_t handle_result = _packet_handler->on_handle_request((size_t)retval, indicator);
+    utils::handle_result_t handle_result = _packet_handler->on_handle_request(data_size, indicator);
     if (indicator.reset)
     {
         reset();
@@ -18,6 +18,7 @@
  */
 #ifndef MOOON_SERVER_WAITER_H
 #define MOOON_SERVER_WAITER_H
+#include <string>
 #include <mooon/sys/log.h>
 #include <mooon/utils/listable.h>
 #include <mooon/net/tcp_waiter.h>
@@ -60,10 +61,56 @@ public:
     virtual const net::ip_address_t& peer_ip() const;
     virtual uint16_t get_thread_index() const;
 
+#if MOOON_HAVE_IO_URING==1
+public: // 只有io_uring模式下的CWorkThread会调用
+    uint16_t get_uring_generation() const { return _uring_generation; }
+    void inc_uring_generation();
+    bool has_uring_pending() const { return !_uring_pending.empty(); }
+
+    // 响应期间暂存的数据达到上限后停止接收，和epoll模式一样让TCP的流控生效，
+    // 否则客户端在响应较慢时不停地发送，会使暂存的数据无限增长
+    enum { URING_PENDING_MAX = 65536 };
+    bool is_uring_pending_full() const { return _uring_pending.size() >= URING_PENDING_MAX; }
+
+    // multishot recv的状态
+    enum
+    {
+        uring_recv_armed,      // 正在接收
+        uring_recv_cancelling, // 已提交取消，等待它的最后一个完成事件
+        uring_recv_paused      // 已停止接收，暂存的数据处理后再重新注册
+    };
+    int get_uring_recv_state() const { return _uring_recv_state; }
+    void set_uring_recv_state(int uring_recv_state) { _uring_recv_state = uring_recv_state; }
+
+    /***
+      * 处理multishot recv收到的数据，数据会被复制到RequestContext中，
+      * 处理不完的（如已进入响应状态）暂存起来，待响应完成后再处理
+      * @data: 收到的数据，为NULL时只处理暂存的数据
+      */
+    net::epoll_event_t handle_uring_recv(void* input_ptr, const char* data, size_t data_size, void* ouput_ptr);
+
+    /***
+      * 处理send的完成事件
+      * @result: 完成事件的结果，即已发送的字节数或负的错误码
+      */
+    net::epoll_event_t handle_uring_send(void* input_ptr, int result, void* ouput_ptr);
+
+    /***
+      * 得到需要通过io_uring发送的Buffer
+      * @return: 如果响应的是文件、响应链或无数据需要发送，则返回false，这时应走同步发送
+      */
+    bool get_uring_send_buffer(const char** buffer, size_t* buffer_size);
+#endif // MOOON_HAVE_IO_URING
+
 private:    
     net::epoll_event_t do_handle_epoll_send(void* input_ptr, void* ouput_ptr);
     net::epoll_event_t do_handle_epoll_read(void* input_ptr, void* ouput_ptr);
     net::epoll_event_t do_handle_epoll_error(void* input_ptr, void* ouput_ptr);
+    net::epoll_event_t do_handle_request(size_t data_size, void* ouput_ptr);
+    net::epoll_event_t do_response_completed(void* ouput_ptr);
+    void begin_response();
+    ssize_t do_send_buffer(const char* buffer, size_t buffer_size, uint32_t zerocopy_threshold);
+    ssize_t do_send_response_chain(const ResponseContext* response_context);
 
 private:        
     bool _is_sending; // 是否处于正发送数据状态中
@@ -71,6 +118,16 @@ private:
     uint16_t _thread_index;
     IPacketHandler* _packet_handler;
     mutable std::string _string_id;
+
+private: // MSG_ZEROCOPY
+    net::CZeroCopyState _zerocopy;
+
+#if MOOON_HAVE_IO_URING==1
+private:
+    uint16_t _uring_generation; // 用来识别连接关闭后才到达的完成事件
+    std::string _uring_pending; // 已收到但还未交给IPacketHandler的数据
+    int _uring_recv_state;
+#endif // MOOON_HAVE_IO_URING
 };
 
 SERVER_NAMESPACE_END
@@ -16,6 +16,7 @@
  *
  * Author: jian yi, eyjian@qq.com
  */
+#include <poll.h>
 #include <sstream>
 #include <mooon/net/utils.h>
 #include <mooon/sys/utils.h>
@@ -28,6 +29,11 @@ CWorkThread::CWorkThread()
     ,_context(NULL)
     ,_follower(NULL)
     ,_takeover_waiter_queue(NULL)
+#if MOOON_HAVE_IO_URING==1
+    ,_use_uring(false)
+    ,_uring_listener_array(NULL)
+    ,_uring_listen_count(0)
+#endif // MOOON_HAVE_IO_URING
 {
     _current_time = time(NULL);
     _timeout_manager.set_timeout_handler(this);  
@@ -46,6 +52,14 @@ void CWorkThread::run()
 {
     int retval; // _epoller.timed_wait的返回值
 
+#if MOOON_HAVE_IO_URING==1
+    if (_use_uring)
+    {
+        uring_run();
+        return;
+    }
+#endif // MOOON_HAVE_IO_URING
+
     _timeout_manager.check_timeout(_current_time);
     check_pending_queue();
         
@@ -139,6 +153,12 @@ void CWorkThread::before_start() throw (utils::CException, sys::CSyscallExceptio
         _timeout_manager.set_timeout_seconds(config->get_connection_timeout_seconds());       
         
         _epoller.create(config->get_epoll_size());        
+#if MOOON_HAVE_IO_URING==1
+        if (config->use_io_uring())
+        {
+            create_uring();
+        }
+#endif // MOOON_HAVE_IO_URING
         
         uint32_t thread_connection_pool_size = config->get_connection_pool_size();
         
@@ -181,7 +201,7 @@ void CWorkThread::on_timeout_event(CWaiter* waiter)
     {
         try
         {
-            _epoller.del_events(waiter);                    
+            unwatch_waiter(waiter);
         }
         catch (sys::CSyscallException& ex)
         {
@@ -230,6 +250,20 @@ bool CWorkThread::watch_waiter(CWaiter* waiter, uint32_t epoll_events)
 {
     try
     {               
+#if MOOON_HAVE_IO_URING==1
+        if (_use_uring)
+        {
+            _uring.prep_recv_multishot(waiter->get_fd(), make_user_data(waiter, uring_op_recv, waiter->get_uring_generation()));
+            _timeout_manager.push(waiter, _current_time);
+            if (EPOLLOUT & epoll_events)
+            {
+                uring_send(waiter);
+            }
+
+            return true;
+        }
+#endif // MOOON_HAVE_IO_URING
+
         _epoller.set_events(waiter, epoll_events);
         _timeout_manager.push(waiter, _current_time);
 
@@ -246,6 +280,22 @@ bool CWorkThread::watch_waiter(CWaiter* waiter, uint32_t epoll_events)
     }
 }
 
+void CWorkThread::unwatch_waiter(CWaiter* waiter)
+{
+#if MOOON_HAVE_IO_URING==1
+    if (_use_uring)
+    {
+        // 须在关闭连接前提交，之后才到达的完成事件以代数不同被丢弃
+        _uring.prep_cancel_fd(waiter->get_fd(), make_user_data(NULL, uring_op_cancel, 0));
+        _uring.submit();
+        waiter->inc_uring_generation();
+        return;
+    }
+#endif // MOOON_HAVE_IO_URING
+
+    _epoller.del_events(waiter);
+}
+
 void CWorkThread::handover_waiter(CWaiter* waiter, const HandOverParam& handover_param)
 {
     std::string waiter_str = waiter->to_string();
@@ -278,7 +328,7 @@ void CWorkThread::remove_waiter(CWaiter* waiter)
 {
     try
     {
-        _epoller.del_events(waiter);        
+        unwatch_waiter(waiter);
         _timeout_manager.remove(waiter);        
     }
     catch (sys::CSyscallException& ex)
@@ -309,8 +359,25 @@ bool CWorkThread::add_waiter(int fd, const net::ip_address_t& peer_ip, net::port
     return watch_waiter(waiter, EPOLLIN);    
 }
 
+uint32_t CWorkThread::get_zerocopy_threshold() const
+{
+    return _context->get_config()->get_zerocopy_threshold();
+}
+
 void CWorkThread::add_listener_array(CListener* listener_array, uint16_t listen_count)
 {        
+#if MOOON_HAVE_IO_URING==1
+    if (_use_uring)
+    {
+        // 请求只能由本线程准备，交给线程自己去注册multishot accept
+        sys::LockHelper<sys::CLock> lock_helper(_pending_lock);
+        _uring_listener_array = listener_array;
+        _uring_listen_count = listen_count;
+        _epoller.wakeup();
+        return;
+    }
+#endif // MOOON_HAVE_IO_URING
+
     for (uint16_t i=0; i<listen_count; ++i)
          _epoller.set_events(&listener_array[i], EPOLLIN, true);    
 }
@@ -390,4 +457,367 @@ void CWorkThread::epoll_event_release(net::CEpollable* epollable, void* param)
     }
 }
 
+#if MOOON_HAVE_IO_URING==1
+////////////////////////////////////////////////////////////////////////////////
+// io_uring模式
+// 连接的收发改由io_uring完成：每个线程一个io_uring，
+// 监听者使用multishot accept，连接使用multishot recv（数据存放在provided buffer中），
+// Buffer类型的响应使用send，文件类型的响应仍走同步的sendfile，阻塞时通过poll等待可写，
+// 每轮循环只调用一次io_uring_enter，完成所有请求的提交和完成事件的等待；
+// Sensor等仍由Epoll管理，通过poll Epoll句柄得到唤醒
+
+static bool get_peer_address(int fd, net::ip_address_t& peer_ip, net::port_t& peer_port)
+{
+    struct sockaddr_in6 peer_addr_in6;
+    struct sockaddr* peer_addr = (struct sockaddr*)&peer_addr_in6;
+    socklen_t peer_addrlen = sizeof(struct sockaddr_in6); // 使用最大的
+
+    if (-1 == getpeername(fd, peer_addr, &peer_addrlen))
+    {
+        SERVER_LOG_ERROR("Getpeername error: %s.\n", strerror(errno));
+        return false;
+    }
+
+    // 和net::CListener::accept保持一致
+    if (AF_INET == peer_addr->sa_family)
+    {
+        struct sockaddr_in* peer_addr_in = (struct sockaddr_in*)peer_addr;
+        peer_port = peer_addr_in->sin_port;
+        peer_ip = peer_addr_in->sin_addr.s_addr;
+    }
+    else
+    {
+        peer_port = peer_addr_in6.sin6_port;
+        peer_ip = (uint32_t*)&peer_addr_in6.sin6_addr;
+    }
+
+    return true;
+}
+
+uint64_t CWorkThread::make_user_data(const void* ptr, uring_op_t op, uint16_t generation)
+{
+    // 低48位为对象地址，中间12位为连接的代数，高4位为操作类型
+    return (uint64_t)(uintptr_t)ptr
+         | ((uint64_t)(generation & 0x0FFF) << 48)
+         | ((uint64_t)op << 60);
+}
+
+void CWorkThread::create_uring()
+{
+    IConfig* config = _context->get_config();
+
+    try
+    {
+        _uring.create(config->get_epoll_size());
+        _uring.register_buffer_ring(0, config->get_io_uring_buffer_count(), config->get_io_uring_buffer_size());
+        _uring.prep_poll_add(_epoller.get_fd(), POLLIN, make_user_data(NULL, uring_op_epoll, 0));
+        _use_uring = true;
+
+        SERVER_LOG_INFO("Server thread[%u] uses io_uring.\n", get_index());
+    }
+    catch (sys::CSyscallException& ex)
+    {
+        _uring.destroy();
+        SERVER_LOG_WARN("Server thread[%u] falls back to epoll for %s.\n", get_index(), ex.str().c_str());
+    }
+}
+
+void CWorkThread::uring_run()
+{
+    _timeout_manager.check_timeout(_current_time);
+    check_pending_queue();
+    uring_arm_listeners();
+
+    // epoll前回调
+    if (_follower != NULL)
+    {
+        _follower->before_epoll();
+    }
+    try
+    {
+        // 提交本轮所有请求，并等待完成事件
+        _uring.submit_and_wait(1, _context->get_config()->get_epoll_timeout_milliseconds());
+    }
+    catch (sys::CSyscallException& ex)
+    {
+        SERVER_LOG_FATAL("Waiter thread wait error for %s.\n", ex.str().c_str());
+        throw; // 和timed_wait一样，是不能恢复的
+    }
+
+    try
+    {
+        // 得到当前时间
+        _current_time = time(NULL);
+
+        struct io_uring_cqe* cqe = _uring.peek_cqe();
+        if (_follower != NULL)
+        {
+            _follower->after_epoll(_current_time, NULL == cqe);
+        }
+        for (; cqe != NULL; cqe = _uring.peek_cqe())
+        {
+            struct io_uring_cqe cqe_copy = *cqe;
+            _uring.cqe_seen();
+            uring_handle_cqe(&cqe_copy);
+        }
+    }
+    catch (sys::CSyscallException& ex)
+    {
+        SERVER_LOG_FATAL("Waiter thread run error for %s.\n", ex.str().c_str());
+    }
+}
+
+void CWorkThread::uring_arm_listeners()
+{
+    if (_uring_listener_array != NULL)
+    {
+        sys::LockHelper<sys::CLock> lock_helper(_pending_lock);
+        for (uint16_t i=0; i<_uring_listen_count; ++i)
+        {
+            CListener* listener = &_uring_listener_array[i];
+            _uring.prep_accept_multishot(listener->get_fd(), make_user_data(listener, uring_op_accept, 0));
+        }
+
+        _uring_listener_array = NULL;
+    }
+}
+
+void CWorkThread::uring_handle_cqe(const struct io_uring_cqe* cqe)
+{
+    uring_op_t op = (uring_op_t)(cqe->user_data >> 60);
+    uint16_t generation = (uint16_t)((cqe->user_data >> 48) & 0x0FFF);
+    void* ptr = (void*)(uintptr_t)(cqe->user_data & UINT64_C(0x0000FFFFFFFFFFFF));
+
+    if (uring_op_epoll == op)
+    {
+        uring_handle_epoll();
+        return;
+    }
+    if (uring_op_accept == op)
+    {
+        uring_handle_accept(static_cast<CListener*>(ptr), cqe);
+        return;
+    }
+    if (uring_op_cancel == op)
+    {
+        return;
+    }
+
+    CWaiter* waiter = static_cast<CWaiter*>(ptr);
+    bool has_buffer = (cqe->flags & IORING_CQE_F_BUFFER) != 0;
+    uint16_t buffer_id = (uint16_t)(cqe->flags >> IORING_CQE_BUFFER_SHIFT);
+    if (generation != waiter->get_uring_generation())
+    {
+        // 连接已经关闭
+        if (has_buffer)
+        {
+            _uring.recycle_buffer(buffer_id);
+        }
+
+        return;
+    }
+
+    HandOverParam handover_param(get_index());
+    net::epoll_event_t retval;
+    if (uring_op_recv == op)
+    {
+        if ((cqe->res > 0) && has_buffer)
+        {
+            retval = waiter->handle_uring_recv(this, _uring.get_buffer(buffer_id), (size_t)cqe->res, &handover_param);
+            _uring.recycle_buffer(buffer_id);
+        }
+        else if (0 == cqe->res)
+        {
+            SERVER_LOG_DEBUG("Waiter %s closed by peer.\n", waiter->to_string().c_str());
+            retval = net::epoll_close;
+        }
+        else if (-ECANCELED == cqe->res)
+        {
+            // 暂存的数据达到上限，被取消了
+            retval = net::epoll_none;
+        }
+        else if (-ENOBUFS == cqe->res)
+        {
+            // 缓冲区暂时用完，重新注册recv即可
+            SERVER_LOG_DEBUG("Waiter %s has no buffer to receive.\n", waiter->to_string().c_str());
+            retval = net::epoll_none;
+        }
+        else
+        {
+            SERVER_LOG_DEBUG("Waiter %s receive error: %s.\n", waiter->to_string().c_str(), strerror(-cqe->res));
+            retval = net::epoll_close;
+        }
+    }
+    else if (uring_op_send == op)
+    {
+        retval = waiter->handle_uring_send(this, cqe->res, &handover_param);
+    }
+    else if ((uring_op_pollout == op) && (cqe->res > 0))
+    {
+        net::CEpollable* epollable = waiter;
+        retval = epollable->handle_epoll_event(this, (uint32_t)cqe->res, &handover_param);
+    }
+    else
+    {
+        retval = net::epoll_close;
+    }
+
+    uring_dispatch(waiter, retval, &handover_param);
+
+    if ((uring_op_recv == op) && (generation == waiter->get_uring_generation()))
+    {
+        if (0 == (cqe->flags & IORING_CQE_F_MORE))
+        {
+            // multishot recv终止了（如缓冲区用完或被取消），但连接还在使用
+            if (waiter->is_uring_pending_full())
+            {
+                waiter->set_uring_recv_state(CWaiter::uring_recv_paused);
+            }
+            else
+            {
+                waiter->set_uring_recv_state(CWaiter::uring_recv_armed);
+                _uring.prep_recv_multishot(waiter->get_fd(), make_user_data(waiter, uring_op_recv, generation));
+            }
+        }
+        else if ((CWaiter::uring_recv_armed == waiter->get_uring_recv_state()) && waiter->is_uring_pending_full())
+        {
+            // 停止接收，只取消recv，正在进行的send不受影响
+            SERVER_LOG_DEBUG("Waiter %s pauses receiving.\n", waiter->to_string().c_str());
+            waiter->set_uring_recv_state(CWaiter::uring_recv_cancelling);
+            _uring.prep_cancel(make_user_data(waiter, uring_op_recv, generation), make_user_data(NULL, uring_op_cancel, 0));
+        }
+    }
+}
+
+void CWorkThread::uring_handle_accept(CListener* listener, const struct io_uring_cqe* cqe)
+{
+    if (cqe->res >= 0)
+    {
+        int newfd = cqe->res;
+        net::port_t peer_port;
+        net::ip_address_t peer_ip;
+
+        if (!get_peer_address(newfd, peer_ip, peer_port)
+         || !add_waiter(newfd, peer_ip, peer_port, listener->get_listen_ip(), listener->get_listen_port()))
+        {
+            net::close_fd(newfd);
+        }
+    }
+    else if (cqe->res != -EAGAIN)
+    {
+        // 对于某些server，这类信息巨大，如webserver
+        SERVER_LOG_ERROR("Accept error: %s.\n", strerror(-cqe->res));
+    }
+
+    if (0 == (cqe->flags & IORING_CQE_F_MORE))
+    {
+        _uring.prep_accept_multishot(listener->get_fd(), make_user_data(listener, uring_op_accept, 0));
+    }
+}
+
+void CWorkThread::uring_handle_epoll()
+{
+    int retval = _epoller.timed_wait(0);
+    for (int i=0; i<retval; ++i)
+    {
+        HandOverParam handover_param(this->get_index());
+        net::CEpollable* epollable = _epoller.get(i);
+        net::epoll_event_t event_retval = epollable->handle_epoll_event(this, _epoller.get_events(i), &handover_param);
+
+        if ((event_retval < 8) && (event_retval >= 0))
+        {
+            (this->*_epoll_event_proc[event_retval])(epollable, &handover_param);
+        }
+        else
+        {
+            epoll_event_close(epollable, NULL);
+        }
+    }
+
+    _uring.prep_poll_add(_epoller.get_fd(), POLLIN, make_user_data(NULL, uring_op_epoll, 0));
+}
+
+void CWorkThread::uring_dispatch(CWaiter* waiter, net::epoll_event_t retval, HandOverParam* handover_param)
+{
+    uint32_t epoll_events;
+
+    // 响应完成后，继续处理暂存的数据，如客户端以pipeline方式发来的请求
+    if (((net::epoll_none == retval) || (net::epoll_read == retval))
+     && (0 == (EPOLLOUT & handover_param->epoll_events))
+     && waiter->has_uring_pending())
+    {
+        retval = waiter->handle_uring_recv(this, NULL, 0, handover_param);
+    }
+
+    switch (retval)
+    {
+    case net::epoll_none:
+        epoll_events = handover_param->epoll_events;
+        break;
+    case net::epoll_read:
+        epoll_events = EPOLLIN;
+        break;
+    case net::epoll_write:
+    case net::epoll_read_write:
+        epoll_events = EPOLLOUT;
+        break;
+    case net::epoll_release:
+        if (handover_param->thread_index == get_index())
+        {
+            epoll_events = handover_param->epoll_events;
+            break;
+        }
+
+        SERVER_LOG_ERROR("Can not handover %s to thread[%u] in io_uring mode.\n", waiter->to_string().c_str(), handover_param->thread_index);
+        waiter->on_switch_failure(false);
+        del_waiter(waiter);
+        return;
+    default:
+        del_waiter(waiter);
+        return;
+    }
+
+    // 暂存的数据处理后，恢复因暂存的数据达到上限而停止的接收
+    if ((CWaiter::uring_recv_paused == waiter->get_uring_recv_state()) && !waiter->is_uring_pending_full())
+    {
+        waiter->set_uring_recv_state(CWaiter::uring_recv_armed);
+        _uring.prep_recv_multishot(waiter->get_fd(), make_user_data(waiter, uring_op_recv, waiter->get_uring_generation()));
+    }
+
+    // 接收总是由multishot recv进行，只需处理发送
+    if (EPOLLOUT & epoll_events)
+    {
+        uring_send(waiter);
+    }
+}
+
+void CWorkThread::uring_send(CWaiter* waiter)
+{
+    const char* buffer;
+    size_t buffer_size;
+    uint16_t generation = waiter->get_uring_generation();
+
+    if (waiter->get_uring_send_buffer(&buffer, &buffer_size))
+    {
+        _uring.prep_send(waiter->get_fd(), buffer, buffer_size, make_user_data(waiter, uring_op_send, generation));
+    }
+    else
+    {
+        // 文件和响应链走同步发送，阻塞时等待可写
+        HandOverParam handover_param(get_index());
+        net::CEpollable* epollable = waiter;
+        net::epoll_event_t retval = epollable->handle_epoll_event(this, EPOLLOUT, &handover_param);
+
+        if ((net::epoll_write == retval) || (net::epoll_read_write == retval))
+        {
+            _uring.prep_poll_add(waiter->get_fd(), POLLOUT, make_user_data(waiter, uring_op_pollout, generation));
+        }
+        else
+        {
+            uring_dispatch(waiter, retval, &handover_param);
+        }
+    }
+}
+#endif // MOOON_HAVE_IO_URING
+
 SERVER_NAMESPACE_END
@@ -19,6 +19,7 @@
 #ifndef MOOON_SERVER_THREAD_H
 #define MOOON_SERVER_THREAD_H
 #include <mooon/net/epoller.h>
+#include <mooon/net/uring.h>
 #include <mooon/sys/pool_thread.h>
 #include <mooon/utils/timeout_manager.h>
 #include "log.h"
@@ -54,6 +55,7 @@ public:
                           , const net::ip_address_t& self_ip, net::port_t self_port);   
       
     void add_listener_array(CListener* listener_array, uint16_t listen_count);    
+    uint32_t get_zerocopy_threshold() const;
     bool takeover_waiter(CWaiter* waiter, uint32_t epoll_event);
         
 private:
@@ -71,6 +73,7 @@ public:
 private:    
     void check_pending_queue();
     bool watch_waiter(CWaiter* waiter, uint32_t epoll_events);
+    void unwatch_waiter(CWaiter* waiter);
     void handover_waiter(CWaiter* waiter, const HandOverParam& handover_param);
 
 private:    
@@ -108,6 +111,35 @@ private:
     void epoll_event_close(net::CEpollable* epollable, void* param);
     void epoll_event_destroy(net::CEpollable* epollable, void* param);
     void epoll_event_release(net::CEpollable* epollable, void* param);  
+
+#if MOOON_HAVE_IO_URING==1
+private: // io_uring模式
+    typedef enum
+    {
+        uring_op_accept  = 1, // multishot accept
+        uring_op_recv    = 2, // multishot recv
+        uring_op_send    = 3, // send
+        uring_op_pollout = 4, // 同步发送阻塞后等待可写
+        uring_op_epoll   = 5, // 等待Epoll可读，Sensor仍由Epoll管理
+        uring_op_cancel  = 6  // 取消请求
+    }uring_op_t;
+
+    static uint64_t make_user_data(const void* ptr, uring_op_t op, uint16_t generation);
+    void create_uring();
+    void uring_run();
+    void uring_arm_listeners();
+    void uring_handle_cqe(const struct io_uring_cqe* cqe);
+    void uring_handle_accept(CListener* listener, const struct io_uring_cqe* cqe);
+    void uring_handle_epoll();
+    void uring_dispatch(CWaiter* waiter, net::epoll_event_t retval, HandOverParam* handover_param);
+    void uring_send(CWaiter* waiter);
+
+private:
+    bool _use_uring;
+    net::CUring _uring;
+    CListener* _uring_listener_array; // 待注册multishot accept的监听者
+    uint16_t _uring_listen_count;
+#endif // MOOON_HAVE_IO_URING
 };
 
 SERVER_NAMESPACE_END
@@ -0,0 +1,210 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Author: eyjian@qq.com or eyjian@gmail.com
+ */
+#ifndef MOOON_NET_BUFFER_RECV_MACHINE_H
+#define MOOON_NET_BUFFER_RECV_MACHINE_H
+#include <mooon/net/config.h>
+NET_NAMESPACE_BEGIN
+
+/***
+  * 基于可增长缓冲区的接收状态机，对ProcessorManager的要求和CRecvMachine相同，区别在于：
+  * 1) 缓冲区由状态机持有并重复使用，调用者通过get_buffer得到空闲空间后直接recv进去，
+  *    一次recv可以读入多个消息
+  * 2) 只有消息完整地收到后才回调on_message，并且消息体在缓冲区中总是连续的，
+  *    因此每个消息只回调一次on_message，finished_size为0，buffer_size等于header.size，
+  *    ProcessorManager可直接使用buffer，不需要拷贝拼接，但buffer只在on_message期间有效
+  * 3) 缓冲区容纳不下一个完整的消息时自动增长，空闲时恢复到初始大小；
+  *    处理完的数据通过将剩余的不完整消息移到缓冲区头部来回收
+  *
+  * 使用示例：
+  * size_t buffer_size;
+  * char* buffer = recv_machine.get_buffer(&buffer_size);
+  * ssize_t bytes_recved = receive(buffer, buffer_size);
+  * if (bytes_recved > 0)
+  *     hr = recv_machine.work(bytes_recved);
+  */
+template <typename MessageHeaderType, class ProcessorManager>
+class CBufferRecvMachine
+{
+public:
+    /***
+      * @buffer_size: 缓冲区的初始大小
+      * @max_message_size: 允许的最大消息体字节数，超过时work返回utils::handle_error
+      */
+    CBufferRecvMachine(ProcessorManager* processor_manager, size_t buffer_size=65536, size_t max_message_size=64*1024*1024);
+    ~CBufferRecvMachine();
+
+    /***
+      * 得到可写入数据的空闲缓冲区，必要时会移动或增长缓冲区，
+      * 保证能够容纳当前不完整的消息
+      * @buffer_size: 输出参数，空闲缓冲区的字节数，总是大于0
+      */
+    char* get_buffer(size_t* buffer_size);
+
+    /***
+      * 处理新写入get_buffer所得缓冲区的数据
+      * @buffer_size: 新写入的字节数
+      * @return: 1) 如果出错，则返回utils::handle_error
+      *          2) 如果还有不完整的消息，则返回utils::handle_continue
+      *          3) 如果刚好到包的边界，则返回utils::handle_finish
+      */
+    utils::handle_result_t work(size_t buffer_size);
+
+    // 复位状态，丢弃缓冲区中的数据
+    void reset();
+
+private:
+    void resize(size_t capacity);
+
+private:
+    MessageHeaderType _header;
+    ProcessorManager* _processor_manager;
+    size_t _buffer_size;      // 初始大小
+    size_t _max_message_size;
+    char* _buffer;
+    size_t _capacity;
+    size_t _head;             // 第一个未处理的字节
+    size_t _tail;             // 数据的结尾
+    bool _header_finished;    // _head处的消息头是否已经回调过on_header
+};
+
+template <typename MessageHeaderType, class ProcessorManager>
+CBufferRecvMachine<MessageHeaderType, ProcessorManager>::CBufferRecvMachine(
+    ProcessorManager* processor_manager, 
+    size_t buffer_size, 
+    size_t max_message_size)
+ :_processor_manager(processor_manager)
+ ,_buffer_size(buffer_size < sizeof(MessageHeaderType)? sizeof(MessageHeaderType): buffer_size)
+ ,_max_message_size(max_message_size)
+ ,_buffer(NULL)
+ ,_capacity(0)
+ ,_head(0)
+ ,_tail(0)
+ ,_header_finished(false)
+{
+    resize(_buffer_size);
+}
+
+template <typename MessageHeaderType, class ProcessorManager>
+CBufferRecvMachine<MessageHeaderType, ProcessorManager>::~CBufferRecvMachine()
+{
+    delete []_buffer;
+}
+
+template <typename MessageHeaderType, class ProcessorManager>
+char* CBufferRecvMachine<MessageHeaderType, ProcessorManager>::get_buffer(size_t* buffer_size)
+{
+    size_t data_size = _tail - _head;
+    size_t message_size = _header_finished
+                        ? sizeof(MessageHeaderType) + _header.size
+                        : sizeof(MessageHeaderType);
+
+    if (0 == data_size)
+    {
+        _head = _tail = 0;
+        // 大消息处理完后，归还多占用的内存
+        if (_capacity > _buffer_size)
+            resize(_buffer_size);
+    }
+    else if ((_head + message_size > _capacity) || (_capacity - _tail < _capacity / 4))
+    {
+        // 尾部放不下当前消息，或者空闲太少，将不完整的消息移到头部
+        memmove(_buffer, _buffer + _head, data_size);
+        _head = 0;
+        _tail = data_size;
+    }
+    if (message_size > _capacity)
+    {
+        resize(message_size);
+    }
+
+    *buffer_size = _capacity - _tail;
+    return _buffer + _tail;
+}
+
+template <typename MessageHeaderType, class ProcessorManager>
+utils::handle_result_t CBufferRecvMachine<MessageHeaderType, ProcessorManager>::work(size_t buffer_size)
+{
+    _tail += buffer_size;
+
+    while (_tail - _head >= sizeof(MessageHeaderType))
+    {
+        if (!_header_finished)
+        {
+            // 缓冲区中的消息头不一定是对齐的
+            memcpy(reinterpret_cast<char*>(&_header), _buffer + _head, sizeof(MessageHeaderType));
+            if ((_header.size > _max_message_size)
+             || !_processor_manager->on_header(_header))
+            {
+                reset();
+                return utils::handle_error;
+            }
+
+            _header_finished = true;
+        }
+
+        size_t message_size = sizeof(MessageHeaderType) + _header.size;
+        if (_tail - _head < message_size)
+        {
+            break;
+        }
+
+        const char* body = (0 == _header.size)? NULL: _buffer + _head + sizeof(MessageHeaderType);
+        if (!_processor_manager->on_message(_header, 0, body, _header.size))
+        {
+            reset();
+            return utils::handle_error;
+        }
+
+        _head += message_size;
+        _header_finished = false;
+    }
+
+    return (_head == _tail)
+          ? utils::handle_finish
+          : utils::handle_continue;
+}
+
+template <typename MessageHeaderType, class ProcessorManager>
+void CBufferRecvMachine<MessageHeaderType, ProcessorManager>::reset()
+{
+    _head = 0;
+    _tail = 0;
+    _header_finished = false;
+}
+
+template <typename MessageHeaderType, class ProcessorManager>
+void CBufferRecvMachine<MessageHeaderType, ProcessorManager>::resize(size_t capacity)
+{
+    char* buffer = new char[capacity];
+    size_t data_size = _tail - _head;
+
+    if (data_size > 0)
+    {
+        memcpy(buffer, _buffer + _head, data_size);
+    }
+
+    delete []_buffer;
+    _buffer = buffer;
+    _capacity = capacity;
+    _head = 0;
+    _tail = data_size;
+}
+
+NET_NAMESPACE_END
+#endif // MOOON_NET_BUFFER_RECV_MACHINE_H
@@ -108,6 +108,71 @@ void set_nodelay(int fd, bool yes) throw (sys::CSyscallException);
   */
 void close_fd(int fd) throw ();
 
+/***
+  * 为指定的套接字打开SO_ZEROCOPY，打开后才可以MSG_ZEROCOPY方式发送
+  * @return: 如果系统不支持，则返回false
+  * @exception: 如果发生其它错误，则抛出CSyscallException异常
+  */
+bool enable_zerocopy(int fd) throw (sys::CSyscallException);
+
+/***
+  * 从套接字的错误队列中取一个MSG_ZEROCOPY的完成通知，
+  * 错误队列非空时，Epoll会报告EPOLLERR事件，应循环调用直到返回false
+  * 每个成功的MSG_ZEROCOPY发送调用按顺序得到一个从0开始的32位编号，
+  * 完成通知给出的是已完成的编号区间[lo, hi]，编号完成后对应的Buffer才可以释放或修改
+  * @lo: 输出参数，已完成的最小编号
+  * @hi: 输出参数，已完成的最大编号
+  * @return: 如果取到完成通知，则返回true；如果错误队列为空，则返回false
+  * @exception: 如果错误队列中为其它错误，或发生系统调用错误，则抛出CSyscallException异常
+  */
+bool recv_zerocopy_completion(int fd, uint32_t* lo, uint32_t* hi) throw (sys::CSyscallException);
+
+/***
+  * 一个连接上的MSG_ZEROCOPY状态：是否已打开SO_ZEROCOPY，已发送和已完成的编号，
+  * 连接断开后须调用reset，新连接的编号从0开始
+  */
+class CZeroCopyState
+{
+public:
+    CZeroCopyState();
+
+    /** 恢复到未打开SO_ZEROCOPY、无发送的状态 */
+    void reset();
+
+    /***
+      * 判断是否应以MSG_ZEROCOPY方式发送，第一次需要时才为fd打开SO_ZEROCOPY
+      * @zerocopy_threshold: 数据不小于该字节数时才以MSG_ZEROCOPY发送，为0表示不使用
+      * @exception: 打开SO_ZEROCOPY出错时，抛出CSyscallException异常
+      */
+    bool need_zerocopy(int fd, size_t buffer_size, uint32_t zerocopy_threshold) throw (sys::CSyscallException);
+
+    /** 一次MSG_ZEROCOPY发送调用成功后调用 */
+    void on_zerocopy_sent() { ++_next_id; }
+
+    /***
+      * 取完fd错误队列中的完成通知，更新已完成的编号
+      * @exception: 同recv_zerocopy_completion
+      */
+    void handle_completion(int fd) throw (sys::CSyscallException);
+
+    /** 是否已打开SO_ZEROCOPY，为true时EPOLLERR可能是完成通知 */
+    bool is_enabled() const { return 1 == _state; }
+
+    /** 是否有未完成的MSG_ZEROCOPY发送调用 */
+    bool has_pending() const { return _done_id != _next_id; }
+
+    /** 得到下一个MSG_ZEROCOPY发送调用的编号，小于它的编号都完成后，已发送的Buffer才可释放 */
+    uint32_t get_next_id() const { return _next_id; }
+
+    /** 判断小于id的编号是否都已完成 */
+    bool is_done(uint32_t id) const { return (int32_t)(_done_id - id) >= 0; }
+
+private:
+    int8_t _state;     // 0表示未打开SO_ZEROCOPY，1表示已打开，-1表示不支持
+    uint32_t _next_id; // 下一个MSG_ZEROCOPY发送调用的编号
+    uint32_t _done_id; // 小于它的编号都已完成
+};
+
 /***
   * 得到已经发送的文件总字节数
   */
@@ -96,6 +96,11 @@ public:
       */
     void wakeup();
 
+    /***
+      * 得到Epoll句柄，可用于将Epoll嵌入到其它事件机制中，如io_uring
+      */
+    int get_fd() const { return _epfd; }
+
 private:
     int _epfd;
     CSensor _sensor;
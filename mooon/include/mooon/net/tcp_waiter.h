@@ -78,6 +78,15 @@ public:
       */
     ssize_t send(const char* buffer, size_t buffer_size);
 
+    /***
+      * 以MSG_ZEROCOPY方式发送数据，须先对套接字调用enable_zerocopy，
+      * 如果zerocopy返回true，则在从错误队列收到完成通知前，Buffer不能被释放或修改
+      * @zerocopy: 输出参数，是否真的以MSG_ZEROCOPY发送了
+      * @return: 同send
+      * @exception: 同send
+      */
+    ssize_t send_zerocopy(const char* buffer, size_t buffer_size, bool& zerocopy);
+
     /***
       * 以超时方式接收数据，如果在指定的时间内未接收完，则返回
       * @timeout_milliseconds: 超时毫秒数
@@ -31,6 +31,24 @@ NET_NAMESPACE_BEGIN
 // UDP首部8字节，所以UDP数据大小为1472，当UDP发送大小1472的数据时，链路层需要分片（Fragment），这样IP层需要重组数据，可能会重组失败导致数据丢失
 //
 // 标准的MTU大小为576（Windows默认为1500），减去IP首部和UDP首部后为548，因此UDP发送的数据大小不超过548是最安全的。
+
+/***
+  * 一次批量收发的最大数据报个数，超出的部分需要再次调用
+  */
+enum { UDP_BATCH_MAX = 64 };
+
+/***
+  * 批量收发的数据报
+  */
+typedef struct TUdpPacket
+{
+    void* buffer;            /** 接收时为接收缓冲区，发送时为待发送的数据 */
+    size_t buffer_size;      /** 接收时为缓冲区大小，发送时为数据字节数 */
+    size_t bytes;            /** 输出参数，实际收到或发送出去的字节数 */
+    struct sockaddr_in addr; /** 接收时为来源地址，发送时为目标地址 */
+    uint16_t segment_size;   /** 仅接收有效，启用GRO后，不为0表示buffer中是多个合并的数据报，除最后一个外每个都是segment_size字节 */
+}udp_packet_t;
+
 class CUdpSocket: public CEpollable
 {
 public:
@@ -52,6 +70,47 @@ public:
 
     int timed_receive_from(void* buffer, size_t buffer_size, uint32_t* from_ip, uint16_t* from_port, uint32_t milliseconds) throw (sys::CSyscallException);
     int timed_receive_from(void* buffer, size_t buffer_size, struct sockaddr_in* from_addr, uint32_t milliseconds) throw (sys::CSyscallException);
+
+public:
+    /***
+      * 批量接收（recvmmsg），一次系统调用接收多个数据报，与是否为非阻塞模式无关
+      * @packets: 数据报数组，需设置好buffer和buffer_size，收到的字节数、来源地址等存放在bytes、addr和segment_size中
+      * @packet_number: 数据报个数，最多处理UDP_BATCH_MAX个
+      * @milliseconds: 没有数据报时最长等待的毫秒数，为0表示不等待
+      * @return: 返回收到的数据报个数，为0表示没有数据报（或等待超时）
+      * @exception: 出错抛出CSyscallException异常
+      */
+    int receive_batch(udp_packet_t* packets, int packet_number, uint32_t milliseconds=0) throw (sys::CSyscallException);
+
+    /***
+      * 批量发送（sendmmsg），一次系统调用发送多个数据报，各数据报可发往不同的目标
+      * @packets: 数据报数组，需设置好buffer、buffer_size和addr，bytes返回发送出去的字节数
+      * @packet_number: 数据报个数，最多处理UDP_BATCH_MAX个
+      * @milliseconds: 发送缓冲区满时最长等待的毫秒数，为0表示不等待
+      * @return: 返回发送出去的数据报个数，总是从数组头部开始连续的
+      * @exception: 出错抛出CSyscallException异常
+      */
+    int send_batch(udp_packet_t* packets, int packet_number, uint32_t milliseconds=0) throw (sys::CSyscallException);
+
+    /***
+      * 将buffer按segment_size字节切成多个数据报，发往同一个目标，
+      * 系统支持GSO（UDP_SEGMENT，4.18及以上内核）时只需一次系统调用，并由内核或网卡完成切分，
+      * 否则退回以send_batch方式发送
+      * @buffer_size: 最大64KB，并且最多切成64个数据报
+      * @segment_size: 不能为0，否则抛出EINVAL异常
+      * @return: 返回发送出去的字节数，如果返回-1表示为非阻塞模式发送缓冲区已满
+      * @exception: 出错抛出CSyscallException异常
+      */
+    int send_segments(const void* buffer, size_t buffer_size, uint16_t segment_size, const struct sockaddr_in& to_addr) throw (sys::CSyscallException);
+
+    /***
+      * 启用GRO（UDP_GRO，5.0及以上内核），内核可将来自同一个对端的连续数据报合并后交给receive_batch，
+      * 合并后的数据报通过udp_packet_t的segment_size来拆分，
+      * 启用后receive_batch的缓冲区应当足够大（建议64KB），否则合并后的数据报会被截断
+      * @return: 不支持时返回false
+      * 不会抛出任何异常
+      */
+    bool enable_gro();
 };
 
 NET_NAMESPACE_END
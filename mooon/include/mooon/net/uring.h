@@ -0,0 +1,153 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Author: jian yi, eyjian@qq.com
+ */
+#ifndef MOOON_NET_URING_H
+#define MOOON_NET_URING_H
+#include "mooon/net/config.h"
+#include "mooon/sys/syscall_exception.h"
+#if MOOON_HAVE_IO_URING==1
+#include <linux/io_uring.h>
+NET_NAMESPACE_BEGIN
+
+/***
+  * io_uring操作封装类，直接基于系统调用，不依赖liburing
+  * 需要6.0及以上版本内核（multishot accept/recv和provided buffer ring）
+  *
+  * 使用方式：每轮循环通过prep_xxx准备若干请求，
+  * 然后调用submit_and_wait一次性提交并等待完成事件，
+  * 再通过peek_cqe和cqe_seen逐个处理完成事件
+  */
+class CUring
+{
+public:
+    CUring();
+    ~CUring();
+
+    /***
+      * 创建io_uring，并检查内核是否支持所需特性
+      * @entries: 提交队列大小
+      * @exception: 如果出错或内核不支持，抛出CSyscallException异常
+      */
+    void create(uint32_t entries);
+
+    /***
+      * 销毁已经创建的io_uring
+      * 不会抛出任何异常
+      */
+    void destroy();
+
+    /** 得到io_uring的句柄 */
+    int get_fd() const { return _ring_fd; }
+
+    /***
+      * 注册provided buffer ring，供multishot recv使用
+      * @group: 缓冲区组ID
+      * @buffer_count: 缓冲区个数，必须为2的幂
+      * @buffer_size: 每个缓冲区的字节数
+      * @exception: 如果出错，抛出CSyscallException异常
+      */
+    void register_buffer_ring(uint16_t group, uint16_t buffer_count, uint32_t buffer_size);
+
+    /** 根据完成事件中的缓冲区ID得到缓冲区地址 */
+    char* get_buffer(uint16_t buffer_id) const { return _buffer_base + (size_t)buffer_id * _buffer_size; }
+
+    /** 将用完的缓冲区归还给内核 */
+    void recycle_buffer(uint16_t buffer_id);
+
+public:
+    /** 准备multishot accept */
+    void prep_accept_multishot(int fd, uint64_t user_data);
+
+    /** 准备multishot recv，数据存放在register_buffer_ring注册的缓冲区中 */
+    void prep_recv_multishot(int fd, uint64_t user_data);
+
+    /** 准备send */
+    void prep_send(int fd, const void* buffer, size_t buffer_size, uint64_t user_data);
+
+    /** 准备一次性的poll */
+    void prep_poll_add(int fd, uint32_t poll_events, uint64_t user_data);
+
+    /***
+      * 准备取消fd上的所有请求，需在关闭fd之前提交，
+      * 因为未完成的请求持有对fd的引用，仅关闭fd并不能终止它们
+      */
+    void prep_cancel_fd(int fd, uint64_t user_data);
+
+    /** 准备取消user_data为target_user_data的请求，如multishot recv */
+    void prep_cancel(uint64_t target_user_data, uint64_t user_data);
+
+    /***
+      * 提交所有已准备的请求，并等待完成事件
+      * @wait_nr: 最少等待的完成事件个数，为0时只提交不等待
+      * @milliseconds: 最长等待的毫秒数
+      * @return: 返回本次提交的请求个数
+      * @exception: 如果出错，抛出CSyscallException异常
+      */
+    int submit_and_wait(uint32_t wait_nr, uint32_t milliseconds);
+
+    /** 只提交不等待 */
+    int submit() { return submit_and_wait(0, 0); }
+
+    /***
+      * 取一个完成事件，但不从完成队列中移除
+      * @return: 如果有完成事件，则返回指向它的指针，否则返回NULL
+      */
+    struct io_uring_cqe* peek_cqe();
+
+    /** 将peek_cqe取到的完成事件从完成队列中移除 */
+    void cqe_seen();
+
+private:
+    struct io_uring_sqe* get_sqe();
+    void probe_features();
+
+    // ring的tail和第一个io_uring_buf的resv字段重叠
+    uint16_t* get_buffer_ring_tail() const { return &((struct io_uring_buf*)_buffer_ring)->resv; }
+
+private:
+    int _ring_fd;
+    uint32_t _sq_entries;
+    uint32_t _sqe_tail;     // 已准备的请求尾部
+    void* _sq_ring;
+    size_t _sq_ring_size;
+    void* _cq_ring;
+    size_t _cq_ring_size;
+    struct io_uring_sqe* _sqes;
+    size_t _sqes_size;
+
+    unsigned* _sq_head;
+    unsigned* _sq_tail;
+    unsigned* _sq_mask;
+    unsigned* _sq_array;
+    unsigned* _cq_head;
+    unsigned* _cq_tail;
+    unsigned* _cq_mask;
+    struct io_uring_cqe* _cqes;
+
+private: // provided buffer ring
+    uint16_t _buffer_group;
+    uint16_t _buffer_count;
+    uint32_t _buffer_size;
+    char* _buffer_base;
+    struct io_uring_buf_ring* _buffer_ring;
+    size_t _buffer_ring_size;
+};
+
+NET_NAMESPACE_END
+#endif // MOOON_HAVE_IO_URING
+#endif // MOOON_NET_URING_H
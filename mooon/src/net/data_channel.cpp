@@ -20,6 +20,7 @@
 #include <mooon/sys/atomic.h>
 #include <mooon/sys/utils.h>
 #include <mooon/net/utils.h>
+#include <fcntl.h>
 #include <sys/types.h>
 #include <sys/socket.h>
 #include <sys/sendfile.h>
@@ -115,6 +116,42 @@ ssize_t CDataChannel::send(const char* buffer, size_t buffer_size)
     return retval;
 }
 
+ssize_t CDataChannel::send_zerocopy(const char* buffer, size_t buffer_size, bool& zerocopy)
+{
+#ifdef MSG_ZEROCOPY
+    ssize_t retval;
+
+    if (0 == buffer_size)
+    {
+        THROW_SYSCALL_EXCEPTION(NULL, EINVAL, NULL);
+    }
+    for (;;)
+    {
+        retval = ::send(_fd, buffer, buffer_size, MSG_ZEROCOPY);
+
+        if (retval != -1) break;
+        if (EWOULDBLOCK == errno) break;
+        if (EINTR == errno) continue;
+        if (ENOBUFS == errno)
+        {
+            // 超出optmem_max限制，退化为普通发送
+            zerocopy = false;
+            return send(buffer, buffer_size);
+        }
+
+        THROW_SYSCALL_EXCEPTION(NULL, errno, "send");
+    }
+
+    // 返回-1时没有发送，不会产生完成通知
+    zerocopy = (retval != -1);
+    atomic_add(retval, &gs_send_buffer_bytes);
+    return retval;
+#else
+    zerocopy = false;
+    return send(buffer, buffer_size);
+#endif // MSG_ZEROCOPY
+}
+
 ssize_t CDataChannel::timed_receive(char* buffer, size_t buffer_size, uint32_t milliseconds)
 {
     size_t buffer_offset = 0;
@@ -225,6 +262,28 @@ ssize_t CDataChannel::send_file(int file_fd, off_t *offset, size_t count)
     return retval;
 }
 
+ssize_t CDataChannel::send_splice(int pipe_fd, size_t count)
+{
+    ssize_t retval;
+
+    for (;;)
+    {
+        retval = splice(pipe_fd, NULL, _fd, NULL, count, SPLICE_F_MOVE|SPLICE_F_NONBLOCK|SPLICE_F_MORE);
+        if (retval != -1) break;
+        if (EWOULDBLOCK == errno) break;
+        if (EINTR == errno) continue;
+
+        THROW_SYSCALL_EXCEPTION(NULL, errno, "splice");
+    }
+
+    if (retval > 0)
+    {
+        atomic_add(retval, &gs_send_file_bytes);
+    }
+
+    return retval;
+}
+
 void CDataChannel::full_send_file(int file_fd, off_t *offset, size_t& count)
 {    
     size_t remaining_size = count;
@@ -50,6 +50,15 @@ public:
       */
     ssize_t send(const char* buffer, size_t buffer_size);
 
+    /** 以MSG_ZEROCOPY方式发送SOCKET数据，套接字须已调用enable_zerocopy
+      * @zerocopy: 输出参数，是否真的以MSG_ZEROCOPY发送了，
+      *            为true时，在收到完成通知前Buffer不能被释放或修改；
+      *            内核无法为零拷贝分配资源（ENOBUFS）时，退化为普通发送，值为false
+      * @return: 同send
+      * @exception: 同send
+      */
+    ssize_t send_zerocopy(const char* buffer, size_t buffer_size, bool& zerocopy);
+
     /***
       * 以超时方式接收数据，如果在指定的时间内未接收完，则返回
       * @milliseconds: 超时毫秒数
@@ -91,6 +100,15 @@ public:
     ssize_t send_file(int file_fd, off_t *offset, size_t count);
     void full_send_file(int file_fd, off_t *offset, size_t& count);
 
+    /** 以splice方式将管道中的数据发送出去，数据不经过用户空间
+      * @pipe_fd: 管道的读端
+      * @count: 需要发送的大小
+      * @return: 返回实际发送的字节数，如果管道中已无数据且写端已关闭则返回0，
+      *          如果连接不可写或管道暂无数据，则返回-1
+      * @exception: 如果出错，抛出CSyscallException异常
+      */
+    ssize_t send_splice(int pipe_fd, size_t count);
+
     /** 采用内存映射的方式接收，并将数据存放文件，适合文件不是太大
       * @file_fd: 打开的文件句柄
       * @size: 需要写入文件的大小，返回实际已经接收到的字节数(不管成功还是失败或异常)
@@ -17,6 +17,7 @@
  * Author: eyjian@qq.com or eyjian@gmail.com
  */
 #include <signal.h>
+#include <linux/errqueue.h>
 #include "net/utils.h"
 #include "net/epollable.h"
 NET_NAMESPACE_BEGIN
@@ -137,6 +138,107 @@ void close_fd(int fd) throw ()
     (void)::close(fd);
 }
 
+bool enable_zerocopy(int fd) throw (sys::CSyscallException)
+{
+#if defined(SO_ZEROCOPY) && defined(SO_EE_ORIGIN_ZEROCOPY)
+    int on = 1;
+    if (0 == setsockopt(fd, SOL_SOCKET, SO_ZEROCOPY, &on, sizeof(on)))
+        return true;
+
+    // 内核不支持（4.14以下）
+    if ((ENOPROTOOPT == errno) || (EOPNOTSUPP == errno))
+        return false;
+
+    THROW_SYSCALL_EXCEPTION(NULL, errno, "setsockopt");
+#else
+    return false;
+#endif // SO_ZEROCOPY
+}
+
+bool recv_zerocopy_completion(int fd, uint32_t* lo, uint32_t* hi) throw (sys::CSyscallException)
+{
+#if defined(SO_ZEROCOPY) && defined(SO_EE_ORIGIN_ZEROCOPY)
+    char control[128];
+    struct msghdr msg;
+
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+
+    for (;;)
+    {
+        if (recvmsg(fd, &msg, MSG_ERRQUEUE|MSG_DONTWAIT) != -1) break;
+        if (EINTR == errno) continue;
+        if (EAGAIN == errno) return false;
+
+        THROW_SYSCALL_EXCEPTION(NULL, errno, "recvmsg");
+    }
+
+    struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+    if ((NULL == cmsg)
+     || !(((SOL_IP == cmsg->cmsg_level) && (IP_RECVERR == cmsg->cmsg_type))
+       || ((SOL_IPV6 == cmsg->cmsg_level) && (IPV6_RECVERR == cmsg->cmsg_type))))
+    {
+        THROW_SYSCALL_EXCEPTION(NULL, EPROTO, "recvmsg");
+    }
+
+    struct sock_extended_err* serr = (struct sock_extended_err*)CMSG_DATA(cmsg);
+    if ((serr->ee_errno != 0) || (serr->ee_origin != SO_EE_ORIGIN_ZEROCOPY))
+    {
+        THROW_SYSCALL_EXCEPTION(NULL, (0 == serr->ee_errno)? EPROTO: serr->ee_errno, "recvmsg");
+    }
+
+    // ee_code为SO_EE_CODE_ZEROCOPY_COPIED时，表示内核实际做了复制，但对调用者无区别
+    *lo = serr->ee_info;
+    *hi = serr->ee_data;
+    return true;
+#else
+    THROW_SYSCALL_EXCEPTION(NULL, ENOTSUP, "recvmsg");
+#endif // SO_ZEROCOPY
+}
+
+//////////////////////////////////////////////////////////////////////////
+// CZeroCopyState
+
+CZeroCopyState::CZeroCopyState()
+    :_state(0)
+    ,_next_id(0)
+    ,_done_id(0)
+{
+}
+
+void CZeroCopyState::reset()
+{
+    _state = 0;
+    _next_id = 0;
+    _done_id = 0;
+}
+
+bool CZeroCopyState::need_zerocopy(int fd, size_t buffer_size, uint32_t zerocopy_threshold) throw (sys::CSyscallException)
+{
+    if ((0 == zerocopy_threshold) || (buffer_size < zerocopy_threshold) || (_state < 0))
+        return false;
+
+    // 第一次使用时才打开SO_ZEROCOPY
+    if (0 == _state)
+        _state = enable_zerocopy(fd)? 1: -1;
+
+    return 1 == _state;
+}
+
+void CZeroCopyState::handle_completion(int fd) throw (sys::CSyscallException)
+{
+    uint32_t lo;
+    uint32_t hi;
+
+    while (recv_zerocopy_completion(fd, &lo, &hi))
+    {
+        // 编号会回绕，以差值比较
+        if ((int32_t)(hi + 1 - _done_id) > 0)
+            _done_id = hi + 1;
+    }
+}
+
 //////////////////////////////////////////////////////////////////////////
 // CEpollable
 
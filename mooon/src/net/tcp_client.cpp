@@ -284,6 +284,11 @@ ssize_t CTcpClient::send(const char* buffer, size_t buffer_size)
 	return ((CDataChannel *)_data_channel)->send(buffer, buffer_size); 
 }
 
+ssize_t CTcpClient::send_zerocopy(const char* buffer, size_t buffer_size, bool& zerocopy)
+{
+    return ((CDataChannel *)_data_channel)->send_zerocopy(buffer, buffer_size, zerocopy);
+}
+
 ssize_t CTcpClient::timed_receive(char* buffer, size_t buffer_size, uint32_t milliseconds)
 {
     return ((CDataChannel *)_data_channel)->timed_receive(buffer, buffer_size, milliseconds); 
@@ -314,6 +319,11 @@ void CTcpClient::full_send_file(int file_fd, off_t *offset, size_t& count)
     ((CDataChannel *)_data_channel)->full_send_file(file_fd, offset, count); 
 }
 
+ssize_t CTcpClient::send_splice(int pipe_fd, size_t count)
+{
+    return ((CDataChannel *)_data_channel)->send_splice(pipe_fd, count);
+}
+
 bool CTcpClient::full_map_tofile(int file_fd, size_t& size, size_t offset)
 {
     return ((CDataChannel *)_data_channel)->full_map_tofile(file_fd, size, offset); 
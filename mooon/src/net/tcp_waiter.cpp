@@ -79,6 +79,11 @@ ssize_t CTcpWaiter::send(const char* buffer, size_t buffer_size)
 	return ((CDataChannel *)_data_channel)->send(buffer, buffer_size); 
 }
 
+ssize_t CTcpWaiter::send_zerocopy(const char* buffer, size_t buffer_size, bool& zerocopy)
+{
+    return ((CDataChannel *)_data_channel)->send_zerocopy(buffer, buffer_size, zerocopy);
+}
+
 ssize_t CTcpWaiter::timed_receive(char* buffer, size_t buffer_size, uint32_t milliseconds)
 {
     return ((CDataChannel *)_data_channel)->timed_receive(buffer, buffer_size, milliseconds); 
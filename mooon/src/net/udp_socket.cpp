@@ -18,6 +18,8 @@
  */
 #include "mooon/net/udp_socket.h"
 #include "mooon/net/utils.h"
+#include "mooon/sys/datetime_utils.h"
+#include <netinet/udp.h>
 #include <unistd.h>
 NET_NAMESPACE_BEGIN
 
@@ -144,4 +146,185 @@ int CUdpSocket::timed_receive_from(void* buffer, size_t buffer_size, struct sock
     return receive_from(buffer, buffer_size, from_addr);
 }
 
+int CUdpSocket::receive_batch(udp_packet_t* packets, int packet_number, uint32_t milliseconds) throw (sys::CSyscallException)
+{
+    int number = std::min<int>(packet_number, UDP_BATCH_MAX);
+    struct mmsghdr msgs[UDP_BATCH_MAX];
+    struct iovec iovs[UDP_BATCH_MAX];
+#if defined(UDP_GRO)
+    char controls[UDP_BATCH_MAX][CMSG_SPACE(sizeof(int))];
+#endif // UDP_GRO
+
+    memset(msgs, 0, sizeof(struct mmsghdr) * number);
+    for (int i=0; i<number; ++i)
+    {
+        iovs[i].iov_base = packets[i].buffer;
+        iovs[i].iov_len = packets[i].buffer_size;
+        msgs[i].msg_hdr.msg_iov = &iovs[i];
+        msgs[i].msg_hdr.msg_iovlen = 1;
+        msgs[i].msg_hdr.msg_name = &packets[i].addr;
+        msgs[i].msg_hdr.msg_namelen = sizeof(struct sockaddr_in);
+#if defined(UDP_GRO)
+        msgs[i].msg_hdr.msg_control = controls[i];
+        msgs[i].msg_hdr.msg_controllen = sizeof(controls[i]);
+#endif // UDP_GRO
+    }
+
+    // recvmmsg自带的timeout只在收到一个数据报后才检查，不能用于等待，所以先poll
+    int received = recvmmsg(get_fd(), msgs, number, MSG_DONTWAIT, NULL);
+    if ((-1 == received) && ((EAGAIN == errno) || (EWOULDBLOCK == errno)) && (milliseconds > 0))
+    {
+        if (!CUtils::timed_poll(get_fd(), POLLIN, milliseconds))
+            return 0;
+        received = recvmmsg(get_fd(), msgs, number, MSG_DONTWAIT, NULL);
+    }
+    if (-1 == received)
+    {
+        if ((EAGAIN == errno) || (EWOULDBLOCK == errno))
+            return 0;
+        THROW_SYSCALL_EXCEPTION(NULL, errno, "recvmmsg");
+    }
+
+    for (int i=0; i<received; ++i)
+    {
+        packets[i].bytes = msgs[i].msg_len;
+        packets[i].segment_size = 0;
+#if defined(UDP_GRO)
+        for (struct cmsghdr* cmsg=CMSG_FIRSTHDR(&msgs[i].msg_hdr); cmsg!=NULL; cmsg=CMSG_NXTHDR(&msgs[i].msg_hdr, cmsg))
+        {
+            if ((SOL_UDP == cmsg->cmsg_level) && (UDP_GRO == cmsg->cmsg_type))
+            {
+                int segment_size;
+                memcpy(&segment_size, CMSG_DATA(cmsg), sizeof(segment_size));
+                packets[i].segment_size = static_cast<uint16_t>(segment_size);
+                break;
+            }
+        }
+#endif // UDP_GRO
+    }
+
+    return received;
+}
+
+int CUdpSocket::send_batch(udp_packet_t* packets, int packet_number, uint32_t milliseconds) throw (sys::CSyscallException)
+{
+    int number = std::min<int>(packet_number, UDP_BATCH_MAX);
+    struct mmsghdr msgs[UDP_BATCH_MAX];
+    struct iovec iovs[UDP_BATCH_MAX];
+
+    memset(msgs, 0, sizeof(struct mmsghdr) * number);
+    for (int i=0; i<number; ++i)
+    {
+        iovs[i].iov_base = packets[i].buffer;
+        iovs[i].iov_len = packets[i].buffer_size;
+        msgs[i].msg_hdr.msg_iov = &iovs[i];
+        msgs[i].msg_hdr.msg_iovlen = 1;
+        msgs[i].msg_hdr.msg_name = &packets[i].addr;
+        msgs[i].msg_hdr.msg_namelen = sizeof(struct sockaddr_in);
+    }
+
+    int sent = 0;
+    uint64_t deadline = (0 == milliseconds)? 0: sys::current_milliseconds() + milliseconds;
+    while (sent < number)
+    {
+        int n = sendmmsg(get_fd(), msgs + sent, number - sent, MSG_DONTWAIT);
+        if (n >= 0)
+        {
+            for (int i=sent; i<sent+n; ++i)
+                packets[i].bytes = msgs[i].msg_len;
+            sent += n;
+            if (0 == n)
+                break;
+            continue;
+        }
+        if ((errno != EAGAIN) && (errno != EWOULDBLOCK))
+        {
+            // 已发送出去的部分需要告诉调用者，错误留到下一次调用时再报告
+            if (sent > 0)
+                break;
+            THROW_SYSCALL_EXCEPTION(NULL, errno, "sendmmsg");
+        }
+
+        uint64_t now = (0 == deadline)? 0: sys::current_milliseconds();
+        if ((now >= deadline)
+         || !CUtils::timed_poll(get_fd(), POLLOUT, static_cast<int>(deadline - now)))
+            break;
+    }
+
+    return sent;
+}
+
+int CUdpSocket::send_segments(const void* buffer, size_t buffer_size, uint16_t segment_size, const struct sockaddr_in& to_addr) throw (sys::CSyscallException)
+{
+    // 为0时切分循环不会前进
+    if (0 == segment_size)
+    {
+        THROW_SYSCALL_EXCEPTION("segment_size is 0", EINVAL, "send_segments");
+    }
+
+#if defined(UDP_SEGMENT)
+    if (buffer_size > segment_size)
+    {
+        struct iovec iov;
+        struct msghdr msg;
+        char control[CMSG_SPACE(sizeof(uint16_t))];
+
+        iov.iov_base = const_cast<void*>(buffer);
+        iov.iov_len = buffer_size;
+        memset(&msg, 0, sizeof(msg));
+        memset(control, 0, sizeof(control));
+        msg.msg_name = const_cast<struct sockaddr_in*>(&to_addr);
+        msg.msg_namelen = sizeof(struct sockaddr_in);
+        msg.msg_iov = &iov;
+        msg.msg_iovlen = 1;
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof(control);
+
+        struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+        cmsg->cmsg_level = SOL_UDP;
+        cmsg->cmsg_type = UDP_SEGMENT;
+        cmsg->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+        memcpy(CMSG_DATA(cmsg), &segment_size, sizeof(segment_size));
+
+        int bytes = ::sendmsg(get_fd(), &msg, 0);
+        if (bytes != -1)
+            return bytes;
+        if ((EAGAIN == errno) || (EWOULDBLOCK == errno))
+            return -1;
+        // 内核或网卡不支持时（如老内核和不支持校验和卸载的网卡），退回普通发送
+        if ((errno != EINVAL) && (errno != EIO) && (errno != ENOPROTOOPT) && (errno != EOPNOTSUPP))
+            THROW_SYSCALL_EXCEPTION(NULL, errno, "sendmsg");
+    }
+#endif // UDP_SEGMENT
+
+    udp_packet_t packets[UDP_BATCH_MAX];
+    int packet_number = 0;
+    for (size_t offset=0; (offset<buffer_size) && (packet_number<UDP_BATCH_MAX); offset+=segment_size)
+    {
+        packets[packet_number].buffer = static_cast<char*>(const_cast<void*>(buffer)) + offset;
+        packets[packet_number].buffer_size = std::min<size_t>(segment_size, buffer_size - offset);
+        packets[packet_number].addr = to_addr;
+        ++packet_number;
+    }
+
+    int sent = send_batch(packets, packet_number);
+    if (0 == sent)
+        return -1;
+
+    int bytes = 0;
+    for (int i=0; i<sent; ++i)
+        bytes += static_cast<int>(packets[i].bytes);
+    return bytes;
+}
+
+bool CUdpSocket::enable_gro()
+{
+#if defined(UDP_GRO)
+    int on = 1;
+    return 0 == ::setsockopt(get_fd(), SOL_UDP, UDP_GRO, &on, sizeof(on));
+#else
+    return false;
+#endif // UDP_GRO
+}
+
 NET_NAMESPACE_END
@@ -0,0 +1,384 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Author: jian yi, eyjian@qq.com
+ */
+#include "net/uring.h"
+#if MOOON_HAVE_IO_URING==1
+#include <signal.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+NET_NAMESPACE_BEGIN
+
+static int io_uring_setup(uint32_t entries, struct io_uring_params* params)
+{
+    return (int)syscall(__NR_io_uring_setup, entries, params);
+}
+
+static int io_uring_enter(int fd, uint32_t to_submit, uint32_t min_complete, uint32_t flags, void* arg, size_t argsz)
+{
+    return (int)syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, arg, argsz);
+}
+
+static int io_uring_register(int fd, uint32_t opcode, void* arg, uint32_t nr_args)
+{
+    return (int)syscall(__NR_io_uring_register, fd, opcode, arg, nr_args);
+}
+
+CUring::CUring()
+    :_ring_fd(-1)
+    ,_sq_entries(0)
+    ,_sqe_tail(0)
+    ,_sq_ring(MAP_FAILED)
+    ,_sq_ring_size(0)
+    ,_cq_ring(MAP_FAILED)
+    ,_cq_ring_size(0)
+    ,_sqes((struct io_uring_sqe*)MAP_FAILED)
+    ,_sqes_size(0)
+    ,_sq_head(NULL)
+    ,_sq_tail(NULL)
+    ,_sq_mask(NULL)
+    ,_sq_array(NULL)
+    ,_cq_head(NULL)
+    ,_cq_tail(NULL)
+    ,_cq_mask(NULL)
+    ,_cqes(NULL)
+    ,_buffer_group(0)
+    ,_buffer_count(0)
+    ,_buffer_size(0)
+    ,_buffer_base(NULL)
+    ,_buffer_ring((struct io_uring_buf_ring*)MAP_FAILED)
+    ,_buffer_ring_size(0)
+{
+}
+
+CUring::~CUring()
+{
+    destroy();
+}
+
+void CUring::create(uint32_t entries)
+{
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    params.flags = IORING_SETUP_CLAMP;
+
+    _ring_fd = io_uring_setup(entries, &params);
+    if (-1 == _ring_fd)
+        THROW_SYSCALL_EXCEPTION(NULL, errno, "io_uring_setup");
+
+    try
+    {
+        // 超时等待依赖IORING_ENTER_EXT_ARG（5.11）
+        if (0 == (params.features & IORING_FEAT_EXT_ARG))
+            THROW_SYSCALL_EXCEPTION(NULL, ENOTSUP, "io_uring_setup");
+
+        _sq_entries = params.sq_entries;
+        _sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+        _cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+        if (params.features & IORING_FEAT_SINGLE_MMAP)
+        {
+            if (_cq_ring_size > _sq_ring_size)
+                _sq_ring_size = _cq_ring_size;
+            _cq_ring_size = _sq_ring_size;
+        }
+
+        _sq_ring = mmap(NULL, _sq_ring_size, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_POPULATE, _ring_fd, IORING_OFF_SQ_RING);
+        if (MAP_FAILED == _sq_ring)
+            THROW_SYSCALL_EXCEPTION(NULL, errno, "mmap");
+
+        if (params.features & IORING_FEAT_SINGLE_MMAP)
+        {
+            _cq_ring = _sq_ring;
+        }
+        else
+        {
+            _cq_ring = mmap(NULL, _cq_ring_size, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_POPULATE, _ring_fd, IORING_OFF_CQ_RING);
+            if (MAP_FAILED == _cq_ring)
+                THROW_SYSCALL_EXCEPTION(NULL, errno, "mmap");
+        }
+
+        _sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+        _sqes = (struct io_uring_sqe*)mmap(NULL, _sqes_size, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_POPULATE, _ring_fd, IORING_OFF_SQES);
+        if (MAP_FAILED == (void*)_sqes)
+            THROW_SYSCALL_EXCEPTION(NULL, errno, "mmap");
+
+        char* sq_ring = (char*)_sq_ring;
+        _sq_head  = (unsigned*)(sq_ring + params.sq_off.head);
+        _sq_tail  = (unsigned*)(sq_ring + params.sq_off.tail);
+        _sq_mask  = (unsigned*)(sq_ring + params.sq_off.ring_mask);
+        _sq_array = (unsigned*)(sq_ring + params.sq_off.array);
+
+        char* cq_ring = (char*)_cq_ring;
+        _cq_head = (unsigned*)(cq_ring + params.cq_off.head);
+        _cq_tail = (unsigned*)(cq_ring + params.cq_off.tail);
+        _cq_mask = (unsigned*)(cq_ring + params.cq_off.ring_mask);
+        _cqes    = (struct io_uring_cqe*)(cq_ring + params.cq_off.cqes);
+
+        _sqe_tail = *_sq_tail;
+        probe_features();
+    }
+    catch (sys::CSyscallException&)
+    {
+        destroy();
+        throw;
+    }
+}
+
+void CUring::destroy()
+{
+    if (_buffer_ring != MAP_FAILED)
+    {
+        munmap(_buffer_ring, _buffer_ring_size);
+        _buffer_ring = (struct io_uring_buf_ring*)MAP_FAILED;
+    }
+    if (_buffer_base != NULL)
+    {
+        delete []_buffer_base;
+        _buffer_base = NULL;
+    }
+    if (_sqes != MAP_FAILED)
+    {
+        munmap(_sqes, _sqes_size);
+        _sqes = (struct io_uring_sqe*)MAP_FAILED;
+    }
+    if ((_cq_ring != MAP_FAILED) && (_cq_ring != _sq_ring))
+    {
+        munmap(_cq_ring, _cq_ring_size);
+    }
+    _cq_ring = MAP_FAILED;
+    if (_sq_ring != MAP_FAILED)
+    {
+        munmap(_sq_ring, _sq_ring_size);
+        _sq_ring = MAP_FAILED;
+    }
+    if (_ring_fd != -1)
+    {
+        ::close(_ring_fd);
+        _ring_fd = -1;
+    }
+}
+
+void CUring::probe_features()
+{
+    // IORING_OP_SEND_ZC和multishot recv同在6.0引入，以此判断内核版本是否满足
+    size_t probe_size = sizeof(struct io_uring_probe) + IORING_OP_LAST * sizeof(struct io_uring_probe_op);
+    char* probe_buffer = new char[probe_size];
+    struct io_uring_probe* probe = (struct io_uring_probe*)probe_buffer;
+    memset(probe_buffer, 0, probe_size);
+
+    int retval = io_uring_register(_ring_fd, IORING_REGISTER_PROBE, probe, IORING_OP_LAST);
+    int errcode = errno;
+    bool supported = (0 == retval)
+                  && (probe->last_op >= IORING_OP_SEND_ZC)
+                  && (probe->ops[IORING_OP_SEND_ZC].flags & IO_URING_OP_SUPPORTED);
+    delete []probe_buffer;
+
+    if (-1 == retval)
+        THROW_SYSCALL_EXCEPTION(NULL, errcode, "io_uring_register");
+    if (!supported)
+        THROW_SYSCALL_EXCEPTION(NULL, ENOTSUP, "io_uring_register");
+}
+
+void CUring::register_buffer_ring(uint16_t group, uint16_t buffer_count, uint32_t buffer_size)
+{
+    if ((0 == buffer_count) || (buffer_count & (buffer_count-1)))
+        THROW_SYSCALL_EXCEPTION(NULL, EINVAL, "io_uring_register");
+
+    _buffer_ring_size = buffer_count * sizeof(struct io_uring_buf);
+    _buffer_ring = (struct io_uring_buf_ring*)mmap(NULL, _buffer_ring_size, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+    if (MAP_FAILED == (void*)_buffer_ring)
+        THROW_SYSCALL_EXCEPTION(NULL, errno, "mmap");
+
+    struct io_uring_buf_reg reg;
+    memset(&reg, 0, sizeof(reg));
+    reg.ring_addr = (uint64_t)(uintptr_t)_buffer_ring;
+    reg.ring_entries = buffer_count;
+    reg.bgid = group;
+    if (-1 == io_uring_register(_ring_fd, IORING_REGISTER_PBUF_RING, &reg, 1))
+    {
+        int errcode = errno;
+        munmap(_buffer_ring, _buffer_ring_size);
+        _buffer_ring = (struct io_uring_buf_ring*)MAP_FAILED;
+        THROW_SYSCALL_EXCEPTION(NULL, errcode, "io_uring_register");
+    }
+
+    _buffer_group = group;
+    _buffer_count = buffer_count;
+    _buffer_size = buffer_size;
+    _buffer_base = new char[(size_t)buffer_count * buffer_size];
+    *get_buffer_ring_tail() = 0;
+    for (uint16_t i=0; i<buffer_count; ++i)
+    {
+        recycle_buffer(i);
+    }
+}
+
+void CUring::recycle_buffer(uint16_t buffer_id)
+{
+    // C++下__DECLARE_FLEX_ARRAY会使bufs偏移8字节，故不直接使用bufs成员
+    uint16_t* tail_ptr = get_buffer_ring_tail();
+    uint16_t tail = *tail_ptr;
+    struct io_uring_buf* buf = (struct io_uring_buf*)_buffer_ring + (tail & (_buffer_count-1));
+
+    buf->addr = (uint64_t)(uintptr_t)get_buffer(buffer_id);
+    buf->len = _buffer_size;
+    buf->bid = buffer_id;
+    __atomic_store_n(tail_ptr, (uint16_t)(tail+1), __ATOMIC_RELEASE);
+}
+
+struct io_uring_sqe* CUring::get_sqe()
+{
+    for (;;)
+    {
+        uint32_t head = __atomic_load_n(_sq_head, __ATOMIC_ACQUIRE);
+        if (_sqe_tail - head < _sq_entries)
+            break;
+
+        // 提交队列满，先提交已准备好的
+        submit();
+    }
+
+    uint32_t index = _sqe_tail & *_sq_mask;
+    struct io_uring_sqe* sqe = &_sqes[index];
+
+    _sq_array[index] = index;
+    ++_sqe_tail;
+    memset(sqe, 0, sizeof(struct io_uring_sqe));
+    return sqe;
+}
+
+void CUring::prep_accept_multishot(int fd, uint64_t user_data)
+{
+    struct io_uring_sqe* sqe = get_sqe();
+
+    sqe->opcode = IORING_OP_ACCEPT;
+    sqe->fd = fd;
+    sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+    sqe->accept_flags = SOCK_NONBLOCK|SOCK_CLOEXEC;
+    sqe->user_data = user_data;
+}
+
+void CUring::prep_recv_multishot(int fd, uint64_t user_data)
+{
+    struct io_uring_sqe* sqe = get_sqe();
+
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = fd;
+    sqe->ioprio = IORING_RECV_MULTISHOT;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = _buffer_group;
+    sqe->user_data = user_data;
+}
+
+void CUring::prep_send(int fd, const void* buffer, size_t buffer_size, uint64_t user_data)
+{
+    struct io_uring_sqe* sqe = get_sqe();
+
+    sqe->opcode = IORING_OP_SEND;
+    sqe->fd = fd;
+    sqe->addr = (uint64_t)(uintptr_t)buffer;
+    sqe->len = (uint32_t)buffer_size;
+    sqe->msg_flags = MSG_NOSIGNAL;
+    sqe->user_data = user_data;
+}
+
+void CUring::prep_poll_add(int fd, uint32_t poll_events, uint64_t user_data)
+{
+    struct io_uring_sqe* sqe = get_sqe();
+
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = fd;
+    sqe->poll32_events = poll_events;
+    sqe->user_data = user_data;
+}
+
+void CUring::prep_cancel_fd(int fd, uint64_t user_data)
+{
+    struct io_uring_sqe* sqe = get_sqe();
+
+    sqe->opcode = IORING_OP_ASYNC_CANCEL;
+    sqe->fd = fd;
+    sqe->cancel_flags = IORING_ASYNC_CANCEL_FD | IORING_ASYNC_CANCEL_ALL;
+    sqe->user_data = user_data;
+}
+
+void CUring::prep_cancel(uint64_t target_user_data, uint64_t user_data)
+{
+    struct io_uring_sqe* sqe = get_sqe();
+
+    sqe->opcode = IORING_OP_ASYNC_CANCEL;
+    sqe->fd = -1;
+    sqe->addr = target_user_data;
+    sqe->user_data = user_data;
+}
+
+int CUring::submit_and_wait(uint32_t wait_nr, uint32_t milliseconds)
+{
+    uint32_t to_submit;
+    uint32_t flags = 0;
+    struct __kernel_timespec ts;
+    struct io_uring_getevents_arg arg;
+
+    // 发布给内核，提交个数以内核已取走的位置（SQ头部）为准，
+    // 这样之前因EINTR或EBUSY未被取走的请求，这次会一起提交，不会滞留在队列中
+    __atomic_store_n(_sq_tail, _sqe_tail, __ATOMIC_RELEASE);
+    to_submit = _sqe_tail - __atomic_load_n(_sq_head, __ATOMIC_ACQUIRE);
+
+    memset(&arg, 0, sizeof(arg));
+    if (wait_nr > 0)
+    {
+        ts.tv_sec = milliseconds / 1000;
+        ts.tv_nsec = (milliseconds % 1000) * 1000000;
+        arg.sigmask_sz = _NSIG / 8;
+        arg.ts = (uint64_t)(uintptr_t)&ts;
+        flags = IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG;
+    }
+    else if (0 == to_submit)
+    {
+        return 0;
+    }
+
+    for (;;)
+    {
+        int retval = io_uring_enter(_ring_fd, to_submit, wait_nr, flags, (wait_nr > 0)? &arg: NULL, (wait_nr > 0)? sizeof(arg): 0);
+        if (retval > -1) return retval;
+        if (ETIME == errno) return 0;  // 超时，提交已完成
+        if (EINTR == errno) return 0;  // 被中断，由调用者再次进入，未提交的下次提交
+        if (EBUSY == errno) return 0;  // 完成队列溢出，先处理完成事件，未提交的下次提交
+
+        THROW_SYSCALL_EXCEPTION(NULL, errno, "io_uring_enter");
+    }
+}
+
+struct io_uring_cqe* CUring::peek_cqe()
+{
+    uint32_t head = *_cq_head;
+    uint32_t tail = __atomic_load_n(_cq_tail, __ATOMIC_ACQUIRE);
+
+    return (head == tail)? NULL: &_cqes[head & *_cq_mask];
+}
+
+void CUring::cqe_seen()
+{
+    __atomic_store_n(_cq_head, *_cq_head + 1, __ATOMIC_RELEASE);
+}
+
+NET_NAMESPACE_END
+#endif // MOOON_HAVE_IO_URING
@@ -0,0 +1,210 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Author: eyjian@qq.com or eyjian@gmail.com
+ */
+// 对比CRecvMachine和CBufferRecvMachine的接收性能
+// 用法：recv_machine_bench [每种消息大小的总兆字节数]
+// CRecvMachine使用1024字节的栈上缓冲区接收，处理器在on_header中分配消息体并拷贝拼接，与agent原先的做法相同；
+// CBufferRecvMachine直接接收到它的缓冲区，处理器直接使用消息体
+#include <sys/socket.h>
+#include "mooon/net/buffer_recv_machine.h"
+#include "mooon/net/inttypes.h"
+#include "mooon/net/recv_machine.h"
+#include "mooon/sys/datetime_utils.h"
+#include "mooon/sys/thread_engine.h"
+using namespace mooon;
+
+class CProcessorBase
+{
+public:
+    CProcessorBase()
+     :_messages(0), _bytes(0), _checksum(0)
+    {
+    }
+
+    uint64_t get_messages() const { return _messages; }
+    uint64_t get_bytes() const { return _bytes; }
+
+protected:
+    void consume(const char* body, size_t body_size)
+    {
+        ++_messages;
+        _bytes += sizeof(net::TCommonMessageHeader) + body_size;
+        if (body_size > 0)
+            _checksum += body[0] + body[body_size-1];
+    }
+
+private:
+    uint64_t _messages;
+    uint64_t _bytes;
+    uint64_t _checksum;
+};
+
+// 拷贝拼接消息体
+class CCopyProcessor: public CProcessorBase
+{
+public:
+    CCopyProcessor()
+     :_body(NULL)
+    {
+    }
+
+    bool on_header(const net::TCommonMessageHeader& header)
+    {
+        _body = new char[header.size];
+        return true;
+    }
+
+    bool on_message(const net::TCommonMessageHeader& header, size_t finished_size, const char* buffer, size_t buffer_size)
+    {
+        memcpy(_body + finished_size, buffer, buffer_size);
+        if (finished_size + buffer_size == header.size)
+        {
+            consume(_body, header.size);
+            delete []_body;
+            _body = NULL;
+        }
+
+        return true;
+    }
+
+private:
+    char* _body;
+};
+
+// 直接使用缓冲区中的消息体
+class CDirectProcessor: public CProcessorBase
+{
+public:
+    bool on_header(const net::TCommonMessageHeader& header)
+    {
+        return true;
+    }
+
+    bool on_message(const net::TCommonMessageHeader& header, size_t finished_size, const char* buffer, size_t buffer_size)
+    {
+        consume(buffer, buffer_size);
+        return true;
+    }
+};
+
+static void write_messages(int fd, size_t message_size, uint64_t total_bytes)
+{
+    // 预先生成一批连续的消息，然后反复发送
+    size_t message_number = (1024*1024 + message_size - 1) / message_size;
+    size_t frame_size = sizeof(net::TCommonMessageHeader) + message_size;
+    std::string chunk(message_number * frame_size, 'x');
+
+    for (size_t i=0; i<message_number; ++i)
+    {
+        net::TCommonMessageHeader* header = reinterpret_cast<net::TCommonMessageHeader*>(&chunk[i * frame_size]);
+        header->size = static_cast<uint32_t>(message_size);
+        header->command = 1;
+    }
+    for (uint64_t written=0; written<total_bytes; )
+    {
+        size_t bytes = std::min<uint64_t>(chunk.size(), total_bytes - written);
+        ssize_t n = send(fd, chunk.data(), bytes, 0);
+        if (n < 0)
+            break;
+        written += n;
+    }
+
+    shutdown(fd, SHUT_WR);
+}
+
+static void print_result(const char* name, size_t message_size, const CProcessorBase& processor, uint64_t microseconds)
+{
+    double seconds = microseconds / 1000000.0;
+    fprintf(stdout, "%-18s %6zu bytes: %10" PRIu64" messages, %8.1f MB/s, %8.3f M messages/s\n"
+          , name, message_size, processor.get_messages()
+          , processor.get_bytes() / seconds / (1024*1024)
+          , processor.get_messages() / seconds / 1000000);
+}
+
+static void bench_recv_machine(size_t message_size, uint64_t total_bytes)
+{
+    int fds[2];
+    if (-1 == socketpair(AF_UNIX, SOCK_STREAM, 0, fds))
+    {
+        perror("socketpair");
+        exit(1);
+    }
+
+    CCopyProcessor processor;
+    net::CRecvMachine<net::TCommonMessageHeader, CCopyProcessor> recv_machine(&processor);
+    uint64_t begin = sys::CDatetimeUtils::get_current_microseconds();
+    {
+        sys::CThreadEngine writer(sys::bind(&write_messages, fds[1], message_size, total_bytes));
+        char buffer[1024];
+        ssize_t n;
+
+        while ((n = recv(fds[0], buffer, sizeof(buffer), 0)) > 0)
+        {
+            if (utils::handle_error == recv_machine.work(buffer, n))
+                break;
+        }
+    }
+
+    print_result("CRecvMachine", message_size, processor, sys::CDatetimeUtils::get_current_microseconds() - begin);
+    close(fds[0]);
+    close(fds[1]);
+}
+
+static void bench_buffer_recv_machine(size_t message_size, uint64_t total_bytes)
+{
+    int fds[2];
+    if (-1 == socketpair(AF_UNIX, SOCK_STREAM, 0, fds))
+    {
+        perror("socketpair");
+        exit(1);
+    }
+
+    CDirectProcessor processor;
+    net::CBufferRecvMachine<net::TCommonMessageHeader, CDirectProcessor> recv_machine(&processor);
+    uint64_t begin = sys::CDatetimeUtils::get_current_microseconds();
+    {
+        sys::CThreadEngine writer(sys::bind(&write_messages, fds[1], message_size, total_bytes));
+        while (true)
+        {
+            size_t buffer_size;
+            char* buffer = recv_machine.get_buffer(&buffer_size);
+            ssize_t n = recv(fds[0], buffer, buffer_size, 0);
+
+            if ((n <= 0) || (utils::handle_error == recv_machine.work(n)))
+                break;
+        }
+    }
+
+    print_result("CBufferRecvMachine", message_size, processor, sys::CDatetimeUtils::get_current_microseconds() - begin);
+    close(fds[0]);
+    close(fds[1]);
+}
+
+int main(int argc, char* argv[])
+{
+    uint64_t megabytes = (argc > 1)? atoi(argv[1]): 512;
+    const size_t message_sizes[] = { 64, 65536 };
+
+    for (size_t i=0; i<sizeof(message_sizes)/sizeof(message_sizes[0]); ++i)
+    {
+        bench_recv_machine(message_sizes[i], megabytes * 1024 * 1024);
+        bench_buffer_recv_machine(message_sizes[i], megabytes * 1024 * 1024);
+    }
+
+    return 0;
+}